@@ -98,23 +98,12 @@ APU::APU() :
     m_Channel4Counter(0x00),
     m_ChannelControlOnOffVolume(0x00),
     m_OutputTerminal(0x00),
-    m_SoundOnOff(0x00)
+    m_SoundOnOff(0x00),
+    m_isAudioEnabled(false)
 {
     memset(m_Initialized, false, ARRAYSIZE(m_Initialized));
     memset(m_DeviceChannel, 0, ARRAYSIZE(m_DeviceChannel));
     memset(m_WavePatternRAM, 0x00, ARRAYSIZE(m_WavePatternRAM));
-
-    if (SDL_Init(SDL_INIT_AUDIO))
-    {
-        Logger::LogError("[SDL] Failed to initialize: %s", SDL_GetError());
-    }
-    else
-    {
-        LoadChannel(CHANNEL1, Channel1CallbackStatic);
-        LoadChannel(CHANNEL2, Channel2CallbackStatic);
-        LoadChannel(CHANNEL3, Channel3CallbackStatic);
-        LoadChannel(CHANNEL4, Channel4CallbackStatic);
-    }
 }
 
 APU::~APU()
@@ -128,7 +117,35 @@ APU::~APU()
         }
     }
 
-    SDL_Quit();
+    if (m_isAudioEnabled)
+    {
+        SDL_QuitSubSystem(SDL_INIT_AUDIO);
+    }
+}
+
+/*
+    Opens the audio devices. Instances that never call this (tests, headless runs) do not touch SDL
+    at all.
+*/
+bool APU::EnableAudio()
+{
+    if (m_isAudioEnabled)
+    {
+        return true;
+    }
+
+    if (SDL_InitSubSystem(SDL_INIT_AUDIO))
+    {
+        Logger::LogError("[SDL] Failed to initialize: %s", SDL_GetError());
+        return false;
+    }
+
+    m_isAudioEnabled = true;
+    LoadChannel(CHANNEL1, Channel1CallbackStatic);
+    LoadChannel(CHANNEL2, Channel2CallbackStatic);
+    LoadChannel(CHANNEL3, Channel3CallbackStatic);
+    LoadChannel(CHANNEL4, Channel4CallbackStatic);
+    return true;
 }
 
 void APU::Step(unsigned long cycles)
@@ -196,6 +213,67 @@ void APU::Channel4Callback(Uint8* pStream, int length)
     }*/
 }
 
+// Only the registers are saved, the audio devices belong to the host
+void APU::SaveState(StateWriter& writer)
+{
+    writer.Write(m_Channel1Sweep);
+    writer.Write(m_Channel1SoundLength);
+    writer.Write(m_Channel1VolumeEnvelope);
+    writer.Write(m_Channel1FrequencyLo);
+    writer.Write(m_Channel1FrequencyHi);
+
+    writer.Write(m_Channel2SoundLength);
+    writer.Write(m_Channel2VolumeEnvelope);
+    writer.Write(m_Channel2FrequencyLo);
+    writer.Write(m_Channel2FrequencyHi);
+
+    writer.Write(m_Channel3SoundOnOff);
+    writer.Write(m_Channel3SoundLength);
+    writer.Write(m_Channel3SelectOutputLevel);
+    writer.Write(m_Channel3FreuqencyLo);
+    writer.Write(m_Channel3FreuqencyHi);
+    writer.Write(m_WavePatternRAM);
+
+    writer.Write(m_Channel4SoundLength);
+    writer.Write(m_Channel4VolumeEnvelope);
+    writer.Write(m_Channel4PolynomialCounter);
+    writer.Write(m_Channel4Counter);
+
+    writer.Write(m_ChannelControlOnOffVolume);
+    writer.Write(m_OutputTerminal);
+    writer.Write(m_SoundOnOff);
+}
+
+void APU::LoadState(StateReader& reader)
+{
+    reader.Read(m_Channel1Sweep);
+    reader.Read(m_Channel1SoundLength);
+    reader.Read(m_Channel1VolumeEnvelope);
+    reader.Read(m_Channel1FrequencyLo);
+    reader.Read(m_Channel1FrequencyHi);
+
+    reader.Read(m_Channel2SoundLength);
+    reader.Read(m_Channel2VolumeEnvelope);
+    reader.Read(m_Channel2FrequencyLo);
+    reader.Read(m_Channel2FrequencyHi);
+
+    reader.Read(m_Channel3SoundOnOff);
+    reader.Read(m_Channel3SoundLength);
+    reader.Read(m_Channel3SelectOutputLevel);
+    reader.Read(m_Channel3FreuqencyLo);
+    reader.Read(m_Channel3FreuqencyHi);
+    reader.Read(m_WavePatternRAM);
+
+    reader.Read(m_Channel4SoundLength);
+    reader.Read(m_Channel4VolumeEnvelope);
+    reader.Read(m_Channel4PolynomialCounter);
+    reader.Read(m_Channel4Counter);
+
+    reader.Read(m_ChannelControlOnOffVolume);
+    reader.Read(m_OutputTerminal);
+    reader.Read(m_SoundOnOff);
+}
+
 // IMemoryUnit
 byte APU::ReadByte(const ushort& address)
 {
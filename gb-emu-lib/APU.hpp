@@ -12,11 +12,14 @@ public:
     APU();
     ~APU();
 
+    bool EnableAudio();
     void Step(unsigned long cycles);
     void Channel1Callback(Uint8* pStream, int length);
     void Channel2Callback(Uint8* pStream, int length);
     void Channel3Callback(Uint8* pStream, int length);
     void Channel4Callback(Uint8* pStream, int length);
+    void SaveState(StateWriter& writer);
+    void LoadState(StateReader& reader);
 
     // IMemoryUnit
     byte ReadByte(const ushort& address);
@@ -56,4 +59,6 @@ private:
     byte m_OutputTerminal;
 
     byte m_SoundOnOff;
+
+    bool m_isAudioEnabled;      // The audio devices are only opened on request
 };
@@ -0,0 +1,60 @@
+#include "pch.hpp"
+#include "Arena.hpp"
+
+Arena::Arena(byte* pMemory, size_t size) :
+    m_Front(0),
+    m_ObjectCount(0)
+{
+    size_t offset = CACHELINES(reinterpret_cast<uintptr_t>(pMemory)) - reinterpret_cast<uintptr_t>(pMemory);
+    m_pBase = pMemory + offset;
+    m_Size = (size > offset) ? ((size - offset) & ~static_cast<size_t>(CacheLineSize - 1)) : 0;
+    m_Back = m_Size;
+}
+
+Arena::~Arena()
+{
+    Reset();
+}
+
+byte* Arena::Allocate(size_t size)
+{
+    size = CACHELINES(size);
+    if (size > (m_Back - m_Front))
+    {
+        LogOutOfMemory(size);
+        return nullptr;
+    }
+
+    m_Back -= size;
+    byte* pMemory = m_pBase + m_Back;
+    memset(pMemory, 0x00, size);
+    return pMemory;
+}
+
+// Destroys every object in reverse order of creation and frees the whole block
+void Arena::Reset()
+{
+    while (m_ObjectCount > 0)
+    {
+        m_ObjectCount--;
+        m_Objects[m_ObjectCount].pDestroy(m_Objects[m_ObjectCount].pObject);
+    }
+
+    m_Front = 0;
+    m_Back = m_Size;
+}
+
+const byte* Arena::GetBase()
+{
+    return m_pBase;
+}
+
+size_t Arena::GetUsedSize()
+{
+    return m_Front + (m_Size - m_Back);
+}
+
+void Arena::LogOutOfMemory(size_t size)
+{
+    Logger::LogError("Arena is out of memory, %d of %d bytes used, %d more requested", static_cast<int>(GetUsedSize()), static_cast<int>(m_Size), static_cast<int>(size));
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <new>
+#include <utility>
+
+#define CacheLineSize       64
+#define ArenaMaxObjects     16
+
+// Rounds a size up to whole cache lines
+#define CACHELINES(size)    ((static_cast<size_t>(size) + CacheLineSize - 1) & ~static_cast<size_t>(CacheLineSize - 1))
+
+/*
+    Hands out a fixed block of memory, each allocation starting on its own cache line. Objects made
+    with Create() are placement constructed from the front and destroyed in reverse order along
+    with the arena. Blocks from Allocate() are plain zeroed memory taken from the back, so bulk
+    buffers end up behind every object no matter when they are allocated.
+
+    The arena does not own the memory, it only has to be CacheLineSize bytes larger than what is
+    handed out so the start can be aligned.
+*/
+class Arena
+{
+public:
+    Arena(byte* pMemory, size_t size);
+    ~Arena();
+
+    template<typename T, typename... Args> T* Create(Args&&... args)
+    {
+        if (m_ObjectCount == ArenaMaxObjects)
+        {
+            Logger::LogError("Arena is out of object slots");
+            return nullptr;
+        }
+
+        size_t size = CACHELINES(sizeof(T));
+        if (size > (m_Back - m_Front))
+        {
+            LogOutOfMemory(size);
+            return nullptr;
+        }
+
+        byte* pMemory = m_pBase + m_Front;
+        m_Front += size;
+
+        T* pObject = new (pMemory) T(std::forward<Args>(args)...);
+        m_Objects[m_ObjectCount].pObject = pObject;
+        m_Objects[m_ObjectCount].pDestroy = &Destroy<T>;
+        m_ObjectCount++;
+        return pObject;
+    }
+
+    byte* Allocate(size_t size);
+    void Reset();
+
+    const byte* GetBase();
+    size_t GetUsedSize();
+
+private:
+    void LogOutOfMemory(size_t size);
+
+    template<typename T> static void Destroy(void* pObject)
+    {
+        static_cast<T*>(pObject)->~T();
+    }
+
+private:
+    byte* m_pBase;
+    size_t m_Size;
+    size_t m_Front;     // End of the objects
+    size_t m_Back;      // Start of the raw blocks
+
+    struct Object
+    {
+        void* pObject;
+        void(*pDestroy)(void* pObject);
+    } m_Objects[ArenaMaxObjects];
+    unsigned int m_ObjectCount;
+};
@@ -0,0 +1,53 @@
+#include "pch.hpp"
+#include "AtomicFile.hpp"
+
+#include <cstdio>
+#include <functional>
+#include <sstream>
+#include <thread>
+
+#if WINDOWS
+    #include <windows.h>
+#else
+    #include <unistd.h>
+#endif
+
+bool WriteFileAtomic(const std::string& path, const void* pData, size_t size)
+{
+#if WINDOWS
+    unsigned long processID = GetCurrentProcessId();
+#else
+    unsigned long processID = static_cast<unsigned long>(getpid());
+#endif
+    std::ostringstream temporaryPath;
+    temporaryPath << path << "." << processID << "." << std::hex << std::hash<std::thread::id>()(std::this_thread::get_id()) << ".tmp";
+
+    {
+        std::ofstream file(temporaryPath.str(), std::ios::out | std::ios::binary | std::ios::trunc);
+        if (!file.is_open())
+        {
+            return false;
+        }
+
+        file.write(static_cast<const char*>(pData), static_cast<std::streamsize>(size));
+        if (!file)
+        {
+            file.close();
+            std::remove(temporaryPath.str().c_str());
+            return false;
+        }
+    }
+
+    // std::rename does not replace an existing file on Windows
+#if WINDOWS
+    bool isMoved = MoveFileExA(temporaryPath.str().c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING) != FALSE;
+#else
+    bool isMoved = std::rename(temporaryPath.str().c_str(), path.c_str()) == 0;
+#endif
+    if (!isMoved)
+    {
+        std::remove(temporaryPath.str().c_str());
+    }
+
+    return isMoved;
+}
@@ -0,0 +1,10 @@
+#pragma once
+
+#include <string>
+
+/*
+    Writes size bytes of pData to path through a temporary file that is then moved over it, so a
+    concurrent reader sees either the old file or the whole new one. The temporary file is named
+    after the process and thread, writers in other processes or threads never share it.
+*/
+bool WriteFileAtomic(const std::string& path, const void* pData, size_t size);
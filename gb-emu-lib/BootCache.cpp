@@ -0,0 +1,146 @@
+#include "pch.hpp"
+#include "BootCache.hpp"
+#include "AtomicFile.hpp"
+#include "Hash.hpp"
+
+#include "MachineState.hpp"
+
+#include <cstdio>
+
+/*
+    On-disk format:
+        4 bytes     Magic "GBBC"
+        4 bytes     MachineStateVersion
+        8 bytes     Size of the snapshot
+        ...         The snapshot
+*/
+const char BootCacheMagic[4] = { 'G', 'B', 'B', 'C' };
+
+std::mutex BootCache::m_Mutex;
+std::map<unsigned long long, std::vector<byte>> BootCache::m_States;
+std::string BootCache::m_Directory;
+
+unsigned long long BootCache::MakeKey(const byte* pBootROM, size_t bootROMSize, const byte* pHeader, size_t headerSize)
+{
+    // Over the state version, the boot ROM and the header
+    unsigned int version = MachineStateVersion;
+    unsigned long long hash = FNVHash(FNVOffsetBasis, &version, sizeof(version));
+    hash = FNVHash(hash, pBootROM, bootROMSize);
+    hash = FNVHash(hash, pHeader, headerSize);
+    return hash;
+}
+
+void BootCache::SetDirectory(const char* directory)
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    m_Directory = (directory != nullptr) ? directory : "";
+}
+
+bool BootCache::Find(unsigned long long key, std::vector<byte>& state)
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+
+    auto it = m_States.find(key);
+    if (it != m_States.end())
+    {
+        state = it->second;
+        return true;
+    }
+
+    if (!ReadFile(key, state))
+    {
+        return false;
+    }
+
+    m_States[key] = state;
+    return true;
+}
+
+void BootCache::Store(unsigned long long key, const std::vector<byte>& state)
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    m_States[key] = state;
+    WriteFile(key, state);
+}
+
+void BootCache::Remove(unsigned long long key)
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    m_States.erase(key);
+    if (!m_Directory.empty())
+    {
+        std::remove(GetPath(key).c_str());
+    }
+}
+
+void BootCache::Clear()
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    m_States.clear();
+}
+
+std::string BootCache::GetPath(unsigned long long key)
+{
+    char name[32];
+    snprintf(name, sizeof(name), "boot-%016llx.state", key);
+    return m_Directory + "/" + name;
+}
+
+bool BootCache::ReadFile(unsigned long long key, std::vector<byte>& state)
+{
+    if (m_Directory.empty())
+    {
+        return false;
+    }
+
+    std::ifstream file(GetPath(key), std::ios::in | std::ios::binary);
+    if (!file.is_open())
+    {
+        return false;
+    }
+
+    char magic[4];
+    unsigned int version = 0;
+    unsigned long long size = 0;
+    file.read(magic, sizeof(magic));
+    file.read(reinterpret_cast<char*>(&version), sizeof(version));
+    file.read(reinterpret_cast<char*>(&size), sizeof(size));
+    if (!file || (memcmp(magic, BootCacheMagic, sizeof(magic)) != 0) || (version != MachineStateVersion))
+    {
+        Logger::LogError("Ignoring invalid boot cache entry %s", GetPath(key).c_str());
+        return false;
+    }
+
+    state.resize(static_cast<size_t>(size));
+    if (!file.read(reinterpret_cast<char*>(state.data()), static_cast<std::streamsize>(size)))
+    {
+        Logger::LogError("Ignoring truncated boot cache entry %s", GetPath(key).c_str());
+        state.clear();
+        return false;
+    }
+
+    return true;
+}
+
+void BootCache::WriteFile(unsigned long long key, const std::vector<byte>& state)
+{
+    if (m_Directory.empty())
+    {
+        return;
+    }
+
+    unsigned int version = MachineStateVersion;
+    unsigned long long size = state.size();
+    std::vector<byte> entry(sizeof(BootCacheMagic) + sizeof(version) + sizeof(size));
+    memcpy(entry.data(), BootCacheMagic, sizeof(BootCacheMagic));
+    memcpy(entry.data() + sizeof(BootCacheMagic), &version, sizeof(version));
+    memcpy(entry.data() + sizeof(BootCacheMagic) + sizeof(version), &size, sizeof(size));
+    entry.insert(entry.end(), state.begin(), state.end());
+
+    // A concurrent reader never sees a partial entry
+    std::string path = GetPath(key);
+    if (!WriteFileAtomic(path, entry.data(), entry.size()))
+    {
+        Logger::LogError("Failed to write boot cache entry %s", path.c_str());
+    }
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <mutex>
+#include <string>
+#include <vector>
+
+/*
+    Post-boot machine snapshots, keyed by the boot ROM and the cartridge header.
+
+    The boot ROM only looks at the cartridge header (logo, title and checksums), so two starts with
+    the same boot ROM and the same header always end in the same machine state. The first start
+    runs the real boot ROM and stores the snapshot here, later starts restore it instead of running
+    the ~2.5M cycle boot animation again.
+
+    Snapshots are kept in memory for the lifetime of the process and, if a directory is set, also
+    written to disk so other processes can pick them up.
+*/
+class BootCache
+{
+private:
+    BootCache() { }
+
+public:
+    static unsigned long long MakeKey(const byte* pBootROM, size_t bootROMSize, const byte* pHeader, size_t headerSize);
+
+    static void SetDirectory(const char* directory);
+    static bool Find(unsigned long long key, std::vector<byte>& state);
+    static void Store(unsigned long long key, const std::vector<byte>& state);
+    static void Remove(unsigned long long key);
+    static void Clear();
+
+private:
+    static std::string GetPath(unsigned long long key);
+    static bool ReadFile(unsigned long long key, std::vector<byte>& state);
+    static void WriteFile(unsigned long long key, const std::vector<byte>& state);
+
+private:
+    static std::mutex m_Mutex;
+    static std::map<unsigned long long, std::vector<byte>> m_States;
+    static std::string m_Directory;
+};
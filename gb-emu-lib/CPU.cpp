@@ -1,29 +1,94 @@
 #include "pch.hpp"
 #include "CPU.hpp"
-
+#include "BootCache.hpp"
+#include "Cheats.hpp"
+#include "Coverage.hpp"
+#include "Debugger.hpp"
+#include "JIT.hpp"
+#include "Recorder.hpp"
+#include "Trace.hpp"
+
+#include <algorithm>
 #include <vector>
 
+CPU::opCodeFunction CPU::m_operationMap[0xFF + 1];
+CPU::opCodeFunction CPU::m_operationMapCB[0xFF + 1];
+bool CPU::m_isFusedLead[0xFF + 1];
+
 CPU::CPU() :
-    m_cycles(0),
-    m_isHalted(false),
-    m_IFWhenHalted(0x00),
     m_AF(0x0000),
     m_BC(0x0000),
     m_DE(0x0000),
     m_HL(0x0000),
     m_SP(0x0000),
     m_PC(0x0000),
-    m_IME(0x00)
-{
-    for (unsigned int index = 0; index < ARRAYSIZE(m_operationMap); index++)
-    {
-        m_operationMap[index] = nullptr;
-    }
-    for (unsigned int index = 0; index < ARRAYSIZE(m_operationMapCB); index++)
-    {
-        m_operationMapCB[index] = nullptr;
-    }
+    m_IME(0x00),
+    m_cycles(0),
+    m_isHalted(false),
+    m_IFWhenHalted(0x00),
+    m_isCGB(false),
+    m_SpeedShift(0),
+    m_isSpeedSwitchPrepared(false),
+    m_isFastBoot(false),
+    m_isFusionEnabled(true),
+    m_MMU(nullptr),
+    m_cartridge(nullptr),
+    m_GPU(nullptr),
+    m_APU(nullptr),
+    m_joypad(nullptr),
+    m_serial(nullptr),
+    m_timer(nullptr),
+    m_Arena(m_ArenaMemory, sizeof(m_ArenaMemory))
+{
+    // The opcode tables are shared by every instance, only the first one fills them in
+    static const bool isOperationMapInitialized = InitializeOperationMaps();
+    (void)isOperationMapInitialized;
+
+    /*
+        Initialize the register map.
+
+        I'm not 100% sure about this, so ensure the lookup is right for each opcode before using
+        GetByteRegister.
+
+        000 B
+        001 C
+        010 D
+        011 E
+        100 H
+        101 L
+        110 ? (F?)
+        111 A
+    */
+    m_ByteRegisterMap[0x00] = reinterpret_cast<byte*>(&m_BC) + 1;   // ushort memory is [C][B]
+    m_ByteRegisterMap[0x01] = reinterpret_cast<byte*>(&m_BC);
+    m_ByteRegisterMap[0x02] = reinterpret_cast<byte*>(&m_DE) + 1;
+    m_ByteRegisterMap[0x03] = reinterpret_cast<byte*>(&m_DE);
+    m_ByteRegisterMap[0x04] = reinterpret_cast<byte*>(&m_HL) + 1;
+    m_ByteRegisterMap[0x05] = reinterpret_cast<byte*>(&m_HL);
+    m_ByteRegisterMap[0x06] = reinterpret_cast<byte*>(&m_AF);       // Should not be used (F)
+    m_ByteRegisterMap[0x07] = reinterpret_cast<byte*>(&m_AF) + 1;
 
+    /*
+        I'm not 100% sure about this, so ensure the lookup is right for each opcode before using
+        GetUShortRegister.
+
+        00 = BC
+        01 = DE
+        10 = HL
+        11 = SP
+    */
+    m_UShortRegisterMap[0x00] = &m_BC;
+    m_UShortRegisterMap[0x01] = &m_DE;
+    m_UShortRegisterMap[0x02] = &m_HL;
+    m_UShortRegisterMap[0x03] = &m_SP;
+}
+
+/*
+    Fills in the static opcode tables. Unlisted opcodes stay nullptr, since the tables have static
+    storage duration.
+*/
+bool CPU::InitializeOperationMaps()
+{
     /*
         Z80 Command Set
     */
@@ -608,96 +673,73 @@ CPU::CPU() :
     m_operationMapCB[0xFE] = &CPU::SETb_HL_;
     m_operationMapCB[0xFF] = &CPU::SETbr;
 
-    /*
-        Initialize the register map.
-
-        I'm not 100% sure about this, so ensure the lookup is right for each opcode before using
-        GetByteRegister.
-
-        000 B
-        001 C
-        010 D
-        011 E
-        100 H
-        101 L
-        110 ? (F?)
-        111 A
-    */
-    m_ByteRegisterMap[0x00] = reinterpret_cast<byte*>(&m_BC) + 1;   // ushort memory is [C][B]
-    m_ByteRegisterMap[0x01] = reinterpret_cast<byte*>(&m_BC);
-    m_ByteRegisterMap[0x02] = reinterpret_cast<byte*>(&m_DE) + 1;
-    m_ByteRegisterMap[0x03] = reinterpret_cast<byte*>(&m_DE);
-    m_ByteRegisterMap[0x04] = reinterpret_cast<byte*>(&m_HL) + 1;
-    m_ByteRegisterMap[0x05] = reinterpret_cast<byte*>(&m_HL);
-    m_ByteRegisterMap[0x06] = reinterpret_cast<byte*>(&m_AF);       // Should not be used (F)
-    m_ByteRegisterMap[0x07] = reinterpret_cast<byte*>(&m_AF) + 1;
-
-    /*
-        I'm not 100% sure about this, so ensure the lookup is right for each opcode before using
-        GetUShortRegister.
+    // The first opcodes of the sequences in MatchFused
+    const byte fusedLeads[] = { 0x18, 0xD6, 0xE6, 0xFE, 0xF0, 0x2A, 0x78 };
+    for (byte opCode : fusedLeads)
+    {
+        m_isFusedLead[opCode] = true;
+    }
 
-        00 = BC
-        01 = DE
-        10 = HL
-        11 = SP
-    */
-    m_UShortRegisterMap[0x00] = &m_BC;
-    m_UShortRegisterMap[0x01] = &m_DE;
-    m_UShortRegisterMap[0x02] = &m_HL;
-    m_UShortRegisterMap[0x03] = &m_SP;
+    return true;
 }
 
 CPU::~CPU()
 {
-    m_timer.reset();
-    m_serial.reset();
-    m_joypad.reset();
-    m_APU.reset();
-    m_GPU.reset();
-    m_cartridge.reset();
-    m_MMU.reset();
+    // The JIT, the debugger, the coverage and the cheats put the MMU back the way it was, and the
+    // components may still talk to each other on the way out, so they go before the CPU does
+    m_spJIT.reset();
+    m_spDebugger.reset();
+    m_spCoverage.reset();
+    m_spCheats.reset();
+    m_Arena.Reset();
 }
 
-bool CPU::Initialize(IMMU* pMMU, bool isFromTest)
+void* CPU::operator new(size_t size)
 {
-    // Create the MMU
-    m_MMU = std::unique_ptr<IMMU>(pMMU);
+    // Over-allocate and remember the offset to the real block in the byte before the object
+    byte* pMemory = static_cast<byte*>(::operator new(size + CacheLineSize));
+    byte* pObject = pMemory + CacheLineSize - (reinterpret_cast<uintptr_t>(pMemory) % CacheLineSize);
+    pObject[-1] = static_cast<byte>(pObject - pMemory);
+    return pObject;
+}
 
-    if (!isFromTest)
+void CPU::operator delete(void* pMemory)
+{
+    if (pMemory != nullptr)
     {
-        // Create the Cartridge
-        m_cartridge = std::make_unique<Cartridge>();
-
-        // Create the GPU
-        m_GPU = std::unique_ptr<GPU>(new GPU(pMMU, this));
-
-        // Create the APU
-        m_APU = std::make_unique<APU>();
-
-        // Create the Joypad
-        m_joypad = std::make_unique<Joypad>(this);
-
-        // Create the Serial
-        m_serial = std::make_unique<Serial>();
+        byte* pObject = static_cast<byte*>(pMemory);
+        ::operator delete(pObject - pObject[-1]);
+    }
+}
 
-        // Create the Timer
-        m_timer = std::unique_ptr<Timer>(new Timer(this));
+bool CPU::Initialize(IMMU* pMMU, bool isFromTest)
+{
+    m_MMU = pMMU;
 
-        m_MMU->RegisterMemoryUnit(0x0000, 0x7FFF, m_cartridge.get());
-        m_MMU->RegisterMemoryUnit(0x8000, 0x9FFF, m_GPU.get());
-        m_MMU->RegisterMemoryUnit(0xA000, 0xBFFF, m_cartridge.get());
-        m_MMU->RegisterMemoryUnit(0xFE00, 0xFE9F, m_GPU.get());
+    if (isFromTest)
+    {
+        // The tests hand over their own MMU
+        m_spTestMMU = std::unique_ptr<IMMU>(pMMU);
+    }
+    else
+    {
+        m_MMU->RegisterMemoryUnit(0x0000, 0x7FFF, m_cartridge);
+        m_MMU->RegisterMemoryUnit(0x8000, 0x9FFF, m_GPU);
+        m_MMU->RegisterMemoryUnit(0xA000, 0xBFFF, m_cartridge);
+        m_MMU->RegisterMemoryUnit(0xFE00, 0xFE9F, m_GPU);
         // 0xFEA0-0xFEFF - Unusable
-        m_MMU->RegisterMemoryUnit(0xFF00, 0xFF00, m_joypad.get());
-        m_MMU->RegisterMemoryUnit(0xFF01, 0xFF02, m_serial.get());
-        m_MMU->RegisterMemoryUnit(0xFF04, 0xFF07, m_timer.get());
-        m_MMU->RegisterMemoryUnit(0xFF10, 0xFF3F, m_APU.get());
-        m_MMU->RegisterMemoryUnit(0xFF40, 0xFF4C, m_GPU.get());
-        m_MMU->RegisterMemoryUnit(0xFF4E, 0xFF4F, m_GPU.get());
+        m_MMU->RegisterMemoryUnit(0xFF00, 0xFF00, m_joypad);
+        m_MMU->RegisterMemoryUnit(0xFF01, 0xFF02, m_serial);
+        m_MMU->RegisterMemoryUnit(0xFF04, 0xFF07, m_timer);
+        m_MMU->RegisterMemoryUnit(0xFF10, 0xFF3F, m_APU);
+        m_MMU->RegisterMemoryUnit(0xFF40, 0xFF4C, m_GPU);
+        m_MMU->RegisterMemoryUnit(0xFF4D, 0xFF4D, this);
+        m_MMU->RegisterMemoryUnit(0xFF4E, 0xFF4F, m_GPU);
         // 0xFF50 - MMU
-        m_MMU->RegisterMemoryUnit(0xFF51, 0xFF55, m_GPU.get());
-        m_MMU->RegisterMemoryUnit(0xFF57, 0xFF6B, m_GPU.get());
-        m_MMU->RegisterMemoryUnit(0xFF6D, 0xFF6F, m_GPU.get());
+        m_MMU->RegisterMemoryUnit(0xFF51, 0xFF55, m_GPU);
+        m_MMU->RegisterMemoryUnit(0xFF57, 0xFF6B, m_GPU);
+        m_MMU->RegisterMemoryUnit(0xFF6D, 0xFF6F, m_GPU);
+        // 0xFF70 - MMU
     }
 
     return true;
@@ -705,18 +747,42 @@ bool CPU::Initialize(IMMU* pMMU, bool isFromTest)
 
 bool CPU::Initialize()
 {
-    return Initialize(new MMU(), false);
+    // The tools sit in front of the old MMU's pages, take them out before it goes
+    m_spJIT.reset();
+    m_spDebugger.reset();
+    m_spCoverage.reset();
+    m_spCheats.reset();
+    m_Arena.Reset();
+
+    // Bulk memory is taken from the back of the arena, the hot state fills it from the front
+    byte* pWRAM = m_Arena.Allocate(WRAMSize);
+    byte* pVRAM = m_Arena.Allocate(VRAMSize);
+    IMemoryUnit** pPageTable = reinterpret_cast<IMemoryUnit**>(m_Arena.Allocate(MMUPageTableSize));
+
+    m_timer = m_Arena.Create<Timer>(this);
+    m_joypad = m_Arena.Create<Joypad>(this);
+    m_serial = m_Arena.Create<Serial>(this);
+    m_APU = m_Arena.Create<APU>();
+    m_cartridge = m_Arena.Create<Cartridge>();
+    MMU* pMMU = m_Arena.Create<MMU>(pWRAM, pPageTable);
+    m_GPU = m_Arena.Create<GPU>(pMMU, this, pVRAM);
+    m_GPU->SetRecorder(m_spRecorder.get());
+
+    return Initialize(pMMU, false);
 }
 
 bool CPU::LoadROM(const char* bootROMPath, const char* cartridgePath)
 {
+    memset(m_FusedRejects, 0x00, sizeof(m_FusedRejects));
+
     if (!m_MMU->LoadBootROM(bootROMPath))
     {
         return false;
     }
 
     // If we are already booted
-    if (m_MMU->Read(0xFF50) != 0x00)
+    bool isPreBooted = (m_MMU->Read(0xFF50) != 0x00);
+    if (isPreBooted)
     {
         m_PC = 0x0100;
 
@@ -765,11 +831,42 @@ bool CPU::LoadROM(const char* bootROMPath, const char* cartridgePath)
         m_GPU->PreBoot();
     }
 
-    return m_cartridge->LoadROM(cartridgePath);
+    if (!m_cartridge->LoadROM(cartridgePath))
+    {
+        return false;
+    }
+
+    m_isCGB = m_cartridge->IsCGB();
+    m_GPU->SetCGBMode(m_isCGB);
+    m_MMU->SetCGBMode(m_isCGB);
+    if (m_isCGB && isPreBooted)
+    {
+        // The CGB boot ROM leaves 0x11 in A, games check it to enable their CGB features
+        m_AF = 0x1180;
+    }
+
+    if (m_isFastBoot && !isPreBooted)
+    {
+        return FastBoot();
+    }
+
+    return true;
 }
 
 int CPU::Step()
 {
+    if ((m_spJIT != nullptr) && !m_isHalted)
+    {
+        // Translated code steps the rest of the machine itself, it runs nothing when it cannot be
+        // exact here and the instruction is interpreted instead
+        unsigned long cycles = m_spJIT->Run();
+        if (cycles > 0)
+        {
+            HandleInterrupts();
+            return cycles >> m_SpeedShift;
+        }
+    }
+
     unsigned long cycles = 0x00;
 
     if (m_isHalted)
@@ -784,53 +881,280 @@ int CPU::Step()
     }
     else
     {
-        ushort addr = m_PC;
-        // Read through the memory, starting at m_PC
-        byte opCode = ReadBytePC();
-        opCodeFunction instruction; // Execute the correct function for each OpCode
+        cycles = ExecuteInstruction(m_isFusionEnabled);
+    }
+
+    StepComponents(cycles);
+    HandleInterrupts();
+
+    // In double speed, the CPU executes two cycles for every cycle of the GPU and APU
+    return cycles >> m_SpeedShift;
+}
+
+// Runs the instruction at PC and returns its cycles, without stepping the rest of the machine
+unsigned long CPU::ExecuteInstruction(bool canFuse)
+{
+    ushort addr = m_PC;
+    // Read through the memory, starting at m_PC
+    byte opCode = ReadBytePC();
+    opCodeFunction instruction; // Execute the correct function for each OpCode
 
-        if (opCode == 0xCB)
+    if (m_spTrace != nullptr)
+    {
+        RecordTrace(addr, opCode);
+    }
+
+    /*
+        Anything that can not start a sequence is turned down with one lookup. The debugger and coverage
+        look at every instruction, the tests run the CPU without the rest of the machine.
+    */
+    if (canFuse && m_isFusedLead[opCode] && (m_cartridge != nullptr) &&
+        (m_spDebugger == nullptr) && (m_spCoverage == nullptr))
+    {
+        unsigned long cycles = ExecuteFused(opCode);
+        if (cycles > 0)
         {
-            opCode = ReadBytePC();
-            instruction = m_operationMapCB[opCode];
+            return cycles;
         }
-        else
+    }
+
+    if (opCode == 0xCB)
+    {
+        opCode = ReadBytePC();
+        instruction = m_operationMapCB[opCode];
+    }
+    else
+    {
+        instruction = m_operationMap[opCode];
+    }
+
+    if (instruction != nullptr)
+    {
+        return (this->*instruction)(opCode);
+    }
+
+    Logger::LogError("OpCode 0x%02X at address 0x%04X could not be interpreted.", opCode, addr);
+    if (m_spTrace != nullptr)
+    {
+        // Keep the path that led here
+        m_spTrace->Dump(TraceFaultPath);
+    }
+
+    return HALT(0x76);
+}
+
+// Adds the instruction at addr to the trace, before it runs
+void CPU::RecordTrace(ushort addr, byte opCode)
+{
+    ushort bank = ((addr >= 0x4000) && (addr <= 0x7FFF) && (m_cartridge != nullptr)) ? static_cast<ushort>(m_cartridge->GetROMBank()) : 0;
+    m_spTrace->Record(addr, bank, opCode, m_AF, m_HL);
+}
+
+/*
+    Runs one of the instruction sequences that make up most of the time spent in games (picked with
+    Trace::Profile) as a single step, the opCode is already read. Returns 0 if the code at PC is not
+    one of them or the sequence can not be run exactly, PC is left alone then.
+
+    The instructions run through their usual handlers, what is saved is stepping the components and
+    checking for interrupts after each of them. That only gives the same result if nothing happens
+    in between: no event may come up before the last instruction starts (see GetCyclesUntilEvent),
+    no interrupt may be due, and only the first instruction may access memory the components time.
+    A sequence that jumps back to its own start without touching memory is run again for as long as
+    that holds. Every instruction of it goes into the trace, as it would when single stepping.
+*/
+unsigned long CPU::ExecuteFused(byte opCode)
+{
+    unsigned long leadCycles = 0;
+    bool isLoop = false;
+    unsigned int count = MatchFused(opCode, leadCycles, isLoop);
+    if (count == 0)
+    {
+        return 0;
+    }
+
+    if ((m_IME == 0x01) && ((m_MMU->Read(0xFFFF) & m_MMU->Read(0xFF0F) & 0x0F) != 0))
+    {
+        return 0;
+    }
+
+    unsigned long deadline = GetCyclesUntilEvent();
+    if (deadline <= leadCycles)
+    {
+        return 0;
+    }
+
+    ushort start = m_PC - 1;
+    unsigned long cycles = 0;
+    while (true)
+    {
+        cycles += (this->*m_operationMap[opCode])(opCode);
+        for (unsigned int index = 1; index < count; index++)
         {
-            instruction = m_operationMap[opCode];
+            ushort addr = m_PC;
+            byte next = ReadBytePC();
+            if (m_spTrace != nullptr)
+            {
+                RecordTrace(addr, next);
+            }
+
+            cycles += (this->*m_operationMap[next])(next);
+        }
+
+        if (!isLoop || (m_PC != start) || (cycles + leadCycles >= deadline) || (cycles >= FusedMaxCycles))
+        {
+            return cycles;
         }
 
-        if (instruction != nullptr)
+        m_PC = start + 1;
+        if (m_spTrace != nullptr)
         {
-            cycles = (this->*instruction)(opCode);
+            RecordTrace(start, opCode);
         }
-        else
+    }
+}
+
+/*
+    The sequences, with the opcode at PC - 1:
+        JR -2                               Waiting for an interrupt
+        SUB/AND/CP d8; JR cc                Delay loops and tests
+        LDH A,(a8); AND/CP d8; JR cc        Polling LY, STAT or the joypad
+        LD A,(HL+); LD (DE),A [INC DE] [DEC BC]     Copying
+        LD A,B; OR C; JR cc                 Loop counters
+    Returns the number of instructions, 0 for none, and the cycles before the last one.
+
+    A place that is not the start of a sequence is remembered and turned down with one compare the
+    next time. Only a match is ever acted on, so code that changes under a remembered place at worst
+    stays unfused until the entry is replaced. The bytes after the opcode are read straight from the
+    memory block when they are all in it, a block of patched or watched memory goes through Read.
+*/
+unsigned int CPU::MatchFused(byte opCode, unsigned long& leadCycles, bool& isLoop)
+{
+    // The boot ROM is mapped over the cartridge while it runs, it is left out
+    FusedReject* pReject = nullptr;
+    ushort bank = 0;
+    if (m_PC > 0x0100)
+    {
+        bank = ((m_PC >= 0x4000) && (m_PC < 0x8000)) ? static_cast<ushort>(m_cartridge->GetROMBank()) : 0;
+        pReject = &m_FusedRejects[m_PC & (FusedRejectCount - 1)];
+        if ((pReject->PC == m_PC) && (pReject->bank == bank))
+        {
+            return 0;
+        }
+    }
+
+    const byte* pNext = ((m_PC & 0x0F) <= 0x0C) ? m_MMU->ResolveBlock(m_PC) : nullptr;
+    auto next = [&](ushort offset) { return (pNext != nullptr) ? pNext[offset] : m_MMU->Read(m_PC + offset); };
+
+    unsigned int count = 0;
+    switch (opCode)
+    {
+    case 0x18:
+        isLoop = true;
+        count = (next(0) == 0xFE) ? 1 : 0;
+        break;
+    case 0xD6:
+    case 0xE6:
+    case 0xFE:
+        leadCycles = 8;
+        isLoop = true;
+        count = ((next(1) & 0xE7) == 0x20) ? 2 : 0;
+        break;
+    case 0xF0:
+    {
+        byte test = next(1);
+        leadCycles = 20;
+        count = (((test == 0xE6) || (test == 0xFE)) && ((next(3) & 0xE7) == 0x20)) ? 3 : 0;
+        break;
+    }
+    case 0x2A:
+        if (next(0) == 0x12)
+        {
+            count = 2;
+            if (next(1) == 0x13)
+            {
+                count++;
+                if (next(2) == 0x0B)
+                {
+                    count++;
+                }
+            }
+
+            leadCycles = 8 * (count - 1);
+        }
+        break;
+    case 0x78:
+        leadCycles = 8;
+        count = ((next(0) == 0xB1) && ((next(1) & 0xE7) == 0x20)) ? 3 : 0;
+        break;
+    }
+
+    if ((count == 0) && (pReject != nullptr))
+    {
+        pReject->PC = m_PC;
+        pReject->bank = bank;
+    }
+
+    // Both accesses of a copy have to be plain memory, and the write must not change the sequence itself
+    if ((opCode == 0x2A) && (count > 0))
+    {
+        ushort start = m_PC - 1;
+        if (((m_HL >= 0x8000) && (m_HL < 0xA000)) || (m_HL >= 0xFE00) ||
+            ((m_DE >= 0x8000) && (m_DE < 0xA000)) || (m_DE >= 0xFE00) ||
+            (static_cast<ushort>(m_DE - start) < 4))
         {
-            Logger::LogError("OpCode 0x%02X at address 0x%04X could not be interpreted.", opCode, addr);
-            HALT(0x76);
+            return 0;
         }
     }
 
+    return count;
+}
+
+void CPU::StepComponents(unsigned long cycles)
+{
     m_cycles += cycles;
 
+    // In double speed, the CPU executes two cycles for every cycle of the GPU and APU
+    unsigned long realCycles = cycles >> m_SpeedShift;
+
     if (m_GPU != nullptr)
     {
         // Step GPU by # of elapsed cycles
-        m_GPU->Step(cycles);
+        m_GPU->Step(realCycles);
     }
 
     if (m_timer != nullptr)
     {
-        // Step the timer by the # of elapsed cycles
+        // Step the timer by the # of elapsed cycles, it runs off the CPU clock
         m_timer->Step(cycles);
     }
 
+    if (m_serial != nullptr)
+    {
+        // Step the serial port, this may wait on a linked peer
+        m_serial->Step(realCycles);
+    }
+
     if (m_APU != nullptr)
     {
         // Step the audio processing unit by the # of elapsed cycles
-        m_APU->Step(cycles);
+        m_APU->Step(realCycles);
+    }
+}
+
+/*
+    How many CPU cycles can go by before the components have to be stepped, 0 if they have to be
+    stepped after every instruction. Up to there, stepping them once by the cycles of several
+    instructions does the same as stepping them after each one.
+*/
+unsigned long CPU::GetCyclesUntilEvent()
+{
+    unsigned long cycles = m_timer->GetCyclesUntilEvent();
+    unsigned long realCycles = std::min(m_GPU->GetCyclesUntilEvent(), m_serial->GetCyclesUntilEvent());
+    if (realCycles != NoEventCycles)
+    {
+        cycles = std::min(cycles, realCycles << m_SpeedShift);
     }
 
-    HandleInterrupts();
     return cycles;
 }
 
@@ -844,6 +1168,11 @@ void CPU::TriggerInterrupt(byte interrupt)
     else if (interrupt == INT60) IF = SETBIT(IF, 4);
 
     m_MMU->Write(0xFF0F, IF);
+
+    if ((interrupt == INT40) && (m_spCheats != nullptr))
+    {
+        m_spCheats->ApplyPokes();
+    }
 }
 
 byte* CPU::GetCurrentFrame()
@@ -851,6 +1180,11 @@ byte* CPU::GetCurrentFrame()
     return m_GPU->GetCurrentFrame();
 }
 
+const bool* CPU::GetDirtyLines()
+{
+    return m_GPU->GetDirtyLines();
+}
+
 void CPU::SetInput(byte input, byte buttons)
 {
     m_joypad->SetInput(input, buttons);
@@ -861,6 +1195,387 @@ void CPU::SetVSyncCallback(void(*pCallback)())
     m_GPU->SetVSyncCallback(pCallback);
 }
 
+void CPU::SetColorCorrection(bool isEnabled)
+{
+    m_GPU->SetColorCorrection(isEnabled);
+}
+
+void CPU::ConnectLink(ILinkPort* pPort)
+{
+    m_serial->Connect(pPort);
+}
+
+void CPU::SetLinkSyncWindow(unsigned long cycles)
+{
+    m_serial->SetSyncWindow(cycles);
+}
+
+void CPU::SetFastBoot(bool isEnabled)
+{
+    m_isFastBoot = isEnabled;
+}
+
+void CPU::SetFusion(bool isEnabled)
+{
+    m_isFusionEnabled = isEnabled;
+}
+
+bool CPU::EnableAudio()
+{
+    return m_APU->EnableAudio();
+}
+
+// Returns nullptr when the tests run the CPU on its own, there is no machine to debug
+Debugger* CPU::GetDebugger()
+{
+    if ((m_spDebugger == nullptr) && (GetMachineMMU() != nullptr))
+    {
+        // Translated code would run past the checks
+        m_spJIT.reset();
+        m_spDebugger = std::make_unique<Debugger>(this, GetMachineMMU());
+    }
+
+    return m_spDebugger.get();
+}
+
+// Starts recording every executed instruction in a ring of the given size, once enabled the trace stays
+Trace* CPU::EnableTrace(unsigned int size)
+{
+    if (m_spTrace == nullptr)
+    {
+        m_spJIT.reset();
+        m_spTrace = std::make_unique<Trace>(size);
+    }
+
+    return m_spTrace.get();
+}
+
+// Starts recording how the ROM is used, needs the cartridge to be loaded
+Coverage* CPU::EnableCoverage()
+{
+    if ((m_spCoverage == nullptr) && (GetMachineMMU() != nullptr) && (m_cartridge->GetROMSize() > 0))
+    {
+        m_spJIT.reset();
+        m_spCoverage = std::make_unique<Coverage>(this, GetMachineMMU(), m_cartridge);
+    }
+
+    return m_spCoverage.get();
+}
+
+Cheats* CPU::GetCheats()
+{
+    if ((m_spCheats == nullptr) && (GetMachineMMU() != nullptr))
+    {
+        m_spJIT.reset();
+        m_spCheats = std::make_unique<Cheats>(GetMachineMMU());
+    }
+
+    return m_spCheats.get();
+}
+
+/*
+    The recorder sees the frames before the VSync callback does. It records nothing and the display
+    is not drawn for it until it is started.
+*/
+Recorder* CPU::GetRecorder()
+{
+    if (m_spRecorder == nullptr)
+    {
+        m_spRecorder = std::make_unique<Recorder>();
+        if (m_GPU != nullptr)
+        {
+            m_GPU->SetRecorder(m_spRecorder.get());
+        }
+    }
+
+    return m_spRecorder.get();
+}
+
+/*
+    Runs the CPU through translated code where that gives the same result as interpreting it, see
+    JIT. The debugger, trace, coverage and cheats look at every instruction, so it is refused while
+    any of them is on and dropped when one is turned on. Initialize drops it as well.
+*/
+bool CPU::EnableJIT(bool isEnabled)
+{
+    m_spJIT.reset();
+    if (!isEnabled)
+    {
+        return true;
+    }
+
+    MMU* pMMU = GetMachineMMU();
+    if (pMMU == nullptr)
+    {
+        Logger::LogError("The JIT needs a full machine");
+        return false;
+    }
+
+    if ((m_spDebugger != nullptr) || (m_spTrace != nullptr) || (m_spCoverage != nullptr) || (m_spCheats != nullptr))
+    {
+        Logger::LogError("The JIT can not run with the debugger, trace, coverage or cheats on");
+        return false;
+    }
+
+    std::unique_ptr<JIT> spJIT = std::make_unique<JIT>(this, pMMU);
+    if (!spJIT->Initialize())
+    {
+        return false;
+    }
+
+    m_spJIT = std::move(spJIT);
+    return true;
+}
+
+// With a full machine the MMU is always our own, the tests run the CPU on a test MMU without one
+MMU* CPU::GetMachineMMU()
+{
+    return (m_cartridge != nullptr) ? static_cast<MMU*>(m_MMU) : nullptr;
+}
+
+// The whole machine, including the cartridge RAM and MBC registers
+void CPU::SaveState(StateWriter& writer)
+{
+    SaveMachineState(writer);
+    m_cartridge->SaveState(writer);
+}
+
+// Returns false if the snapshot has the wrong size, the machine state is undefined afterwards
+bool CPU::LoadState(StateReader& reader)
+{
+    LoadMachineState(reader);
+    m_cartridge->LoadState(reader);
+    return reader.IsComplete();
+}
+
+void CPU::SaveMachineState(StateWriter& writer)
+{
+    writer.Write(m_cycles);
+    writer.Write(m_isHalted);
+    writer.Write(m_IFWhenHalted);
+    writer.Write(m_isCGB);
+    writer.Write(m_SpeedShift);
+    writer.Write(m_isSpeedSwitchPrepared);
+
+    writer.Write(m_AF);
+    writer.Write(m_BC);
+    writer.Write(m_DE);
+    writer.Write(m_HL);
+    writer.Write(m_SP);
+    writer.Write(m_PC);
+    writer.Write(m_IME);
+
+    m_MMU->SaveState(writer);
+    m_GPU->SaveState(writer);
+    m_APU->SaveState(writer);
+    m_joypad->SaveState(writer);
+    m_serial->SaveState(writer);
+    m_timer->SaveState(writer);
+}
+
+void CPU::LoadMachineState(StateReader& reader)
+{
+    reader.Read(m_cycles);
+    reader.Read(m_isHalted);
+    reader.Read(m_IFWhenHalted);
+    reader.Read(m_isCGB);
+    reader.Read(m_SpeedShift);
+    reader.Read(m_isSpeedSwitchPrepared);
+
+    reader.Read(m_AF);
+    reader.Read(m_BC);
+    reader.Read(m_DE);
+    reader.Read(m_HL);
+    reader.Read(m_SP);
+    reader.Read(m_PC);
+    reader.Read(m_IME);
+
+    m_MMU->LoadState(reader);
+    m_GPU->LoadState(reader);
+    m_APU->LoadState(reader);
+    m_joypad->LoadState(reader);
+    m_serial->LoadState(reader);
+    m_timer->LoadState(reader);
+
+    if (m_spJIT != nullptr)
+    {
+        // The RAM was replaced under the code translated from it
+        m_spJIT->Flush();
+    }
+}
+
+/*
+    Runs the boot ROM once per (boot ROM, cartridge header) and restores the resulting state on
+    later starts. The boot ROM only reads the header, so the post-boot state depends on nothing
+    else. The cartridge itself is not touched by the boot ROM and is left as loaded.
+*/
+bool CPU::FastBoot()
+{
+    // The boot ROM stays mapped over 0x0000-0x00FF until it writes to 0xFF50
+    byte bootROM[0x100];
+    for (unsigned int address = 0x0000; address < ARRAYSIZE(bootROM); address++)
+    {
+        bootROM[address] = m_MMU->Read(static_cast<ushort>(address));
+    }
+
+    byte header[0x50];
+    for (unsigned int index = 0; index < ARRAYSIZE(header); index++)
+    {
+        header[index] = m_cartridge->ReadByte(static_cast<ushort>(0x0100 + index));
+    }
+
+    unsigned long long key = BootCache::MakeKey(bootROM, sizeof(bootROM), header, sizeof(header));
+
+    std::vector<byte> state;
+    if (BootCache::Find(key, state))
+    {
+        StateReader reader(state.data(), state.size());
+        LoadMachineState(reader);
+        if (!reader.IsComplete())
+        {
+            Logger::LogError("Boot cache entry %016llx does not match this build and was removed", key);
+            BootCache::Remove(key);
+            return false;
+        }
+
+        return true;
+    }
+
+    unsigned long cycles = 0;
+    while ((m_MMU->Read(0xFF50) == 0x00) && (cycles < FastBootCycleLimit))
+    {
+        cycles += Step();
+    }
+
+    if (m_MMU->Read(0xFF50) == 0x00)
+    {
+        // Real hardware would hang here as well (e.g. on a bad logo), keep running without caching
+        Logger::LogError("The boot ROM did not finish after %lu cycles, its state is not cached", cycles);
+        return true;
+    }
+
+    StateWriter writer;
+    SaveMachineState(writer);
+    BootCache::Store(key, writer.GetData());
+    return true;
+}
+
+void CPU::GetState(CPUState& state)
+{
+    state.AF = m_AF;
+    state.BC = m_BC;
+    state.DE = m_DE;
+    state.HL = m_HL;
+    state.SP = m_SP;
+    state.PC = m_PC;
+    state.IME = m_IME;
+    state.isHalted = m_isHalted;
+    state.cycles = m_cycles;
+}
+
+// IMemoryUnit
+byte CPU::ReadByte(const ushort& address)
+{
+    if ((address == SpeedSwitchAddress) && m_isCGB)
+    {
+        return static_cast<byte>((m_SpeedShift << 7) | 0x7E | (m_isSpeedSwitchPrepared ? 0x01 : 0x00));
+    }
+
+    return 0xFF;
+}
+
+bool CPU::WriteByte(const ushort& address, const byte val)
+{
+    if ((address == SpeedSwitchAddress) && m_isCGB)
+    {
+        // Only the prepare bit is writable, the speed changes on STOP
+        m_isSpeedSwitchPrepared = ISBITSET(val, 0);
+    }
+
+    return true;
+}
+
+/*
+    Computes a FNV-1a hash of the RAM visible to the CPU. When running against a flat test MMU the
+    whole address space is hashed. Otherwise only VRAM, WRAM, OAM and HRAM are included, since
+    cartridge RAM and the I/O ports can have side effects (or log) when read.
+*/
+unsigned int CPU::GetMemoryDigest()
+{
+    const ushort flatRegions[][2] = { { 0x0000, 0xFFFF } };
+    const ushort ramRegions[][2] =
+    {
+        { 0x8000, 0x9FFF },     // VRAM
+        { 0xC000, 0xDFFF },     // WRAM
+        { 0xFE00, 0xFE9F },     // OAM
+        { 0xFF80, 0xFFFF },     // HRAM + IE
+    };
+
+    bool isFlat = (m_cartridge == nullptr);
+    const ushort(*regions)[2] = isFlat ? flatRegions : ramRegions;
+    unsigned int regionCount = isFlat ? ARRAYSIZE(flatRegions) : ARRAYSIZE(ramRegions);
+
+    unsigned int hash = 2166136261u;
+    for (unsigned int region = 0; region < regionCount; region++)
+    {
+        for (unsigned int address = regions[region][0]; address <= regions[region][1]; address++)
+        {
+            hash ^= m_MMU->Read(static_cast<ushort>(address));
+            hash *= 16777619u;
+        }
+    }
+
+    return hash;
+}
+
+/*
+    The bytes of mutable state owned by this machine: the CPU with the components embedded in it
+    and the cartridge RAM. The ROM is shared between machines and the display buffer is only
+    allocated once someone asks for frames, so neither is counted.
+*/
+size_t CPU::GetMemoryFootprint()
+{
+    size_t size = sizeof(CPU);
+    if (m_cartridge != nullptr)
+    {
+        size += m_cartridge->GetRAMSize();
+    }
+
+    return size;
+}
+
+byte CPU::PeekMemory(const ushort& address)
+{
+    return m_MMU->Read(address);
+}
+
+/*
+    Copies the work RAM, HRAM and cartridge RAM back to back into snapshot, see MemorySearch.
+    Returns how much of it is work RAM. Without a full machine the snapshot is empty.
+*/
+unsigned int CPU::SnapshotRAM(std::vector<byte>& snapshot)
+{
+    MMU* pMMU = GetMachineMMU();
+    if (pMMU == nullptr)
+    {
+        snapshot.clear();
+        return 0;
+    }
+
+    unsigned int workRAMSize = pMMU->GetWRAMSize();
+    unsigned int cartridgeRAMSize = m_cartridge->GetRAMSize();
+
+    snapshot.resize(workRAMSize + HRAMSize + cartridgeRAMSize);
+    memcpy(snapshot.data(), pMMU->GetWRAM(), workRAMSize);
+    memcpy(snapshot.data() + workRAMSize, pMMU->GetHRAM(), HRAMSize);
+    if (cartridgeRAMSize > 0)
+    {
+        memcpy(snapshot.data() + workRAMSize + HRAMSize, m_cartridge->GetRAM(), cartridgeRAMSize);
+    }
+
+    return workRAMSize;
+}
+
 byte CPU::GetHighByte(ushort dest)
 {
     return ((dest >> 8) & 0xFF);
@@ -2148,14 +2863,35 @@ unsigned long CPU::SBCAr(const byte& opCode)
 /*
     STOP - 0x10
 
-    For the purposes of this emulator, this is identical to HALT.
+    On a CGB with a speed switch prepared in KEY1, this switches between normal and double speed.
+    The CPU is stopped while the clock settles, and the byte following STOP is skipped. The stall
+    takes the same real time in both directions.
 
-    0 Cycles
+    Otherwise, for the purposes of this emulator, this is identical to HALT.
+
+    0 Cycles (8200 Cycles at normal speed for a speed switch)
 
     Flags affected(znhc): ----
 */
 unsigned long CPU::STOP(const byte& opCode)
 {
+    if (m_isCGB && m_isSpeedSwitchPrepared)
+    {
+        // The cycles are counted on the clock we switch to
+        unsigned long cycles = SpeedSwitchCycles << (m_SpeedShift ^ 0x01);
+
+        m_SpeedShift ^= 0x01;
+        m_isSpeedSwitchPrepared = false;
+        m_PC++;
+
+        if (m_serial != nullptr)
+        {
+            m_serial->SetDoubleSpeed(m_SpeedShift != 0);
+        }
+
+        return cycles;
+    }
+
     return HALT(opCode);
 }
 
@@ -1,5 +1,6 @@
 #pragma once
 
+#include "Arena.hpp"
 #include "MMU.hpp"
 #include "Cartridge.hpp"
 #include "GPU.hpp"
@@ -8,6 +9,8 @@
 #include "Serial.hpp"
 #include "Timer.hpp"
 
+class JIT;
+
 /*
     The Flag Register (lower 8bit of AF register)
     Bit  Name  Set Clr  Expl.
@@ -22,14 +25,74 @@
 #define HalfCarryFlag   5
 #define CarryFlag       4
 
-class CPU : public ICPU
+/*
+    FF4D - KEY1 - CGB Mode Only - Prepare Speed Switch
+    Bit 7: Current Speed     (0=Normal, 1=Double) (Read Only)
+    Bit 0: Prepare Speed Switch (0=No, 1=Prepare) (Read/Write)
+
+    Writing 1 to bit 0 and executing STOP switches between normal and double speed. In double speed
+    the CPU, the timer and the serial port run at 8 MHz, while the GPU and APU keep their timing.
+*/
+#define SpeedSwitchAddress  0xFF4D
+#define SpeedSwitchCycles   8200    // How long the CPU is stopped while the clock switches, at normal speed
+
+// The DMG boot ROM takes ~2.5M cycles, give up on a boot ROM that has not finished after ~4 seconds
+#define FastBootCycleLimit  0x1000000
+
+// A fused sequence that loops on itself is run again while it stays exact, up to about this many cycles
+#define FusedMaxCycles      0x1000
+#define FusedRejectCount    0x200   // Places remembered not to start a sequence, see MatchFused
+
+// A place that does not start a fused sequence, the bank is only kept for 0x4000-0x7FFF
+struct FusedReject
+{
+    ushort PC;      // The address after the opcode, 0 for none
+    ushort bank;
+};
+
+// The mutable state of one machine, excluding the cartridge RAM, must fit in this many bytes
+#define MachineStateBudget  (64 * 1024)
+
+// Room for every component of a machine, plus a cache line to align the start
+#define MachineArenaSize    (CACHELINES(sizeof(Timer)) + CACHELINES(sizeof(Joypad)) + CACHELINES(sizeof(Serial)) + \
+                             CACHELINES(sizeof(APU)) + CACHELINES(sizeof(Cartridge)) + CACHELINES(sizeof(GPU)) + \
+                             CACHELINES(sizeof(MMU)) + CACHELINES(MMUPageTableSize) + CACHELINES(WRAMSize) + \
+                             CACHELINES(VRAMSize) + CacheLineSize)
+
+/*
+    A copy of the architectural state of the CPU, used to compare execution cores and to report
+    the machine state to tools.
+*/
+struct CPUState
+{
+    ushort AF;
+    ushort BC;
+    ushort DE;
+    ushort HL;
+    ushort SP;
+    ushort PC;
+    byte IME;
+    bool isHalted;
+    unsigned long cycles;
+};
+
+class CPU : public ICPU, public IMemoryUnit
 {
     friend class CPUTests;
+    friend class CheatsTests;
+    friend class DebuggerTests;
+    friend class MemorySearchTests;
+    friend class RecorderTests;
+    friend class JIT;
 
 public:
     CPU();
     ~CPU();
 
+    // Keep the machine state on cache line boundaries, plain new only guarantees 16 bytes
+    static void* operator new(size_t size);
+    static void operator delete(void* pMemory);
+
 private:
     bool Initialize(IMMU* pMMU, bool isFromTest);
 
@@ -39,8 +102,36 @@ public:
     int Step();
     void TriggerInterrupt(byte interrupt);
     byte* GetCurrentFrame();
+    const bool* GetDirtyLines();
     void SetInput(byte input, byte buttons);
     void SetVSyncCallback(void(*pCallback)());
+    void SetColorCorrection(bool isEnabled);
+    void ConnectLink(ILinkPort* pPort);
+    void SetLinkSyncWindow(unsigned long cycles);
+    void SetFastBoot(bool isEnabled);
+    void SetFusion(bool isEnabled);
+    bool EnableAudio();
+    Debugger* GetDebugger();
+    Trace* EnableTrace(unsigned int size);
+    Coverage* EnableCoverage();
+    Cheats* GetCheats();
+    bool EnableJIT(bool isEnabled);
+    Recorder* GetRecorder();
+
+    // Snapshots of the whole machine, everything but the ROM
+    void SaveState(StateWriter& writer);
+    bool LoadState(StateReader& reader);
+
+    // Debugging
+    void GetState(CPUState& state);
+    unsigned int GetMemoryDigest();
+    size_t GetMemoryFootprint();
+    byte PeekMemory(const ushort& address);
+    unsigned int SnapshotRAM(std::vector<byte>& snapshot);
+
+    // IMemoryUnit
+    byte ReadByte(const ushort& address);
+    bool WriteByte(const ushort& address, const byte val);
 
 private:
     static byte GetHighByte(ushort dest);
@@ -68,7 +159,20 @@ private:
     void ADC(byte val);
     void SBC(byte val);
 
+    unsigned long ExecuteInstruction(bool canFuse = false);
+    void RecordTrace(ushort addr, byte opCode);
+    unsigned long ExecuteFused(byte opCode);
+    unsigned int MatchFused(byte opCode, unsigned long& leadCycles, bool& isLoop);
+    void StepComponents(unsigned long cycles);
+    unsigned long GetCyclesUntilEvent();
     void HandleInterrupts();
+    static bool InitializeOperationMaps();
+    bool FastBoot();
+    MMU* GetMachineMMU();
+
+    // Everything but the cartridge, which the boot ROM does not touch
+    void SaveMachineState(StateWriter& writer);
+    void LoadMachineState(StateReader& reader);
 
     // TODO: Organize the following...
     // Z80 Instruction Set
@@ -181,32 +285,6 @@ private:
     unsigned long SWAP_HL_(const byte& opCode);
 
 private:
-    // MMU (Memory Map Unit)
-    std::unique_ptr<IMMU> m_MMU;
-
-    // Cartridge
-    std::unique_ptr<Cartridge> m_cartridge;
-
-    // GPU
-    std::unique_ptr<GPU> m_GPU;
-
-    // APU
-    std::unique_ptr<APU> m_APU;
-
-    // Joypad
-    std::unique_ptr<Joypad> m_joypad;
-
-    // Serial
-    std::unique_ptr<Serial> m_serial;
-
-    // Timer
-    std::unique_ptr<Timer> m_timer;
-
-    // Clock cycles
-    unsigned long m_cycles; // The current number of cycles
-    bool m_isHalted;
-    byte m_IFWhenHalted;
-
     // Registers
     ushort m_AF; // Accumulator & flags
     ushort m_BC; // General purpose
@@ -214,14 +292,60 @@ private:
     ushort m_HL; // General purpose
     ushort m_SP; // Stack pointer
     ushort m_PC; // Program counter
-    byte* m_ByteRegisterMap[0x07 + 1];
-    ushort* m_UShortRegisterMap[0x03 + 1];
 
     // Interrupts
     byte m_IME; // Interrupt master enable
 
-    // OpCode Function Map
+    // Clock cycles
+    unsigned long m_cycles; // The current number of cycles
+    bool m_isHalted;
+    byte m_IFWhenHalted;
+
+    // CGB speed switch
+    bool m_isCGB;
+    byte m_SpeedShift;      // Real cycles = CPU cycles >> m_SpeedShift (0 = normal, 1 = double speed)
+    bool m_isSpeedSwitchPrepared;
+    bool m_isFastBoot;      // Restore the post-boot state from the boot cache instead of running the boot ROM
+    bool m_isFusionEnabled; // Run the common instruction sequences as one step, see ExecuteFused
+
+    std::unique_ptr<Trace> m_spTrace;   // Every executed instruction, if enabled
+
+    // MMU (Memory Map Unit), either the machine's own or one supplied by the tests
+    IMMU* m_MMU;
+
+    // The rest of the machine, nullptr when the tests run the CPU on its own
+    Cartridge* m_cartridge;
+    GPU* m_GPU;
+    APU* m_APU;
+    Joypad* m_joypad;
+    Serial* m_serial;
+    Timer* m_timer;
+
+    byte* m_ByteRegisterMap[0x07 + 1];
+    ushort* m_UShortRegisterMap[0x03 + 1];
+
+    // OpCode Function Map, shared by all instances
     typedef unsigned long(CPU::*opCodeFunction)(const byte& opCode);
-    opCodeFunction m_operationMap[0xFF + 1];
-    opCodeFunction m_operationMapCB[0xFF + 1];
+    static opCodeFunction m_operationMap[0xFF + 1];
+    static opCodeFunction m_operationMapCB[0xFF + 1];
+    static bool m_isFusedLead[0xFF + 1];       // Opcodes a sequence in MatchFused starts with
+
+    std::unique_ptr<IMMU> m_spTestMMU;
+    std::unique_ptr<Debugger> m_spDebugger;     // Only created once someone debugs
+    std::unique_ptr<Coverage> m_spCoverage;     // Only created once someone asks for it
+    std::unique_ptr<Cheats> m_spCheats;         // Only created once a code is entered
+    std::unique_ptr<JIT> m_spJIT;               // Only created once enabled, see EnableJIT
+    std::unique_ptr<Recorder> m_spRecorder;     // Only created once someone records
+
+    /*
+        The components are placement constructed in this block right behind the registers, so the
+        mutable state of a machine is one contiguous allocation (see MachineStateBudget). The small
+        components go first and the GPU and MMU keep their scalar state ahead of their tables, the
+        MMU page tables, work RAM and video RAM come last. Only the ROM, which is shared between
+        instances, the cartridge RAM and the display buffer live elsewhere.
+    */
+    byte m_ArenaMemory[MachineArenaSize];
+    Arena m_Arena;
+
+    FusedReject m_FusedRejects[FusedRejectCount];   // By address, see MatchFused
 };
@@ -1,10 +1,15 @@
 #include "pch.hpp"
 #include "Cartridge.hpp"
+#include "Hash.hpp"
 
 #include "MBC.hpp"
 
+std::mutex Cartridge::m_SharedROMMutex;
+std::multimap<unsigned long long, std::weak_ptr<const std::vector<byte>>> Cartridge::m_SharedROMs;
+
 Cartridge::Cartridge() :
-    m_MBCType(ROMOnly)
+    m_MBCType(ROMOnly),
+    m_RAMSize(0)
 {
 }
 
@@ -51,11 +56,12 @@ bool Cartridge::LoadROM(const char* path)
 
         file.seekg(0, std::ios::beg);
 
-        m_ROM = std::unique_ptr<byte>(new byte[static_cast<unsigned int>(iSize)]);
+        std::vector<byte> rom(static_cast<unsigned int>(iSize));
 
-        if (file.read(reinterpret_cast<char*>(m_ROM.get()), size))
+        if (file.read(reinterpret_cast<char*>(rom.data()), size))
         {
             Logger::Log("Loaded game ROM %s (%d bytes)", path, iSize);
+            m_ROM = ShareROM(rom);
 
             if (iSize < 0x014F)
             {
@@ -78,6 +84,57 @@ bool Cartridge::LoadROM(const char* path)
     return succeeded;
 }
 
+bool Cartridge::IsCGB()
+{
+    return (m_ROM != nullptr) && ((m_ROM->data()[CGBFlagAddress] & CGBFlag) != 0x00);
+}
+
+unsigned int Cartridge::GetRAMSize()
+{
+    return (m_RAM != nullptr) ? m_RAMSize : 0;
+}
+
+const byte* Cartridge::GetRAM()
+{
+    return m_RAM.get();
+}
+
+unsigned int Cartridge::GetROMBank()
+{
+    return (m_MBC != nullptr) ? m_MBC->GetROMBank() : 0;
+}
+
+unsigned int Cartridge::GetROMSize()
+{
+    return (m_ROM != nullptr) ? static_cast<unsigned int>(m_ROM->size()) : 0;
+}
+
+void Cartridge::SaveState(StateWriter& writer)
+{
+    if (m_RAM != nullptr)
+    {
+        writer.Write(m_RAM.get(), m_RAMSize);
+    }
+
+    if (m_MBC != nullptr)
+    {
+        m_MBC->SaveState(writer);
+    }
+}
+
+void Cartridge::LoadState(StateReader& reader)
+{
+    if (m_RAM != nullptr)
+    {
+        reader.Read(m_RAM.get(), m_RAMSize);
+    }
+
+    if (m_MBC != nullptr)
+    {
+        m_MBC->LoadState(reader);
+    }
+}
+
 // IMemoryUnit
 byte Cartridge::ReadByte(const ushort& address)
 {
@@ -89,11 +146,51 @@ bool Cartridge::WriteByte(const ushort& address, const byte val)
     return m_MBC->WriteByte(address, val);
 }
 
+const byte* Cartridge::GetMemoryBlock(const ushort& address)
+{
+    return m_MBC->GetMemoryBlock(address);
+}
+
+/*
+    Returns the shared copy of a ROM, so instances running the same game only keep it in memory
+    once. The ROM is found by content rather than by path, a file that changed on disk is never
+    mixed up with an older copy. The passed in vector is consumed if no copy exists yet.
+*/
+std::shared_ptr<const std::vector<byte>> Cartridge::ShareROM(std::vector<byte>& rom)
+{
+    unsigned long long hash = FNVHash(FNVOffsetBasis, rom.data(), rom.size());
+
+    std::lock_guard<std::mutex> lock(m_SharedROMMutex);
+
+    auto range = m_SharedROMs.equal_range(hash);
+    for (auto it = range.first; it != range.second;)
+    {
+        std::shared_ptr<const std::vector<byte>> spROM = it->second.lock();
+        if (spROM == nullptr)
+        {
+            // Every cartridge using this one is gone
+            it = m_SharedROMs.erase(it);
+        }
+        else if (*spROM == rom)
+        {
+            return spROM;
+        }
+        else
+        {
+            ++it;
+        }
+    }
+
+    std::shared_ptr<const std::vector<byte>> spROM = std::make_shared<const std::vector<byte>>(std::move(rom));
+    m_SharedROMs.emplace(hash, spROM);
+    return spROM;
+}
+
 bool Cartridge::LoadMBC(unsigned int actualSize)
 {
-    m_MBCType = m_ROM.get()[CartridgeTypeAddress];
-    byte romSizeFlag = m_ROM.get()[ROMSizeAddress];
-    byte ramSizeFlag = m_ROM.get()[RAMSizeAddress];
+    m_MBCType = m_ROM->data()[CartridgeTypeAddress];
+    byte romSizeFlag = m_ROM->data()[ROMSizeAddress];
+    byte ramSizeFlag = m_ROM->data()[RAMSizeAddress];
 
     unsigned int romSize = (32 * 1024) << romSizeFlag;
     switch (romSizeFlag)
@@ -164,24 +261,24 @@ bool Cartridge::LoadMBC(unsigned int actualSize)
     switch (m_MBCType)
     {
     case ROMOnly:
-        m_MBC = std::unique_ptr<ROMOnly_MBC>(new ROMOnly_MBC(m_ROM.get(), m_RAM.get()));
+        m_MBC = std::unique_ptr<ROMOnly_MBC>(new ROMOnly_MBC(m_ROM->data(), m_RAM.get()));
         return true;
     case MBC1:
     case MBC1RAM:
     case MBC1RAMBattery:
-        m_MBC = std::unique_ptr<MBC1_MBC>(new MBC1_MBC(m_ROM.get(), m_RAM.get()));
+        m_MBC = std::unique_ptr<MBC1_MBC>(new MBC1_MBC(m_ROM->data(), m_RAM.get()));
         return true;
     case MBC2:
     case MBC2Battery:
         m_RAM.reset();
-        m_MBC = std::unique_ptr<MBC2_MBC>(new MBC2_MBC(m_ROM.get()));
+        m_MBC = std::unique_ptr<MBC2_MBC>(new MBC2_MBC(m_ROM->data()));
         return true;
     case MBC3TimerBattery:
     case MBC3TimerRAMBattery:
     case MBC3:
     case MBC3RAM:
     case MBC3RAMBattery:
-        m_MBC = std::unique_ptr<MBC3_MBC>(new MBC3_MBC(m_ROM.get(), m_RAM.get()));
+        m_MBC = std::unique_ptr<MBC3_MBC>(new MBC3_MBC(m_ROM->data(), m_RAM.get()));
         return true;
     case MBC5:
     case MBC5RAM:
@@ -189,7 +286,7 @@ bool Cartridge::LoadMBC(unsigned int actualSize)
     case MBC5Rumble:
     case MBC5RumbleRAM:
     case MBC5RumbleRAMBattery:
-        m_MBC = std::unique_ptr<MBC5_MBC>(new MBC5_MBC(m_ROM.get(), m_RAM.get()));
+        m_MBC = std::unique_ptr<MBC5_MBC>(new MBC5_MBC(m_ROM->data(), m_RAM.get()));
         return true;
     default:
         Logger::Log("Unsupported Cartridge MBC type: 0x%02X", m_MBCType);
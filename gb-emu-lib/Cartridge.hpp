@@ -1,9 +1,21 @@
 #pragma once
 
+#include <mutex>
+#include <string>
+#include <vector>
+
+#define CGBFlagAddress 0x0143
 #define CartridgeTypeAddress 0x0147
 #define ROMSizeAddress 0x0148
 #define RAMSizeAddress 0x0149
 
+/*
+0x0143 - CGB Flag
+In older cartridges this byte is part of the title. Bit 7 is set when the game supports CGB
+functions, i.e. 80h (CGB and DMG) or C0h (CGB only).
+*/
+#define CGBFlag         0x80
+
 /*
 0x0147 - Cartridge Type
 Specifies which Memory Bank Controller (if any) is used in the cartridge, and if further external hardware exists in the cartridge.
@@ -67,6 +79,8 @@ RAM of 512 x 4 bits.
 #define RAM_8KB         0x02
 #define RAM_32KB        0x03
 
+class MBC;
+
 class Cartridge : public IMemoryUnit
 {
 public:
@@ -74,19 +88,34 @@ public:
     ~Cartridge();
 
     bool LoadROM(const char* path);
+    bool IsCGB();
+    unsigned int GetRAMSize();
+    const byte* GetRAM();
+    unsigned int GetROMBank();
+    unsigned int GetROMSize();
+
+    // The RAM and the MBC registers, the ROM is not part of a snapshot
+    void SaveState(StateWriter& writer);
+    void LoadState(StateReader& reader);
 
     // IMemoryUnit
     byte ReadByte(const ushort& address);
     bool WriteByte(const ushort& address, const byte val);
+    const byte* GetMemoryBlock(const ushort& address);
 
 private:
     bool LoadMBC(unsigned int actualSize);
+    static std::shared_ptr<const std::vector<byte>> ShareROM(std::vector<byte>& rom);
 
 private:
     std::string m_Path;
     byte m_MBCType;
     unsigned int m_RAMSize;
-    std::unique_ptr<byte> m_ROM;
+    std::shared_ptr<const std::vector<byte>> m_ROM;    // Read only, shared with every cartridge holding the same ROM
     std::unique_ptr<byte> m_RAM;
-    std::unique_ptr<IMemoryUnit> m_MBC;
+    std::unique_ptr<MBC> m_MBC;
+
+    // ROMs currently loaded by any cartridge, by content hash
+    static std::mutex m_SharedROMMutex;
+    static std::multimap<unsigned long long, std::weak_ptr<const std::vector<byte>>> m_SharedROMs;
 };
@@ -0,0 +1,228 @@
+#include "pch.hpp"
+#include "Cheats.hpp"
+
+#include <cctype>
+
+Cheats::Cheats(MMU* pMMU) :
+    m_pMMU(pMMU)
+{
+}
+
+Cheats::~Cheats()
+{
+    ClearAll();
+}
+
+bool Cheats::AddCode(const char* code)
+{
+    std::string normalized = Normalize(code);
+
+    GameGenieCode gameGenie;
+    if (ParseGameGenie(normalized, gameGenie))
+    {
+        ushort pageAddress = gameGenie.address & 0xFF00;
+        std::unique_ptr<CheatPage>& spPage = m_Pages[pageAddress];
+        if (spPage == nullptr)
+        {
+            spPage = std::unique_ptr<CheatPage>(new CheatPage());
+        }
+
+        spPage->m_Codes.push_back(gameGenie);
+        Update(*spPage, pageAddress);
+        return true;
+    }
+
+    GameSharkCode gameShark;
+    if (ParseGameShark(normalized, gameShark))
+    {
+        m_Pokes.push_back(gameShark);
+        return true;
+    }
+
+    Logger::LogError("Cheats: '%s' is not a Game Genie or type 01 GameShark code", code);
+    return false;
+}
+
+bool Cheats::RemoveCode(const char* code)
+{
+    std::string normalized = Normalize(code);
+    for (auto& entry : m_Pages)
+    {
+        std::vector<GameGenieCode>& codes = entry.second->m_Codes;
+        for (auto it = codes.begin(); it != codes.end(); ++it)
+        {
+            if (it->code == normalized)
+            {
+                codes.erase(it);
+                Update(*entry.second, entry.first);
+                return true;
+            }
+        }
+    }
+
+    for (auto it = m_Pokes.begin(); it != m_Pokes.end(); ++it)
+    {
+        if (it->code == normalized)
+        {
+            m_Pokes.erase(it);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void Cheats::ClearAll()
+{
+    for (auto& entry : m_Pages)
+    {
+        entry.second->m_Codes.clear();
+        Update(*entry.second, entry.first);
+    }
+
+    m_Pokes.clear();
+}
+
+void Cheats::ApplyPokes()
+{
+    for (const GameSharkCode& poke : m_Pokes)
+    {
+        m_pMMU->Write(poke.address, poke.value);
+    }
+}
+
+// Upper case hex digits without the dashes and spaces codes are usually written with
+std::string Cheats::Normalize(const char* code)
+{
+    std::string normalized;
+    for (const char* pChar = code; *pChar != '\0'; pChar++)
+    {
+        if ((*pChar != '-') && (*pChar != ' '))
+        {
+            normalized += static_cast<char>(toupper(static_cast<unsigned char>(*pChar)));
+        }
+    }
+
+    return normalized;
+}
+
+/*
+    ABC-DEF-GHI, all hex digits:
+        AB      The new value
+        FCDE    The address, with F inverted
+        GI      The compare value XORed with 0xBA and rotated left by 2
+        H       Unused by the hardware
+    Without GHI the value is replaced unconditionally.
+*/
+bool Cheats::ParseGameGenie(const std::string& code, GameGenieCode& gameGenie)
+{
+    if (((code.size() != 6) && (code.size() != 9)) ||
+        (code.find_first_not_of("0123456789ABCDEF") != std::string::npos))
+    {
+        return false;
+    }
+
+    byte digits[9];
+    for (size_t index = 0; index < code.size(); index++)
+    {
+        digits[index] = static_cast<byte>(std::stoi(code.substr(index, 1), nullptr, 16));
+    }
+
+    gameGenie.code = code;
+    gameGenie.value = (digits[0] << 4) | digits[1];
+    gameGenie.address = ((digits[5] ^ 0x0F) << 12) | (digits[2] << 8) | (digits[3] << 4) | digits[4];
+    gameGenie.hasCompare = (code.size() == 9);
+    gameGenie.compare = 0x00;
+    if (gameGenie.hasCompare)
+    {
+        byte compare = (digits[6] << 4) | digits[8];
+        gameGenie.compare = static_cast<byte>((compare >> 2) | (compare << 6)) ^ 0xBA;
+    }
+
+    // Only the ROM can be patched
+    return gameGenie.address <= 0x7FFF;
+}
+
+/*
+    TTVVLLHH, all hex digits:
+        TT      The type, 01 writes to whatever is mapped at the address
+        VV      The value
+        HHLL    The address
+    The 8x and 9x types write to one cartridge RAM or work RAM bank. Poking them into the bank that
+    happens to be mapped at VBlank can corrupt saves, so they are turned down.
+*/
+bool Cheats::ParseGameShark(const std::string& code, GameSharkCode& gameShark)
+{
+    if ((code.size() != 8) || (code.find_first_not_of("0123456789ABCDEF") != std::string::npos))
+    {
+        return false;
+    }
+
+    unsigned int value = std::stoul(code, nullptr, 16);
+    if ((value >> 24) != 0x01)
+    {
+        return false;
+    }
+
+    gameShark.code = code;
+    gameShark.value = static_cast<byte>(value >> 16);
+    gameShark.address = static_cast<ushort>(((value & 0xFF) << 8) | ((value >> 8) & 0xFF));
+    return true;
+}
+
+// Puts the page in front of the MMU while it has codes, takes it out again once it has none
+void Cheats::Update(CheatPage& page, ushort pageAddress)
+{
+    memset(page.m_IsPatched, 0x00, sizeof(page.m_IsPatched));
+    for (const GameGenieCode& code : page.m_Codes)
+    {
+        page.m_IsPatched[code.address & 0xFF] = true;
+    }
+
+    if (!page.m_Codes.empty() && (page.m_pUnit == nullptr))
+    {
+        m_pMMU->InstallInterposer(pageAddress, &page);
+    }
+    else if (page.m_Codes.empty() && (page.m_pUnit != nullptr))
+    {
+        m_pMMU->RemoveInterposer(pageAddress, &page);
+    }
+}
+
+Cheats::CheatPage::CheatPage()
+{
+    memset(m_IsPatched, 0x00, sizeof(m_IsPatched));
+}
+
+// IMemoryUnit
+byte Cheats::CheatPage::ReadByte(const ushort& address)
+{
+    byte value = m_pUnit->ReadByte(address);
+    if (!m_IsPatched[address & 0xFF])
+    {
+        return value;
+    }
+
+    // The compare value picks the bank, the same address may have a code for each of them
+    for (const GameGenieCode& code : m_Codes)
+    {
+        if ((code.address == address) && (!code.hasCompare || (code.compare == value)))
+        {
+            return code.value;
+        }
+    }
+
+    return value;
+}
+
+bool Cheats::CheatPage::WriteByte(const ushort& address, const byte val)
+{
+    // MBC registers
+    return m_pUnit->WriteByte(address, val);
+}
+
+// Block transfers go byte by byte through ReadByte so they see the patched values
+const byte* Cheats::CheatPage::GetMemoryBlock(const ushort& address)
+{
+    return nullptr;
+}
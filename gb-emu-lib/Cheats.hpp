@@ -0,0 +1,77 @@
+#pragma once
+
+#include "MMU.hpp"
+
+#include <map>
+#include <string>
+#include <vector>
+
+/*
+    Game Genie and GameShark codes.
+
+    Game Genie codes ("ABC-DEF" or "ABC-DEF-GHI") replace a ROM byte, optionally only while the
+    byte underneath has the compare value so they stick to one bank. Like the Debugger they work by
+    redirecting MMU pages: a page with a code on it gets a CheatPage in front that forwards the read
+    and swaps in the new value where a code matches. Pages without codes keep their direct dispatch
+    and the ROM itself is never written, so it stays shared between machines.
+
+    GameShark codes ("01VVLLHH") write VV to HHLL once per VBlank. Codes for a given RAM bank are not
+    supported.
+
+    With no codes set nothing is redirected and nothing runs at VBlank.
+*/
+class Cheats
+{
+public:
+    Cheats(MMU* pMMU);
+    ~Cheats();
+
+    bool AddCode(const char* code);
+    bool RemoveCode(const char* code);
+    void ClearAll();
+
+    // Called when the GPU enters VBlank
+    void ApplyPokes();
+
+private:
+    struct GameGenieCode
+    {
+        std::string code;
+        ushort address;
+        byte value;
+        byte compare;
+        bool hasCompare;
+    };
+
+    struct GameSharkCode
+    {
+        std::string code;
+        ushort address;
+        byte value;
+    };
+
+    class CheatPage : public MemoryInterposer
+    {
+    public:
+        CheatPage();
+
+        // IMemoryUnit
+        byte ReadByte(const ushort& address);
+        bool WriteByte(const ushort& address, const byte val);
+        const byte* GetMemoryBlock(const ushort& address);
+
+    public:
+        std::vector<GameGenieCode> m_Codes;
+        byte m_IsPatched[0x100];    // Whether any code is on the address, so the rest skip the search
+    };
+
+    static std::string Normalize(const char* code);
+    static bool ParseGameGenie(const std::string& code, GameGenieCode& gameGenie);
+    static bool ParseGameShark(const std::string& code, GameSharkCode& gameShark);
+    void Update(CheatPage& page, ushort pageAddress);
+
+private:
+    MMU* m_pMMU;
+    std::map<ushort, std::unique_ptr<CheatPage>> m_Pages;
+    std::vector<GameSharkCode> m_Pokes;
+};
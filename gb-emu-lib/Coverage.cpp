@@ -0,0 +1,208 @@
+#include "pch.hpp"
+#include "Coverage.hpp"
+
+#include <iomanip>
+
+#define ROMBankSize 0x4000
+
+Coverage::Coverage(CPU* pCPU, MMU* pMMU, Cartridge* pCartridge) :
+    m_pCPU(pCPU),
+    m_pMMU(pMMU),
+    m_pCartridge(pCartridge),
+    m_FetchCycles(static_cast<unsigned long>(-1))
+{
+    m_Map.resize(m_pCartridge->GetROMSize(), 0x00);
+
+    for (unsigned int pageAddress = 0x0000; pageAddress < 0x8000; pageAddress += 0x100)
+    {
+        CoveragePage* pPage = new CoveragePage(this);
+        m_pMMU->InstallInterposer(static_cast<ushort>(pageAddress), pPage);
+        m_Pages.push_back(std::unique_ptr<CoveragePage>(pPage));
+    }
+}
+
+Coverage::~Coverage()
+{
+    for (unsigned int index = 0; index < m_Pages.size(); index++)
+    {
+        m_pMMU->RemoveInterposer(static_cast<ushort>(index * 0x100), m_Pages[index].get());
+    }
+}
+
+const std::vector<byte>& Coverage::GetMap()
+{
+    return m_Map;
+}
+
+bool Coverage::Save(const char* path)
+{
+    std::ofstream file(path, std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!file.is_open() || !file.write(reinterpret_cast<const char*>(m_Map.data()), m_Map.size()))
+    {
+        Logger::LogError("Coverage: Failed to write %s", path);
+        return false;
+    }
+
+    return true;
+}
+
+// ORs a map saved earlier for the same ROM into this one
+bool Coverage::Load(const char* path)
+{
+    std::ifstream file(path, std::ios::in | std::ios::binary);
+    std::vector<byte> map(m_Map.size());
+    if (!file.is_open() || !file.read(reinterpret_cast<char*>(map.data()), map.size()) || (file.peek() != EOF))
+    {
+        Logger::LogError("Coverage: %s is not a coverage map of this ROM", path);
+        return false;
+    }
+
+    for (size_t index = 0; index < m_Map.size(); index++)
+    {
+        m_Map[index] |= map[index];
+    }
+
+    return true;
+}
+
+void Coverage::WriteSummary(std::ostream& out)
+{
+    unsigned int totals[4] = { 0, 0, 0, 0 };
+    out << "Bank  Opcodes  Operands     Data   Unused  Covered" << std::endl;
+    for (size_t bankStart = 0; bankStart < m_Map.size(); bankStart += ROMBankSize)
+    {
+        // A byte counts once, as code before data
+        unsigned int counts[4] = { 0, 0, 0, 0 };
+        size_t bankEnd = (bankStart + ROMBankSize < m_Map.size()) ? (bankStart + ROMBankSize) : m_Map.size();
+        for (size_t index = bankStart; index < bankEnd; index++)
+        {
+            byte flags = m_Map[index];
+            int kind = (flags & CoverageOpcode) ? 0 : (flags & CoverageOperand) ? 1 : (flags & CoverageData) ? 2 : 3;
+            counts[kind]++;
+            totals[kind]++;
+        }
+
+        unsigned int size = static_cast<unsigned int>(bankEnd - bankStart);
+        char line[80];
+        snprintf(line, sizeof(line), "%4X  %7u  %8u  %7u  %7u  %6.1f%%",
+            static_cast<unsigned int>(bankStart / ROMBankSize), counts[0], counts[1], counts[2], counts[3],
+            (100.0 * (size - counts[3])) / size);
+        out << line << std::endl;
+    }
+
+    if (!m_Map.empty())
+    {
+        char line[80];
+        snprintf(line, sizeof(line), "All   %7u  %8u  %7u  %7u  %6.1f%%",
+            totals[0], totals[1], totals[2], totals[3],
+            (100.0 * (m_Map.size() - totals[3])) / m_Map.size());
+        out << line << std::endl;
+    }
+}
+
+// Runs of executed bytes, opcodes and operands alike, in ROM order
+std::vector<CodeRegion> Coverage::GetCodeRegions()
+{
+    std::vector<CodeRegion> regions;
+    for (size_t index = 0; index < m_Map.size(); index++)
+    {
+        if ((m_Map[index] & (CoverageOpcode | CoverageOperand)) == 0x00)
+        {
+            continue;
+        }
+
+        if (!regions.empty() && ((regions.back().offset + regions.back().length) == index))
+        {
+            regions.back().length++;
+        }
+        else
+        {
+            CodeRegion region = { static_cast<unsigned int>(index), 1 };
+            regions.push_back(region);
+        }
+    }
+
+    return regions;
+}
+
+/*
+    The regions are a text file with one region per line:
+        <offset> <length>
+    both in hex, where the offset is into the ROM, i.e. bank * 0x4000 + (address - 0x4000) for
+    banked code.
+*/
+bool Coverage::SaveCodeRegions(const char* path)
+{
+    std::ofstream file(path, std::ios::out | std::ios::trunc);
+    if (!file.is_open())
+    {
+        Logger::LogError("Coverage: Failed to write %s", path);
+        return false;
+    }
+
+    std::vector<CodeRegion> regions = GetCodeRegions();
+    file << std::hex << std::uppercase << std::setfill('0');
+    for (const CodeRegion& region : regions)
+    {
+        file << std::setw(6) << region.offset << " " << std::setw(4) << region.length << std::endl;
+    }
+
+    Logger::Log("Coverage: Wrote %d code regions to %s", static_cast<int>(regions.size()), path);
+    return true;
+}
+
+void Coverage::OnRead(ushort address)
+{
+    size_t offset = address;
+    if (address >= ROMBankSize)
+    {
+        offset = (m_pCartridge->GetROMBank() * ROMBankSize) + (address - ROMBankSize);
+    }
+
+    if (offset >= m_Map.size())
+    {
+        return;
+    }
+
+    CPUState state;
+    m_pCPU->GetState(state);
+
+    if ((address == state.PC) && (state.cycles != m_FetchCycles))
+    {
+        m_FetchCycles = state.cycles;
+        m_Map[offset] |= CoverageOpcode;
+    }
+    else if ((state.cycles == m_FetchCycles) && ((address == state.PC) || (address == static_cast<ushort>(state.PC + 1))))
+    {
+        // 16 bit operands are read high byte first, before PC moves
+        m_Map[offset] |= CoverageOperand;
+    }
+    else
+    {
+        m_Map[offset] |= CoverageData;
+    }
+}
+
+Coverage::CoveragePage::CoveragePage(Coverage* pCoverage) :
+    m_pCoverage(pCoverage)
+{
+}
+
+// IMemoryUnit
+byte Coverage::CoveragePage::ReadByte(const ushort& address)
+{
+    m_pCoverage->OnRead(address);
+    return m_pUnit->ReadByte(address);
+}
+
+bool Coverage::CoveragePage::WriteByte(const ushort& address, const byte val)
+{
+    // MBC register writes, nothing to record
+    return m_pUnit->WriteByte(address, val);
+}
+
+// Block transfers go byte by byte through ReadByte so they are recorded as data
+const byte* Coverage::CoveragePage::GetMemoryBlock(const ushort& address)
+{
+    return nullptr;
+}
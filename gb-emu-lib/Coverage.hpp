@@ -0,0 +1,74 @@
+#pragma once
+
+#include "CPU.hpp"
+
+#include <ostream>
+#include <vector>
+
+// How a ROM byte has been used, one byte of these per ROM byte in the map
+#define CoverageOpcode      0x01
+#define CoverageOperand     0x02
+#define CoverageData        0x04
+
+// A run of ROM bytes that were executed, as an offset into the ROM
+struct CodeRegion
+{
+    unsigned int offset;
+    unsigned int length;
+};
+
+/*
+    Records which bytes of the ROM were executed as opcodes, read as operands or read as data.
+
+    Like the Debugger, this works by redirecting MMU pages: enabling it puts a CoveragePage in front
+    of each of the 0x80 ROM pages, the rest of the memory map keeps its direct dispatch and nothing
+    is checked while coverage is off. A read at PC is an instruction fetch, the first one at a given
+    cycle count is the opcode and the later ones, or a read at PC + 1 for the high byte of a 16 bit
+    operand, are its operands. Any other read is data. Block transfers from the ROM go byte by byte
+    so they are counted as well.
+
+    The map is one byte of Coverage* flags per ROM byte and is saved as is, loading one ORs it into
+    the current map so coverage adds up over several runs. The executed bytes can also be saved as a
+    list of code regions, e.g. for a disassembler.
+*/
+class Coverage
+{
+public:
+    Coverage(CPU* pCPU, MMU* pMMU, Cartridge* pCartridge);
+    ~Coverage();
+
+    const std::vector<byte>& GetMap();
+    bool Save(const char* path);
+    bool Load(const char* path);
+
+    // Opcode, operand, data and unused byte counts for every 16KB bank
+    void WriteSummary(std::ostream& out);
+
+    std::vector<CodeRegion> GetCodeRegions();
+    bool SaveCodeRegions(const char* path);
+
+private:
+    class CoveragePage : public MemoryInterposer
+    {
+    public:
+        CoveragePage(Coverage* pCoverage);
+
+        // IMemoryUnit
+        byte ReadByte(const ushort& address);
+        bool WriteByte(const ushort& address, const byte val);
+        const byte* GetMemoryBlock(const ushort& address);
+
+    public:
+        Coverage* m_pCoverage;
+    };
+
+    void OnRead(ushort address);
+
+private:
+    CPU* m_pCPU;
+    MMU* m_pMMU;
+    Cartridge* m_pCartridge;
+    unsigned long m_FetchCycles;    // Cycle count of the last opcode fetch seen
+    std::vector<byte> m_Map;
+    std::vector<std::unique_ptr<CoveragePage>> m_Pages;
+};
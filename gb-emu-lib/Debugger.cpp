@@ -0,0 +1,229 @@
+#include "pch.hpp"
+#include "Debugger.hpp"
+
+Debugger::Debugger(CPU* pCPU, MMU* pMMU) :
+    m_pCPU(pCPU),
+    m_pMMU(pMMU),
+    m_pCallback(nullptr),
+    m_FetchCycles(static_cast<unsigned long>(-1))
+{
+}
+
+Debugger::~Debugger()
+{
+    ClearAll();
+}
+
+void Debugger::SetBreakpoint(ushort address)
+{
+    DebugPage* pPage = GetPage(address, true);
+    byte& breakpoint = pPage->m_Breakpoints[address & 0xFF];
+    if (!breakpoint)
+    {
+        breakpoint = true;
+        pPage->m_Count++;
+    }
+
+    // The two addresses before it may hold the opcode of an instruction that reaches into it
+    Update(address);
+    Update(static_cast<ushort>(address - 1));
+    Update(static_cast<ushort>(address - 2));
+}
+
+void Debugger::ClearBreakpoint(ushort address)
+{
+    DebugPage* pPage = GetPage(address, false);
+    if ((pPage == nullptr) || !pPage->m_Breakpoints[address & 0xFF])
+    {
+        return;
+    }
+
+    pPage->m_Breakpoints[address & 0xFF] = false;
+    pPage->m_Count--;
+
+    Update(address);
+    Update(static_cast<ushort>(address - 1));
+    Update(static_cast<ushort>(address - 2));
+}
+
+void Debugger::SetWatchpoint(ushort address, byte access)
+{
+    DebugPage* pPage = GetPage(address, true);
+    byte& watchpoint = pPage->m_Watchpoints[address & 0xFF];
+    if ((watchpoint == 0x00) && (access != 0x00))
+    {
+        pPage->m_Count++;
+    }
+    else if ((watchpoint != 0x00) && (access == 0x00))
+    {
+        pPage->m_Count--;
+    }
+
+    watchpoint = access & (WatchRead | WatchWrite);
+    Update(address);
+}
+
+void Debugger::ClearWatchpoint(ushort address)
+{
+    SetWatchpoint(address, 0x00);
+}
+
+void Debugger::ClearAll()
+{
+    for (auto& entry : m_Pages)
+    {
+        DebugPage* pPage = entry.second.get();
+        memset(pPage->m_Breakpoints, 0x00, sizeof(pPage->m_Breakpoints));
+        memset(pPage->m_Watchpoints, 0x00, sizeof(pPage->m_Watchpoints));
+        pPage->m_Count = 0;
+        Update(entry.first);
+    }
+}
+
+// The callback runs on the emulation thread, in the middle of the instruction that hit
+void Debugger::SetCallback(void(*pCallback)(const DebugEvent& event))
+{
+    m_pCallback = pCallback;
+}
+
+// Pages below 0xFE00 are 256 bytes, above that every address is a page of its own
+ushort Debugger::GetPageAddress(ushort address)
+{
+    return (address < 0xFE00) ? (address & 0xFF00) : address;
+}
+
+Debugger::DebugPage* Debugger::GetPage(ushort address, bool create)
+{
+    ushort pageAddress = GetPageAddress(address);
+    auto it = m_Pages.find(pageAddress);
+    if (it != m_Pages.end())
+    {
+        return it->second.get();
+    }
+
+    if (!create)
+    {
+        return nullptr;
+    }
+
+    DebugPage* pPage = new DebugPage(this);
+    m_Pages[pageAddress] = std::unique_ptr<DebugPage>(pPage);
+    return pPage;
+}
+
+bool Debugger::IsBreakpoint(unsigned int address)
+{
+    if (address > 0xFFFF)
+    {
+        return false;
+    }
+
+    DebugPage* pPage = GetPage(static_cast<ushort>(address), false);
+    return (pPage != nullptr) && pPage->m_Breakpoints[address & 0xFF];
+}
+
+/*
+    Puts the page of address in front of the MMU if it has anything set, or if one of the two
+    addresses after its end has a breakpoint. Takes it out again otherwise.
+*/
+void Debugger::Update(ushort address)
+{
+    ushort pageAddress = GetPageAddress(address);
+    unsigned int pageEnd = (pageAddress < 0xFE00) ? (pageAddress + 0xFF) : pageAddress;
+    bool isNeeded = IsBreakpoint(pageEnd + 1) || IsBreakpoint(pageEnd + 2);
+
+    DebugPage* pPage = GetPage(pageAddress, isNeeded);
+    if (pPage == nullptr)
+    {
+        return;
+    }
+
+    isNeeded = isNeeded || (pPage->m_Count > 0);
+    if (isNeeded && (pPage->m_pUnit == nullptr))
+    {
+        m_pMMU->InstallInterposer(pageAddress, pPage);
+    }
+    else if (!isNeeded && (pPage->m_pUnit != nullptr))
+    {
+        m_pMMU->RemoveInterposer(pageAddress, pPage);
+    }
+}
+
+void Debugger::OnRead(DebugPage& page, ushort address, byte value)
+{
+    CPUState state;
+    m_pCPU->GetState(state);
+
+    if ((address == state.PC) && (state.cycles != m_FetchCycles))
+    {
+        // The opcode fetch, the instruction has not done anything yet
+        m_FetchCycles = state.cycles;
+        if (page.m_Breakpoints[address & 0xFF])
+        {
+            Report(DebugEventBreakpoint, address, value, state);
+        }
+    }
+    else if ((page.m_Watchpoints[address & 0xFF] & WatchRead) != 0x00)
+    {
+        Report(DebugEventRead, address, value, state);
+    }
+}
+
+void Debugger::OnWrite(DebugPage& page, ushort address, byte value)
+{
+    if ((page.m_Watchpoints[address & 0xFF] & WatchWrite) != 0x00)
+    {
+        CPUState state;
+        m_pCPU->GetState(state);
+        Report(DebugEventWrite, address, value, state);
+    }
+}
+
+void Debugger::Report(DebugEventType type, ushort address, byte value, const CPUState& state)
+{
+    if (m_pCallback == nullptr)
+    {
+        return;
+    }
+
+    StateWriter writer;
+    m_pCPU->SaveState(writer);
+
+    DebugEvent event;
+    event.type = type;
+    event.address = address;
+    event.value = value;
+    event.state = state;
+    event.snapshot = writer.GetData();
+    m_pCallback(event);
+}
+
+Debugger::DebugPage::DebugPage(Debugger* pDebugger) :
+    m_pDebugger(pDebugger),
+    m_Count(0)
+{
+    memset(m_Breakpoints, 0x00, sizeof(m_Breakpoints));
+    memset(m_Watchpoints, 0x00, sizeof(m_Watchpoints));
+}
+
+// IMemoryUnit
+byte Debugger::DebugPage::ReadByte(const ushort& address)
+{
+    byte value = m_pUnit->ReadByte(address);
+    m_pDebugger->OnRead(*this, address, value);
+    return value;
+}
+
+bool Debugger::DebugPage::WriteByte(const ushort& address, const byte val)
+{
+    // The callback may take the page out
+    IMemoryUnit* pUnit = m_pUnit;
+    m_pDebugger->OnWrite(*this, address, val);
+    return pUnit->WriteByte(address, val);
+}
+
+// Block transfers go byte by byte through ReadByte while the page is watched
+const byte* Debugger::DebugPage::GetMemoryBlock(const ushort& address)
+{
+    return nullptr;
+}
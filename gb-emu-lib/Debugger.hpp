@@ -0,0 +1,93 @@
+#pragma once
+
+#include "CPU.hpp"
+
+#include <vector>
+
+// What a watchpoint triggers on
+#define WatchRead   0x01
+#define WatchWrite  0x02
+
+enum DebugEventType
+{
+    DebugEventBreakpoint,
+    DebugEventRead,
+    DebugEventWrite,
+};
+
+/*
+    Passed to the debug callback on every hit. For breakpoints the instruction at address has not
+    run yet and value is its opcode. For watchpoints the access happens in the middle of an
+    instruction, PC already points past the bytes fetched so far and value is the byte read or
+    about to be written.
+*/
+struct DebugEvent
+{
+    DebugEventType type;
+    ushort address;
+    byte value;
+    CPUState state;
+    std::vector<byte> snapshot;     // CPU::SaveState of the whole machine, cartridge RAM and MBC included
+};
+
+/*
+    Breakpoints and watchpoints without a check on the normal execution path.
+
+    Nothing is checked until something is set. Setting one swaps the MMU entry for its page (a
+    single address above 0xFE00) for a DebugPage that checks the access and forwards it to the unit
+    that was there before, every other page keeps its direct dispatch. Clearing the last one on a
+    page puts the original unit back.
+
+    A read of the address in PC is an instruction fetch, and the first one at a given cycle count is
+    the opcode. Later reads at the same cycle count are operands. To see the opcode of an
+    instruction that starts at the end of the previous page, a breakpoint also redirects that page.
+    Breakpoints in the boot ROM never trigger, the MMU reads it without going through a unit.
+*/
+class Debugger
+{
+public:
+    Debugger(CPU* pCPU, MMU* pMMU);
+    ~Debugger();
+
+    void SetBreakpoint(ushort address);
+    void ClearBreakpoint(ushort address);
+    void SetWatchpoint(ushort address, byte access);
+    void ClearWatchpoint(ushort address);
+    void ClearAll();
+    void SetCallback(void(*pCallback)(const DebugEvent& event));
+
+private:
+    class DebugPage : public MemoryInterposer
+    {
+    public:
+        DebugPage(Debugger* pDebugger);
+
+        // IMemoryUnit
+        byte ReadByte(const ushort& address);
+        bool WriteByte(const ushort& address, const byte val);
+        const byte* GetMemoryBlock(const ushort& address);
+
+    public:
+        Debugger* m_pDebugger;
+        byte m_Breakpoints[0x100];
+        byte m_Watchpoints[0x100];  // WatchRead | WatchWrite
+        unsigned int m_Count;       // Breakpoints and watchpoints set on the page
+    };
+
+    static ushort GetPageAddress(ushort address);
+    DebugPage* GetPage(ushort address, bool create);
+    bool IsBreakpoint(unsigned int address);
+    void Update(ushort address);
+    void OnRead(DebugPage& page, ushort address, byte value);
+    void OnWrite(DebugPage& page, ushort address, byte value);
+    void Report(DebugEventType type, ushort address, byte value, const CPUState& state);
+
+private:
+    CPU* m_pCPU;
+    MMU* m_pMMU;
+    void(*m_pCallback)(const DebugEvent& event);
+    unsigned long m_FetchCycles;    // Cycle count of the last opcode fetch seen
+
+    // Pages are kept once created, a callback may clear the page it was called from
+    std::map<ushort, std::unique_ptr<DebugPage>> m_Pages;
+};
@@ -2,8 +2,15 @@
 #include "Emulator.hpp"
 
 #include "CPU.hpp"
+#include "BootCache.hpp"
+#include "Cheats.hpp"
+#include "Coverage.hpp"
+#include "Debugger.hpp"
+#include "JITCache.hpp"
+#include "Trace.hpp"
 
-Emulator::Emulator()
+Emulator::Emulator() :
+    m_isFastBoot(false)
 {
 }
 
@@ -33,6 +40,7 @@ bool Emulator::Initialize(const char* bootROMPath, const char* cartridgePath)
         return false;
     }
 
+    m_cpu->SetFastBoot(m_isFastBoot);
     if (!m_cpu->LoadROM(bootROMPath, cartridgePath))
     {
         Logger::Log("Failed to load the Gameboy ROM");
@@ -42,11 +50,22 @@ bool Emulator::Initialize(const char* bootROMPath, const char* cartridgePath)
     return true;
 }
 
+void Emulator::SetFastBoot(bool isEnabled, const char* cacheDirectory)
+{
+    m_isFastBoot = isEnabled;
+    BootCache::SetDirectory(cacheDirectory);
+}
+
 byte* Emulator::GetCurrentFrame()
 {
     return m_cpu->GetCurrentFrame();
 }
 
+const bool* Emulator::GetDirtyLines()
+{
+    return m_cpu->GetDirtyLines();
+}
+
 void Emulator::SetInput(byte input, byte buttons)
 {
     m_cpu->SetInput(input, buttons);
@@ -56,3 +75,146 @@ void Emulator::SetVSyncCallback(void(*pCallback)())
 {
     m_cpu->SetVSyncCallback(pCallback);
 }
+
+void Emulator::SetColorCorrection(bool isEnabled)
+{
+    m_cpu->SetColorCorrection(isEnabled);
+}
+
+bool Emulator::EnableAudio()
+{
+    return m_cpu->EnableAudio();
+}
+
+void Emulator::ConnectLink(ILinkPort* pPort)
+{
+    m_cpu->ConnectLink(pPort);
+}
+
+void Emulator::SetLinkSyncWindow(unsigned long cycles)
+{
+    m_cpu->SetLinkSyncWindow(cycles);
+}
+
+void Emulator::SetBreakpoint(ushort address)
+{
+    m_cpu->GetDebugger()->SetBreakpoint(address);
+}
+
+void Emulator::ClearBreakpoint(ushort address)
+{
+    m_cpu->GetDebugger()->ClearBreakpoint(address);
+}
+
+void Emulator::SetWatchpoint(ushort address, byte access)
+{
+    m_cpu->GetDebugger()->SetWatchpoint(address, access);
+}
+
+void Emulator::ClearWatchpoint(ushort address)
+{
+    m_cpu->GetDebugger()->ClearWatchpoint(address);
+}
+
+void Emulator::ClearDebugPoints()
+{
+    m_cpu->GetDebugger()->ClearAll();
+}
+
+void Emulator::SetDebugCallback(void(*pCallback)(const DebugEvent& event))
+{
+    m_cpu->GetDebugger()->SetCallback(pCallback);
+}
+
+void Emulator::EnableTrace(unsigned int size)
+{
+    m_cpu->EnableTrace(size);
+}
+
+bool Emulator::DumpTrace(const char* path)
+{
+    return m_cpu->EnableTrace(TraceDefaultSize)->Dump(path);
+}
+
+bool Emulator::StartTraceWriter(const char* path)
+{
+    return m_cpu->EnableTrace(TraceDefaultSize)->StartWriter(path);
+}
+
+void Emulator::StopTraceWriter()
+{
+    m_cpu->EnableTrace(TraceDefaultSize)->StopWriter();
+}
+
+bool Emulator::EnableCoverage()
+{
+    return m_cpu->EnableCoverage() != nullptr;
+}
+
+bool Emulator::LoadCoverage(const char* path)
+{
+    Coverage* pCoverage = m_cpu->EnableCoverage();
+    return (pCoverage != nullptr) && pCoverage->Load(path);
+}
+
+bool Emulator::SaveCoverage(const char* path)
+{
+    Coverage* pCoverage = m_cpu->EnableCoverage();
+    return (pCoverage != nullptr) && pCoverage->Save(path);
+}
+
+bool Emulator::SaveCoverageSummary(const char* path)
+{
+    Coverage* pCoverage = m_cpu->EnableCoverage();
+    std::ofstream file(path, std::ios::out | std::ios::trunc);
+    if ((pCoverage == nullptr) || !file.is_open())
+    {
+        Logger::LogError("Coverage: Failed to write %s", path);
+        return false;
+    }
+
+    pCoverage->WriteSummary(file);
+    return true;
+}
+
+bool Emulator::SaveCodeRegions(const char* path)
+{
+    Coverage* pCoverage = m_cpu->EnableCoverage();
+    return (pCoverage != nullptr) && pCoverage->SaveCodeRegions(path);
+}
+
+bool Emulator::AddCheat(const char* code)
+{
+    return m_cpu->GetCheats()->AddCode(code);
+}
+
+bool Emulator::RemoveCheat(const char* code)
+{
+    return m_cpu->GetCheats()->RemoveCode(code);
+}
+
+void Emulator::ClearCheats()
+{
+    m_cpu->GetCheats()->ClearAll();
+}
+
+bool Emulator::EnableJIT(bool isEnabled, const char* cacheDirectory)
+{
+    JITCache::SetDirectory(cacheDirectory);
+    return m_cpu->EnableJIT(isEnabled);
+}
+
+bool Emulator::StartRecording(const char* path, RecordingFormat format)
+{
+    return m_cpu->GetRecorder()->Start(path, format);
+}
+
+void Emulator::StopRecording()
+{
+    m_cpu->GetRecorder()->Stop();
+}
+
+unsigned long long Emulator::GetDroppedFrames()
+{
+    return m_cpu->GetRecorder()->GetDroppedCount();
+}
@@ -1,6 +1,9 @@
 #pragma once
 
 #include "ICPU.hpp"
+#include "Recorder.hpp"
+
+struct DebugEvent;
 
 #define JOYPAD_NONE             0
 
@@ -22,10 +25,55 @@ public:
     int Step();
     void Stop();
     bool Initialize(const char* bootROMPath, const char* cartridgePath);
+
+    // Must be called before Initialize. The cache directory is optional and shared by all instances.
+    void SetFastBoot(bool isEnabled, const char* cacheDirectory = nullptr);
     byte* GetCurrentFrame();
+    const bool* GetDirtyLines();
     void SetInput(byte input, byte buttons);
     void SetVSyncCallback(void(*pCallback)());
+    void SetColorCorrection(bool isEnabled);
+    bool EnableAudio();
+    void ConnectLink(ILinkPort* pPort);
+    void SetLinkSyncWindow(unsigned long cycles);
+
+    // Debugging, see Debugger. Code runs at full speed on pages with nothing set.
+    void SetBreakpoint(ushort address);
+    void ClearBreakpoint(ushort address);
+    void SetWatchpoint(ushort address, byte access);
+    void ClearWatchpoint(ushort address);
+    void ClearDebugPoints();
+    void SetDebugCallback(void(*pCallback)(const DebugEvent& event));
+
+    // Instruction trace, see Trace. Dumping or starting the writer enables it at the default size.
+    void EnableTrace(unsigned int size);
+    bool DumpTrace(const char* path);
+    bool StartTraceWriter(const char* path);
+    void StopTraceWriter();
+
+    // ROM coverage, see Coverage. Loading a map saved earlier adds it to the one being recorded.
+    bool EnableCoverage();
+    bool LoadCoverage(const char* path);
+    bool SaveCoverage(const char* path);
+    bool SaveCoverageSummary(const char* path);
+    bool SaveCodeRegions(const char* path);
+
+    // Game Genie and GameShark codes, see Cheats
+    bool AddCheat(const char* code);
+    bool RemoveCheat(const char* code);
+    void ClearCheats();
+
+    // Translated code instead of the interpreter, see JIT. Must be called after Initialize, the
+    // debug tools above turn it off again. The cache directory is optional and shared by all
+    // instances, see JITCache.
+    bool EnableJIT(bool isEnabled, const char* cacheDirectory = nullptr);
+
+    // Video and audio recording, see Recorder. Call these from the thread that steps the emulator.
+    bool StartRecording(const char* path, RecordingFormat format);
+    void StopRecording();
+    unsigned long long GetDroppedFrames();
 
 private:
     std::unique_ptr<ICPU> m_cpu;
+    bool m_isFastBoot;
 };
@@ -1,7 +1,9 @@
 #include "pch.hpp"
 #include "GPU.hpp"
 
-#define TINT 0
+#include "Recorder.hpp"
+
+#include <algorithm>
 
 /*
     FF40 - LCDC - LCD Control (R/W)
@@ -48,13 +50,13 @@ const byte GBColors[]
     0xEB, 0xC4, 0x60, 0x00
 };
 
-GPU::GPU(IMMU* pMMU, ICPU* pCPU) :
-    m_MMU(pMMU),
-    m_CPU(pCPU),
+// pVRAM is VRAMSize bytes of storage for the video RAM, without it the GPU allocates its own
+GPU::GPU(IMMU* pMMU, ICPU* pCPU, byte* pVRAM) :
     m_ModeClock(VBlankCycles),
     m_DMAClocksRemaining(0),
-    m_pVSyncCallback(nullptr),
+    m_isCGB(false),
     m_LCDControl(0x00),
+    m_LCDControllerStatus(0x00),
     m_ScrollY(0x00),
     m_ScrollX(0x00),
     m_LCDControllerYCoordinate(153),
@@ -63,14 +65,43 @@ GPU::GPU(IMMU* pMMU, ICPU* pCPU) :
     m_WindowXPositionMinus7(0x00),
     m_BGPaletteData(0x00),
     m_ObjectPalette0Data(0x00),
-    m_ObjectPalette1Data(0x00)
+    m_ObjectPalette1Data(0x00),
+    m_HDMASource(0x0000),
+    m_HDMADestination(0x0000),
+    m_HDMALength(0x7F),
+    m_IsHDMAActive(false),
+    m_MMU(pMMU),
+    m_CPU(pCPU),
+    m_pVSyncCallback(nullptr),
+    m_pRecorder(nullptr),
+    m_VRAM(pVRAM),
+    m_CGBBGPaletteIndex(0x00),
+    m_CGBOBJPaletteIndex(0x00),
+    m_IsColorCorrected(false)
 {
+    if (m_VRAM == nullptr)
+    {
+        m_spVRAM = std::unique_ptr<byte[]>(new byte[VRAMSize]);
+        m_VRAM = m_spVRAM.get();
+    }
+
+    m_pVRAMBank = m_VRAM;
+
+    // The CGB boot ROM leaves every palette white
+    memset(m_BGPaletteRAM, 0xFF, sizeof(m_BGPaletteRAM));
+    memset(m_OBJPaletteRAM, 0xFF, sizeof(m_OBJPaletteRAM));
+    UpdateColors();
+
+    memset(m_VRAM, 0x00, VRAMSize);
+    memset(m_OAM, 0x00, sizeof(m_OAM));
+
     SETMODE(ModeVBlank);
-    memset(m_DisplayPixels, 0x00, ARRAYSIZE(m_DisplayPixels));
+    memset(m_DirtyLines, true, sizeof(m_DirtyLines));
 }
 
 GPU::~GPU()
 {
+    SetRecorder(nullptr);
 }
 
 /*
@@ -131,6 +162,12 @@ void GPU::Step(unsigned long cycles)
 
             // Go to HBlank
             SETMODE(ModeHBlank);
+            if (m_IsHDMAActive)
+            {
+                // An HBlank DMA copies one block at the start of every HBlank
+                StepHDMATransfer();
+            }
+
             if (HBlankInterrupt && (m_CPU != nullptr))
             {
                 m_CPU->TriggerInterrupt(INT48);
@@ -207,9 +244,58 @@ void GPU::Step(unsigned long cycles)
     }
 }
 
+/*
+    How many cycles Step can be given in one go without changing what it does, for running several
+    instructions between steps. Until the mode changes a step only adds to the clocks, except that
+    the coincidence interrupt is raised again on every step while LY matches LYC.
+*/
+unsigned long GPU::GetCyclesUntilEvent()
+{
+    if (!IsLCDDisplayEnabled)
+    {
+        return NoEventCycles;
+    }
+
+    if (LYCoincidenceInterrupt && (m_LYCompare == m_LCDControllerYCoordinate))
+    {
+        return 1;
+    }
+
+    unsigned long modeCycles = 0;
+    switch (GETMODE)
+    {
+    case ModeReadingOAM:
+        modeCycles = ReadingOAMCycles;
+        break;
+    case ModeReadingOAMVRAM:
+        modeCycles = ReadingOAMVRAMCycles;
+        break;
+    case ModeHBlank:
+        modeCycles = HBlankCycles;
+        break;
+    case ModeVBlank:
+        modeCycles = VBlankCycles;
+        break;
+    }
+
+    return (m_ModeClock < modeCycles) ? (modeCycles - m_ModeClock) : 1;
+}
+
 byte* GPU::GetCurrentFrame()
 {
-    return m_DisplayPixels;
+    AttachDisplay();
+    return m_spDisplayPixels.get();
+}
+
+/*
+    Returns one flag per line of the display, set if that line differs from what it was at the
+    previous VSync. The flags are only meaningful inside the VSync callback, they are cleared as
+    soon as it returns.
+*/
+const bool* GPU::GetDirtyLines()
+{
+    AttachDisplay();
+    return m_DirtyLines;
 }
 
 // IMemoryUnit
@@ -219,7 +305,7 @@ byte GPU::ReadByte(const ushort& address)
     {
         // TODO: It is possible some of our graphical issues come from this
         // Zelda reads/writes from this when it shouldn't.
-        return m_VRAM[address - 0x8000];
+        return m_pVRAMBank[address - 0x8000];
     }
     else if (address >= 0xFE00 && address <= 0xFE9F)
     {
@@ -255,6 +341,25 @@ byte GPU::ReadByte(const ushort& address)
     case DMATransferAndStartAddress:
         Logger::Log("GPU::ReadByte cannot read from address 0x%04X (DMATransferAndStartAddress)", address);
         return 0x00;
+    case VRAMBank:
+        return m_isCGB ? static_cast<byte>(0xFE | ((m_pVRAMBank == m_VRAM) ? 0x00 : 0x01)) : 0xFF;
+    case HDMASourceHigh:
+    case HDMASourceLow:
+    case HDMADestinationHigh:
+    case HDMADestinationLow:
+        // Write only
+        return 0xFF;
+    case HDMALengthModeStart:
+        // Bit 7 is cleared while an HBlank DMA is running, 0xFF once it is done
+        return m_isCGB ? static_cast<byte>((m_IsHDMAActive ? 0x00 : 0x80) | m_HDMALength) : 0xFF;
+    case CGBBGPaletteIndex:
+        return m_isCGB ? (m_CGBBGPaletteIndex | 0x40) : 0xFF;
+    case CGBBGPaletteData:
+        return m_isCGB ? m_BGPaletteRAM[m_CGBBGPaletteIndex & 0x3F] : 0xFF;
+    case CGBOBJPaletteIndex:
+        return m_isCGB ? (m_CGBOBJPaletteIndex | 0x40) : 0xFF;
+    case CGBOBJPaletteData:
+        return m_isCGB ? m_OBJPaletteRAM[m_CGBOBJPaletteIndex & 0x3F] : 0xFF;
     default:
         Logger::Log("GPU::ReadByte cannot read from address 0x%04X", address);
         return 0x00;
@@ -267,7 +372,7 @@ bool GPU::WriteByte(const ushort& address, const byte val)
     {
         // TODO: It is possible some of our graphical issues come from this
         // Zelda reads/writes from this when it shouldn't.
-        m_VRAM[address - 0x8000] = val;
+        m_pVRAMBank[address - 0x8000] = val;
         return true;
     }
     else if (address >= 0xFE00 && address <= 0xFE9F)
@@ -292,12 +397,7 @@ bool GPU::WriteByte(const ushort& address, const byte val)
                 }
 
                 // The display was turned off, clear the screen
-                // Set color to white
-                memset(m_DisplayPixels, GBColors[0], ARRAYSIZE(m_DisplayPixels));
-                for (unsigned int a = 0;a < ARRAYSIZE(m_DisplayPixels);a += 4)
-                {
-                    m_DisplayPixels[a] = 0xFF;   // Set Alpha to 0xFF
-                }
+                ClearDisplay();
 
                 m_LCDControllerYCoordinate = 153;
                 m_ModeClock = VBlankCycles;
@@ -329,16 +429,70 @@ bool GPU::WriteByte(const ushort& address, const byte val)
         return true;
     case BGPaletteData:
         m_BGPaletteData = val;
+        if (!m_isCGB)
+        {
+            UpdateColors();
+        }
         return true;
     case ObjectPalette0Data:
         m_ObjectPalette0Data = val;
+        if (!m_isCGB)
+        {
+            UpdateColors();
+        }
         return true;
     case ObjectPalette1Data:
         m_ObjectPalette1Data = val;
+        if (!m_isCGB)
+        {
+            UpdateColors();
+        }
         return true;
     case DMATransferAndStartAddress:
         LaunchDMATransfer(val);
         return true;
+    case VRAMBank:
+        if (m_isCGB)
+        {
+            m_pVRAMBank = ISBITSET(val, 0) ? (m_VRAM + 0x2000) : m_VRAM;
+        }
+        return true;
+    case HDMASourceHigh:
+        m_HDMASource = static_cast<ushort>((val << 8) | (m_HDMASource & 0x00FF));
+        return true;
+    case HDMASourceLow:
+        m_HDMASource = static_cast<ushort>((m_HDMASource & 0xFF00) | (val & 0xF0));
+        return true;
+    case HDMADestinationHigh:
+        m_HDMADestination = static_cast<ushort>(((val & 0x1F) << 8) | (m_HDMADestination & 0x00FF));
+        return true;
+    case HDMADestinationLow:
+        m_HDMADestination = static_cast<ushort>((m_HDMADestination & 0xFF00) | (val & 0xF0));
+        return true;
+    case HDMALengthModeStart:
+        if (m_isCGB)
+        {
+            LaunchHDMATransfer(val);
+        }
+        return true;
+    case CGBBGPaletteIndex:
+        m_CGBBGPaletteIndex = val & 0xBF;
+        return true;
+    case CGBBGPaletteData:
+        if (m_isCGB)
+        {
+            WritePaletteData(m_BGPaletteRAM, m_BGColors, m_CGBBGPaletteIndex, val);
+        }
+        return true;
+    case CGBOBJPaletteIndex:
+        m_CGBOBJPaletteIndex = val & 0xBF;
+        return true;
+    case CGBOBJPaletteData:
+        if (m_isCGB)
+        {
+            WritePaletteData(m_OBJPaletteRAM, m_OBJColors, m_CGBOBJPaletteIndex, val);
+        }
+        return true;
     default:
         Logger::Log("GPU::WriteByte cannot write to address 0x%04X", address);
         return false;
@@ -348,6 +502,41 @@ bool GPU::WriteByte(const ushort& address, const byte val)
 void GPU::SetVSyncCallback(void(*pCallback)())
 {
     m_pVSyncCallback = pCallback;
+    if (pCallback != nullptr)
+    {
+        AttachDisplay();
+    }
+}
+
+// The display is only drawn once the recording starts, see Recorder::Start
+void GPU::SetRecorder(Recorder* pRecorder)
+{
+    if (m_pRecorder != nullptr)
+    {
+        m_pRecorder->SetGPU(nullptr);
+    }
+
+    m_pRecorder = pRecorder;
+    if (pRecorder != nullptr)
+    {
+        pRecorder->SetGPU(this);
+        if (pRecorder->IsRecording())
+        {
+            AttachDisplay();
+        }
+    }
+}
+
+void GPU::SetCGBMode(bool isCGB)
+{
+    m_isCGB = isCGB;
+    UpdateColors();
+}
+
+void GPU::SetColorCorrection(bool isEnabled)
+{
+    m_IsColorCorrected = isEnabled;
+    UpdateColors();
 }
 
 void GPU::PreBoot()
@@ -361,13 +550,81 @@ void GPU::PreBoot()
     m_ObjectPalette1Data = 0xFF;
     m_WindowYPosition = 0x00;
     m_WindowXPositionMinus7 = 0x00;
+    UpdateColors();
+    ClearDisplay();
+}
 
-    // Initialize color to white
-    memset(m_DisplayPixels, GBColors[0], ARRAYSIZE(m_DisplayPixels));
-    for (unsigned int a = 0;a < ARRAYSIZE(m_DisplayPixels);a += 4)
-    {
-        m_DisplayPixels[a] = 0xFF;   // Set Alpha to 0xFF
-    }
+void GPU::SaveState(StateWriter& writer)
+{
+    byte vramBank = (m_pVRAMBank == m_VRAM) ? 0x00 : 0x01;
+
+    writer.Write(m_VRAM, VRAMSize);
+    writer.Write(vramBank);
+    writer.Write(m_OAM);
+    writer.Write(m_ModeClock);
+    writer.Write(m_DMAClocksRemaining);
+    writer.Write(m_isCGB);
+
+    writer.Write(m_HDMASource);
+    writer.Write(m_HDMADestination);
+    writer.Write(m_HDMALength);
+    writer.Write(m_IsHDMAActive);
+
+    writer.Write(m_LCDControl);
+    writer.Write(m_LCDControllerStatus);
+    writer.Write(m_ScrollY);
+    writer.Write(m_ScrollX);
+    writer.Write(m_LCDControllerYCoordinate);
+    writer.Write(m_LYCompare);
+    writer.Write(m_WindowYPosition);
+    writer.Write(m_WindowXPositionMinus7);
+    writer.Write(m_BGPaletteData);
+    writer.Write(m_ObjectPalette0Data);
+    writer.Write(m_ObjectPalette1Data);
+
+    writer.Write(m_BGPaletteRAM);
+    writer.Write(m_OBJPaletteRAM);
+    writer.Write(m_CGBBGPaletteIndex);
+    writer.Write(m_CGBOBJPaletteIndex);
+}
+
+void GPU::LoadState(StateReader& reader)
+{
+    byte vramBank = 0x00;
+
+    reader.Read(m_VRAM, VRAMSize);
+    reader.Read(vramBank);
+    reader.Read(m_OAM);
+    reader.Read(m_ModeClock);
+    reader.Read(m_DMAClocksRemaining);
+    reader.Read(m_isCGB);
+
+    reader.Read(m_HDMASource);
+    reader.Read(m_HDMADestination);
+    reader.Read(m_HDMALength);
+    reader.Read(m_IsHDMAActive);
+
+    reader.Read(m_LCDControl);
+    reader.Read(m_LCDControllerStatus);
+    reader.Read(m_ScrollY);
+    reader.Read(m_ScrollX);
+    reader.Read(m_LCDControllerYCoordinate);
+    reader.Read(m_LYCompare);
+    reader.Read(m_WindowYPosition);
+    reader.Read(m_WindowXPositionMinus7);
+    reader.Read(m_BGPaletteData);
+    reader.Read(m_ObjectPalette0Data);
+    reader.Read(m_ObjectPalette1Data);
+
+    reader.Read(m_BGPaletteRAM);
+    reader.Read(m_OBJPaletteRAM);
+    reader.Read(m_CGBBGPaletteIndex);
+    reader.Read(m_CGBOBJPaletteIndex);
+
+    // The pixel lookup tables and the scanline buffers are derived state
+    m_pVRAMBank = (vramBank == 0x00) ? m_VRAM : (m_VRAM + 0x2000);
+    UpdateColors();
+    memset(m_DirtyLines, true, sizeof(m_DirtyLines));
 }
 
 void GPU::LaunchDMATransfer(const byte address)
@@ -392,38 +649,161 @@ void GPU::LaunchDMATransfer(const byte address)
     }
 }
 
+void GPU::LaunchHDMATransfer(const byte val)
+{
+    /*
+    Writing to HDMA5 starts a transfer of (val & 0x7F) + 1 blocks of 16 bytes from the source
+    (0000-7FF0 or A000-DFF0) to the current VRAM bank (8000-9FF0).
+
+    Bit 7 = 0: General Purpose DMA, everything is copied at once.
+    Bit 7 = 1: HBlank DMA, one block is copied at the start of every HBlank. With the LCD off the
+               first block is copied right away.
+
+    Writing with bit 7 = 0 while an HBlank DMA is running stops it instead.
+
+    The CPU is not stalled for the duration of either transfer.
+    */
+    if (m_IsHDMAActive && !ISBITSET(val, 7))
+    {
+        m_IsHDMAActive = false;
+        return;
+    }
+
+    m_HDMALength = val & 0x7F;
+    if (ISBITSET(val, 7))
+    {
+        m_IsHDMAActive = true;
+        if (!IsLCDDisplayEnabled)
+        {
+            StepHDMATransfer();
+        }
+    }
+    else
+    {
+        for (int block = 0; block <= m_HDMALength; block++)
+        {
+            CopyHDMABlock();
+        }
+
+        m_HDMALength = 0x7F;
+    }
+}
+
+void GPU::StepHDMATransfer()
+{
+    CopyHDMABlock();
+    if (m_HDMALength == 0x00)
+    {
+        m_IsHDMAActive = false;
+        m_HDMALength = 0x7F;
+    }
+    else
+    {
+        m_HDMALength--;
+    }
+}
+
+void GPU::CopyHDMABlock()
+{
+    // The source and destination are block aligned, so a block never straddles two memory banks
+    // and can be copied straight from the memory behind it.
+    byte* pDestination = m_pVRAMBank + m_HDMADestination;
+    const byte* pSource = m_MMU->ResolveBlock(m_HDMASource);
+    if (pSource != nullptr)
+    {
+        memcpy(pDestination, pSource, HDMABlockSize);
+    }
+    else
+    {
+        for (ushort offset = 0; offset < HDMABlockSize; offset++)
+        {
+            pDestination[offset] = m_MMU->Read(static_cast<ushort>(m_HDMASource + offset));
+        }
+    }
+
+    m_HDMASource += HDMABlockSize;
+    m_HDMADestination = static_cast<ushort>((m_HDMADestination + HDMABlockSize) & 0x1FF0);
+}
+
+/*
+    Allocates the frame buffer the first time frames are requested. Until then nothing is drawn,
+    which saves the memory and the rendering time of instances that never look at the screen.
+*/
+void GPU::AttachDisplay()
+{
+    if (m_spDisplayPixels != nullptr)
+    {
+        return;
+    }
+
+    m_spDisplayPixels = std::unique_ptr<byte[]>(new byte[DisplayBufferSize]);
+    memset(m_spDisplayPixels.get(), 0x00, DisplayBufferSize);
+    memset(m_DirtyLines, true, sizeof(m_DirtyLines));
+}
+
+// Clears the display to white
+void GPU::ClearDisplay()
+{
+    memset(m_DirtyLines, true, sizeof(m_DirtyLines));
+    if (m_spDisplayPixels == nullptr)
+    {
+        return;
+    }
+
+    byte* pPixels = m_spDisplayPixels.get();
+    memset(pPixels, GBColors[0], DisplayBufferSize);
+    for (unsigned int a = 0; a < DisplayBufferSize; a += 4)
+    {
+        pPixels[a] = 0xFF;   // Set Alpha to 0xFF
+    }
+}
+
 void GPU::RenderScanline()
 {
+    if (m_spDisplayPixels == nullptr)
+    {
+        return;
+    }
+
     RenderBackgroundScanline();
     if (WindowDisplayEnable)
     {
         RenderWindowScanline();
     }
 
-
-    // Copy this line from m_bgPixels (BG and Window) to m_DisplayPixels
-    memcpy(
-        m_DisplayPixels + (m_LCDControllerYCoordinate * 160 * 4),
-        m_bgPixels + (m_LCDControllerYCoordinate * 160 * 4),
-        160 * 4);
-
     if (OBJDisplayEnable)
     {
         RenderOBJScanline();
     }
+
+    // Only touch the display if the line changed
+    byte* pLine = m_spDisplayPixels.get() + (m_LCDControllerYCoordinate * 160 * 4);
+    if (memcmp(m_LinePixels, pLine, sizeof(m_LinePixels)) != 0)
+    {
+        memcpy(pLine, m_LinePixels, sizeof(m_LinePixels));
+        m_DirtyLines[m_LCDControllerYCoordinate] = true;
+    }
 }
 
 void GPU::RenderImage()
 {
+    if (m_pRecorder != nullptr)
+    {
+        m_pRecorder->AddFrame(m_spDisplayPixels.get());
+    }
+
     if (m_pVSyncCallback != nullptr)
     {
         m_pVSyncCallback();
     }
+
+    // Start tracking the next frame
+    memset(m_DirtyLines, false, sizeof(m_DirtyLines));
 }
 
 void GPU::RenderBackgroundScanline()
 {
-    if (!BGDisplayEnable)
+    if (!BGDisplayEnable && !m_isCGB)
     {
         /*
         LCDC.0 - 1) Monochrome Gameboy and SGB: BG Display
@@ -432,28 +812,17 @@ void GPU::RenderBackgroundScanline()
 
         So, we just need to render a white background and get out early
         */
+        unsigned int white = MakePixel(GBColors[0], GBColors[0], GBColors[0]);
         for (int x = 0;x < 160;x++)
         {
             // If BG is disabled, render a white background
-            int index = ((m_LCDControllerYCoordinate * 160) + x) * 4;
-            m_bgPixels[index + 3] = GBColors[0];   // R
-            m_bgPixels[index + 2] = GBColors[0];   // G
-            m_bgPixels[index + 1] = GBColors[0];   // B
-            m_bgPixels[index + 0] = 0xFF;          // A
+            memcpy(&m_LinePixels[x * 4], &white, 4);
+            m_bgPriority[x] = 0x00;
         }
 
         return;
     }
 
-    // Load BG (and window) palette data
-    const byte palette[]
-    {
-        GBColors[m_BGPaletteData & 0x03],
-        GBColors[(m_BGPaletteData >> 2) & 0x03],
-        GBColors[(m_BGPaletteData >> 4) & 0x03],
-        GBColors[(m_BGPaletteData >> 6) & 0x03],
-    };
-
     // If bit 3 is NOT set: BG Tile Numbers at 0x9800
     // if bit 3 IS     set: BG Tile Numbers at 0x9C00
     //     Bit 3 - BG Tile Map Display Select     (0=9800-9BFF, 1=9C00-9FFF)
@@ -484,8 +853,11 @@ void GPU::RenderBackgroundScanline()
         // We need to determine the current X tile (in the same way we did the Y tile)
         byte tileX = (byte)(((m_ScrollX + x) / 8) % 32);
 
-        // Finally, we can read the correct tile number from the tile map (32x32)
-        byte tileNumber = m_VRAM[(ushort)(tileNumberMap + (tileY * 32) + tileX)];
+        // Finally, we can read the correct tile number from the tile map (32x32). In CGB mode,
+        // the same spot in VRAM bank 1 holds the attributes of the tile.
+        ushort tileMapPtr = (ushort)(tileNumberMap + (tileY * 32) + tileX);
+        byte tileNumber = m_VRAM[tileMapPtr];
+        byte attributes = m_isCGB ? m_VRAM[0x2000 + tileMapPtr] : 0x00;
 
         // Now we need to get a pointer to the tile data
         ushort tileDataPtr = 0;
@@ -498,36 +870,30 @@ void GPU::RenderBackgroundScanline()
         {
             // Tile number is "signed" and each tile is 16 bytes
             tileDataPtr = (ushort)(tileData + static_cast<sbyte>(tileNumber) * 0x10);
-    }
+        }
 
         // Each line is 2 bytes long, so we need to offset for the current line
-        tileDataPtr += (ushort)(tileYOffset * 2);
+        tileDataPtr += (ushort)((ISBITSET(attributes, 6) ? (7 - tileYOffset) : tileYOffset) * 2);
 
         // Read the two bytes!
-        byte b1 = m_VRAM[tileDataPtr];
-        byte b2 = m_VRAM[(ushort)(tileDataPtr + 1)];
+        const byte* pTileBank = ISBITSET(attributes, 3) ? (m_VRAM + 0x2000) : m_VRAM;
+        byte b1 = pTileBank[tileDataPtr];
+        byte b2 = pTileBank[(ushort)(tileDataPtr + 1)];
 
         // Figure out which palette # it uses
-        byte bit = (byte)(7 - ((m_ScrollX + x) % 8));
+        byte bit = (byte)((m_ScrollX + x) % 8);
+        if (!ISBITSET(attributes, 5))
+        {
+            bit = 7 - bit;
+        }
+
         byte pLo = ISBITSET(b1, bit) ? 0x01 : 0x00;
         byte pHi = ISBITSET(b2, bit) ? 0x02 : 0x00;
 
-        // Get the color
-        byte color = palette[pLo + pHi];
-
-        // Find and set the index of the image
-        int index = ((m_LCDControllerYCoordinate * 160) + x) * 4;
-        m_bgPixels[index + 3] = color; // R
-#if TINT
-        if (m_bgPixels[index + 3] == 0x00) m_bgPixels[index + 3] = 0x30;
-        m_bgPixels[index + 2] = 0x00; // G
-        m_bgPixels[index + 1] = 0x00; // B
-#else
-        m_bgPixels[index + 2] = color; // G
-        m_bgPixels[index + 1] = color; // B
-#endif
-        m_bgPixels[index + 0] = 0xFF;  // A
-}
+        // Look up the color and set the pixel
+        memcpy(&m_LinePixels[x * 4], &m_BGColors[((attributes & 0x07) * 4) + pLo + pHi], 4);
+        m_bgPriority[x] = BGDisplayEnable ? static_cast<byte>((attributes & 0x80) | pLo | pHi) : 0x00;
+    }
 }
 
 void GPU::RenderWindowScanline()
@@ -537,14 +903,6 @@ void GPU::RenderWindowScanline()
     if (winY < 0)
         return;
 
-    const byte palette[]
-    {
-        GBColors[m_BGPaletteData & 0x03],
-        GBColors[(m_BGPaletteData >> 2) & 0x03],
-        GBColors[(m_BGPaletteData >> 4) & 0x03],
-        GBColors[(m_BGPaletteData >> 6) & 0x03],
-    };
-
     // If bit 6 is NOT set: BG Tile Numbers at 0x9800
     // if bit 6 IS     set: BG Tile Numbers at 0x9C00
     //     Bit 6 - Window Tile Map Display Select (0=9800-9BFF, 1=9C00-9FFF)
@@ -575,57 +933,48 @@ void GPU::RenderWindowScanline()
         // Get the X tile for this pixel
         byte tileX = (byte)((x - winX) / 8);
 
-        // Calculate the tile number
-        byte tileNumber = m_VRAM[(ushort)(tileNumberMap + (tileY * 32) + tileX)];
+        // Calculate the tile number, and find its attributes in CGB mode
+        ushort tileMapPtr = (ushort)(tileNumberMap + (tileY * 32) + tileX);
+        byte tileNumber = m_VRAM[tileMapPtr];
+        byte attributes = m_isCGB ? m_VRAM[0x2000 + tileMapPtr] : 0x00;
 
         // Find the tile data
         ushort tileDataPtr = 0;
         if (BGWindowTileDataSelect)
         {
             tileDataPtr = (ushort)(tileData + tileNumber * 0x10);
-    }
+        }
         else
         {
             tileDataPtr = (ushort)(tileData + static_cast<sbyte>(tileNumber) * 0x10);
         }
 
-        tileDataPtr += (ushort)(tileYOffset * 2);
+        tileDataPtr += (ushort)((ISBITSET(attributes, 6) ? (7 - tileYOffset) : tileYOffset) * 2);
 
         // Read tile data
-        byte b1 = m_VRAM[tileDataPtr];
-        byte b2 = m_VRAM[(ushort)(tileDataPtr + 1)];
+        const byte* pTileBank = ISBITSET(attributes, 3) ? (m_VRAM + 0x2000) : m_VRAM;
+        byte b1 = pTileBank[tileDataPtr];
+        byte b2 = pTileBank[(ushort)(tileDataPtr + 1)];
 
         // Find the pixel we care about and look up palette and color
-        byte bit = (byte)(7 - x % 8);
+        byte bit = (byte)(x % 8);
+        if (!ISBITSET(attributes, 5))
+        {
+            bit = 7 - bit;
+        }
+
         byte pLo = ISBITSET(b1, bit) ? 0x01 : 0x00;
         byte pHi = ISBITSET(b2, bit) ? 0x02 : 0x00;
-        byte color = palette[pLo + pHi];
 
         // Set the image color
-        int index = ((m_LCDControllerYCoordinate * 160) + x) * 4;
-        m_bgPixels[index + 1] = color; // B
-#if TINT
-        if (m_bgPixels[index + 1] == 0x00) m_bgPixels[index + 1] = 0x30;
-        m_bgPixels[index + 2] = 0x00; // G
-        m_bgPixels[index + 3] = 0x00; // R
-#else
-        m_bgPixels[index + 2] = color; // G
-        m_bgPixels[index + 3] = color; // R
-#endif
-        m_bgPixels[index + 0] = 0xFF;  // A
-}
+        memcpy(&m_LinePixels[x * 4], &m_BGColors[((attributes & 0x07) * 4) + pLo + pHi], 4);
+        m_bgPriority[x] = BGDisplayEnable ? static_cast<byte>((attributes & 0x80) | pLo | pHi) : 0x00;
+    }
 }
 
 void GPU::RenderOBJScanline()
 {
     const byte SPRITESIZEINBYTES = 16;
-    const byte bgPalette[]
-    {
-        GBColors[m_BGPaletteData & 0x03],
-        GBColors[(m_BGPaletteData >> 2) & 0x03],
-        GBColors[(m_BGPaletteData >> 4) & 0x03],
-        GBColors[(m_BGPaletteData >> 6) & 0x03],
-    };
 
     // Loop through each sprite (backwards)
     for (int i = 156; i >= 0; i -= 4)
@@ -655,22 +1004,16 @@ void GPU::RenderOBJScanline()
                 spriteTileNumber &= 0xFE;
             }
 
-            byte paletteNumber = ISBITSET(spriteFlags, 4) ? 0x01 : 0x00;
+            // DMG: Bit 4 selects OBP0 or OBP1. CGB: Bits 0-2 select the palette, bit 3 the VRAM bank.
+            byte paletteNumber = m_isCGB ? (spriteFlags & 0x07) : (ISBITSET(spriteFlags, 4) ? 0x01 : 0x00);
+            const unsigned int* palette = &m_OBJColors[paletteNumber * 4];
+            const byte* pTileBank = (m_isCGB && ISBITSET(spriteFlags, 3)) ? (m_VRAM + 0x2000) : m_VRAM;
 
             int x = objX - 8;
 
             // Mapped for direct VRAM access
             const ushort tileData = 0x0000;
 
-            // Create the palette to use for this sprite
-            byte palette[]
-            {
-                0x00, // Unused - Transparent
-                GBColors[(paletteNumber == 0x00) ? (m_ObjectPalette0Data >> 2 & 0x03) : (m_ObjectPalette1Data >> 2 & 0x03)],
-                GBColors[(paletteNumber == 0x00) ? (m_ObjectPalette0Data >> 4 & 0x03) : (m_ObjectPalette1Data >> 4 & 0x03)],
-                GBColors[(paletteNumber == 0x00) ? (m_ObjectPalette0Data >> 6 & 0x03) : (m_ObjectPalette1Data >> 6 & 0x03)]
-            };
-
             // The memory location of this sprites tile can be found by adding the sprites tile
             // number to the location of the tile data.
             // If the spriteSize == 0x00, ignore the lower bit of the tile number.
@@ -679,8 +1022,8 @@ void GPU::RenderOBJScanline()
             tilePointer += (tileYOffset * 2);
 
             // The data for this line of the sprite, 8 pixels
-            byte low = m_VRAM[tilePointer];
-            byte high = m_VRAM[(ushort)(tilePointer + 1)];
+            byte low = pTileBank[tilePointer];
+            byte high = pTileBank[(ushort)(tilePointer + 1)];
 
             // Loop through all 8 pixels of this line
             for (int indexX = 0; indexX < 8; indexX++)
@@ -693,7 +1036,6 @@ void GPU::RenderOBJScanline()
                     byte pixelVal = 0x00;
                     if (ISBITSET(high, bit)) pixelVal |= 0x02;
                     if (ISBITSET(low, bit)) pixelVal |= 0x01;
-                    byte color = palette[pixelVal];
 
                     // If two sprites x coordinates are the same on DMG OR CGB, the one with the lower address in OAM will be 'on top'
                     // If two sprites x coordinates are different on DMG, the one with the x coordinate closer to the ? right ? of the screen will be on top, regardless of position in OAM. (When in DMG mode(i.e.when playing a non - color enhanced game), the CGB emulates this behavior)
@@ -702,26 +1044,13 @@ void GPU::RenderOBJScanline()
                     // If the pixel is not transparent
                     if (pixelVal != 0x00)
                     {
-                        int index = ((m_LCDControllerYCoordinate * 160) + pixelX) * 4;
-
-                        // If the sprite has priority 0 (Render above BG)
-                        if (!ISBITSET(spriteFlags, 7) || (m_bgPixels[index + 3] == bgPalette[0x00]))
+                        // The BG stays on top if its color is not 0, and either the sprite has
+                        // priority 1 (Render behind BG) or the BG tile has its priority attribute set
+                        byte bgPriority = m_bgPriority[pixelX];
+                        bool isBehindBG = ISBITSET(spriteFlags, 7) || ISBITSET(bgPriority, 7);
+                        if (!isBehindBG || ((bgPriority & 0x03) == 0x00))
                         {
-                            // If the BG pixel is white
-                            //  This sprite has priority 1 (Render behind BG)
-                            //  The sprite pixels only get rendered above BG pixels that are white.
-                            //  All other BG pixels stay on top.
-                            // Render that sprite pixel
-                            m_DisplayPixels[index + 2] = color; // G
-#if TINT
-                            if (m_DisplayPixels[index + 2] == 0x00) m_DisplayPixels[index + 2] = 0x30;
-                            m_DisplayPixels[index + 3] = 0x00; // R
-                            m_DisplayPixels[index + 1] = 0x00; // B
-#else
-                            m_DisplayPixels[index + 3] = color; // R
-                            m_DisplayPixels[index + 1] = color; // B
-#endif
-                            m_DisplayPixels[index + 0] = 0xFF;  // A
+                            memcpy(&m_LinePixels[pixelX * 4], &palette[pixelVal], 4);
                         }
                     }
                 }
@@ -729,3 +1058,86 @@ void GPU::RenderOBJScanline()
         }
     }
 }
+
+/*
+    Builds a pixel in the layout of the display: A, B, G, R in memory (RGBA8888 on a little
+    endian host). Palette entries are kept in this form, so drawing a pixel is a single copy.
+*/
+unsigned int GPU::MakePixel(byte red, byte green, byte blue)
+{
+    const byte bytes[] = { 0xFF, blue, green, red };
+
+    unsigned int pixel;
+    memcpy(&pixel, bytes, sizeof(pixel));
+    return pixel;
+}
+
+/*
+    Converts a CGB color (xBBBBBGG GGGRRRRR) to a pixel. The CGB LCD is not as saturated and
+    brighter than a PC monitor, the color correction mixes the channels to get closer to it.
+*/
+unsigned int GPU::MakeCGBPixel(ushort color)
+{
+    unsigned int red = color & 0x1F;
+    unsigned int green = (color >> 5) & 0x1F;
+    unsigned int blue = (color >> 10) & 0x1F;
+
+    if (!m_IsColorCorrected)
+    {
+        return MakePixel(
+            static_cast<byte>((red << 3) | (red >> 2)),
+            static_cast<byte>((green << 3) | (green >> 2)),
+            static_cast<byte>((blue << 3) | (blue >> 2)));
+    }
+
+    return MakePixel(
+        static_cast<byte>(std::min(960u, (red * 26) + (green * 4) + (blue * 2)) >> 2),
+        static_cast<byte>(std::min(960u, (green * 24) + (blue * 8)) >> 2),
+        static_cast<byte>(std::min(960u, (red * 6) + (green * 4) + (blue * 22)) >> 2));
+}
+
+void GPU::WritePaletteData(byte* pPaletteRAM, unsigned int* pColors, byte& paletteIndex, const byte val)
+{
+    byte address = paletteIndex & 0x3F;
+    pPaletteRAM[address] = val;
+    UpdateCGBColor(pPaletteRAM, pColors, address / 2);
+
+    // Bit 7 of the index register increments it after every write
+    if (ISBITSET(paletteIndex, 7))
+    {
+        paletteIndex = 0x80 | ((address + 1) & 0x3F);
+    }
+}
+
+void GPU::UpdateCGBColor(const byte* pPaletteRAM, unsigned int* pColors, byte entry)
+{
+    ushort color = static_cast<ushort>(pPaletteRAM[entry * 2] | (pPaletteRAM[(entry * 2) + 1] << 8));
+    pColors[entry] = MakeCGBPixel(color);
+}
+
+void GPU::UpdateColors()
+{
+    if (m_isCGB)
+    {
+        for (byte entry = 0; entry < 32; entry++)
+        {
+            UpdateCGBColor(m_BGPaletteRAM, m_BGColors, entry);
+            UpdateCGBColor(m_OBJPaletteRAM, m_OBJColors, entry);
+        }
+
+        return;
+    }
+
+    // DMG mode only uses the first BG palette and the first two OBJ palettes
+    for (byte color = 0; color < 4; color++)
+    {
+        byte shade = GBColors[(m_BGPaletteData >> (color * 2)) & 0x03];
+        m_BGColors[color] = MakePixel(shade, shade, shade);
+
+        shade = GBColors[(m_ObjectPalette0Data >> (color * 2)) & 0x03];
+        m_OBJColors[color] = MakePixel(shade, shade, shade);
+
+        shade = GBColors[(m_ObjectPalette1Data >> (color * 2)) & 0x03];
+        m_OBJColors[4 + color] = MakePixel(shade, shade, shade);
+    }
+}
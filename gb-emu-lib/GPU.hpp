@@ -25,6 +25,30 @@
 #define ObjectPalette1Data 0xFF49
 #define DMATransferAndStartAddress 0xFF46
 
+// FF4F - VBK - CGB Mode Only - VRAM Bank (R/W)
+// FF51 - HDMA1 - CGB Mode Only - New DMA Source, High (W)
+// FF52 - HDMA2 - CGB Mode Only - New DMA Source, Low (W)
+// FF53 - HDMA3 - CGB Mode Only - New DMA Destination, High (W)
+// FF54 - HDMA4 - CGB Mode Only - New DMA Destination, Low (W)
+// FF55 - HDMA5 - CGB Mode Only - New DMA Length/Mode/Start (R/W)
+#define VRAMBank 0xFF4F
+#define HDMASourceHigh 0xFF51
+#define HDMASourceLow 0xFF52
+#define HDMADestinationHigh 0xFF53
+#define HDMADestinationLow 0xFF54
+#define HDMALengthModeStart 0xFF55
+
+#define HDMABlockSize 0x10
+
+// FF68 - BCPS/BGPI - CGB Mode Only - Background Palette Index (R/W)
+// FF69 - BCPD/BGPD - CGB Mode Only - Background Palette Data (R/W)
+// FF6A - OCPS/OBPI - CGB Mode Only - Sprite Palette Index (R/W)
+// FF6B - OCPD/OBPD - CGB Mode Only - Sprite Palette Data (R/W)
+#define CGBBGPaletteIndex 0xFF68
+#define CGBBGPaletteData 0xFF69
+#define CGBOBJPaletteIndex 0xFF6A
+#define CGBOBJPaletteData 0xFF6B
+
 #define ModeHBlank 0
 #define ModeVBlank 1
 #define ModeReadingOAM 2
@@ -35,43 +59,66 @@
 #define ReadingOAMCycles 80
 #define ReadingOAMVRAMCycles 172
 
+// RGBA8888, 160x144
+#define DisplayBufferSize (160 * 144 * 4)
+#define VRAMSize 0x4000     // Two 8k banks, only the first one is used in DMG mode
+
+class Recorder;
+
 class GPU : public IMemoryUnit
 {
+    friend class CPUTests;
     friend class GPUTests;
+    friend class JIT;
+    friend class RecorderTests;
+    friend class Recorder;
 
 public:
-    GPU(IMMU* pMMU, ICPU* pCPU);
+    GPU(IMMU* pMMU, ICPU* pCPU, byte* pVRAM = nullptr);
     ~GPU();
 
     void Step(unsigned long cycles);
+    unsigned long GetCyclesUntilEvent();
     byte* GetCurrentFrame();
+    const bool* GetDirtyLines();
 
     // IMemoryUnit
     byte ReadByte(const ushort& address);
     bool WriteByte(const ushort& address, const byte val);
     void SetVSyncCallback(void(*pCallback)());
+    void SetRecorder(Recorder* pRecorder);
+    void SetCGBMode(bool isCGB);
+    void SetColorCorrection(bool isEnabled);
     void PreBoot();
+    void SaveState(StateWriter& writer);
+    void LoadState(StateReader& reader);
 
 private:
     void LaunchDMATransfer(const byte address);
+    void LaunchHDMATransfer(const byte val);
+    void StepHDMATransfer();
+    void CopyHDMABlock();
+    void AttachDisplay();
+    void ClearDisplay();
     void RenderScanline();
     void RenderImage();
     void RenderBackgroundScanline();
     void RenderWindowScanline();
     void RenderOBJScanline();
 
-private:
-    IMMU* m_MMU;
-    ICPU* m_CPU;
-    byte m_VRAM[0x1FFF + 1];
-    byte m_OAM[0x009F + 1];
-    byte m_bgPixels[160 * 144 * 4];
-    byte m_DisplayPixels[160 * 144 * 4];
+    // Palettes
+    static unsigned int MakePixel(byte red, byte green, byte blue);
+    unsigned int MakeCGBPixel(ushort color);
+    void WritePaletteData(byte* pPaletteRAM, unsigned int* pColors, byte& paletteIndex, const byte val);
+    void UpdateCGBColor(const byte* pPaletteRAM, unsigned int* pColors, byte entry);
+    void UpdateColors();
 
+private:
+    // Timing and registers first, they are touched on every step
     unsigned long m_ModeClock;
     int m_DMAClocksRemaining;
-    void(*m_pVSyncCallback)();
-    
+    bool m_isCGB;
+
     byte m_LCDControl;
     byte m_LCDControllerStatus;
     byte m_ScrollY;
@@ -83,4 +130,37 @@ private:
     byte m_BGPaletteData;
     byte m_ObjectPalette0Data;
     byte m_ObjectPalette1Data;
+
+    // CGB DMA to VRAM
+    ushort m_HDMASource;
+    ushort m_HDMADestination;   // Offset into the VRAM bank
+    byte m_HDMALength;          // Blocks left to copy, minus one, as read from HDMA5
+    bool m_IsHDMAActive;        // An HBlank DMA is in progress
+
+    IMMU* m_MMU;
+    ICPU* m_CPU;
+    void(*m_pVSyncCallback)();
+    Recorder* m_pRecorder;      // Gets every frame before the callback does
+
+    byte* m_VRAM;               // VRAMSize bytes
+    byte* m_pVRAMBank;          // The bank the CPU sees at 0x8000-0x9FFF
+    byte m_OAM[0x009F + 1];
+
+    // CGB palette RAM, 8 palettes of 4 colors, 2 bytes each
+    byte m_BGPaletteRAM[0x3F + 1];
+    byte m_OBJPaletteRAM[0x3F + 1];
+    byte m_CGBBGPaletteIndex;
+    byte m_CGBOBJPaletteIndex;
+    bool m_IsColorCorrected;
+
+    // The same palettes converted to pixels, updated when a palette is written. In DMG mode the
+    // first BG palette holds BGP and the first two OBJ palettes hold OBP0 and OBP1.
+    unsigned int m_BGColors[8 * 4];
+    unsigned int m_OBJColors[8 * 4];
+
+    byte m_LinePixels[160 * 4]; // The line being drawn, copied to the display once it is done
+    byte m_bgPriority[160];     // BG color number of the current line, bit 7 set for CGB BG-to-OAM priority
+    bool m_DirtyLines[144];     // Lines that changed since the last VSync
+    std::unique_ptr<byte[]> m_spDisplayPixels;  // Only allocated once someone asks for frames
+    std::unique_ptr<byte[]> m_spVRAM;           // Only used when no storage was handed in
 };
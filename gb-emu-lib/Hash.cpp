@@ -0,0 +1,14 @@
+#include "pch.hpp"
+#include "Hash.hpp"
+
+unsigned long long FNVHash(unsigned long long hash, const void* pData, size_t size)
+{
+    const byte* pBytes = static_cast<const byte*>(pData);
+    for (size_t index = 0; index < size; index++)
+    {
+        hash ^= pBytes[index];
+        hash *= 0x100000001B3ULL;
+    }
+
+    return hash;
+}
@@ -0,0 +1,7 @@
+#pragma once
+
+// Where a new FNVHash starts
+#define FNVOffsetBasis 0xCBF29CE484222325ULL
+
+// 64-bit FNV-1a, continuing from hash so several pieces of data can go into one hash
+unsigned long long FNVHash(unsigned long long hash, const void* pData, size_t size);
@@ -1,5 +1,13 @@
 #pragma once
 
+#include "ILinkPort.hpp"
+
+class Debugger;
+class Trace;
+class Coverage;
+class Cheats;
+class Recorder;
+
 #define INT40 0x40  // VBlank
 #define INT48 0x48  // STAT
 #define INT50 0x50  // Timer
@@ -15,6 +23,18 @@ public:
     virtual int Step() = 0;
     virtual void TriggerInterrupt(byte interrupt) = 0;
     virtual byte* GetCurrentFrame() = 0;
+    virtual const bool* GetDirtyLines() = 0;
     virtual void SetInput(byte input, byte buttons) = 0;
     virtual void SetVSyncCallback(void(*pCallback)()) = 0;
+    virtual void SetColorCorrection(bool isEnabled) = 0;
+    virtual void ConnectLink(ILinkPort* pPort) = 0;
+    virtual void SetLinkSyncWindow(unsigned long cycles) = 0;
+    virtual void SetFastBoot(bool isEnabled) = 0;
+    virtual bool EnableAudio() = 0;
+    virtual Debugger* GetDebugger() = 0;
+    virtual Trace* EnableTrace(unsigned int size) = 0;
+    virtual Coverage* EnableCoverage() = 0;
+    virtual Cheats* GetCheats() = 0;
+    virtual bool EnableJIT(bool isEnabled) = 0;
+    virtual Recorder* GetRecorder() = 0;
 };
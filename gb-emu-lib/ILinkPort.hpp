@@ -0,0 +1,28 @@
+#pragma once
+
+#define LinkMessageTime     0x00    // The sender has reached this cycle
+#define LinkMessageTransfer 0x01    // The sender clocks out data, the transfer completes at this cycle
+#define LinkMessageReply    0x02    // The receiver's side of the transfer that completed at this cycle
+
+// A message between the two ends of a link cable, cycles are counted from when the cable was connected
+struct LinkMessage
+{
+    byte type;
+    byte data;
+    bool isAccepted;                // Reply only: the receiver was waiting for an external clock
+    unsigned long long cycle;
+};
+
+/*
+    One end of a link cable. The serial unit on either side runs the synchronization protocol, the
+    port only has to deliver messages in order. Receive never blocks.
+*/
+class ILinkPort
+{
+public:
+    virtual ~ILinkPort() {}
+    virtual bool Send(const LinkMessage& message) = 0;
+    virtual bool Receive(LinkMessage& message) = 0;
+    virtual bool IsConnected() = 0;
+    virtual void Disconnect() = 0;
+};
@@ -7,7 +7,12 @@ public:
     virtual void RegisterMemoryUnit(const ushort& startRange, const ushort& endRange, IMemoryUnit* pUnit) = 0;
     virtual unsigned short ReadUShort(const ushort& address) = 0;
     virtual bool LoadBootROM(const char* bootROMPath) = 0;
+    virtual void SetCGBMode(bool isCGB) = 0;
 
     virtual byte Read(const ushort& address) = 0;
     virtual bool Write(const ushort& address, const byte val) = 0;
+    virtual const byte* ResolveBlock(const ushort& address) = 0;
+
+    virtual void SaveState(StateWriter& writer) = 0;
+    virtual void LoadState(StateReader& reader) = 0;
 };
@@ -6,4 +6,21 @@ public:
     virtual ~IMemoryUnit() {}
     virtual byte ReadByte(const ushort& address) = 0;
     virtual bool WriteByte(const ushort& address, const byte val) = 0;
+
+    // Returns the memory behind address, valid up to the end of its 16 byte aligned block, so that
+    // block transfers can copy it directly. Returns nullptr if it is not plain memory.
+    virtual const byte* GetMemoryBlock(const ushort& address) { return nullptr; }
+};
+
+/*
+    A unit the tools put in front of a page to watch or patch it, see MMU::InstallInterposer.
+    m_pUnit is the next unit down and is kept by the MMU, nullptr while not installed.
+*/
+class MemoryInterposer : public IMemoryUnit
+{
+public:
+    MemoryInterposer() : m_pUnit(nullptr) {}
+
+public:
+    IMemoryUnit* m_pUnit;
 };
@@ -0,0 +1,2106 @@
+#include "pch.hpp"
+#include "JIT.hpp"
+
+#include <algorithm>
+#include <cstddef>
+
+#if JIT_X64
+    #if WINDOWS
+        #include <windows.h>
+    #else
+        #include <sys/mman.h>
+    #endif
+#endif
+
+JIT::BlockPage::BlockPage() :
+    m_HasCode(false),
+    m_Invalidations(0)
+{
+    memset(m_Code, 0x00, sizeof(m_Code));
+    memset(m_Hits, 0x00, sizeof(m_Hits));
+    memset(m_CodeBytes, 0x00, sizeof(m_CodeBytes));
+}
+
+JIT::CodePage::CodePage(JIT* pJIT) :
+    m_pJIT(pJIT)
+{
+}
+
+// IMemoryUnit
+byte JIT::CodePage::ReadByte(const ushort& address)
+{
+    return m_pUnit->ReadByte(address);
+}
+
+bool JIT::CodePage::WriteByte(const ushort& address, const byte val)
+{
+    bool result = m_pUnit->WriteByte(address, val);
+    m_pJIT->OnCodeWrite(address);
+    return result;
+}
+
+const byte* JIT::CodePage::GetMemoryBlock(const ushort& address)
+{
+    return m_pUnit->GetMemoryBlock(address);
+}
+
+#if JIT_X64
+
+enum X64Register
+{
+    RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI, R8, R9, R10, R11, R12, R13, R14, R15
+};
+
+// Condition codes of Jcc and SETcc
+enum X64Condition
+{
+    CondB = 0x2,
+    CondAE = 0x3,
+    CondZ = 0x4,
+    CondNZ = 0x5,
+    CondLE = 0xE,
+};
+
+// The /digit of the ALU and shift instructions
+enum X64Operation
+{
+    ALUAdd = 0, ALUOr = 1, ALUAdc = 2, ALUSbb = 3, ALUAnd = 4, ALUSub = 5, ALUXor = 6, ALUCmp = 7,
+    ShiftRol = 0, ShiftRor = 1, ShiftRcl = 2, ShiftRcr = 3, ShiftShl = 4, ShiftShr = 5, ShiftSar = 7,
+};
+
+/*
+    Where the Gameboy registers live while translated code runs. A and F get a register each, the
+    pairs keep their 16 bit value. ebx counts the cycles down, rbp points at the Context.
+*/
+#define RegBudget   RBX
+#define RegContext  RBP
+#define RegA        R12
+#define RegF        R13
+static const int PairRegisters[4] = { R14, R15, RSI, RDI };     // BC, DE, HL, SP
+
+#if WINDOWS
+    static const int ArgumentRegisters[4] = { RCX, RDX, R8, R9 };
+    #define StackAdjust 40      // Shadow space, and rsp back to 16 byte alignment
+#else
+    static const int ArgumentRegisters[4] = { RDI, RSI, RDX, RCX };
+    #define StackAdjust 8
+#endif
+
+// Just the x86-64 encodings the translation needs
+class X64Emitter
+{
+public:
+    X64Emitter(byte* pStart, byte* pEnd) :
+        m_pCurrent(pStart),
+        m_pEnd(pEnd)
+    {
+    }
+
+    byte* GetCurrent()
+    {
+        return m_pCurrent;
+    }
+
+    // Nothing is written past the end, the caller checks this once it is done
+    bool IsFull()
+    {
+        return m_pCurrent > m_pEnd;
+    }
+
+    void Byte(unsigned int value)
+    {
+        if (m_pCurrent < m_pEnd)
+        {
+            *m_pCurrent = static_cast<byte>(value);
+        }
+
+        m_pCurrent++;
+    }
+
+    void Int32(unsigned int value)
+    {
+        for (int index = 0; index < 4; index++)
+        {
+            Byte(value >> (index * 8));
+        }
+    }
+
+    void Int64(unsigned long long value)
+    {
+        Int32(static_cast<unsigned int>(value));
+        Int32(static_cast<unsigned int>(value >> 32));
+    }
+
+    // reg, rm: register direct. isByteForced for spl, bpl, sil and dil, which need a REX prefix
+    void RR(unsigned int opcode, int size, int reg, int rm, bool isByteForced = false)
+    {
+        if (size == 8)
+        {
+            isByteForced = isByteForced || IsHighByteAlias(reg) || IsHighByteAlias(rm);
+        }
+
+        Prefixes(size, reg, 0, rm, isByteForced);
+        Opcode(opcode);
+        Byte(0xC0 | ((reg & 0x07) << 3) | (rm & 0x07));
+    }
+
+    // reg, [base + index * scale + displacement], index < 0 for none
+    void RM(unsigned int opcode, int size, int reg, int base, int index, int scale, int displacement)
+    {
+        Prefixes(size, reg, (index >= 0) ? index : 0, base, (size == 8) && IsHighByteAlias(reg));
+        Opcode(opcode);
+        if ((index < 0) && ((base & 0x07) != RSP))
+        {
+            Byte(0x80 | ((reg & 0x07) << 3) | (base & 0x07));
+        }
+        else
+        {
+            int scaleBits = (scale == 8) ? 3 : (scale == 4) ? 2 : (scale == 2) ? 1 : 0;
+            Byte(0x80 | ((reg & 0x07) << 3) | 0x04);
+            Byte((scaleBits << 6) | ((((index >= 0) ? index : RSP) & 0x07) << 3) | (base & 0x07));
+        }
+
+        Int32(static_cast<unsigned int>(displacement));
+    }
+
+    void Mov(int dst, int src, int size = 32)
+    {
+        RR((size == 8) ? 0x88 : 0x89, size, src, dst);
+    }
+
+    void MovImm(int dst, unsigned int value)
+    {
+        Prefixes(32, 0, 0, dst, false);
+        Byte(0xB8 | (dst & 0x07));
+        Int32(value);
+    }
+
+    void MovImm64(int dst, unsigned long long value)
+    {
+        Prefixes(64, 0, 0, dst, false);
+        Byte(0xB8 | (dst & 0x07));
+        Int64(value);
+    }
+
+    void MovZX8(int dst, int src)
+    {
+        RR(0x0FB6, 32, dst, src, IsHighByteAlias(src));
+    }
+
+    void MovZX16(int dst, int src)
+    {
+        RR(0x0FB7, 32, dst, src);
+    }
+
+    // movzx eax, ah, which can not be encoded with a REX prefix
+    void MovZXAH()
+    {
+        Byte(0x0F);
+        Byte(0xB6);
+        Byte(0xC4);
+    }
+
+    void Load(int dst, int base, int displacement, int size = 32)
+    {
+        RM(0x8B, size, dst, base, -1, 1, displacement);
+    }
+
+    void LoadIndexed(int dst, int base, int index, int scale, int displacement)
+    {
+        RM(0x8B, 64, dst, base, index, scale, displacement);
+    }
+
+    void LoadZX8(int dst, int base, int index, int displacement)
+    {
+        RM(0x0FB6, 32, dst, base, index, 1, displacement);
+    }
+
+    void LoadZX16(int dst, int base, int displacement)
+    {
+        RM(0x0FB7, 32, dst, base, -1, 1, displacement);
+    }
+
+    void Store(int base, int index, int displacement, int src, int size)
+    {
+        RM((size == 8) ? 0x88 : 0x89, size, src, base, index, 1, displacement);
+    }
+
+    void Lea(int dst, int base, int displacement)
+    {
+        RM(0x8D, 32, dst, base, -1, 1, displacement);
+    }
+
+    void ALU(int operation, int dst, int src, int size = 32)
+    {
+        RR((operation << 3) | ((size == 8) ? 0x00 : 0x01), size, src, dst);
+    }
+
+    void ALUImm(int operation, int dst, int value, int size = 32)
+    {
+        if (size == 8)
+        {
+            RR(0x80, 8, operation, dst);
+            Byte(value);
+        }
+        else if ((value >= -128) && (value <= 127))
+        {
+            RR(0x83, size, operation, dst);
+            Byte(value);
+        }
+        else
+        {
+            RR(0x81, size, operation, dst);
+            Int32(value);
+        }
+    }
+
+    void Test(int dst, int src, int size = 32)
+    {
+        RR((size == 8) ? 0x84 : 0x85, size, src, dst);
+    }
+
+    void TestImm(int dst, unsigned int value, int size = 32)
+    {
+        if (size == 8)
+        {
+            RR(0xF6, 8, 0, dst);
+            Byte(value);
+        }
+        else
+        {
+            RR(0xF7, size, 0, dst);
+            Int32(value);
+        }
+    }
+
+    void Shift(int operation, int dst, int count, int size = 32)
+    {
+        if (count == 1)
+        {
+            RR((size == 8) ? 0xD0 : 0xD1, size, operation, dst);
+        }
+        else
+        {
+            RR((size == 8) ? 0xC0 : 0xC1, size, operation, dst);
+            Byte(count);
+        }
+    }
+
+    void IncDec8(bool isDecrement, int dst)
+    {
+        RR(0xFE, 8, isDecrement ? 1 : 0, dst);
+    }
+
+    void BitTest(int dst, int bit)
+    {
+        RR(0x0FBA, 32, 4, dst);
+        Byte(bit);
+    }
+
+    void SetCC(int condition, int dst)
+    {
+        RR(0x0F90 | condition, 8, 0, dst);
+    }
+
+    void Lahf()
+    {
+        Byte(0x9F);
+    }
+
+    void Push(int reg)
+    {
+        Prefixes(32, 0, 0, reg, false);
+        Byte(0x50 | (reg & 0x07));
+    }
+
+    void Pop(int reg)
+    {
+        Prefixes(32, 0, 0, reg, false);
+        Byte(0x58 | (reg & 0x07));
+    }
+
+    void Ret()
+    {
+        Byte(0xC3);
+    }
+
+    void CallReg(int reg)
+    {
+        RR(0xFF, 32, 2, reg);
+    }
+
+    void JmpReg(int reg)
+    {
+        RR(0xFF, 32, 4, reg);
+    }
+
+    // Jumps with a 32 bit displacement, returns the displacement to Patch or Bind later
+    byte* Jcc(int condition)
+    {
+        Byte(0x0F);
+        Byte(0x80 | condition);
+        byte* pField = m_pCurrent;
+        Int32(0);
+        return pField;
+    }
+
+    byte* Jmp()
+    {
+        Byte(0xE9);
+        byte* pField = m_pCurrent;
+        Int32(0);
+        return pField;
+    }
+
+    void JccTo(int condition, const byte* pTarget)
+    {
+        Patch(Jcc(condition), pTarget);
+    }
+
+    void JmpTo(const byte* pTarget)
+    {
+        Patch(Jmp(), pTarget);
+    }
+
+    void CallTo(const byte* pTarget)
+    {
+        Byte(0xE8);
+        byte* pField = m_pCurrent;
+        Int32(0);
+        Patch(pField, pTarget);
+    }
+
+    void Patch(byte* pField, const byte* pTarget)
+    {
+        if (pField + 4 <= m_pEnd)
+        {
+            int displacement = static_cast<int>(pTarget - (pField + 4));
+            memcpy(pField, &displacement, sizeof(displacement));
+        }
+    }
+
+    void Bind(byte* pField)
+    {
+        Patch(pField, m_pCurrent);
+    }
+
+private:
+    static bool IsHighByteAlias(int reg)
+    {
+        return (reg >= RSP) && (reg <= RDI);
+    }
+
+    void Prefixes(int size, int reg, int index, int base, bool isByteForced)
+    {
+        if (size == 16)
+        {
+            Byte(0x66);
+        }
+
+        byte rex = 0x40 | ((size == 64) ? 0x08 : 0x00) | ((reg & 0x08) ? 0x04 : 0x00) |
+            ((index & 0x08) ? 0x02 : 0x00) | ((base & 0x08) ? 0x01 : 0x00);
+        if ((rex != 0x40) || isByteForced)
+        {
+            Byte(rex);
+        }
+    }
+
+    void Opcode(unsigned int opcode)
+    {
+        if (opcode > 0xFF)
+        {
+            Byte(opcode >> 8);
+        }
+
+        Byte(opcode & 0xFF);
+    }
+
+private:
+    byte* m_pCurrent;
+    byte* m_pEnd;
+};
+
+// Gameboy register r (B, C, D, E, H, L, -, A) to and from dst/src, as a zero extended byte
+static void LoadRegister(X64Emitter& e, int dst, int r)
+{
+    if (r == 7)
+    {
+        e.Mov(dst, RegA);
+        return;
+    }
+
+    int pair = PairRegisters[r >> 1];
+    if ((r & 0x01) != 0)
+    {
+        e.MovZX8(dst, pair);
+    }
+    else
+    {
+        e.Mov(dst, pair);
+        e.Shift(ShiftShr, dst, 8);
+    }
+}
+
+static void StoreRegister(X64Emitter& e, int r, int src)
+{
+    if (r == 7)
+    {
+        e.MovZX8(RegA, src);
+        return;
+    }
+
+    int pair = PairRegisters[r >> 1];
+    if ((r & 0x01) != 0)
+    {
+        e.Mov(pair, src, 8);
+    }
+    else
+    {
+        e.MovZX8(R11, src);
+        e.Shift(ShiftShl, R11, 8);
+        e.ALUImm(ALUAnd, pair, 0xFF);
+        e.ALU(ALUOr, pair, R11);
+    }
+}
+
+static int GetInstructionLength(byte opCode)
+{
+    switch (opCode)
+    {
+    case 0x01: case 0x11: case 0x21: case 0x31: case 0x08:
+    case 0xC2: case 0xC3: case 0xC4: case 0xCA: case 0xCC: case 0xCD:
+    case 0xD2: case 0xD4: case 0xDA: case 0xDC: case 0xEA: case 0xFA:
+        return 3;
+    case 0x06: case 0x0E: case 0x16: case 0x1E: case 0x26: case 0x2E: case 0x36: case 0x3E:
+    case 0x10: case 0x18: case 0x20: case 0x28: case 0x30: case 0x38:
+    case 0xC6: case 0xCE: case 0xD6: case 0xDE: case 0xE6: case 0xEE: case 0xF6: case 0xFE:
+    case 0xE0: case 0xF0: case 0xE8: case 0xF8: case 0xCB:
+        return 2;
+    default:
+        return 1;
+    }
+}
+
+// Code is only translated from ROM bank 0, the switchable bank and the two work RAM banks, a block never crosses from one to the next
+static int GetRegion(unsigned int page)
+{
+    if (page < 0x40)
+    {
+        return 0;
+    }
+    else if (page < 0x80)
+    {
+        return 1;
+    }
+    else if ((page >= 0xC0) && (page < 0xD0))
+    {
+        return 2;
+    }
+    else if ((page >= 0xD0) && (page < 0xE0))
+    {
+        return 3;
+    }
+
+    return -1;
+}
+
+// Whether a Gameboy address has to see the components stepped up to the access
+static bool IsTimed(unsigned int address)
+{
+    return (address >= 0xFE00) || ((address >= 0x8000) && (address < 0xA000));
+}
+
+JIT::JIT(CPU* pCPU, MMU* pMMU) :
+    m_pCPU(pCPU),
+    m_pMMU(pMMU),
+    m_Synced(0),
+    m_pROM(nullptr),
+    m_ROMSize(0),
+    m_pMappedROMX(nullptr),
+    m_pMappedWRAMX(nullptr),
+    m_WasBooting(0xFF),
+    m_pCode(nullptr),
+    m_pBlocks(nullptr),
+    m_pFree(nullptr),
+    m_pEntry(nullptr),
+    m_pExit(nullptr),
+    m_pDispatch(nullptr),
+    m_pReadThunk(nullptr),
+    m_pWriteThunk(nullptr),
+    m_pInterpretThunk(nullptr),
+    m_BlockStart(0),
+    m_pBlockCode(nullptr)
+{
+    memset(&m_Context, 0x00, sizeof(m_Context));
+}
+
+JIT::~JIT()
+{
+    for (unsigned int page = 0; page < 0x100; page++)
+    {
+        if (m_CodePages[page] != nullptr)
+        {
+            m_pMMU->RemoveInterposer(static_cast<ushort>(page << 8), m_CodePages[page].get());
+        }
+    }
+
+    if (m_pCode != nullptr)
+    {
+#if WINDOWS
+        VirtualFree(m_pCode, 0, MEM_RELEASE);
+#else
+        munmap(m_pCode, JITCodeSize);
+#endif
+    }
+}
+
+bool JIT::Initialize()
+{
+    m_pROM = m_pCPU->m_cartridge->GetMemoryBlock(0x0000);
+    m_ROMSize = m_pCPU->m_cartridge->GetROMSize();
+    if ((m_pROM == nullptr) || (m_ROMSize < 0x8000))
+    {
+        Logger::LogError("JIT: No cartridge is loaded");
+        return false;
+    }
+
+    // Never writable and executable at once, see SetCodeWritable
+#if WINDOWS
+    m_pCode = static_cast<byte*>(VirtualAlloc(nullptr, JITCodeSize, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE));
+#else
+    int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+#ifdef MAP_JIT
+    flags |= MAP_JIT;
+#endif
+    void* pCode = mmap(nullptr, JITCodeSize, PROT_READ | PROT_WRITE, flags, -1, 0);
+    m_pCode = (pCode != MAP_FAILED) ? static_cast<byte*>(pCode) : nullptr;
+#endif
+    if (m_pCode == nullptr)
+    {
+        Logger::LogError("JIT: Could not allocate executable memory");
+        return false;
+    }
+
+    // LAHF has SF ZF - AF - PF - CF from the high bit down, the Gameboy has Z N H C
+    for (unsigned int value = 0; value < 0x100; value++)
+    {
+        m_Context.flags[value] = ((value & 0x40) ? 0x80 : 0x00) | ((value & 0x10) ? 0x20 : 0x00) | ((value & 0x01) ? 0x10 : 0x00);
+    }
+
+    m_Context.pHRAM = m_pMMU->m_HRAM;
+    m_Context.pJIT = this;
+    m_ROMPages.resize(m_ROMSize >> 8);
+    m_Cache.Open(m_pROM, m_ROMSize);
+
+    EmitSharedCode();
+    return SetCodeWritable(m_pCode, JITCodeSize, false);
+}
+
+unsigned long JIT::Run()
+{
+    UpdateMappings();
+
+    ushort address = m_pCPU->m_PC;
+    unsigned int page = address >> 8;
+    BlockPage* pPage = m_Context.blockPages[page];
+    if (pPage == nullptr)
+    {
+        if ((GetRegion(page) < 0) || (m_Context.readPages[page] == 0))
+        {
+            return 0;
+        }
+
+        pPage = GetBlockPage(reinterpret_cast<const byte*>(m_Context.readPages[page] + (page << 8)));
+        m_Context.blockPages[page] = pPage;
+    }
+
+    void* pCode = pPage->m_Code[address & 0xFF];
+    if (pCode == nullptr)
+    {
+        byte& hits = pPage->m_Hits[address & 0xFF];
+        if ((hits == JITNeverCount) || (++hits < JITHotCount))
+        {
+            return 0;
+        }
+
+        pCode = Compile(address);
+        if (pCode == nullptr)
+        {
+            // A flush may have dropped the page's hits, but not the page itself
+            pPage->m_Hits[address & 0xFF] = JITNeverCount;
+            return 0;
+        }
+    }
+
+    // An interrupt that is due is taken by the interpreter first
+    if ((m_pCPU->m_IME == 0x01) && ((m_pMMU->m_IE & m_pMMU->m_IF & 0x0F) != 0))
+    {
+        return 0;
+    }
+
+    int budget = GetBudget();
+    if (budget <= 0)
+    {
+        return 0;
+    }
+
+    m_Context.AF = m_pCPU->m_AF;
+    m_Context.BC = m_pCPU->m_BC;
+    m_Context.DE = m_pCPU->m_DE;
+    m_Context.HL = m_pCPU->m_HL;
+    m_Context.SP = m_pCPU->m_SP;
+    m_Context.start = budget;
+    m_Context.isExitForced = 0;
+    m_Synced = 0;
+
+    int remaining = m_pEntry(&m_Context, pCode, budget);
+    Sync(remaining);
+
+    m_pCPU->m_AF = m_Context.AF;
+    m_pCPU->m_BC = m_Context.BC;
+    m_pCPU->m_DE = m_Context.DE;
+    m_pCPU->m_HL = m_Context.HL;
+    m_pCPU->m_SP = m_Context.SP;
+    m_pCPU->m_PC = m_Context.PC;
+    return m_Synced;
+}
+
+// The pages themselves are kept, the Context and Run may be pointing at them
+void JIT::Flush()
+{
+    for (size_t index = 0; index < m_ROMPages.size(); index++)
+    {
+        if (m_ROMPages[index] != nullptr)
+        {
+            *m_ROMPages[index] = BlockPage();
+            SeedHits(m_ROMPages[index].get(), static_cast<unsigned int>(index));
+        }
+    }
+
+    for (std::unique_ptr<BlockPage>& spPage : m_WRAMPages)
+    {
+        if (spPage != nullptr)
+        {
+            *spPage = BlockPage();
+        }
+    }
+
+    m_pFree = m_pBlocks;
+    MapWorkRAM();
+}
+
+bool JIT::IsMappingCurrent()
+{
+    return (m_pCPU->m_cartridge->GetMemoryBlock(0x4000) == m_pMappedROMX) &&
+        (m_pMMU->m_pWRAMBank == m_pMappedWRAMX) && (m_pMMU->m_isBooting == m_WasBooting);
+}
+
+// Points the pages at the ROM banks and work RAM banks that are mapped now
+void JIT::UpdateMappings()
+{
+    if (IsMappingCurrent())
+    {
+        return;
+    }
+
+    m_pMappedROMX = m_pCPU->m_cartridge->GetMemoryBlock(0x4000);
+    m_pMappedWRAMX = m_pMMU->m_pWRAMBank;
+    m_WasBooting = m_pMMU->m_isBooting;
+
+    MapROM(0x00, m_pROM);
+    MapROM(0x40, m_pMappedROMX);
+    if (m_WasBooting == 0x00)
+    {
+        // The boot ROM is in front of the first page
+        m_Context.readPages[0x00] = 0;
+        m_Context.blockPages[0x00] = nullptr;
+    }
+
+    MapWorkRAM();
+}
+
+void JIT::MapROM(unsigned int firstPage, const byte* pBank)
+{
+    uintptr_t bank = reinterpret_cast<uintptr_t>(pBank);
+    uintptr_t ROM = reinterpret_cast<uintptr_t>(m_pROM);
+    bool isValid = (bank >= ROM) && (bank + 0x4000 <= ROM + m_ROMSize);
+    for (unsigned int index = 0; index < 0x40; index++)
+    {
+        unsigned int page = firstPage + index;
+        m_Context.writePages[page] = 0;
+        m_Context.readPages[page] = isValid ? (bank + (index << 8) - (page << 8)) : 0;
+        m_Context.blockPages[page] = isValid ? m_ROMPages[((bank - ROM) >> 8) + index].get() : nullptr;
+    }
+}
+
+// Work RAM and its echo, the pages with code on them are left to the CodePage for writes
+void JIT::MapWorkRAM()
+{
+    for (unsigned int page = 0xC0; page <= 0xFD; page++)
+    {
+        unsigned int offset = (page - 0xC0) & 0x1F;
+        byte* pHost = (offset < 0x10) ? (m_pMMU->m_WRAM + (offset << 8)) : (m_pMMU->m_pWRAMBank + ((offset - 0x10) << 8));
+        BlockPage* pPage = m_WRAMPages[(pHost - m_pMMU->m_WRAM) >> 8].get();
+
+        uintptr_t mapping = reinterpret_cast<uintptr_t>(pHost) - (page << 8);
+        m_Context.readPages[page] = mapping;
+        m_Context.writePages[page] = ((pPage != nullptr) && pPage->m_HasCode) ? 0 : mapping;
+        m_Context.blockPages[page] = (page < 0xE0) ? pPage : nullptr;
+    }
+}
+
+JIT::BlockPage* JIT::GetBlockPage(const byte* pHost)
+{
+    std::unique_ptr<BlockPage>* pspPage = nullptr;
+    uintptr_t host = reinterpret_cast<uintptr_t>(pHost);
+    uintptr_t ROM = reinterpret_cast<uintptr_t>(m_pROM);
+    uintptr_t WRAM = reinterpret_cast<uintptr_t>(m_pMMU->m_WRAM);
+    bool isROM = (host >= ROM) && (host < ROM + m_ROMSize);
+    if (isROM)
+    {
+        pspPage = &m_ROMPages[(host - ROM) >> 8];
+    }
+    else if ((host >= WRAM) && (host < WRAM + WRAMSize))
+    {
+        pspPage = &m_WRAMPages[(host - WRAM) >> 8];
+    }
+    else
+    {
+        return nullptr;
+    }
+
+    if (*pspPage == nullptr)
+    {
+        *pspPage = std::unique_ptr<BlockPage>(new BlockPage());
+        if (isROM)
+        {
+            SeedHits(pspPage->get(), static_cast<unsigned int>((host - ROM) >> 8));
+        }
+        else
+        {
+            // The Gameboy pages showing it have to find it from now on
+            MapWorkRAM();
+        }
+    }
+
+    return pspPage->get();
+}
+
+// The blocks the cache has for a ROM page are translated the next time they are reached
+void JIT::SeedHits(BlockPage* pPage, unsigned int ROMPage)
+{
+    const byte* pStarts = m_Cache.GetStarts(ROMPage);
+    if (pStarts == nullptr)
+    {
+        return;
+    }
+
+    for (unsigned int offset = 0; offset < 0x100; offset++)
+    {
+        if (ISBITSET(pStarts[offset >> 3], (offset & 0x07)))
+        {
+            pPage->m_Hits[offset] = JITHotCount - 1;
+        }
+    }
+}
+
+// Puts a CodePage in front of every work RAM page once the first block is translated from there
+void JIT::ProtectCode()
+{
+    if (m_CodePages[0xC0] == nullptr)
+    {
+        for (unsigned int page = 0xC0; page <= 0xFD; page++)
+        {
+            m_CodePages[page] = std::unique_ptr<CodePage>(new CodePage(this));
+            m_pMMU->InstallInterposer(static_cast<ushort>(page << 8), m_CodePages[page].get());
+        }
+    }
+
+    MapWorkRAM();
+}
+
+void JIT::OnCodeWrite(ushort address)
+{
+    const byte* pHost = m_pMMU->GetMemoryBlock(address & 0xFF00);
+    BlockPage* pPage = m_WRAMPages[(pHost - m_pMMU->m_WRAM) >> 8].get();
+    byte offset = address & 0xFF;
+    if ((pPage != nullptr) && ((pPage->m_CodeBytes[offset >> 3] & (1 << (offset & 0x07))) != 0))
+    {
+        Invalidate(pPage);
+        m_Context.isExitForced = 1;
+    }
+}
+
+/*
+    Drops the blocks on a page and those running into it from the page before. Code that keeps
+    rewriting itself would be translated over and over, after JITMaxInvalidations the page is left
+    to the interpreter until the next Flush.
+*/
+void JIT::Invalidate(BlockPage* pPage)
+{
+    std::vector<BlockPage*> dependents;
+    dependents.swap(pPage->m_Dependents);
+    dependents.push_back(pPage);
+    for (BlockPage* pDependent : dependents)
+    {
+        memset(pDependent->m_Code, 0x00, sizeof(pDependent->m_Code));
+        memset(pDependent->m_Hits, 0x00, sizeof(pDependent->m_Hits));
+    }
+
+    if (pPage->m_Invalidations < JITMaxInvalidations)
+    {
+        pPage->m_Invalidations++;
+    }
+
+    if (pPage->m_Invalidations == JITMaxInvalidations)
+    {
+        memset(pPage->m_Hits, JITNeverCount, sizeof(pPage->m_Hits));
+    }
+
+    pPage->m_HasCode = false;
+    memset(pPage->m_CodeBytes, 0x00, sizeof(pPage->m_CodeBytes));
+    MapWorkRAM();
+}
+
+int JIT::GetBudget()
+{
+    return static_cast<int>(std::min(m_pCPU->GetCyclesUntilEvent(), static_cast<unsigned long>(JITMaxRunCycles)));
+}
+
+// Steps the components by the cycles run since they were last stepped
+void JIT::Sync(int budget)
+{
+    int cycles = m_Context.start - budget;
+    if (cycles > 0)
+    {
+        m_pCPU->StepComponents(cycles);
+        m_Synced += cycles;
+    }
+
+    m_Context.start = budget;
+}
+
+/*
+    After the components were stepped, the next event may have moved and an interrupt may be due.
+    Returns the new budget, the run ends after the current instruction if it is 0 or less.
+*/
+int JIT::Restart()
+{
+    if ((m_pCPU->m_IME == 0x01) && ((m_pMMU->m_IE & m_pMMU->m_IF & 0x0F) != 0))
+    {
+        m_Context.isExitForced = 1;
+    }
+
+    m_Context.start = (m_Context.isExitForced != 0) ? 0 : GetBudget();
+    return m_Context.start;
+}
+
+// The budget after an access that did not step the components, 0 to end the run
+int JIT::Finish(int budget)
+{
+    if (m_Context.isExitForced != 0)
+    {
+        // The cycles run so far still have to be stepped
+        m_Context.start -= budget;
+        return 0;
+    }
+
+    return budget;
+}
+
+unsigned int JIT::ReadMemory(Context* pContext, unsigned int address, int budget)
+{
+    JIT* pJIT = pContext->pJIT;
+    if (IsTimed(address))
+    {
+        pJIT->Sync(budget);
+    }
+
+    return pJIT->m_pMMU->Read(static_cast<ushort>(address));
+}
+
+int JIT::WriteMemory(Context* pContext, unsigned int address, unsigned int value, int budget)
+{
+    JIT* pJIT = pContext->pJIT;
+    bool isTimed = IsTimed(address);
+    if (isTimed)
+    {
+        pJIT->Sync(budget);
+    }
+
+    pJIT->m_pMMU->Write(static_cast<ushort>(address), static_cast<byte>(value));
+    if ((address < 0x8000) || (address == 0xFF50) || (address == 0xFF70))
+    {
+        // MBC registers, the boot ROM and SVBK change the memory map
+        pContext->isExitForced = 1;
+    }
+
+    if (address >= 0xFF00)
+    {
+        return pJIT->Restart();
+    }
+
+    return pJIT->Finish(budget);
+}
+
+// Runs one instruction through the interpreter, its cycles are taken off the returned budget
+int JIT::Interpret(Context* pContext, unsigned int address, int budget)
+{
+    JIT* pJIT = pContext->pJIT;
+    CPU* pCPU = pJIT->m_pCPU;
+    pJIT->Sync(budget);
+
+    pCPU->m_AF = pContext->AF;
+    pCPU->m_BC = pContext->BC;
+    pCPU->m_DE = pContext->DE;
+    pCPU->m_HL = pContext->HL;
+    pCPU->m_SP = pContext->SP;
+    pCPU->m_PC = static_cast<ushort>(address);
+    int cycles = static_cast<int>(pCPU->ExecuteInstruction());
+    pContext->AF = pCPU->m_AF;
+    pContext->BC = pCPU->m_BC;
+    pContext->DE = pCPU->m_DE;
+    pContext->HL = pCPU->m_HL;
+    pContext->SP = pCPU->m_SP;
+
+    if (!pJIT->IsMappingCurrent())
+    {
+        pContext->isExitForced = 1;
+    }
+
+    return pJIT->Restart() - cycles;
+}
+
+void JIT::EmitSpill(X64Emitter& e)
+{
+    e.Store(RegContext, -1, offsetof(Context, AF) + 1, RegA, 8);
+    e.Store(RegContext, -1, offsetof(Context, AF), RegF, 8);
+    e.Store(RegContext, -1, offsetof(Context, BC), PairRegisters[0], 16);
+    e.Store(RegContext, -1, offsetof(Context, DE), PairRegisters[1], 16);
+    e.Store(RegContext, -1, offsetof(Context, HL), PairRegisters[2], 16);
+    e.Store(RegContext, -1, offsetof(Context, SP), PairRegisters[3], 16);
+}
+
+void JIT::EmitReload(X64Emitter& e)
+{
+    e.LoadZX8(RegA, RegContext, -1, offsetof(Context, AF) + 1);
+    e.LoadZX8(RegF, RegContext, -1, offsetof(Context, AF));
+    e.LoadZX16(PairRegisters[0], RegContext, offsetof(Context, BC));
+    e.LoadZX16(PairRegisters[1], RegContext, offsetof(Context, DE));
+    e.LoadZX16(PairRegisters[2], RegContext, offsetof(Context, HL));
+    e.LoadZX16(PairRegisters[3], RegContext, offsetof(Context, SP));
+}
+
+// Calls a helper with the context, eax, ecx for a write, and the budget
+void JIT::EmitHelperCall(X64Emitter& e, const void* pHelper, int argumentCount)
+{
+    if (argumentCount == 4)
+    {
+        e.Mov(ArgumentRegisters[2], RCX);
+        e.Mov(ArgumentRegisters[3], RegBudget);
+    }
+    else
+    {
+        e.Mov(ArgumentRegisters[2], RegBudget);
+    }
+
+    e.Mov(ArgumentRegisters[1], RAX);
+    e.Mov(ArgumentRegisters[0], RegContext, 64);
+    e.ALUImm(ALUSub, RSP, StackAdjust, 64);
+    e.MovImm64(RAX, reinterpret_cast<uintptr_t>(pHelper));
+    e.CallReg(RAX);
+    e.ALUImm(ALUAdd, RSP, StackAdjust, 64);
+}
+
+/*
+    The entry and exit of the translated code, the lookup of the next block and the calls out to
+    the helpers. Blocks call the thunks with call, so they keep rsp where the helpers expect it.
+*/
+void JIT::EmitSharedCode()
+{
+    X64Emitter e(m_pCode, m_pCode + JITCodeSize);
+
+    // int Entry(Context* pContext, const void* pCode, int budget)
+    m_pEntry = reinterpret_cast<EntryFunction>(e.GetCurrent());
+    e.Push(RBX);
+    e.Push(RBP);
+    e.Push(R12);
+    e.Push(R13);
+    e.Push(R14);
+    e.Push(R15);
+#if WINDOWS
+    e.Push(RSI);
+    e.Push(RDI);
+#endif
+    e.ALUImm(ALUSub, RSP, StackAdjust, 64);
+    e.Mov(RegContext, ArgumentRegisters[0], 64);
+    e.Mov(RAX, ArgumentRegisters[1], 64);
+    e.Mov(RegBudget, ArgumentRegisters[2]);
+    EmitReload(e);
+    e.JmpReg(RAX);
+
+    m_pExit = e.GetCurrent();
+    e.Store(RegContext, -1, offsetof(Context, PC), RAX, 16);
+    EmitSpill(e);
+    e.Mov(RAX, RegBudget);
+    e.ALUImm(ALUAdd, RSP, StackAdjust, 64);
+#if WINDOWS
+    e.Pop(RDI);
+    e.Pop(RSI);
+#endif
+    e.Pop(R15);
+    e.Pop(R14);
+    e.Pop(R13);
+    e.Pop(R12);
+    e.Pop(RBP);
+    e.Pop(RBX);
+    e.Ret();
+
+    m_pDispatch = e.GetCurrent();
+    e.Mov(RDX, RAX);
+    e.Shift(ShiftShr, RDX, 8);
+    e.LoadIndexed(RDX, RegContext, RDX, 8, offsetof(Context, blockPages));
+    e.Test(RDX, RDX, 64);
+    e.JccTo(CondZ, m_pExit);
+    e.MovZX8(RCX, RAX);
+    e.LoadIndexed(RDX, RDX, RCX, 8, 0);
+    e.Test(RDX, RDX, 64);
+    e.JccTo(CondZ, m_pExit);
+    e.JmpReg(RDX);
+
+    // HRAM is plain memory and accessed a lot, the thunks handle it without leaving
+    m_pReadThunk = e.GetCurrent();
+    e.Lea(RDX, RAX, -0xFF80);
+    e.ALUImm(ALUCmp, RDX, HRAMSize);
+    byte* pSlowRead = e.Jcc(CondAE);
+    e.Load(RCX, RegContext, offsetof(Context, pHRAM), 64);
+    e.LoadZX8(RCX, RCX, RDX, 0);
+    e.Ret();
+    e.Bind(pSlowRead);
+    EmitSpill(e);
+    EmitHelperCall(e, reinterpret_cast<const void*>(&JIT::ReadMemory), 3);
+    e.Mov(RCX, RAX);
+    EmitReload(e);
+    e.Ret();
+
+    m_pWriteThunk = e.GetCurrent();
+    e.Lea(RDX, RAX, -0xFF80);
+    e.ALUImm(ALUCmp, RDX, HRAMSize);
+    byte* pSlowWrite = e.Jcc(CondAE);
+    e.Load(R8, RegContext, offsetof(Context, pHRAM), 64);
+    e.Store(R8, RDX, 0, RCX, 8);
+    e.Ret();
+    e.Bind(pSlowWrite);
+    EmitSpill(e);
+    EmitHelperCall(e, reinterpret_cast<const void*>(&JIT::WriteMemory), 4);
+    e.Mov(RegBudget, RAX);
+    EmitReload(e);
+    e.Ret();
+
+    m_pInterpretThunk = e.GetCurrent();
+    EmitSpill(e);
+    EmitHelperCall(e, reinterpret_cast<const void*>(&JIT::Interpret), 3);
+    e.Mov(RegBudget, RAX);
+    EmitReload(e);
+    e.Ret();
+
+    // Blocks start on a fresh cache line
+    m_pBlocks = m_pCode + ((e.GetCurrent() - m_pCode + 63) & ~63);
+    m_pFree = m_pBlocks;
+}
+
+/*
+    Translates the block starting at address, nullptr if not even its first instruction can be. The
+    blocks it leads to that are one visit from getting hot are translated along with it, so the
+    code memory is made writable and executable again once for all of them.
+*/
+void* JIT::Compile(ushort address)
+{
+    size_t batchSize = JITBatchBlocks * JITBlockReserve;
+    if (m_pFree + batchSize > m_pCode + JITCodeSize)
+    {
+        Flush();
+    }
+
+    // Only the room for the batch is opened up, and only while it is written
+    byte* pBatch = m_pFree;
+    if (!SetCodeWritable(pBatch, batchSize, true))
+    {
+        return nullptr;
+    }
+
+    void* pCode = Translate(address);
+    std::vector<ushort> pending;
+    if (pCode != nullptr)
+    {
+        pending = m_Successors;
+    }
+
+    int count = 1;
+    for (size_t index = 0; (index < pending.size()) && (count < JITBatchBlocks); index++)
+    {
+        ushort target = pending[index];
+        BlockPage* pPage = m_Context.blockPages[target >> 8];
+        if ((pPage == nullptr) || (pPage->m_Code[target & 0xFF] != nullptr) || (pPage->m_Hits[target & 0xFF] != JITHotCount - 1))
+        {
+            continue;
+        }
+
+        if (Translate(target) == nullptr)
+        {
+            pPage->m_Hits[target & 0xFF] = JITNeverCount;
+            continue;
+        }
+
+        pending.insert(pending.end(), m_Successors.begin(), m_Successors.end());
+        count++;
+    }
+
+    if (!SetCodeWritable(pBatch, batchSize, false))
+    {
+        return nullptr;
+    }
+
+    return pCode;
+}
+
+/*
+    Makes the pages of pStart to pStart + size writable, or executable again. The code memory is
+    never both, so a stray write can not turn into code.
+*/
+bool JIT::SetCodeWritable(byte* pStart, size_t size, bool isWritable)
+{
+    uintptr_t start = reinterpret_cast<uintptr_t>(pStart) & ~static_cast<uintptr_t>(JITPageSize - 1);
+    uintptr_t end = std::min(reinterpret_cast<uintptr_t>(pStart + size), reinterpret_cast<uintptr_t>(m_pCode + JITCodeSize));
+    size_t length = ((end - start) + JITPageSize - 1) & ~static_cast<size_t>(JITPageSize - 1);
+
+#if WINDOWS
+    DWORD oldProtection;
+    bool result = VirtualProtect(reinterpret_cast<void*>(start), length, isWritable ? PAGE_READWRITE : PAGE_EXECUTE_READ, &oldProtection) != FALSE;
+    if (result && !isWritable)
+    {
+        FlushInstructionCache(GetCurrentProcess(), reinterpret_cast<void*>(start), length);
+    }
+#else
+    bool result = mprotect(reinterpret_cast<void*>(start), length, isWritable ? (PROT_READ | PROT_WRITE) : (PROT_READ | PROT_EXEC)) == 0;
+#endif
+    if (!result)
+    {
+        Logger::LogError("JIT: Could not change the protection of the code memory");
+    }
+
+    return result;
+}
+
+void* JIT::Translate(ushort address)
+{
+    X64Emitter e(m_pFree, m_pFree + JITBlockReserve);
+    m_BlockStart = address;
+    m_pBlockCode = e.GetCurrent();
+    m_Exits.clear();
+    m_SlowPaths.clear();
+    m_SlowThunks.clear();
+    m_Successors.clear();
+
+    int region = GetRegion(address >> 8);
+    std::vector<const byte*> hostPages;
+    ushort pc = address;
+    int count = 0;
+    bool isEnded = false;
+    while (!isEnded && (count < JITMaxBlockInstructions))
+    {
+        byte bytes[3] = { 0x00, 0x00, 0x00 };
+        const byte* pHostPage = nullptr;
+        if (!Fetch(pc, region, bytes[0], pHostPage))
+        {
+            break;
+        }
+
+        if (std::find(hostPages.begin(), hostPages.end(), pHostPage) == hostPages.end())
+        {
+            hostPages.push_back(pHostPage);
+        }
+
+        // Left to the interpreter between runs: interrupts, halting and opcodes that do not exist
+        byte opCode = bytes[0];
+        if ((opCode == 0x10) || (opCode == 0x76) || (opCode == 0xD9) || (opCode == 0xF3) || (opCode == 0xFB) ||
+            (CPU::m_operationMap[opCode] == nullptr))
+        {
+            break;
+        }
+
+        int length = GetInstructionLength(opCode);
+        bool isFetched = true;
+        for (int index = 1; (index < length) && isFetched; index++)
+        {
+            isFetched = Fetch(static_cast<ushort>(pc + index), region, bytes[index], pHostPage);
+            if (isFetched && (std::find(hostPages.begin(), hostPages.end(), pHostPage) == hostPages.end()))
+            {
+                hostPages.push_back(pHostPage);
+            }
+        }
+
+        if (!isFetched)
+        {
+            break;
+        }
+
+        ushort next = static_cast<ushort>(pc + length);
+        isEnded = EmitInstruction(e, pc, bytes, next);
+        pc = next;
+        count++;
+    }
+
+    if (count == 0)
+    {
+        return nullptr;
+    }
+
+    if (!isEnded)
+    {
+        e.MovImm(RAX, pc);
+        e.JmpTo(m_pDispatch);
+        m_Successors.push_back(pc);
+    }
+
+    for (const std::pair<byte*, ushort>& exit : m_Exits)
+    {
+        e.Bind(exit.first);
+        e.MovImm(RAX, exit.second);
+        e.JmpTo(m_pExit);
+    }
+
+    for (size_t index = 0; index < m_SlowPaths.size(); index++)
+    {
+        e.Bind(m_SlowPaths[index].first);
+        e.CallTo(m_SlowThunks[index]);
+        e.JmpTo(m_SlowPaths[index].second);
+    }
+
+    if (e.IsFull())
+    {
+        Logger::LogError("JIT: The block at 0x%04X does not fit", address);
+        return nullptr;
+    }
+
+    m_pFree = m_pBlockCode + ((e.GetCurrent() - m_pBlockCode + 15) & ~15);
+
+    BlockPage* pStart = GetBlockPage(hostPages[0]);
+    pStart->m_Code[address & 0xFF] = m_pBlockCode;
+    if (region < 2)
+    {
+        m_Cache.Record((hostPages[0] - m_pROM) + (address & 0xFF));
+    }
+    else
+    {
+        for (const byte* pHostPage : hostPages)
+        {
+            BlockPage* pPage = GetBlockPage(pHostPage);
+            pPage->m_HasCode = true;
+            if (pPage != pStart)
+            {
+                pPage->m_Dependents.push_back(pStart);
+            }
+        }
+
+        // Only writes to these bytes drop the blocks, the rest of the page may well be data
+        for (ushort code = address; code != pc; code++)
+        {
+            unsigned int page = code >> 8;
+            byte offset = code & 0xFF;
+            BlockPage* pPage = GetBlockPage(reinterpret_cast<const byte*>(m_Context.readPages[page] + (page << 8)));
+            pPage->m_CodeBytes[offset >> 3] |= 1 << (offset & 0x07);
+        }
+
+        ProtectCode();
+    }
+
+    return m_pBlockCode;
+}
+
+bool JIT::Fetch(ushort address, int region, byte& value, const byte*& pHostPage)
+{
+    unsigned int page = address >> 8;
+    if ((GetRegion(page) != region) || (m_Context.readPages[page] == 0))
+    {
+        return false;
+    }
+
+    // Blocks do not run on into a page that is left to the interpreter
+    BlockPage* pPage = m_Context.blockPages[page];
+    if ((pPage != nullptr) && (pPage->m_Invalidations == JITMaxInvalidations))
+    {
+        return false;
+    }
+
+    pHostPage = reinterpret_cast<const byte*>(m_Context.readPages[page] + (page << 8));
+    value = pHostPage[address & 0xFF];
+    return true;
+}
+
+// Takes the cycles off the budget and leaves with PC = next once it runs out
+void JIT::EmitCycles(X64Emitter& e, int cycles, ushort next)
+{
+    e.ALUImm(ALUSub, RegBudget, cycles);
+    m_Exits.push_back(std::make_pair(e.Jcc(CondLE), next));
+}
+
+// A taken jump: leaves if the budget ran out, otherwise goes on to the target's block
+void JIT::EmitBranch(X64Emitter& e, int cycles, ushort target)
+{
+    e.ALUImm(ALUSub, RegBudget, cycles);
+    e.MovImm(RAX, target);
+    e.JccTo(CondLE, m_pExit);
+    e.JmpTo((target == m_BlockStart) ? m_pBlockCode : m_pDispatch);
+    m_Successors.push_back(target);
+}
+
+// Skips the taken path unless condition cc (NZ, Z, NC, C) holds, returns the jump to Bind
+byte* JIT::EmitCondition(X64Emitter& e, int condition)
+{
+    e.TestImm(RegF, (condition < 2) ? 0x80 : 0x10, 8);
+    return e.Jcc(((condition & 0x01) != 0) ? CondZ : CondNZ);
+}
+
+// eax = address, the value ends up in ecx
+void JIT::EmitRead(X64Emitter& e)
+{
+    e.Mov(RDX, RAX);
+    e.Shift(ShiftShr, RDX, 8);
+    e.LoadIndexed(RDX, RegContext, RDX, 8, offsetof(Context, readPages));
+    e.Test(RDX, RDX, 64);
+    byte* pSlow = e.Jcc(CondZ);
+    e.LoadZX8(RCX, RDX, RAX, 0);
+    m_SlowPaths.push_back(std::make_pair(pSlow, e.GetCurrent()));
+    m_SlowThunks.push_back(m_pReadThunk);
+}
+
+// eax = address, ecx = value
+void JIT::EmitWrite(X64Emitter& e)
+{
+    e.Mov(RDX, RAX);
+    e.Shift(ShiftShr, RDX, 8);
+    e.LoadIndexed(RDX, RegContext, RDX, 8, offsetof(Context, writePages));
+    e.Test(RDX, RDX, 64);
+    byte* pSlow = e.Jcc(CondZ);
+    e.Store(RDX, RAX, 0, RCX, 8);
+    m_SlowPaths.push_back(std::make_pair(pSlow, e.GetCurrent()));
+    m_SlowThunks.push_back(m_pWriteThunk);
+}
+
+/*
+    LY, STAT and IF only change at an event, and a run never gets past the next one (see Run), so
+    polling them does not have to step the components first. The memory they are read from, nullptr
+    for any other register.
+*/
+const byte* JIT::GetStableRegister(ushort address)
+{
+    switch (address)
+    {
+    case LCDControllerYCoordinate:
+        return &m_pCPU->m_GPU->m_LCDControllerYCoordinate;
+    case LCDControllerStatus:
+        return &m_pCPU->m_GPU->m_LCDControllerStatus;
+    case 0xFF0F:
+        return &m_pMMU->m_IF;
+    default:
+        return nullptr;
+    }
+}
+
+void JIT::EmitReadConstant(X64Emitter& e, ushort address)
+{
+    if ((address >= 0xFF80) && (address < 0xFFFF))
+    {
+        e.Load(RDX, RegContext, offsetof(Context, pHRAM), 64);
+        e.LoadZX8(RCX, RDX, -1, address - 0xFF80);
+        return;
+    }
+
+    const byte* pRegister = GetStableRegister(address);
+    if (pRegister != nullptr)
+    {
+        e.MovImm64(RDX, reinterpret_cast<uintptr_t>(pRegister));
+        e.LoadZX8(RCX, RDX, -1, 0);
+        return;
+    }
+
+    e.MovImm(RAX, address);
+    if (address >= 0xFE00)
+    {
+        e.CallTo(m_pReadThunk);
+    }
+    else
+    {
+        EmitRead(e);
+    }
+}
+
+void JIT::EmitWriteConstant(X64Emitter& e, ushort address)
+{
+    if ((address >= 0xFF80) && (address < 0xFFFF))
+    {
+        e.Load(RDX, RegContext, offsetof(Context, pHRAM), 64);
+        e.Store(RDX, -1, address - 0xFF80, RCX, 8);
+        return;
+    }
+
+    e.MovImm(RAX, address);
+    if (address >= 0xFE00)
+    {
+        e.CallTo(m_pWriteThunk);
+    }
+    else
+    {
+        EmitWrite(e);
+    }
+}
+
+// Pushes register pair source (BC, DE, HL, AF), or value if source is negative
+void JIT::EmitPush(X64Emitter& e, int source, ushort value)
+{
+    for (int half = 1; half >= 0; half--)
+    {
+        e.Lea(PairRegisters[3], PairRegisters[3], -1);
+        e.MovZX16(PairRegisters[3], PairRegisters[3]);
+        if (source < 0)
+        {
+            e.MovImm(RCX, (half != 0) ? (value >> 8) : (value & 0xFF));
+        }
+        else if (source == 3)
+        {
+            e.Mov(RCX, (half != 0) ? RegA : RegF);
+        }
+        else if (half != 0)
+        {
+            e.Mov(RCX, PairRegisters[source]);
+            e.Shift(ShiftShr, RCX, 8);
+        }
+        else
+        {
+            e.MovZX8(RCX, PairRegisters[source]);
+        }
+
+        e.Mov(RAX, PairRegisters[3]);
+        EmitWrite(e);
+    }
+}
+
+// The popped value ends up in eax
+void JIT::EmitPop(X64Emitter& e)
+{
+    e.Lea(RAX, PairRegisters[3], 1);
+    e.MovZX16(RAX, RAX);
+    EmitRead(e);
+    e.Store(RegContext, -1, offsetof(Context, scratch), RCX, 32);
+    e.Mov(RAX, PairRegisters[3]);
+    EmitRead(e);
+    e.Load(RAX, RegContext, offsetof(Context, scratch));
+    e.Shift(ShiftShl, RAX, 8);
+    e.ALU(ALUOr, RAX, RCX);
+    e.Lea(PairRegisters[3], PairRegisters[3], 2);
+    e.MovZX16(PairRegisters[3], PairRegisters[3]);
+}
+
+/*
+    F from the flags of the x86 instruction just run: Z, H and C through mask, or'ed with set and
+    the bits of the old F in keep.
+*/
+void JIT::EmitFlags(X64Emitter& e, int mask, int set, int keep)
+{
+    e.Lahf();
+    e.MovZXAH();
+    e.LoadZX8(RAX, RegContext, RAX, offsetof(Context, flags));
+    if (mask != 0xB0)
+    {
+        e.ALUImm(ALUAnd, RAX, mask);
+    }
+
+    if (keep != 0)
+    {
+        e.ALUImm(ALUAnd, RegF, keep);
+        e.ALU(ALUOr, RegF, RAX);
+    }
+    else
+    {
+        e.Mov(RegF, RAX);
+    }
+
+    if (set != 0)
+    {
+        e.ALUImm(ALUOr, RegF, set);
+    }
+}
+
+// F = Z from the x86 zero flag, or'ed with set
+void JIT::EmitZeroFlag(X64Emitter& e, int set)
+{
+    e.SetCC(CondZ, RAX);
+    e.MovZX8(RegF, RAX);
+    e.Shift(ShiftShl, RegF, 7);
+    if (set != 0)
+    {
+        e.ALUImm(ALUOr, RegF, set);
+    }
+}
+
+// ADD, ADC, SUB, SBC, AND, XOR, OR, CP of A and ecx
+void JIT::EmitALU(X64Emitter& e, int operation)
+{
+    switch (operation)
+    {
+    case 0:
+    case 1:
+    case 2:
+    case 3:
+    case 7:
+    {
+        static const int operations[8] = { ALUAdd, ALUAdc, ALUSub, ALUSbb, 0, 0, 0, ALUCmp };
+        if ((operation == 1) || (operation == 3))
+        {
+            e.BitTest(RegF, 4);
+        }
+
+        e.Mov(RAX, RegA);
+        e.ALU(operations[operation], RAX, RCX, 8);
+        if (operation != 7)
+        {
+            e.MovZX8(RegA, RAX);
+        }
+
+        EmitFlags(e, 0xB0, (operation >= 2) ? 0x40 : 0x00, 0x00);
+        break;
+    }
+    case 4:
+        e.ALU(ALUAnd, RegA, RCX);
+        EmitZeroFlag(e, 0x20);
+        break;
+    case 5:
+        e.ALU(ALUXor, RegA, RCX);
+        EmitZeroFlag(e, 0x00);
+        break;
+    case 6:
+        e.ALU(ALUOr, RegA, RCX);
+        EmitZeroFlag(e, 0x00);
+        break;
+    }
+}
+
+// RLC, RRC, RL, RR, SLA, SRA, SWAP, SRL of cl, with Z and C
+void JIT::EmitRotate(X64Emitter& e, int operation)
+{
+    static const int operations[8] = { ShiftRol, ShiftRor, ShiftRcl, ShiftRcr, ShiftShl, ShiftSar, ShiftRol, ShiftShr };
+    if ((operation == 2) || (operation == 3))
+    {
+        e.BitTest(RegF, 4);
+    }
+
+    e.Shift(operations[operation], RCX, (operation == 6) ? 4 : 1, 8);
+    if (operation == 6)
+    {
+        e.Test(RCX, RCX, 8);
+        EmitZeroFlag(e, 0x00);
+        return;
+    }
+
+    e.SetCC(CondB, RAX);
+    e.Test(RCX, RCX, 8);
+    e.SetCC(CondZ, RDX);
+    e.MovZX8(RegF, RAX);
+    e.Shift(ShiftShl, RegF, 4);
+    e.MovZX8(RDX, RDX);
+    e.Shift(ShiftShl, RDX, 7);
+    e.ALU(ALUOr, RegF, RDX);
+}
+
+void JIT::EmitInterpret(X64Emitter& e, ushort address, ushort next)
+{
+    e.MovImm(RAX, address);
+    e.CallTo(m_pInterpretThunk);
+    e.Test(RegBudget, RegBudget);
+    m_Exits.push_back(std::make_pair(e.Jcc(CondLE), next));
+}
+
+// Translates the instruction at address, returns true if it ends the block
+bool JIT::EmitInstruction(X64Emitter& e, ushort address, const byte* pBytes, ushort next)
+{
+    byte opCode = pBytes[0];
+    byte n = pBytes[1];
+    ushort nn = pBytes[1] | (pBytes[2] << 8);
+    int r = (opCode >> 3) & 0x07;
+    int source = opCode & 0x07;
+    int pair = PairRegisters[(opCode >> 4) & 0x03];
+    int condition = (opCode >> 3) & 0x03;
+
+    // LD r, r'
+    if ((opCode >= 0x40) && (opCode <= 0x7F))
+    {
+        if (r == 6)
+        {
+            LoadRegister(e, RCX, source);
+            e.Mov(RAX, PairRegisters[2]);
+            EmitWrite(e);
+        }
+        else if (source == 6)
+        {
+            e.Mov(RAX, PairRegisters[2]);
+            EmitRead(e);
+            StoreRegister(e, r, RCX);
+        }
+        else if (r != source)
+        {
+            LoadRegister(e, RCX, source);
+            StoreRegister(e, r, RCX);
+        }
+
+        EmitCycles(e, ((r == 6) || (source == 6)) ? 8 : 4, next);
+        return false;
+    }
+
+    // ALU A, r
+    if ((opCode >= 0x80) && (opCode <= 0xBF))
+    {
+        if (opCode == 0x96)
+        {
+            // SUB (HL) has its own flags in the interpreter
+            EmitInterpret(e, address, next);
+            return false;
+        }
+
+        if (source == 6)
+        {
+            e.Mov(RAX, PairRegisters[2]);
+            EmitRead(e);
+        }
+        else
+        {
+            LoadRegister(e, RCX, source);
+        }
+
+        EmitALU(e, r);
+        EmitCycles(e, (source == 6) ? 8 : 4, next);
+        return false;
+    }
+
+    switch (opCode)
+    {
+    case 0x00:
+        EmitCycles(e, 4, next);
+        return false;
+
+    // LD rr, nn
+    case 0x01: case 0x11: case 0x21: case 0x31:
+        e.MovImm(pair, nn);
+        EmitCycles(e, 12, next);
+        return false;
+
+    // LD (BC), A; LD (DE), A; LD (HL+), A; LD (HL-), A
+    case 0x02: case 0x12: case 0x22: case 0x32:
+        e.Mov(RAX, (opCode >= 0x22) ? PairRegisters[2] : pair);
+        e.Mov(RCX, RegA);
+        EmitWrite(e);
+        if (opCode >= 0x22)
+        {
+            e.Lea(PairRegisters[2], PairRegisters[2], (opCode == 0x22) ? 1 : -1);
+            e.MovZX16(PairRegisters[2], PairRegisters[2]);
+        }
+
+        EmitCycles(e, 8, next);
+        return false;
+
+    // LD A, (BC); LD A, (DE); LD A, (HL+); LD A, (HL-)
+    case 0x0A: case 0x1A: case 0x2A: case 0x3A:
+        e.Mov(RAX, (opCode >= 0x2A) ? PairRegisters[2] : pair);
+        EmitRead(e);
+        e.MovZX8(RegA, RCX);
+        if (opCode >= 0x2A)
+        {
+            e.Lea(PairRegisters[2], PairRegisters[2], (opCode == 0x2A) ? 1 : -1);
+            e.MovZX16(PairRegisters[2], PairRegisters[2]);
+        }
+
+        EmitCycles(e, 8, next);
+        return false;
+
+    // INC rr, DEC rr
+    case 0x03: case 0x13: case 0x23: case 0x33:
+    case 0x0B: case 0x1B: case 0x2B: case 0x3B:
+        e.Lea(pair, pair, ((opCode & 0x08) != 0) ? -1 : 1);
+        e.MovZX16(pair, pair);
+        EmitCycles(e, 8, next);
+        return false;
+
+    // INC r, DEC r
+    case 0x04: case 0x0C: case 0x14: case 0x1C: case 0x24: case 0x2C: case 0x34: case 0x3C:
+    case 0x05: case 0x0D: case 0x15: case 0x1D: case 0x25: case 0x2D: case 0x35: case 0x3D:
+    {
+        bool isDecrement = (opCode & 0x01) != 0;
+        if (r == 6)
+        {
+            e.Mov(RAX, PairRegisters[2]);
+            EmitRead(e);
+        }
+        else
+        {
+            LoadRegister(e, RCX, r);
+        }
+
+        e.IncDec8(isDecrement, RCX);
+        EmitFlags(e, 0xA0, isDecrement ? 0x40 : 0x00, 0x10);
+        if (r == 6)
+        {
+            e.Mov(RAX, PairRegisters[2]);
+            EmitWrite(e);
+        }
+        else
+        {
+            StoreRegister(e, r, RCX);
+        }
+
+        EmitCycles(e, (r == 6) ? 12 : 4, next);
+        return false;
+    }
+
+    // LD r, n
+    case 0x06: case 0x0E: case 0x16: case 0x1E: case 0x26: case 0x2E: case 0x36: case 0x3E:
+        e.MovImm(RCX, n);
+        if (r == 6)
+        {
+            e.Mov(RAX, PairRegisters[2]);
+            EmitWrite(e);
+        }
+        else
+        {
+            StoreRegister(e, r, RCX);
+        }
+
+        EmitCycles(e, (r == 6) ? 12 : 8, next);
+        return false;
+
+    // RLCA, RRCA, RLA, RRA
+    case 0x07: case 0x0F: case 0x17: case 0x1F:
+    {
+        static const int operations[4] = { ShiftRol, ShiftRor, ShiftRcl, ShiftRcr };
+        if (opCode >= 0x17)
+        {
+            e.BitTest(RegF, 4);
+        }
+
+        e.Mov(RCX, RegA);
+        e.Shift(operations[r], RCX, 1, 8);
+        e.SetCC(CondB, RAX);
+        e.MovZX8(RegA, RCX);
+        e.MovZX8(RegF, RAX);
+        e.Shift(ShiftShl, RegF, 4);
+        EmitCycles(e, 4, next);
+        return false;
+    }
+
+    // ADD HL, rr
+    case 0x09: case 0x19: case 0x29: case 0x39:
+        e.Mov(RAX, PairRegisters[2]);
+        e.ALU(ALUAdd, RAX, pair);
+        e.Mov(RDX, RAX);
+        e.ALU(ALUXor, RDX, PairRegisters[2]);
+        e.ALU(ALUXor, RDX, pair);
+        e.ALUImm(ALUAnd, RDX, 0x1000);
+        e.Shift(ShiftShr, RDX, 7);
+        e.Mov(RCX, RAX);
+        e.Shift(ShiftShr, RCX, 12);
+        e.ALUImm(ALUAnd, RCX, 0x10);
+        e.ALUImm(ALUAnd, RegF, 0x80);
+        e.ALU(ALUOr, RegF, RDX);
+        e.ALU(ALUOr, RegF, RCX);
+        e.MovZX16(PairRegisters[2], RAX);
+        EmitCycles(e, 8, next);
+        return false;
+
+    // JR e
+    case 0x18:
+        EmitBranch(e, 12, static_cast<ushort>(next + static_cast<signed char>(n)));
+        return true;
+
+    // JR cc, e
+    case 0x20: case 0x28: case 0x30: case 0x38:
+    {
+        byte* pNotTaken = EmitCondition(e, condition);
+        EmitBranch(e, 12, static_cast<ushort>(next + static_cast<signed char>(n)));
+        e.Bind(pNotTaken);
+        EmitCycles(e, 8, next);
+        return false;
+    }
+
+    // CPL, SCF, CCF
+    case 0x2F:
+        e.ALUImm(ALUXor, RegA, 0xFF);
+        e.ALUImm(ALUOr, RegF, 0x60);
+        e.ALUImm(ALUAnd, RegF, 0xF0);
+        EmitCycles(e, 4, next);
+        return false;
+    case 0x37:
+        e.ALUImm(ALUAnd, RegF, 0x80);
+        e.ALUImm(ALUOr, RegF, 0x10);
+        EmitCycles(e, 4, next);
+        return false;
+    case 0x3F:
+        e.ALUImm(ALUAnd, RegF, 0x90);
+        e.ALUImm(ALUXor, RegF, 0x10);
+        EmitCycles(e, 4, next);
+        return false;
+
+    // RET cc
+    case 0xC0: case 0xC8: case 0xD0: case 0xD8:
+    {
+        byte* pNotTaken = EmitCondition(e, condition);
+        EmitPop(e);
+        e.ALUImm(ALUSub, RegBudget, 20);
+        e.JccTo(CondLE, m_pExit);
+        e.JmpTo(m_pDispatch);
+        e.Bind(pNotTaken);
+        EmitCycles(e, 8, next);
+        return false;
+    }
+
+    // RET
+    case 0xC9:
+        EmitPop(e);
+        e.ALUImm(ALUSub, RegBudget, 16);
+        e.JccTo(CondLE, m_pExit);
+        e.JmpTo(m_pDispatch);
+        return true;
+
+    // POP rr
+    case 0xC1: case 0xD1: case 0xE1: case 0xF1:
+        EmitPop(e);
+        if (opCode == 0xF1)
+        {
+            e.MovZX8(RegF, RAX);
+            e.ALUImm(ALUAnd, RegF, 0xF0);
+            e.Shift(ShiftShr, RAX, 8);
+            e.Mov(RegA, RAX);
+        }
+        else
+        {
+            e.Mov(pair, RAX);
+        }
+
+        EmitCycles(e, 12, next);
+        return false;
+
+    // PUSH rr
+    case 0xC5: case 0xD5: case 0xE5: case 0xF5:
+        EmitPush(e, (opCode >> 4) & 0x03, 0);
+        EmitCycles(e, 16, next);
+        return false;
+
+    // JP cc, nn
+    case 0xC2: case 0xCA: case 0xD2: case 0xDA:
+    {
+        byte* pNotTaken = EmitCondition(e, condition);
+        EmitBranch(e, 16, nn);
+        e.Bind(pNotTaken);
+        EmitCycles(e, 12, next);
+        return false;
+    }
+
+    // JP nn
+    case 0xC3:
+        EmitBranch(e, 16, nn);
+        return true;
+
+    // CALL cc, nn
+    case 0xC4: case 0xCC: case 0xD4: case 0xDC:
+    {
+        byte* pNotTaken = EmitCondition(e, condition);
+        EmitPush(e, -1, next);
+        EmitBranch(e, 24, nn);
+        e.Bind(pNotTaken);
+        EmitCycles(e, 12, next);
+        return false;
+    }
+
+    // CALL nn
+    case 0xCD:
+        EmitPush(e, -1, next);
+        EmitBranch(e, 24, nn);
+        return true;
+
+    // RST n
+    case 0xC7: case 0xCF: case 0xD7: case 0xDF: case 0xE7: case 0xEF: case 0xF7: case 0xFF:
+        EmitPush(e, -1, next);
+        EmitBranch(e, 16, opCode & 0x38);
+        return true;
+
+    // ALU A, n
+    case 0xC6: case 0xCE: case 0xD6: case 0xDE: case 0xE6: case 0xEE: case 0xF6: case 0xFE:
+        e.MovImm(RCX, n);
+        EmitALU(e, r);
+        EmitCycles(e, 8, next);
+        return false;
+
+    case 0xCB:
+        EmitCB(e, n, next);
+        return false;
+
+    // LDH (n), A; LDH A, (n); LD (C), A; LD A, (C); LD (nn), A; LD A, (nn)
+    case 0xE0:
+        e.Mov(RCX, RegA);
+        EmitWriteConstant(e, 0xFF00 | n);
+        EmitCycles(e, 12, next);
+        return false;
+    case 0xF0:
+        EmitReadConstant(e, 0xFF00 | n);
+        e.MovZX8(RegA, RCX);
+        EmitCycles(e, 12, next);
+        return false;
+    case 0xE2:
+        e.MovZX8(RAX, PairRegisters[0]);
+        e.ALUImm(ALUOr, RAX, 0xFF00);
+        e.Mov(RCX, RegA);
+        e.CallTo(m_pWriteThunk);
+        EmitCycles(e, 8, next);
+        return false;
+    case 0xF2:
+        e.MovZX8(RAX, PairRegisters[0]);
+        e.ALUImm(ALUOr, RAX, 0xFF00);
+        e.CallTo(m_pReadThunk);
+        e.MovZX8(RegA, RCX);
+        EmitCycles(e, 8, next);
+        return false;
+    case 0xEA:
+        e.Mov(RCX, RegA);
+        EmitWriteConstant(e, nn);
+        EmitCycles(e, 16, next);
+        return false;
+    case 0xFA:
+        EmitReadConstant(e, nn);
+        e.MovZX8(RegA, RCX);
+        EmitCycles(e, 16, next);
+        return false;
+
+    // JP HL
+    case 0xE9:
+        e.Mov(RAX, PairRegisters[2]);
+        e.ALUImm(ALUSub, RegBudget, 4);
+        e.JccTo(CondLE, m_pExit);
+        e.JmpTo(m_pDispatch);
+        return true;
+
+    // LD SP, HL
+    case 0xF9:
+        e.Mov(PairRegisters[3], PairRegisters[2]);
+        EmitCycles(e, 8, next);
+        return false;
+
+    // DAA, LD (nn), SP, ADD SP, e, LD HL, SP + e
+    default:
+        EmitInterpret(e, address, next);
+        return false;
+    }
+}
+
+void JIT::EmitCB(X64Emitter& e, byte opCode, ushort next)
+{
+    int r = opCode & 0x07;
+    int bit = (opCode >> 3) & 0x07;
+    int group = opCode >> 6;
+
+    if (r == 6)
+    {
+        e.Mov(RAX, PairRegisters[2]);
+        EmitRead(e);
+        if (group == 1)
+        {
+            e.TestImm(RCX, 1 << bit, 8);
+            EmitBitFlags(e);
+            EmitCycles(e, 12, next);
+            return;
+        }
+
+        if (group == 0)
+        {
+            EmitRotate(e, bit);
+        }
+        else
+        {
+            e.ALUImm((group == 2) ? ALUAnd : ALUOr, RCX, (group == 2) ? ~(1 << bit) & 0xFF : (1 << bit), 8);
+        }
+
+        e.Mov(RAX, PairRegisters[2]);
+        EmitWrite(e);
+        EmitCycles(e, 16, next);
+        return;
+    }
+
+    if (group == 0)
+    {
+        LoadRegister(e, RCX, r);
+        EmitRotate(e, bit);
+        StoreRegister(e, r, RCX);
+    }
+    else
+    {
+        // The bit in the host register, high registers are the high byte of their pair
+        int reg = (r == 7) ? RegA : PairRegisters[r >> 1];
+        int mask = ((r == 7) || ((r & 0x01) != 0)) ? (1 << bit) : (1 << (bit + 8));
+        if (group == 1)
+        {
+            e.TestImm(reg, mask);
+            EmitBitFlags(e);
+        }
+        else if (group == 2)
+        {
+            e.ALUImm(ALUAnd, reg, ~mask & 0xFFFF);
+        }
+        else
+        {
+            e.ALUImm(ALUOr, reg, mask);
+        }
+    }
+
+    EmitCycles(e, 8, next);
+}
+
+// BIT: Z from the x86 zero flag, H set, C kept
+void JIT::EmitBitFlags(X64Emitter& e)
+{
+    e.SetCC(CondZ, RAX);
+    e.MovZX8(RAX, RAX);
+    e.Shift(ShiftShl, RAX, 7);
+    e.ALUImm(ALUAnd, RegF, 0x10);
+    e.ALU(ALUOr, RegF, RAX);
+    e.ALUImm(ALUOr, RegF, 0x20);
+}
+
+#else
+
+JIT::JIT(CPU* pCPU, MMU* pMMU) :
+    m_pCPU(pCPU),
+    m_pMMU(pMMU)
+{
+}
+
+JIT::~JIT()
+{
+}
+
+bool JIT::Initialize()
+{
+    Logger::LogError("JIT: Only x86-64 hosts are supported");
+    return false;
+}
+
+unsigned long JIT::Run()
+{
+    return 0;
+}
+
+void JIT::Flush()
+{
+}
+
+void JIT::OnCodeWrite(ushort address)
+{
+}
+
+#endif
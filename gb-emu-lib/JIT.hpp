@@ -0,0 +1,205 @@
+#pragma once
+
+#include "CPU.hpp"
+#include "JITCache.hpp"
+
+#include <vector>
+
+#if defined(__x86_64__) || defined(_M_X64)
+    #define JIT_X64 1
+#endif
+
+// Bump when the translator changes where blocks start or end, it invalidates the JIT cache entries
+#define JITTranslatorVersion    1
+
+#define JITCodeSize             (8 * 1024 * 1024)   // Flushed and started over when full
+#define JITBlockReserve         0x10000             // Room left for one block before it is translated
+#define JITBatchBlocks          8                   // Blocks translated at most while the code memory is writable
+#define JITPageSize             0x1000              // Granularity of the code memory protection
+#define JITHotCount             2       // Times a block start is run before it is translated
+#define JITNeverCount           0xFF    // Hit count of a block start that can not be translated
+#define JITMaxInvalidations     16      // Times a work RAM page is dropped before it is left to the interpreter
+#define JITMaxBlockInstructions 64
+#define JITMaxRunCycles         0x1000  // A run stops after about this many cycles
+
+class X64Emitter;
+
+/*
+    Runs the CPU through x86-64 code translated from the Gameboy code, with the same results as the
+    interpreter, cycle for cycle.
+
+    A block is translated from a run of instructions once its start has been run JITHotCount times,
+    and ends at an unconditional jump, a call, a return or an instruction that is left to the
+    interpreter (EI, DI, RETI, HALT, STOP). Blocks are kept per host page of the ROM or work RAM
+    they come from, so a bank switch only changes which pages the Gameboy addresses point at. Blocks
+    jump to each other through a lookup in those pages, a loop back to the start of its own block is
+    a direct jump.
+
+    The components are stepped by many instructions at once: Run asks them how far they can go
+    before anything but their clocks changes (see CPU::GetCyclesUntilEvent) and the block counts the
+    cycles down from there, leaving after the instruction that reaches it, exactly where the
+    interpreter would see the same state. Only ROM, work RAM and the registers that only change at an
+    event (LY, STAT, IF) are accessed directly, everything else goes through a helper that steps the
+    components up to the access first. A write that can change the memory map, the events or raise
+    an interrupt ends the run after its instruction. The rare instructions with odd flags (DAA,
+    SUB (HL), the SP arithmetic) are run by the interpreter from inside the block.
+
+    Work RAM pages with translated code are write protected: writes to them go through a CodePage
+    in front of the MMU page, and a write to a byte code was translated from drops the blocks on
+    that page and ends the run. A page that keeps being rewritten is left to the interpreter after
+    JITMaxInvalidations.
+
+    The ROM blocks translated in earlier runs of the game come from the JITCache, they are
+    translated the first time they are reached.
+*/
+class JIT
+{
+public:
+    JIT(CPU* pCPU, MMU* pMMU);
+    ~JIT();
+
+    bool Initialize();
+
+    // Runs translated code from the current PC and returns its CPU cycles, 0 if there is none
+    unsigned long Run();
+
+    // Drops every block, e.g. after the work RAM was loaded
+    void Flush();
+
+private:
+    // The blocks starting on a 256 byte page of ROM or work RAM, by offset into the page
+    struct BlockPage
+    {
+        void* m_Code[0x100];        // First, the translated code looks blocks up at offset 0
+        byte m_Hits[0x100];
+        bool m_HasCode;
+        byte m_CodeBytes[0x20];     // A bit for every byte translated code was read from
+        byte m_Invalidations;
+        std::vector<BlockPage*> m_Dependents;   // Pages with blocks that run on into this one
+
+        BlockPage();
+    };
+
+    /*
+        What the translated code works with, it keeps a pointer to it in rbp. The registers are only
+        up to date outside of the translated code and inside the helpers it calls.
+    */
+    struct Context
+    {
+        uintptr_t readPages[0x100];     // Host address minus Gameboy address, 0 for no direct access
+        uintptr_t writePages[0x100];
+        BlockPage* blockPages[0x100];   // Only for pages code is translated from
+        byte flags[0x100];              // LAHF result to the Z, H and C flags
+        byte* pHRAM;
+        JIT* pJIT;
+        int start;                      // Budget when the components were last stepped
+        int isExitForced;
+        int scratch;
+        ushort AF;
+        ushort BC;
+        ushort DE;
+        ushort HL;
+        ushort SP;
+        ushort PC;
+    };
+
+    class CodePage : public MemoryInterposer
+    {
+    public:
+        CodePage(JIT* pJIT);
+
+        // IMemoryUnit
+        byte ReadByte(const ushort& address);
+        bool WriteByte(const ushort& address, const byte val);
+        const byte* GetMemoryBlock(const ushort& address);
+
+    public:
+        JIT* m_pJIT;
+    };
+
+    typedef int(*EntryFunction)(Context* pContext, const void* pCode, int budget);
+
+    // Mapping
+    bool IsMappingCurrent();
+    void UpdateMappings();
+    void MapROM(unsigned int firstPage, const byte* pBank);
+    void MapWorkRAM();
+    BlockPage* GetBlockPage(const byte* pHost);
+    void SeedHits(BlockPage* pPage, unsigned int ROMPage);
+    void ProtectCode();
+    void OnCodeWrite(ushort address);
+    void Invalidate(BlockPage* pPage);
+
+    // Running
+    int GetBudget();
+    void Sync(int budget);
+    int Restart();
+    int Finish(int budget);
+    static unsigned int ReadMemory(Context* pContext, unsigned int address, int budget);
+    static int WriteMemory(Context* pContext, unsigned int address, unsigned int value, int budget);
+    static int Interpret(Context* pContext, unsigned int address, int budget);
+
+    // Translation
+    void EmitSharedCode();
+    void EmitSpill(X64Emitter& e);
+    void EmitReload(X64Emitter& e);
+    void EmitHelperCall(X64Emitter& e, const void* pHelper, int argumentCount);
+    void* Compile(ushort address);
+    bool SetCodeWritable(byte* pStart, size_t size, bool isWritable);
+    void* Translate(ushort address);
+    bool Fetch(ushort address, int region, byte& value, const byte*& pHostPage);
+    bool EmitInstruction(X64Emitter& e, ushort address, const byte* pBytes, ushort next);
+    void EmitCB(X64Emitter& e, byte opCode, ushort next);
+    void EmitCycles(X64Emitter& e, int cycles, ushort next);
+    void EmitBranch(X64Emitter& e, int cycles, ushort target);
+    byte* EmitCondition(X64Emitter& e, int condition);
+    void EmitRead(X64Emitter& e);
+    void EmitWrite(X64Emitter& e);
+    const byte* GetStableRegister(ushort address);
+    void EmitReadConstant(X64Emitter& e, ushort address);
+    void EmitWriteConstant(X64Emitter& e, ushort address);
+    void EmitPush(X64Emitter& e, int source, ushort value);
+    void EmitPop(X64Emitter& e);
+    void EmitFlags(X64Emitter& e, int mask, int set, int keep);
+    void EmitZeroFlag(X64Emitter& e, int set);
+    void EmitBitFlags(X64Emitter& e);
+    void EmitALU(X64Emitter& e, int operation);
+    void EmitRotate(X64Emitter& e, int operation);
+    void EmitInterpret(X64Emitter& e, ushort address, ushort next);
+
+private:
+    CPU* m_pCPU;
+    MMU* m_pMMU;
+    Context m_Context;
+    unsigned long m_Synced;             // Cycles the components were stepped by during this run
+
+    // Host memory of the cartridge ROM and the work RAM, and what is mapped of it
+    const byte* m_pROM;
+    size_t m_ROMSize;
+    const byte* m_pMappedROMX;
+    const byte* m_pMappedWRAMX;
+    byte m_WasBooting;
+    std::vector<std::unique_ptr<BlockPage>> m_ROMPages;
+    std::unique_ptr<BlockPage> m_WRAMPages[WRAMSize >> 8];
+    std::unique_ptr<CodePage> m_CodePages[0x100];
+    JITCache m_Cache;
+
+    // Code memory, the shared code comes first and the blocks after it
+    byte* m_pCode;
+    byte* m_pBlocks;
+    byte* m_pFree;
+    EntryFunction m_pEntry;
+    byte* m_pExit;                      // eax = PC
+    byte* m_pDispatch;                  // eax = PC, jumps to its block or exits
+    byte* m_pReadThunk;                 // eax = address, returns the value in ecx
+    byte* m_pWriteThunk;                // eax = address, ecx = value
+    byte* m_pInterpretThunk;            // eax = address of the instruction
+
+    // While translating a block
+    ushort m_BlockStart;
+    byte* m_pBlockCode;
+    std::vector<std::pair<byte*, ushort>> m_Exits;      // jle to patch, PC to exit with
+    std::vector<std::pair<byte*, byte*>> m_SlowPaths;   // jz to patch, where to return to
+    std::vector<byte*> m_SlowThunks;
+    std::vector<ushort> m_Successors;                   // Blocks it jumps to or runs on into
+};
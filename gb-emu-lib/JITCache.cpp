@@ -0,0 +1,312 @@
+#include "pch.hpp"
+#include "JITCache.hpp"
+#include "AtomicFile.hpp"
+#include "Hash.hpp"
+#include "JIT.hpp"
+
+#include <cstdio>
+
+#if WINDOWS
+    #include <windows.h>
+#else
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+/*
+    On-disk format, in host byte order:
+        4 bytes     Magic "GBJC"
+        4 bytes     JITCacheVersion
+        8 bytes     Build ID, see GetBuildID
+        8 bytes     Key
+        8 bytes     ROM size
+        ...         For every 256 byte page of the ROM: a 32 bit hash of its bytes, then
+                    JITCachePageBytes of block starts
+*/
+const char JITCacheMagic[4] = { 'G', 'B', 'J', 'C' };
+const size_t JITCacheHeaderSize = 32;
+const size_t JITCachePageSize = sizeof(unsigned int) + JITCachePageBytes;
+
+std::mutex JITCache::m_Mutex;
+std::string JITCache::m_Directory;
+
+JITCache::JITCache() :
+    m_pROM(nullptr),
+    m_ROMSize(0),
+    m_pEntry(nullptr),
+    m_EntrySize(0),
+#if WINDOWS
+    m_hFile(INVALID_HANDLE_VALUE),
+    m_hMapping(nullptr),
+#endif
+    m_IsChanged(false)
+{
+}
+
+JITCache::~JITCache()
+{
+    Close();
+}
+
+// The header checksum, which covers the header, and the global checksum, which covers the ROM
+unsigned long long JITCache::MakeKey(const byte* pROM)
+{
+    unsigned long long buildID = GetBuildID();
+    unsigned long long hash = FNVHash(FNVOffsetBasis, &buildID, sizeof(buildID));
+    return FNVHash(hash, pROM + 0x014D, 3);
+}
+
+void JITCache::SetDirectory(const char* directory)
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    m_Directory = (directory != nullptr) ? directory : "";
+}
+
+void JITCache::Remove(unsigned long long key)
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    if (!m_Directory.empty())
+    {
+        std::remove(GetPath(key).c_str());
+    }
+}
+
+void JITCache::Open(const byte* pROM, size_t ROMSize)
+{
+    Close();
+
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        if (m_Directory.empty() || (ROMSize < 0x0150))
+        {
+            return;
+        }
+
+        m_Path = GetPath(MakeKey(pROM));
+    }
+
+    m_pROM = pROM;
+    m_ROMSize = ROMSize;
+    m_Checked.assign(ROMSize >> 8, 0);
+    m_Recorded.assign((ROMSize >> 8) * JITCachePageBytes, 0x00);
+    if (!Map(m_Path))
+    {
+        return;
+    }
+
+    // Only the header is checked here, the pages are checked as they are used
+    char magic[4];
+    unsigned int version = 0;
+    unsigned long long buildID = 0;
+    unsigned long long key = 0;
+    unsigned long long size = 0;
+    if (m_EntrySize == JITCacheHeaderSize + (ROMSize >> 8) * JITCachePageSize)
+    {
+        memcpy(magic, m_pEntry, sizeof(magic));
+        memcpy(&version, m_pEntry + 4, sizeof(version));
+        memcpy(&buildID, m_pEntry + 8, sizeof(buildID));
+        memcpy(&key, m_pEntry + 16, sizeof(key));
+        memcpy(&size, m_pEntry + 24, sizeof(size));
+    }
+
+    if ((memcmp(magic, JITCacheMagic, sizeof(magic)) != 0) || (version != JITCacheVersion) ||
+        (buildID != GetBuildID()) || (key != MakeKey(pROM)) || (size != ROMSize))
+    {
+        Logger::LogError("Ignoring stale JIT cache entry %s", m_Path.c_str());
+        Unmap();
+    }
+}
+
+void JITCache::Close()
+{
+    if (m_IsChanged)
+    {
+        Store();
+    }
+
+    Unmap();
+    m_Path.clear();
+    m_pROM = nullptr;
+    m_ROMSize = 0;
+    m_Checked.clear();
+    m_Recorded.clear();
+    m_IsChanged = false;
+}
+
+const byte* JITCache::GetStarts(unsigned int page)
+{
+    if ((m_pEntry == nullptr) || (page >= m_Checked.size()))
+    {
+        return nullptr;
+    }
+
+    const byte* pPage = m_pEntry + JITCacheHeaderSize + page * JITCachePageSize;
+    if (m_Checked[page] == 0)
+    {
+        unsigned int hash = 0;
+        memcpy(&hash, pPage, sizeof(hash));
+        m_Checked[page] = (hash == HashPage(m_pROM + (page << 8))) ? 1 : 2;
+    }
+
+    return (m_Checked[page] == 1) ? (pPage + sizeof(unsigned int)) : nullptr;
+}
+
+void JITCache::Record(size_t offset)
+{
+    if (m_Path.empty() || (offset >= m_ROMSize))
+    {
+        return;
+    }
+
+    unsigned int page = static_cast<unsigned int>(offset >> 8);
+    byte bit = static_cast<byte>(1 << (offset & 0x07));
+    byte& recorded = m_Recorded[page * JITCachePageBytes + ((offset & 0xFF) >> 3)];
+    recorded |= bit;
+
+    const byte* pStarts = GetStarts(page);
+    if ((pStarts == nullptr) || ((pStarts[(offset & 0xFF) >> 3] & bit) == 0))
+    {
+        m_IsChanged = true;
+    }
+}
+
+// Changes with the cache format and the translator, a new translator may cut the blocks differently
+unsigned long long JITCache::GetBuildID()
+{
+    unsigned int versions[2] = { JITCacheVersion, JITTranslatorVersion };
+    return FNVHash(FNVOffsetBasis, versions, sizeof(versions));
+}
+
+std::string JITCache::GetPath(unsigned long long key)
+{
+    char name[32];
+    snprintf(name, sizeof(name), "jit-%016llx.cache", key);
+    return m_Directory + "/" + name;
+}
+
+unsigned int JITCache::HashPage(const byte* pPage)
+{
+    unsigned long long hash = FNVHash(FNVOffsetBasis, pPage, 0x100);
+    return static_cast<unsigned int>(hash ^ (hash >> 32));
+}
+
+bool JITCache::Map(const std::string& path)
+{
+#if WINDOWS
+    HANDLE hFile = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (hFile == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+
+    LARGE_INTEGER size;
+    HANDLE hMapping = nullptr;
+    if (GetFileSizeEx(hFile, &size) && (size.QuadPart > 0))
+    {
+        hMapping = CreateFileMappingA(hFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    }
+
+    void* pEntry = (hMapping != nullptr) ? MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+    if (pEntry == nullptr)
+    {
+        if (hMapping != nullptr)
+        {
+            CloseHandle(hMapping);
+        }
+
+        CloseHandle(hFile);
+        return false;
+    }
+
+    m_hFile = hFile;
+    m_hMapping = hMapping;
+    m_pEntry = static_cast<const byte*>(pEntry);
+    m_EntrySize = static_cast<size_t>(size.QuadPart);
+#else
+    int file = open(path.c_str(), O_RDONLY);
+    if (file < 0)
+    {
+        return false;
+    }
+
+    // The mapping stays valid after the file is closed, or renamed over by another process
+    struct stat status;
+    void* pEntry = MAP_FAILED;
+    if ((fstat(file, &status) == 0) && (status.st_size > 0))
+    {
+        pEntry = mmap(nullptr, static_cast<size_t>(status.st_size), PROT_READ, MAP_PRIVATE, file, 0);
+    }
+
+    close(file);
+    if (pEntry == MAP_FAILED)
+    {
+        return false;
+    }
+
+    m_pEntry = static_cast<const byte*>(pEntry);
+    m_EntrySize = static_cast<size_t>(status.st_size);
+#endif
+
+    return true;
+}
+
+void JITCache::Unmap()
+{
+    if (m_pEntry == nullptr)
+    {
+        return;
+    }
+
+#if WINDOWS
+    UnmapViewOfFile(m_pEntry);
+    CloseHandle(m_hMapping);
+    CloseHandle(m_hFile);
+    m_hMapping = nullptr;
+    m_hFile = INVALID_HANDLE_VALUE;
+#else
+    munmap(const_cast<byte*>(m_pEntry), m_EntrySize);
+#endif
+
+    m_pEntry = nullptr;
+    m_EntrySize = 0;
+}
+
+void JITCache::Store()
+{
+    unsigned int version = JITCacheVersion;
+    unsigned long long buildID = GetBuildID();
+    unsigned long long key = MakeKey(m_pROM);
+    unsigned long long size = m_ROMSize;
+
+    std::vector<byte> entry(JITCacheHeaderSize + (m_ROMSize >> 8) * JITCachePageSize);
+    memcpy(&entry[0], JITCacheMagic, sizeof(JITCacheMagic));
+    memcpy(&entry[4], &version, sizeof(version));
+    memcpy(&entry[8], &buildID, sizeof(buildID));
+    memcpy(&entry[16], &key, sizeof(key));
+    memcpy(&entry[24], &size, sizeof(size));
+
+    // The starts of the old entry are kept for the pages that still match
+    for (unsigned int page = 0; page < (m_ROMSize >> 8); page++)
+    {
+        byte* pPage = &entry[JITCacheHeaderSize + page * JITCachePageSize];
+        unsigned int hash = HashPage(m_pROM + (page << 8));
+        memcpy(pPage, &hash, sizeof(hash));
+
+        const byte* pStarts = GetStarts(page);
+        for (unsigned int index = 0; index < JITCachePageBytes; index++)
+        {
+            pPage[sizeof(hash) + index] = m_Recorded[page * JITCachePageBytes + index] | ((pStarts != nullptr) ? pStarts[index] : 0x00);
+        }
+    }
+
+    // Windows can not rename over a file that is still mapped
+    Unmap();
+
+    // A concurrent reader never maps a partial entry
+    if (!WriteFileAtomic(m_Path, entry.data(), entry.size()))
+    {
+        Logger::LogError("Failed to write JIT cache entry %s", m_Path.c_str());
+    }
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <mutex>
+#include <string>
+#include <vector>
+
+#define JITCacheVersion     1
+#define JITCachePageBytes   (0x100 / 8)     // One bit per byte of a ROM page
+
+/*
+    The ROM blocks the JIT translated in earlier runs of a game, so a new run translates them the
+    first time they are reached instead of interpreting them until they get hot again.
+
+    Entries are files in a directory shared by all instances, keyed by the cartridge header
+    checksums (0x014D-0x014F) and JITTranslatorVersion. Open maps the entry and only checks its
+    header, each ROM page is checked against the hash stored with it when the JIT first looks at
+    it, and a page that does not match gives no block starts. A block start is only a hint: the
+    block is translated from the ROM as it is, and one that can not be translated is left to the
+    interpreter as before.
+
+    Close merges the blocks translated during the run into the entry, it is written to a new file
+    and renamed over the old one, so other processes only ever map a complete entry.
+*/
+class JITCache
+{
+public:
+    JITCache();
+    ~JITCache();
+
+    static unsigned long long MakeKey(const byte* pROM);
+    static void SetDirectory(const char* directory);
+    static void Remove(unsigned long long key);
+
+    void Open(const byte* pROM, size_t ROMSize);
+    void Close();
+
+    // The block starts on a 256 byte page of the ROM, one bit per byte, nullptr if there are none
+    const byte* GetStarts(unsigned int page);
+    void Record(size_t offset);
+
+private:
+    static unsigned long long GetBuildID();
+    static std::string GetPath(unsigned long long key);
+    static unsigned int HashPage(const byte* pPage);
+    bool Map(const std::string& path);
+    void Unmap();
+    void Store();
+
+private:
+    static std::mutex m_Mutex;
+    static std::string m_Directory;
+
+    std::string m_Path;                 // Empty while there is no directory or no cartridge
+    const byte* m_pROM;
+    size_t m_ROMSize;
+    const byte* m_pEntry;               // The mapped entry, nullptr if there is none or it is stale
+    size_t m_EntrySize;
+#if WINDOWS
+    void* m_hFile;
+    void* m_hMapping;
+#endif
+    std::vector<byte> m_Checked;        // Per page: 0 not checked yet, 1 the entry matches, 2 it does not
+    std::vector<byte> m_Recorded;       // JITCachePageBytes per page, translated during this run
+    bool m_IsChanged;
+};
@@ -28,6 +28,20 @@ void Joypad::SetInput(byte input, byte buttons)
     }
 }
 
+void Joypad::SaveState(StateWriter& writer)
+{
+    writer.Write(m_SelectValues);
+    writer.Write(m_InputValues);
+    writer.Write(m_ButtonValues);
+}
+
+void Joypad::LoadState(StateReader& reader)
+{
+    reader.Read(m_SelectValues);
+    reader.Read(m_InputValues);
+    reader.Read(m_ButtonValues);
+}
+
 // IMemoryUnit
 byte Joypad::ReadByte(const ushort& address)
 {
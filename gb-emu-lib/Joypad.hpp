@@ -20,6 +20,8 @@ public:
     ~Joypad();
 
     void SetInput(byte input, byte buttons);
+    void SaveState(StateWriter& writer);
+    void LoadState(StateReader& reader);
 
     // IMemoryUnit
     byte ReadByte(const ushort& address);
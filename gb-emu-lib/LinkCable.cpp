@@ -0,0 +1,113 @@
+#include "pch.hpp"
+#include "LinkCable.hpp"
+
+#include <thread>
+
+LinkCable::Queue::Queue() :
+    m_Head(0),
+    m_Tail(0)
+{
+}
+
+bool LinkCable::Queue::Push(const LinkMessage& message)
+{
+    unsigned int tail = m_Tail.load(std::memory_order_relaxed);
+    if ((tail - m_Head.load(std::memory_order_acquire)) >= LinkCableQueueSize)
+    {
+        return false;
+    }
+
+    m_Messages[tail & (LinkCableQueueSize - 1)] = message;
+    m_Tail.store(tail + 1, std::memory_order_release);
+    return true;
+}
+
+bool LinkCable::Queue::Pop(LinkMessage& message)
+{
+    unsigned int head = m_Head.load(std::memory_order_relaxed);
+    if (head == m_Tail.load(std::memory_order_acquire))
+    {
+        return false;
+    }
+
+    message = m_Messages[head & (LinkCableQueueSize - 1)];
+    m_Head.store(head + 1, std::memory_order_release);
+    return true;
+}
+
+LinkCable::Port::Port() :
+    m_Cable(nullptr),
+    m_Incoming(nullptr),
+    m_Outgoing(nullptr)
+{
+}
+
+void LinkCable::Port::Attach(LinkCable* pCable, Queue* pIncoming, Queue* pOutgoing)
+{
+    m_Cable = pCable;
+    m_Incoming = pIncoming;
+    m_Outgoing = pOutgoing;
+}
+
+bool LinkCable::Port::Send(const LinkMessage& message)
+{
+    while (!m_Outgoing->Push(message))
+    {
+        if (!m_Cable->IsConnected())
+        {
+            return false;
+        }
+
+        // The peer drains its queue every step, it will make room soon
+        std::this_thread::yield();
+    }
+
+    return true;
+}
+
+bool LinkCable::Port::Receive(LinkMessage& message)
+{
+    return m_Incoming->Pop(message);
+}
+
+bool LinkCable::Port::IsConnected()
+{
+    return m_Cable->IsConnected();
+}
+
+void LinkCable::Port::Disconnect()
+{
+    m_Cable->Disconnect();
+}
+
+LinkCable::LinkCable() :
+    m_IsConnected(true)
+{
+    m_Ports[0].Attach(this, &m_Queues[0], &m_Queues[1]);
+    m_Ports[1].Attach(this, &m_Queues[1], &m_Queues[0]);
+}
+
+LinkCable::~LinkCable()
+{
+}
+
+ILinkPort* LinkCable::GetPort(int index)
+{
+    if ((index < 0) || (index > 1))
+    {
+        Logger::LogError("LinkCable: There is no port %d", index);
+        return nullptr;
+    }
+
+    return &m_Ports[index];
+}
+
+bool LinkCable::IsConnected()
+{
+    return m_IsConnected.load(std::memory_order_acquire);
+}
+
+void LinkCable::Disconnect()
+{
+    m_IsConnected.store(false, std::memory_order_release);
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <atomic>
+
+// Must be a power of two
+#define LinkCableQueueSize 1024
+
+/*
+    A link cable between two emulators in the same process, each running on its own thread.
+
+    Each direction is a lock-free single-producer, single-consumer queue of link messages. Pass
+    GetPort(0) to one emulator and GetPort(1) to the other. Once either side disconnects, the other
+    side stops waiting on it and sees the input line held high.
+*/
+class LinkCable
+{
+private:
+    class Queue
+    {
+    public:
+        Queue();
+        bool Push(const LinkMessage& message);
+        bool Pop(LinkMessage& message);
+
+    private:
+        LinkMessage m_Messages[LinkCableQueueSize];
+        std::atomic<unsigned int> m_Head;
+        std::atomic<unsigned int> m_Tail;
+    };
+
+    class Port : public ILinkPort
+    {
+    public:
+        Port();
+        void Attach(LinkCable* pCable, Queue* pIncoming, Queue* pOutgoing);
+
+        // ILinkPort
+        bool Send(const LinkMessage& message);
+        bool Receive(LinkMessage& message);
+        bool IsConnected();
+        void Disconnect();
+
+    private:
+        LinkCable* m_Cable;
+        Queue* m_Incoming;
+        Queue* m_Outgoing;
+    };
+
+public:
+    LinkCable();
+    ~LinkCable();
+
+    ILinkPort* GetPort(int index);
+    bool IsConnected();
+    void Disconnect();
+
+private:
+    Queue m_Queues[2];
+    Port m_Ports[2];
+    std::atomic<bool> m_IsConnected;
+};
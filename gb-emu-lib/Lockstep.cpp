@@ -0,0 +1,250 @@
+#include "pch.hpp"
+#include "Lockstep.hpp"
+
+Lockstep::Lockstep() :
+    m_pReference(nullptr),
+    m_pCandidate(nullptr),
+    m_MovieIndex(0),
+    m_DigestInterval(1),
+    m_StepCount(0),
+    m_HasDiverged(false),
+    m_ReferenceDigest(0),
+    m_CandidateDigest(0),
+    m_HistoryCount(0)
+{
+}
+
+Lockstep::Lockstep(CPU* pReference, CPU* pCandidate) :
+    m_pReference(pReference),
+    m_pCandidate(pCandidate),
+    m_MovieIndex(0),
+    m_DigestInterval(1),
+    m_StepCount(0),
+    m_HasDiverged(false),
+    m_ReferenceDigest(0),
+    m_CandidateDigest(0),
+    m_HistoryCount(0)
+{
+}
+
+Lockstep::~Lockstep()
+{
+    m_spCandidate.reset();
+    m_spReference.reset();
+}
+
+bool Lockstep::LoadROM(const char* bootROMPath, const char* cartridgePath)
+{
+    m_spReference = std::make_unique<CPU>();
+    m_spCandidate = std::make_unique<CPU>();
+    m_pReference = m_spReference.get();
+    m_pCandidate = m_spCandidate.get();
+
+    if (!m_pReference->Initialize() || !m_pCandidate->Initialize())
+    {
+        Logger::LogError("Lockstep: CPU could not be initialized!");
+        return false;
+    }
+
+    if (!m_pReference->LoadROM(bootROMPath, cartridgePath) ||
+        !m_pCandidate->LoadROM(bootROMPath, cartridgePath))
+    {
+        Logger::LogError("Lockstep: Failed to load the Gameboy ROM");
+        return false;
+    }
+
+    // The reference runs one instruction per step
+    m_pReference->SetFusion(false);
+    return true;
+}
+
+/*
+    The movie is a text file with one input change per line:
+        <cycle> <input> <buttons>
+    where input and buttons are the JOYPAD_* bit masks in hex, e.g. "70224 04 01".
+*/
+bool Lockstep::LoadInputMovie(const char* moviePath)
+{
+    std::ifstream file(moviePath);
+    if (!file.is_open())
+    {
+        Logger::LogError("Lockstep: Failed to open input movie %s", moviePath);
+        return false;
+    }
+
+    unsigned long cycle;
+    unsigned int input;
+    unsigned int buttons;
+    while (file >> std::dec >> cycle >> std::hex >> input >> buttons)
+    {
+        AddInput(cycle, static_cast<byte>(input), static_cast<byte>(buttons));
+    }
+
+    Logger::Log("Lockstep: Loaded %d inputs from %s", static_cast<int>(m_Movie.size()), moviePath);
+    return true;
+}
+
+void Lockstep::AddInput(unsigned long cycle, byte input, byte buttons)
+{
+    LockstepInput entry = { cycle, input, buttons };
+    m_Movie.push_back(entry);
+}
+
+void Lockstep::SetDigestInterval(unsigned int steps)
+{
+    m_DigestInterval = (steps == 0) ? 1 : steps;
+}
+
+bool Lockstep::Run(unsigned long steps)
+{
+    if ((m_pReference == nullptr) || (m_pCandidate == nullptr))
+    {
+        Logger::LogError("Lockstep: No cores to run!");
+        return false;
+    }
+
+    for (unsigned long step = 0; (step < steps) && !m_HasDiverged; step++)
+    {
+        ApplyInput();
+        Record();
+
+        // The candidate may execute a whole block per step, catch the reference up to it
+        m_pCandidate->Step();
+
+        CPUState candidate;
+        CPUState reference;
+        m_pCandidate->GetState(candidate);
+        m_pReference->GetState(reference);
+        do
+        {
+            m_pReference->Step();
+            m_pReference->GetState(reference);
+        } while (reference.cycles < candidate.cycles);
+
+        m_StepCount++;
+        if (!Compare((m_StepCount % m_DigestInterval) == 0))
+        {
+            m_HasDiverged = true;
+        }
+    }
+
+    return !m_HasDiverged;
+}
+
+bool Lockstep::HasDiverged()
+{
+    return m_HasDiverged;
+}
+
+unsigned long Lockstep::GetStepCount()
+{
+    return m_StepCount;
+}
+
+void Lockstep::DumpDivergence()
+{
+    if (!m_HasDiverged)
+    {
+        Logger::LogError("Lockstep: No divergence after %lu steps", m_StepCount);
+        return;
+    }
+
+    CPUState reference;
+    CPUState candidate;
+    m_pReference->GetState(reference);
+    m_pCandidate->GetState(candidate);
+
+    Logger::LogError("Lockstep: Cores diverged after %lu steps", m_StepCount);
+    LogState("Reference", reference);
+    LogState("Candidate", candidate);
+    if (m_ReferenceDigest != m_CandidateDigest)
+    {
+        Logger::LogError("  Memory digest: reference=0x%08X candidate=0x%08X", m_ReferenceDigest, m_CandidateDigest);
+    }
+
+    // Oldest entry first
+    unsigned int count = (m_HistoryCount < LockstepHistorySize) ? m_HistoryCount : LockstepHistorySize;
+    Logger::LogError("  Last %d steps (state before each step):", count);
+    for (unsigned int index = m_HistoryCount - count; index < m_HistoryCount; index++)
+    {
+        const HistoryEntry& entry = m_History[index % LockstepHistorySize];
+        Logger::LogError(
+            "    PC=%04X [%02X %02X %02X]  ref AF=%04X BC=%04X DE=%04X HL=%04X SP=%04X  cand AF=%04X BC=%04X DE=%04X HL=%04X SP=%04X PC=%04X",
+            entry.reference.PC, entry.bytes[0], entry.bytes[1], entry.bytes[2],
+            entry.reference.AF, entry.reference.BC, entry.reference.DE, entry.reference.HL, entry.reference.SP,
+            entry.candidate.AF, entry.candidate.BC, entry.candidate.DE, entry.candidate.HL, entry.candidate.SP,
+            entry.candidate.PC);
+    }
+}
+
+void Lockstep::ApplyInput()
+{
+    if (m_MovieIndex >= m_Movie.size())
+    {
+        return;
+    }
+
+    CPUState reference;
+    m_pReference->GetState(reference);
+    while ((m_MovieIndex < m_Movie.size()) && (m_Movie[m_MovieIndex].cycle <= reference.cycles))
+    {
+        const LockstepInput& entry = m_Movie[m_MovieIndex];
+        m_pReference->SetInput(entry.input, entry.buttons);
+        m_pCandidate->SetInput(entry.input, entry.buttons);
+        m_MovieIndex++;
+    }
+}
+
+void Lockstep::Record()
+{
+    HistoryEntry& entry = m_History[m_HistoryCount % LockstepHistorySize];
+    m_pReference->GetState(entry.reference);
+    m_pCandidate->GetState(entry.candidate);
+    for (int index = 0; index < 3; index++)
+    {
+        entry.bytes[index] = m_pReference->PeekMemory(static_cast<ushort>(entry.reference.PC + index));
+    }
+
+    m_HistoryCount++;
+}
+
+bool Lockstep::Compare(bool compareDigest)
+{
+    CPUState reference;
+    CPUState candidate;
+    m_pReference->GetState(reference);
+    m_pCandidate->GetState(candidate);
+
+    if ((reference.AF != candidate.AF) ||
+        (reference.BC != candidate.BC) ||
+        (reference.DE != candidate.DE) ||
+        (reference.HL != candidate.HL) ||
+        (reference.SP != candidate.SP) ||
+        (reference.PC != candidate.PC) ||
+        (reference.IME != candidate.IME) ||
+        (reference.isHalted != candidate.isHalted) ||
+        (reference.cycles != candidate.cycles))
+    {
+        return false;
+    }
+
+    if (compareDigest)
+    {
+        m_ReferenceDigest = m_pReference->GetMemoryDigest();
+        m_CandidateDigest = m_pCandidate->GetMemoryDigest();
+        if (m_ReferenceDigest != m_CandidateDigest)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void Lockstep::LogState(const char* name, const CPUState& state)
+{
+    Logger::LogError(
+        "  %s: AF=%04X BC=%04X DE=%04X HL=%04X SP=%04X PC=%04X IME=%d HALT=%d cycles=%lu",
+        name, state.AF, state.BC, state.DE, state.HL, state.SP, state.PC,
+        state.IME, state.isHalted ? 1 : 0, state.cycles);
+}
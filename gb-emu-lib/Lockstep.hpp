@@ -0,0 +1,77 @@
+#pragma once
+
+#include "CPU.hpp"
+
+#include <vector>
+
+// The number of instructions kept for the divergence report
+#define LockstepHistorySize 32
+
+/*
+    A single entry of an input movie. The input is applied to both cores once the reference core
+    reaches the given cycle count.
+*/
+struct LockstepInput
+{
+    unsigned long cycle;
+    byte input;
+    byte buttons;
+};
+
+/*
+    Runs two CPU execution cores side by side and compares them after every step.
+
+    The reference core is usually the CPU::Step interpreter, the candidate is the core under test.
+    The candidate is stepped once (an instruction or a whole block, depending on the core), then the
+    reference is stepped until it has executed the same number of cycles. Registers and cycle count
+    are compared after every step, the memory digest every m_DigestInterval steps. On the first
+    divergence the run stops and DumpDivergence() prints both states and the recent history.
+*/
+class Lockstep
+{
+public:
+    Lockstep();
+    Lockstep(CPU* pReference, CPU* pCandidate);
+    ~Lockstep();
+
+    bool LoadROM(const char* bootROMPath, const char* cartridgePath);
+    bool LoadInputMovie(const char* moviePath);
+    void AddInput(unsigned long cycle, byte input, byte buttons);
+    void SetDigestInterval(unsigned int steps);
+
+    bool Run(unsigned long steps);
+    bool HasDiverged();
+    unsigned long GetStepCount();
+    void DumpDivergence();
+
+private:
+    struct HistoryEntry
+    {
+        CPUState reference;
+        CPUState candidate;
+        byte bytes[3];
+    };
+
+    void ApplyInput();
+    void Record();
+    bool Compare(bool compareDigest);
+    void LogState(const char* name, const CPUState& state);
+
+private:
+    std::unique_ptr<CPU> m_spReference;
+    std::unique_ptr<CPU> m_spCandidate;
+    CPU* m_pReference;
+    CPU* m_pCandidate;
+
+    std::vector<LockstepInput> m_Movie;
+    unsigned int m_MovieIndex;
+
+    unsigned int m_DigestInterval;
+    unsigned long m_StepCount;
+    bool m_HasDiverged;
+    unsigned int m_ReferenceDigest;
+    unsigned int m_CandidateDigest;
+
+    HistoryEntry m_History[LockstepHistorySize];
+    unsigned int m_HistoryCount;
+};
@@ -44,5 +44,10 @@ void Logger::LogError(const char* message, ...)
 
 void Logger::LogCharacter(char character)
 {
+    if (!m_IsEnabled)
+    {
+        return;
+    }
+
     std::cout << character << std::flush;
 }
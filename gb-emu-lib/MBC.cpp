@@ -15,7 +15,7 @@ MBCs Control Registers.
 #define ROMBankMode 0x00
 #define RAMBankMode 0x01
 
-MBC::MBC(byte* pROM, byte* pRAM) :
+MBC::MBC(const byte* pROM, byte* pRAM) :
     m_ROM(pROM),
     m_RAM(pRAM),
     m_isRAMEnabled(false)
@@ -26,13 +26,23 @@ MBC::~MBC()
 {
 }
 
+void MBC::SaveState(StateWriter& writer)
+{
+    writer.Write(m_isRAMEnabled);
+}
+
+void MBC::LoadState(StateReader& reader)
+{
+    reader.Read(m_isRAMEnabled);
+}
+
 /*
 Small games of not more than 32KBytes ROM do not require a MBC chip for ROM banking.
 The ROM is directly mapped to memory at 0000-7FFFh. Optionally up to 8KByte of RAM could be
 connected at A000-BFFF, even though that could require a tiny MBC-like circuit, but no real MBC chip.
 */
 
-ROMOnly_MBC::ROMOnly_MBC(byte* pROM, byte* pRAM) :
+ROMOnly_MBC::ROMOnly_MBC(const byte* pROM, byte* pRAM) :
     MBC(pROM, pRAM)
 {
 }
@@ -81,7 +91,26 @@ bool ROMOnly_MBC::WriteByte(const ushort& address, const byte val)
     return false;
 }
 
-MBC1_MBC::MBC1_MBC(byte* pROM, byte* pRAM) :
+const byte* ROMOnly_MBC::GetMemoryBlock(const ushort& address)
+{
+    if (address <= 0x7FFF)
+    {
+        return &m_ROM[address];
+    }
+    else if ((address >= 0xA000 && address <= 0xBFFF) && (m_RAM != nullptr))
+    {
+        return &m_RAM[address - 0xA000];
+    }
+
+    return nullptr;
+}
+
+unsigned int ROMOnly_MBC::GetROMBank()
+{
+    return 1;
+}
+
+MBC1_MBC::MBC1_MBC(const byte* pROM, byte* pRAM) :
     MBC(pROM, pRAM),
     m_ROMBankLower(0x01),
     m_ROMRAMBankUpper(0x00),
@@ -256,11 +285,68 @@ bool MBC1_MBC::WriteByte(const ushort& address, const byte val)
     return false;
 }
 
+const byte* MBC1_MBC::GetMemoryBlock(const ushort& address)
+{
+    if (address <= 0x3FFF)
+    {
+        return &m_ROM[address];
+    }
+    else if (address <= 0x7FFF)
+    {
+        byte targetBank = m_ROMBankLower;
+        if (m_ROMRAMMode == ROMBankMode)
+        {
+            targetBank |= (m_ROMRAMBankUpper << 4);
+        }
+
+        return &m_ROM[(address - 0x4000) + (0x4000 * targetBank)];
+    }
+    else if ((address >= 0xA000 && address <= 0xBFFF) && m_isRAMEnabled && (m_RAM != nullptr))
+    {
+        unsigned int target = address - 0xA000;
+        if (m_ROMRAMMode == RAMBankMode)
+        {
+            target += (0x2000 * m_ROMRAMBankUpper);
+        }
+
+        return &m_RAM[target];
+    }
+
+    return nullptr;
+}
+
+unsigned int MBC1_MBC::GetROMBank()
+{
+    byte targetBank = m_ROMBankLower;
+    if (m_ROMRAMMode == ROMBankMode)
+    {
+        targetBank |= (m_ROMRAMBankUpper << 4);
+    }
+
+    return targetBank;
+}
+
+void MBC1_MBC::SaveState(StateWriter& writer)
+{
+    MBC::SaveState(writer);
+    writer.Write(m_ROMBankLower);
+    writer.Write(m_ROMRAMBankUpper);
+    writer.Write(m_ROMRAMMode);
+}
+
+void MBC1_MBC::LoadState(StateReader& reader)
+{
+    MBC::LoadState(reader);
+    reader.Read(m_ROMBankLower);
+    reader.Read(m_ROMRAMBankUpper);
+    reader.Read(m_ROMRAMMode);
+}
+
 /*
 MBC2 (max 256KByte ROM and 512x4 bits RAM)
 */
 
-MBC2_MBC::MBC2_MBC(byte* pROM) :
+MBC2_MBC::MBC2_MBC(const byte* pROM) :
     MBC(pROM, new byte[0x1FF + 1]),
     m_ROMBank(0x01)
 {
@@ -370,6 +456,41 @@ bool MBC2_MBC::WriteByte(const ushort& address, const byte val)
     return false;
 }
 
+const byte* MBC2_MBC::GetMemoryBlock(const ushort& address)
+{
+    // The 4 bit RAM is left to ReadByte
+    if (address <= 0x3FFF)
+    {
+        return &m_ROM[address];
+    }
+    else if (address <= 0x7FFF)
+    {
+        return &m_ROM[(address - 0x4000) + (0x4000 * m_ROMBank)];
+    }
+
+    return nullptr;
+}
+
+unsigned int MBC2_MBC::GetROMBank()
+{
+    return m_ROMBank;
+}
+
+// The 512x4 bits RAM is inside the MBC, so it is saved with the registers
+void MBC2_MBC::SaveState(StateWriter& writer)
+{
+    MBC::SaveState(writer);
+    writer.Write(m_ROMBank);
+    writer.Write(m_RAM, 0x1FF + 1);
+}
+
+void MBC2_MBC::LoadState(StateReader& reader)
+{
+    MBC::LoadState(reader);
+    reader.Read(m_ROMBank);
+    reader.Read(m_RAM, 0x1FF + 1);
+}
+
 
 /*
 MBC3 (max 2MByte ROM and/or 32KByte RAM and Timer)
@@ -407,7 +528,7 @@ When accessing the RTC Registers it is recommended to execute a 4ms delay (4 Cyc
 Speed Mode) between the separate accesses.
 */
 
-MBC3_MBC::MBC3_MBC(byte* pROM, byte* pRAM) :
+MBC3_MBC::MBC3_MBC(const byte* pROM, byte* pRAM) :
     MBC(pROM, pRAM),
     m_ROMBank(0x01),
     m_RAMBank(0x00)
@@ -574,6 +695,46 @@ bool MBC3_MBC::WriteByte(const ushort& address, const byte val)
     return false;
 }
 
+const byte* MBC3_MBC::GetMemoryBlock(const ushort& address)
+{
+    // The RTC registers are left to ReadByte
+    if (address <= 0x3FFF)
+    {
+        return &m_ROM[address];
+    }
+    else if (address <= 0x7FFF)
+    {
+        return &m_ROM[(address - 0x4000) + (0x4000 * m_ROMBank)];
+    }
+    else if ((address >= 0xA000 && address <= 0xBFFF) && m_isRAMEnabled && (m_RAM != nullptr) && (m_RAMBank <= 0x03))
+    {
+        return &m_RAM[(address - 0xA000) + (0x2000 * m_RAMBank)];
+    }
+
+    return nullptr;
+}
+
+unsigned int MBC3_MBC::GetROMBank()
+{
+    return m_ROMBank;
+}
+
+void MBC3_MBC::SaveState(StateWriter& writer)
+{
+    MBC::SaveState(writer);
+    writer.Write(m_ROMBank);
+    writer.Write(m_RAMBank);
+    writer.Write(m_RTCRegisters);
+}
+
+void MBC3_MBC::LoadState(StateReader& reader)
+{
+    MBC::LoadState(reader);
+    reader.Read(m_ROMBank);
+    reader.Read(m_RAMBank);
+    reader.Read(m_RTCRegisters);
+}
+
 /*
 MBC5 (max 2MByte ROM and/or 32KByte RAM and Timer)
 
@@ -581,7 +742,7 @@ MBC5 (max 2MByte ROM and/or 32KByte RAM and Timer)
 - RAM upto 1MBit (128kByte) divided into 16 banks, each 8kByte
 */
 
-MBC5_MBC::MBC5_MBC(byte* pROM, byte* pRAM) :
+MBC5_MBC::MBC5_MBC(const byte* pROM, byte* pRAM) :
     MBC(pROM, pRAM),
     m_RAMG(0x00),
     m_ROMBank(0x0000),
@@ -701,3 +862,42 @@ bool MBC5_MBC::WriteByte(const ushort& address, const byte val)
     Logger::Log("MBC5_MBC::WriteByte doesn't support writing to 0x%04X", address);
     return false;
 }
+
+const byte* MBC5_MBC::GetMemoryBlock(const ushort& address)
+{
+    if (address <= 0x3FFF)
+    {
+        return &m_ROM[address];
+    }
+    else if (address <= 0x7FFF)
+    {
+        return &m_ROM[(address - 0x4000) + (0x4000 * m_ROMBank)];
+    }
+    else if ((address >= 0xA000 && address <= 0xBFFF) && (m_RAM != nullptr))
+    {
+        return &m_RAM[(address - 0xA000) + (0x2000 * m_RAMBank)];
+    }
+
+    return nullptr;
+}
+
+unsigned int MBC5_MBC::GetROMBank()
+{
+    return m_ROMBank;
+}
+
+void MBC5_MBC::SaveState(StateWriter& writer)
+{
+    MBC::SaveState(writer);
+    writer.Write(m_RAMG);
+    writer.Write(m_ROMBank);
+    writer.Write(m_RAMBank);
+}
+
+void MBC5_MBC::LoadState(StateReader& reader)
+{
+    MBC::LoadState(reader);
+    reader.Read(m_RAMG);
+    reader.Read(m_ROMBank);
+    reader.Read(m_RAMBank);
+}
@@ -25,16 +25,23 @@
 class MBC : public IMemoryUnit
 {
 public:
-    MBC(byte* pROM, byte* pRAM);
+    MBC(const byte* pROM, byte* pRAM);
     ~MBC();
 
 public:
     // IMemoryUnit
     virtual byte ReadByte(const ushort& address) = 0;
     virtual bool WriteByte(const ushort& address, const byte val) = 0;
+
+    // The bank currently mapped at 0x4000-0x7FFF
+    virtual unsigned int GetROMBank() = 0;
+
+    // The bank registers, the cartridge saves its RAM itself
+    virtual void SaveState(StateWriter& writer);
+    virtual void LoadState(StateReader& reader);
     
 protected:
-    byte* m_ROM;
+    const byte* m_ROM;
     byte* m_RAM;
     bool m_isRAMEnabled;
 };
@@ -42,23 +49,31 @@ protected:
 class ROMOnly_MBC : public MBC
 {
 public:
-    ROMOnly_MBC(byte* pROM, byte* pRAM);
+    ROMOnly_MBC(const byte* pROM, byte* pRAM);
     ~ROMOnly_MBC();
 
     // IMemoryUnit
     byte ReadByte(const ushort& address);
     bool WriteByte(const ushort& address, const byte val);
+    const byte* GetMemoryBlock(const ushort& address);
+
+    unsigned int GetROMBank();
 };
 
 class MBC1_MBC : public MBC
 {
 public:
-    MBC1_MBC(byte* pROM, byte* pRAM);
+    MBC1_MBC(const byte* pROM, byte* pRAM);
     ~MBC1_MBC();
     
     // IMemoryUnit
     byte ReadByte(const ushort& address);
     bool WriteByte(const ushort& address, const byte val);
+    const byte* GetMemoryBlock(const ushort& address);
+
+    unsigned int GetROMBank();
+    void SaveState(StateWriter& writer);
+    void LoadState(StateReader& reader);
 
 private:
     byte m_ROMBankLower;
@@ -69,12 +84,17 @@ private:
 class MBC2_MBC : public MBC
 {
 public:
-    MBC2_MBC(byte* pROM);
+    MBC2_MBC(const byte* pROM);
     ~MBC2_MBC();
 
     // IMemoryUnit
     byte ReadByte(const ushort& address);
     bool WriteByte(const ushort& address, const byte val);
+    const byte* GetMemoryBlock(const ushort& address);
+
+    unsigned int GetROMBank();
+    void SaveState(StateWriter& writer);
+    void LoadState(StateReader& reader);
 
 private:
     byte m_ROMBank;
@@ -83,12 +103,17 @@ private:
 class MBC3_MBC : public MBC
 {
 public:
-    MBC3_MBC(byte* pROM, byte* pRAM);
+    MBC3_MBC(const byte* pROM, byte* pRAM);
     ~MBC3_MBC();
 
     // IMemoryUnit
     byte ReadByte(const ushort& address);
     bool WriteByte(const ushort& address, const byte val);
+    const byte* GetMemoryBlock(const ushort& address);
+
+    unsigned int GetROMBank();
+    void SaveState(StateWriter& writer);
+    void LoadState(StateReader& reader);
 
 private:
     byte m_ROMBank;
@@ -99,12 +124,17 @@ private:
 class MBC5_MBC : public MBC
 {
 public:
-    MBC5_MBC(byte* pROM, byte* pRAM);
+    MBC5_MBC(const byte* pROM, byte* pRAM);
     ~MBC5_MBC();
 
     // IMemoryUnit
     byte ReadByte(const ushort& address);
     bool WriteByte(const ushort& address, const byte val);
+    const byte* GetMemoryBlock(const ushort& address);
+
+    unsigned int GetROMBank();
+    void SaveState(StateWriter& writer);
+    void LoadState(StateReader& reader);
 
 private:
     byte m_RAMG;
@@ -38,9 +38,40 @@
     0xFFFF          Interrupt Enable Register
 */
 
-MMU::MMU() :
-    m_isBooting(0x00)
+/*
+    pWRAM is WRAMSize bytes of storage for the work RAM and pPageTable MMUPageTableSize bytes for the
+    page tables, so a machine can keep them next to its other state. Without them the MMU allocates
+    its own.
+*/
+MMU::MMU(byte* pWRAM, IMemoryUnit** pPageTable) :
+    m_IE(0x00),
+    m_IF(0x00),
+    m_isBooting(0x00),
+    m_WRAM(pWRAM),
+    m_WRAMBank(0x01),
+    m_isCGB(false)
 {
+    if (m_WRAM == nullptr)
+    {
+        m_spWRAM = std::unique_ptr<byte[]>(new byte[WRAMSize]);
+        m_WRAM = m_spWRAM.get();
+    }
+
+    m_pWRAMBank = m_WRAM + 0x1000;
+
+    if (pPageTable == nullptr)
+    {
+        m_spPageTable = std::unique_ptr<IMemoryUnit*[]>(new IMemoryUnit*[MMUPageCount + MMUHighUnitCount]);
+        pPageTable = m_spPageTable.get();
+    }
+
+    m_memoryPages = pPageTable;
+    m_highMemoryUnits = pPageTable + MMUPageCount;
+
+    // Start from a known state, so a cached post-boot snapshot matches a real boot
+    memset(m_WRAM, 0x00, WRAMSize);
+    memset(m_HRAM, 0x00, sizeof(m_HRAM));
+
     RegisterMemoryUnit(0x0000, 0xFFFF, this);
 }
 
@@ -50,10 +81,82 @@ MMU::~MMU()
 
 void MMU::RegisterMemoryUnit(const ushort& startRange, const ushort& endRange, IMemoryUnit* pUnit)
 {
-    for (int index = startRange; index <= endRange; index++)
+    if ((startRange < 0xFE00) && (((startRange & 0x00FF) != 0x00) || ((endRange < 0xFE00) && ((endRange & 0x00FF) != 0xFF))))
     {
-        m_memoryUnits[index] = pUnit;
+        Logger::LogError("Memory unit at 0x%04X-0x%04X must start and end on a page boundary below 0xFE00", startRange, endRange);
     }
+
+    unsigned int address = startRange;
+    while ((address <= endRange) && (address < 0xFE00))
+    {
+        m_memoryPages[address >> 8] = pUnit;
+        address += 0x100;
+    }
+
+    for (address = (address < 0xFE00) ? 0xFE00 : address; address <= endRange; address++)
+    {
+        m_highMemoryUnits[address - 0xFE00] = pUnit;
+    }
+}
+
+/*
+    Puts pInterposer in front of the page of address (the address itself from 0xFE00 on), above any
+    interposers already there. They can be removed in any order, the MMU relinks the ones around it.
+*/
+void MMU::InstallInterposer(const ushort& address, MemoryInterposer* pInterposer)
+{
+    ushort key = (address < 0xFE00) ? (address & 0xFF00) : address;
+    IMemoryUnit*& pEntry = GetMemoryEntry(address);
+    pInterposer->m_pUnit = pEntry;
+    pEntry = pInterposer;
+    m_Interposers[key].push_back(pInterposer);
+}
+
+void MMU::RemoveInterposer(const ushort& address, MemoryInterposer* pInterposer)
+{
+    ushort key = (address < 0xFE00) ? (address & 0xFF00) : address;
+    std::map<ushort, std::vector<MemoryInterposer*>>::iterator iter = m_Interposers.find(key);
+    if (iter == m_Interposers.end())
+    {
+        return;
+    }
+
+    std::vector<MemoryInterposer*>& stack = iter->second;
+    for (unsigned int index = 0; index < stack.size(); index++)
+    {
+        if (stack[index] != pInterposer)
+        {
+            continue;
+        }
+
+        if (index + 1 < stack.size())
+        {
+            stack[index + 1]->m_pUnit = pInterposer->m_pUnit;
+        }
+        else
+        {
+            GetMemoryEntry(address) = pInterposer->m_pUnit;
+        }
+
+        pInterposer->m_pUnit = nullptr;
+        stack.erase(stack.begin() + index);
+        if (stack.empty())
+        {
+            m_Interposers.erase(iter);
+        }
+
+        return;
+    }
+}
+
+IMemoryUnit*& MMU::GetMemoryEntry(const ushort& address)
+{
+    return (address < 0xFE00) ? m_memoryPages[address >> 8] : m_highMemoryUnits[address - 0xFE00];
+}
+
+IMemoryUnit* MMU::GetMemoryUnit(const ushort& address)
+{
+    return (address < 0xFE00) ? m_memoryPages[address >> 8] : m_highMemoryUnits[address - 0xFE00];
 }
 
 byte MMU::Read(const ushort& address)
@@ -70,7 +173,7 @@ byte MMU::Read(const ushort& address)
         return m_BIOS.get()[address];
     }
 
-    return m_memoryUnits[address]->ReadByte(address);
+    return GetMemoryUnit(address)->ReadByte(address);
 }
 
 ushort MMU::ReadUShort(const ushort& address)
@@ -137,7 +240,65 @@ bool MMU::Write(const ushort& address, const byte val)
         return false;
     }
 
-    return m_memoryUnits[address]->WriteByte(address, val);
+    return GetMemoryUnit(address)->WriteByte(address, val);
+}
+
+void MMU::SetCGBMode(bool isCGB)
+{
+    m_isCGB = isCGB;
+}
+
+const byte* MMU::GetWRAM()
+{
+    return m_WRAM;
+}
+
+unsigned int MMU::GetWRAMSize()
+{
+    return m_isCGB ? WRAMSize : 0x2000;
+}
+
+const byte* MMU::GetHRAM()
+{
+    return m_HRAM;
+}
+
+/*
+    Finds the memory behind address for a block transfer, see IMemoryUnit::GetMemoryBlock. Returns
+    nullptr if the transfer has to go through Read instead.
+*/
+const byte* MMU::ResolveBlock(const ushort& address)
+{
+    if ((m_isBooting == 0x00) && (address <= 0x00FF))
+    {
+        return nullptr;
+    }
+
+    return GetMemoryUnit(address)->GetMemoryBlock(address);
+}
+
+void MMU::SaveState(StateWriter& writer)
+{
+    writer.Write(m_isBooting);
+    writer.Write(m_WRAM, WRAMSize);
+    writer.Write(m_WRAMBank);
+    writer.Write(m_isCGB);
+    writer.Write(m_HRAM);
+    writer.Write(m_IE);
+    writer.Write(m_IF);
+}
+
+void MMU::LoadState(StateReader& reader)
+{
+    reader.Read(m_isBooting);
+    reader.Read(m_WRAM, WRAMSize);
+    reader.Read(m_WRAMBank);
+    reader.Read(m_isCGB);
+    reader.Read(m_HRAM);
+    reader.Read(m_IE);
+    reader.Read(m_IF);
+
+    m_pWRAMBank = m_WRAM + ((m_WRAMBank & 0x07) * 0x1000);
 }
 
 byte MMU::ReadByte(const ushort& address)
@@ -148,25 +309,26 @@ byte MMU::ReadByte(const ushort& address)
     0xD000-0xDFFF   4KB Work RAM Bank 1 (WRAM)  (switchable bank 1-7 in CGB Mode)
     0xE000-0xFDFF   Same as C000-DDFF (ECHO)    (typically not used)\
     0xFF50          Boot indicator
+    0xFF70          SVBK - CGB Mode Only - WRAM Bank
     0xFF80-0xFFFE   High RAM (HRAM)
     0xFFFF          Interrupt Enable Register
     */
 
     if (address >= 0xC000 && address <= 0xCFFF)
     {
-        return m_bank0[address - 0xC000];
+        return m_WRAM[address - 0xC000];
     }
     else if (address >= 0xC000 && address <= 0xDFFF)
     {
-        return m_bank1[address - 0xD000];
+        return m_pWRAMBank[address - 0xD000];
     }
     else if (address >= 0xE000 && address <= 0xEFFF)
     {
-        return m_bank0[address - 0xE000];
+        return m_WRAM[address - 0xE000];
     }
     else if (address >= 0xF000 && address <= 0xFDFF)
     {
-        return m_bank1[address - 0xF000];
+        return m_pWRAMBank[address - 0xF000];
     }
     else if (address >= 0xFEA0 && address <= 0xFEFF)
     {
@@ -189,9 +351,9 @@ byte MMU::ReadByte(const ushort& address)
     {
         return m_isBooting;
     }
-    else if (address == 0xFF4D)
+    else if (address == 0xFF70)
     {
-        return m_Key1;
+        return m_isCGB ? (0xF8 | m_WRAMBank) : 0xFF;
     }
     else
     {
@@ -203,19 +365,19 @@ bool MMU::WriteByte(const ushort& address, const byte val)
 {
     if (address >= 0xC000 && address <= 0xCFFF)
     {
-        m_bank0[address - 0xC000] = val;
+        m_WRAM[address - 0xC000] = val;
     }
     else if (address >= 0xC000 && address <= 0xDFFF)
     {
-        m_bank1[address - 0xD000] = val;
+        m_pWRAMBank[address - 0xD000] = val;
     }
     else if (address >= 0xE000 && address <= 0xEFFF)
     {
-        m_bank0[address - 0xE000] = val;
+        m_WRAM[address - 0xE000] = val;
     }
     else if (address >= 0xF000 && address <= 0xFDFF)
     {
-        m_bank1[address - 0xF000] = val;
+        m_pWRAMBank[address - 0xF000] = val;
     }
     else if (address >= 0xFF80 && address <= 0xFFFE)
     {
@@ -233,10 +395,34 @@ bool MMU::WriteByte(const ushort& address, const byte val)
     {
         m_isBooting = val;
     }
-    else if (address == 0xFF4D)
+    else if ((address == 0xFF70) && m_isCGB)
     {
-        m_Key1 = val;
+        // Bank 0 selects bank 1. Swapping the pointer keeps banked RAM as cheap as fixed RAM.
+        m_WRAMBank = ((val & 0x07) == 0x00) ? 0x01 : (val & 0x07);
+        m_pWRAMBank = m_WRAM + (m_WRAMBank * 0x1000);
     }
 
     return true;
 }
+
+const byte* MMU::GetMemoryBlock(const ushort& address)
+{
+    if (address >= 0xC000 && address <= 0xCFFF)
+    {
+        return &m_WRAM[address - 0xC000];
+    }
+    else if (address >= 0xD000 && address <= 0xDFFF)
+    {
+        return &m_pWRAMBank[address - 0xD000];
+    }
+    else if (address >= 0xE000 && address <= 0xEFFF)
+    {
+        return &m_WRAM[address - 0xE000];
+    }
+    else if (address >= 0xF000 && address <= 0xFDFF)
+    {
+        return &m_pWRAMBank[address - 0xF000];
+    }
+
+    return nullptr;
+}
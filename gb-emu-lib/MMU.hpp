@@ -1,37 +1,55 @@
 #pragma once
 
+#include <vector>
+
+#define WRAMSize    0x8000  // 8 4k work RAM banks
+#define HRAMSize    0x007F
+
+// Everything below 0xFE00 is mapped in 256 byte pages, the rest per address
+#define MMUPageCount        (0xFD + 1)
+#define MMUHighUnitCount    (0x01FF + 1)
+#define MMUPageTableSize    ((MMUPageCount + MMUHighUnitCount) * sizeof(IMemoryUnit*))
+
 class MMU : public IMMU, IMemoryUnit
 {
+    friend class JIT;
+
 public:
-    MMU();
+    MMU(byte* pWRAM = nullptr, IMemoryUnit** pPageTable = nullptr);
     ~MMU();
 
     void RegisterMemoryUnit(const ushort& startRange, const ushort& endRange, IMemoryUnit* pUnit);
+    void InstallInterposer(const ushort& address, MemoryInterposer* pInterposer);
+    void RemoveInterposer(const ushort& address, MemoryInterposer* pInterposer);
     unsigned short ReadUShort(const ushort& address);
     bool LoadBootROM(const char* bootROMPath);
+    void SetCGBMode(bool isCGB);
 
     byte Read(const ushort& address);
     bool Write(const ushort& address, const byte val);
+    const byte* ResolveBlock(const ushort& address);
+
+    void SaveState(StateWriter& writer);
+    void LoadState(StateReader& reader);
+
+    // The RAM as it is stored, only banks 0 and 1 of the work RAM outside CGB mode
+    const byte* GetWRAM();
+    unsigned int GetWRAMSize();
+    const byte* GetHRAM();
 
     // IMemoryUnit
     byte ReadByte(const ushort& address);
     bool WriteByte(const ushort& address, const byte val);
+    const byte* GetMemoryBlock(const ushort& address);
 
 private:
+    IMemoryUnit* GetMemoryUnit(const ushort& address);
+    IMemoryUnit*& GetMemoryEntry(const ushort& address);
+
     //byte ReadByteInternal(const ushort& address);
     //bool WriteByteInternal(const ushort& address, const byte val);
 
 private:
-    // Booting
-    byte m_isBooting;
-    std::unique_ptr<byte> m_BIOS;
-
-    // Memory
-    IMemoryUnit* m_memoryUnits[0xFFFF + 1];
-    byte m_bank0[0x0FFF + 1];   // 4k work RAM Bank 0
-    byte m_bank1[0x0FFF + 1];   // 4k work RAM Bank 1
-    byte m_HRAM[0x007E + 1];    // HRAM
-
     /*
         Interrupts
 
@@ -47,5 +65,28 @@ private:
     */
     byte m_IE; // Interrupt enable register (0xFFFF)
     byte m_IF; // Interrupt flag register (0xFF0F)
-    byte m_Key1;
+
+    // Booting
+    byte m_isBooting;
+    std::unique_ptr<byte> m_BIOS;
+
+    // Memory
+    byte* m_WRAM;               // WRAMSize bytes, only banks 0 and 1 are used in DMG mode
+    byte* m_pWRAMBank;          // The bank mapped at 0xD000-0xDFFF (and its echo)
+    byte m_WRAMBank;            // SVBK (0xFF70), CGB mode only
+    bool m_isCGB;
+    byte m_HRAM[HRAMSize];      // HRAM
+    std::unique_ptr<byte[]> m_spWRAM;   // Only used when no storage was handed in
+
+    /*
+        Everything below 0xFE00 is mapped in 256 byte pages, OAM and the I/O ports share their
+        pages with other units and are mapped per address. Both tables live in one block of
+        MMUPageTableSize bytes.
+    */
+    IMemoryUnit** m_memoryPages;                // 0x0000-0xFDFF
+    IMemoryUnit** m_highMemoryUnits;            // 0xFE00-0xFFFF
+    std::unique_ptr<IMemoryUnit*[]> m_spPageTable;  // Only used when no storage was handed in
+
+    // The interposers in front of a page (or high address), bottom first, only pages that have any
+    std::map<ushort, std::vector<MemoryInterposer*>> m_Interposers;
 };
@@ -0,0 +1,42 @@
+#include "pch.hpp"
+#include "MachineState.hpp"
+
+StateWriter::StateWriter()
+{
+}
+
+void StateWriter::Write(const void* pData, size_t size)
+{
+    const byte* pBytes = reinterpret_cast<const byte*>(pData);
+    m_Data.insert(m_Data.end(), pBytes, pBytes + size);
+}
+
+const std::vector<byte>& StateWriter::GetData()
+{
+    return m_Data;
+}
+
+StateReader::StateReader(const byte* pData, size_t size) :
+    m_pData(pData),
+    m_Size(size),
+    m_Offset(0),
+    m_IsValid(pData != nullptr)
+{
+}
+
+void StateReader::Read(void* pData, size_t size)
+{
+    if (!m_IsValid || (size > (m_Size - m_Offset)))
+    {
+        m_IsValid = false;
+        return;
+    }
+
+    memcpy(pData, m_pData + m_Offset, size);
+    m_Offset += size;
+}
+
+bool StateReader::IsComplete()
+{
+    return m_IsValid && (m_Offset == m_Size);
+}
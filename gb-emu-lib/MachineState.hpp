@@ -0,0 +1,46 @@
+#pragma once
+
+#include <vector>
+
+/*
+    Flat binary snapshots of the machine state.
+
+    Each component writes its fields in a fixed order and reads them back in the same order.
+    Values are stored in host byte order with no padding or tags, a snapshot is only meant to be
+    restored by the same build of the emulator. Bump MachineStateVersion whenever a component
+    changes what it writes.
+*/
+#define MachineStateVersion 3
+
+class StateWriter
+{
+public:
+    StateWriter();
+
+    void Write(const void* pData, size_t size);
+    template<typename T> void Write(const T& value) { Write(&value, sizeof(T)); }
+
+    const std::vector<byte>& GetData();
+
+private:
+    std::vector<byte> m_Data;
+};
+
+class StateReader
+{
+public:
+    StateReader(const byte* pData, size_t size);
+
+    // Reads past the end leave the destination untouched and mark the reader invalid
+    void Read(void* pData, size_t size);
+    template<typename T> void Read(T& value) { Read(&value, sizeof(T)); }
+
+    // True if every read succeeded and the whole snapshot was consumed
+    bool IsComplete();
+
+private:
+    const byte* m_pData;
+    size_t m_Size;
+    size_t m_Offset;
+    bool m_IsValid;
+};
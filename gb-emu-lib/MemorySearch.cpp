@@ -0,0 +1,278 @@
+#include "pch.hpp"
+#include "MemorySearch.hpp"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+    #define SEARCH_SSE2 1
+    #include <emmintrin.h>
+#endif
+
+#define WRAMBankSize        0x1000
+#define CartridgeRAMBankSize 0x2000
+
+MemorySearch::MemorySearch() :
+    m_Width(1),
+    m_WRAMSize(0),
+    m_Count(0)
+{
+}
+
+void MemorySearch::Start(CPU* pCPU, unsigned int width)
+{
+    m_Width = (width == 2) ? 2 : 1;
+    m_WRAMSize = pCPU->SnapshotRAM(m_Current);
+    m_Previous = m_Current;
+    m_Candidates.assign(m_Current.size(), 0xFF);
+    if (m_Current.empty())
+    {
+        Logger::LogError("MemorySearch: There is no machine to search");
+        m_Count = 0;
+        return;
+    }
+
+    if (m_Width == 2)
+    {
+        // A 16 bit value can not start on the last byte of a region or of a switchable bank
+        for (size_t index = WRAMBankSize * 2 - 1; index < m_WRAMSize; index += WRAMBankSize)
+        {
+            m_Candidates[index] = 0x00;
+        }
+
+        for (size_t index = m_WRAMSize + HRAMSize + CartridgeRAMBankSize - 1; index < m_Candidates.size(); index += CartridgeRAMBankSize)
+        {
+            m_Candidates[index] = 0x00;
+        }
+
+        m_Candidates[m_WRAMSize + HRAMSize - 1] = 0x00;
+        m_Candidates.back() = 0x00;
+    }
+
+    Count();
+}
+
+bool MemorySearch::Filter(CPU* pCPU, SearchComparison comparison, ushort value)
+{
+    m_Previous.swap(m_Current);
+    if ((pCPU->SnapshotRAM(m_Current) != m_WRAMSize) || (m_Current.size() != m_Candidates.size()))
+    {
+        Logger::LogError("MemorySearch: The RAM layout changed, the search has to start over");
+        return false;
+    }
+
+    if (m_Width == 2)
+    {
+        FilterWords(comparison, value);
+    }
+    else
+    {
+        FilterBytes(comparison, static_cast<byte>(value));
+    }
+
+    Count();
+    return true;
+}
+
+unsigned int MemorySearch::GetCount()
+{
+    return m_Count;
+}
+
+std::vector<SearchResult> MemorySearch::GetResults(unsigned int maxResults)
+{
+    std::vector<SearchResult> results;
+    for (size_t index = 0; (index < m_Candidates.size()) && (results.size() < maxResults); index++)
+    {
+        if (m_Candidates[index] == 0x00)
+        {
+            continue;
+        }
+
+        SearchResult result;
+        result.value = m_Current[index];
+        if (m_Width == 2)
+        {
+            result.value |= m_Current[index + 1] << 8;
+        }
+
+        size_t HRAMStart = m_WRAMSize;
+        size_t cartridgeRAMStart = m_WRAMSize + HRAMSize;
+        if (index < WRAMBankSize)
+        {
+            result.address = static_cast<ushort>(0xC000 + index);
+            result.bank = 0;
+        }
+        else if (index < HRAMStart)
+        {
+            result.address = static_cast<ushort>(0xD000 + (index % WRAMBankSize));
+            result.bank = static_cast<byte>(index / WRAMBankSize);
+        }
+        else if (index < cartridgeRAMStart)
+        {
+            result.address = static_cast<ushort>(0xFF80 + (index - HRAMStart));
+            result.bank = 0;
+        }
+        else
+        {
+            result.address = static_cast<ushort>(0xA000 + ((index - cartridgeRAMStart) % CartridgeRAMBankSize));
+            result.bank = static_cast<byte>((index - cartridgeRAMStart) / CartridgeRAMBankSize);
+        }
+
+        results.push_back(result);
+    }
+
+    return results;
+}
+
+void MemorySearch::FilterBytes(SearchComparison comparison, byte value)
+{
+    const byte* pCurrent = m_Current.data();
+    const byte* pPrevious = m_Previous.data();
+    byte* pCandidates = m_Candidates.data();
+    size_t size = m_Candidates.size();
+    size_t index = 0;
+
+#if SEARCH_SSE2
+    const __m128i values = _mm_set1_epi8(static_cast<char>(value));
+    for (; index + 16 <= size; index += 16)
+    {
+        __m128i current = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pCurrent + index));
+        __m128i previous = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pPrevious + index));
+        __m128i candidates = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pCandidates + index));
+
+        __m128i equal = _mm_cmpeq_epi8(current, previous);
+        __m128i pass;
+        switch (comparison)
+        {
+        case SearchEqual:
+            pass = _mm_cmpeq_epi8(current, values);
+            break;
+        case SearchChanged:
+            pass = _mm_andnot_si128(equal, _mm_set1_epi8(-1));
+            break;
+        case SearchUnchanged:
+            pass = equal;
+            break;
+        case SearchIncreased:
+            pass = _mm_andnot_si128(equal, _mm_cmpeq_epi8(_mm_max_epu8(current, previous), current));
+            break;
+        default:
+            pass = _mm_andnot_si128(equal, _mm_cmpeq_epi8(_mm_min_epu8(current, previous), current));
+            break;
+        }
+
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(pCandidates + index), _mm_and_si128(candidates, pass));
+    }
+#endif
+
+    for (; index < size; index++)
+    {
+        if (!Compare(comparison, pCurrent[index], pPrevious[index], value))
+        {
+            pCandidates[index] = 0x00;
+        }
+    }
+}
+
+void MemorySearch::FilterWords(SearchComparison comparison, ushort value)
+{
+    const byte* pCurrent = m_Current.data();
+    const byte* pPrevious = m_Previous.data();
+    byte* pCandidates = m_Candidates.data();
+    size_t size = m_Candidates.size();
+    size_t index = 0;
+
+#if SEARCH_SSE2
+    /*
+        Each 16 byte block is done as two sets of 8 words, one starting at every even byte of the
+        block and one at every odd byte. The pass mask of the even words goes to the low byte of
+        each word, that of the odd ones to the high byte. Unsigned compares flip the sign bit first.
+    */
+    const __m128i values = _mm_set1_epi16(static_cast<short>(value));
+    const __m128i signBits = _mm_set1_epi16(static_cast<short>(0x8000));
+    const __m128i lowBytes = _mm_set1_epi16(0x00FF);
+    __m128i pass[2];
+    for (; index + 17 <= size; index += 16)
+    {
+        for (int odd = 0; odd < 2; odd++)
+        {
+            __m128i current = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pCurrent + index + odd));
+            __m128i previous = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pPrevious + index + odd));
+            switch (comparison)
+            {
+            case SearchEqual:
+                pass[odd] = _mm_cmpeq_epi16(current, values);
+                break;
+            case SearchChanged:
+                pass[odd] = _mm_andnot_si128(_mm_cmpeq_epi16(current, previous), _mm_set1_epi8(-1));
+                break;
+            case SearchUnchanged:
+                pass[odd] = _mm_cmpeq_epi16(current, previous);
+                break;
+            case SearchIncreased:
+                pass[odd] = _mm_cmpgt_epi16(_mm_xor_si128(current, signBits), _mm_xor_si128(previous, signBits));
+                break;
+            default:
+                pass[odd] = _mm_cmpgt_epi16(_mm_xor_si128(previous, signBits), _mm_xor_si128(current, signBits));
+                break;
+            }
+        }
+
+        __m128i candidates = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pCandidates + index));
+        __m128i combined = _mm_or_si128(_mm_and_si128(pass[0], lowBytes), _mm_andnot_si128(lowBytes, pass[1]));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(pCandidates + index), _mm_and_si128(candidates, combined));
+    }
+#endif
+
+    for (; index + 1 < size; index++)
+    {
+        unsigned int current = pCurrent[index] | (pCurrent[index + 1] << 8);
+        unsigned int previous = pPrevious[index] | (pPrevious[index + 1] << 8);
+        if (!Compare(comparison, current, previous, value))
+        {
+            pCandidates[index] = 0x00;
+        }
+    }
+}
+
+bool MemorySearch::Compare(SearchComparison comparison, unsigned int current, unsigned int previous, unsigned int value)
+{
+    switch (comparison)
+    {
+    case SearchEqual:
+        return current == value;
+    case SearchChanged:
+        return current != previous;
+    case SearchUnchanged:
+        return current == previous;
+    case SearchIncreased:
+        return current > previous;
+    default:
+        return current < previous;
+    }
+}
+
+void MemorySearch::Count()
+{
+    // Every candidate is 0xFF, so the sum of the mask divided by 0xFF is the count
+    const byte* pCandidates = m_Candidates.data();
+    size_t size = m_Candidates.size();
+    size_t index = 0;
+    unsigned int count = 0;
+
+#if SEARCH_SSE2
+    __m128i sums = _mm_setzero_si128();
+    for (; index + 16 <= size; index += 16)
+    {
+        __m128i candidates = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pCandidates + index));
+        sums = _mm_add_epi64(sums, _mm_sad_epu8(candidates, _mm_setzero_si128()));
+    }
+
+    count = static_cast<unsigned int>(_mm_cvtsi128_si32(sums) + _mm_cvtsi128_si32(_mm_srli_si128(sums, 8)));
+#endif
+
+    for (; index < size; index++)
+    {
+        count += pCandidates[index];
+    }
+
+    m_Count = count / 0xFF;
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include "CPU.hpp"
+
+#include <vector>
+
+enum SearchComparison
+{
+    SearchEqual,        // Equal to the given value
+    SearchChanged,      // The rest compare against the previous snapshot
+    SearchUnchanged,
+    SearchIncreased,
+    SearchDecreased,
+};
+
+struct SearchResult
+{
+    ushort address;
+    byte bank;          // SVBK bank for 0xD000-0xDFFF, cartridge RAM bank for 0xA000-0xBFFF, 0 otherwise
+    ushort value;
+};
+
+/*
+    Finds the RAM addresses that hold a value, e.g. the lives or the score of a game, by narrowing
+    down a set of candidates over several snapshots.
+
+    Start takes a snapshot of the work RAM, HRAM and cartridge RAM (see CPU::SnapshotRAM) and makes
+    every address a candidate. Each Filter takes a new snapshot and drops the candidates that do not
+    pass the comparison. Values are 8 bit or little endian 16 bit, at any address. Candidates are
+    kept as a byte mask over the snapshot so each pass is a straight run over both snapshots, 16
+    addresses at a time with SSE2.
+
+    A search is not tied to a machine, it can narrow down over any machine running the same game.
+*/
+class MemorySearch
+{
+public:
+    MemorySearch();
+
+    void Start(CPU* pCPU, unsigned int width);
+    bool Filter(CPU* pCPU, SearchComparison comparison, ushort value = 0);
+    unsigned int GetCount();
+    std::vector<SearchResult> GetResults(unsigned int maxResults);
+
+private:
+    void FilterBytes(SearchComparison comparison, byte value);
+    void FilterWords(SearchComparison comparison, ushort value);
+    static bool Compare(SearchComparison comparison, unsigned int current, unsigned int previous, unsigned int value);
+    void Count();
+
+private:
+    unsigned int m_Width;           // 1 or 2 bytes
+    unsigned int m_WRAMSize;        // The snapshots hold the work RAM, then HRAM, then the cartridge RAM
+    unsigned int m_Count;
+    std::vector<byte> m_Current;
+    std::vector<byte> m_Previous;
+    std::vector<byte> m_Candidates; // 0xFF for an address that is still a candidate, 0x00 otherwise
+};
@@ -0,0 +1,407 @@
+#include "pch.hpp"
+#include "Recorder.hpp"
+
+#include "GPU.hpp"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+    #define RECORDER_SSE2 1
+    #include <emmintrin.h>
+#endif
+
+#define FrameWidth      160
+#define FrameHeight     144
+#define LumaSize        (FrameWidth * FrameHeight)
+#define ChromaSize      (LumaSize / 4)
+#define RGBFrameSize    (LumaSize * 3)
+
+const char Y4MHeader[] = "YUV4MPEG2 W160 H144 F4194304:70224 Ip A1:1 C420jpeg\n";
+const char Y4MFrameHeader[] = "FRAME\n";
+
+// The pixels are A B G R in memory, see GPU::MakePixel
+static byte Luma(const byte* pPixel)
+{
+    return static_cast<byte>(((66 * pPixel[3] + 129 * pPixel[2] + 25 * pPixel[1] + 128) >> 8) + 16);
+}
+
+// The sums of 2x2 pixels are weighted, the offset of 128 << 10 keeps the shift off negative values
+static byte Chroma(const byte* pTop, const byte* pBottom, int red, int green, int blue)
+{
+    int R = pTop[3] + pTop[7] + pBottom[3] + pBottom[7];
+    int G = pTop[2] + pTop[6] + pBottom[2] + pBottom[6];
+    int B = pTop[1] + pTop[5] + pBottom[1] + pBottom[5];
+    return static_cast<byte>((red * R + green * G + blue * B + 512 + (128 << 10)) >> 10);
+}
+
+#if RECORDER_SSE2
+// Adds the two 32 bit halves of each 64 bit lane of both and returns the four sums in order
+static __m128i AddPairs(__m128i low, __m128i high)
+{
+    low = _mm_add_epi32(low, _mm_srli_epi64(low, 32));
+    high = _mm_add_epi32(high, _mm_srli_epi64(high, 32));
+    return _mm_unpacklo_epi64(_mm_shuffle_epi32(low, _MM_SHUFFLE(3, 1, 2, 0)), _mm_shuffle_epi32(high, _MM_SHUFFLE(3, 1, 2, 0)));
+}
+
+// The weighted sums of 4 pixels as 32 bit values
+static __m128i Weigh4(const byte* pPixels, __m128i coefficients)
+{
+    __m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pPixels));
+    __m128i low = _mm_madd_epi16(_mm_unpacklo_epi8(pixels, _mm_setzero_si128()), coefficients);
+    __m128i high = _mm_madd_epi16(_mm_unpackhi_epi8(pixels, _mm_setzero_si128()), coefficients);
+    return AddPairs(low, high);
+}
+
+// The weighted 2x2 sums of 4 pixels on two lines, as two pairs of 32 bit values to add up
+static __m128i WeighBlocks2(const byte* pTop, const byte* pBottom, __m128i coefficients)
+{
+    __m128i top = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pTop));
+    __m128i bottom = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pBottom));
+    __m128i low = _mm_add_epi16(_mm_unpacklo_epi8(top, _mm_setzero_si128()), _mm_unpacklo_epi8(bottom, _mm_setzero_si128()));
+    __m128i high = _mm_add_epi16(_mm_unpackhi_epi8(top, _mm_setzero_si128()), _mm_unpackhi_epi8(bottom, _mm_setzero_si128()));
+    __m128i sums = _mm_unpacklo_epi64(_mm_add_epi16(low, _mm_srli_si128(low, 8)), _mm_add_epi16(high, _mm_srli_si128(high, 8)));
+    return _mm_madd_epi16(sums, coefficients);
+}
+
+// 8 chroma samples from 16 pixels on two lines
+static void Chroma8(const byte* pTop, const byte* pBottom, __m128i coefficients, byte* pOut)
+{
+    const __m128i rounding = _mm_set1_epi32(512 + (128 << 10));
+    __m128i first = AddPairs(WeighBlocks2(pTop, pBottom, coefficients), WeighBlocks2(pTop + 16, pBottom + 16, coefficients));
+    __m128i second = AddPairs(WeighBlocks2(pTop + 32, pBottom + 32, coefficients), WeighBlocks2(pTop + 48, pBottom + 48, coefficients));
+    first = _mm_srli_epi32(_mm_add_epi32(first, rounding), 10);
+    second = _mm_srli_epi32(_mm_add_epi32(second, rounding), 10);
+    __m128i words = _mm_packs_epi32(first, second);
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(pOut), _mm_packus_epi16(words, words));
+}
+#endif
+
+Recorder::Recorder() :
+    m_pGPU(nullptr),
+    m_Format(RecordingY4M),
+    m_Head(0),
+    m_Tail(0),
+    m_Frames(0),
+    m_Dropped(0),
+    m_IsWriterStopping(false),
+    m_Written(0),
+    m_Samples(0),
+    m_SampleRemainder(0)
+{
+}
+
+Recorder::~Recorder()
+{
+    Stop();
+}
+
+/*
+    Starts a new recording, the pool and the writer thread only exist while recording. Start and
+    Stop must not run at the same time as AddFrame, call them from the thread that steps the
+    emulator.
+*/
+bool Recorder::Start(const char* path, RecordingFormat format)
+{
+    Stop();
+
+    m_Path = path;
+    m_Format = format;
+    std::string audioPath = m_Path + ".wav";
+    m_VideoFile.open(path, std::ios::out | std::ios::binary | std::ios::trunc);
+    m_AudioFile.open(audioPath, std::ios::out | std::ios::binary | std::ios::trunc);
+    if (m_VideoFile.is_open() && (m_Format == RecordingY4M))
+    {
+        m_VideoFile.write(Y4MHeader, sizeof(Y4MHeader) - 1);
+    }
+
+    if (!m_VideoFile.is_open() || !m_AudioFile.is_open() || !m_VideoFile || !WriteWAVHeader(0))
+    {
+        Logger::LogError("Recorder: Failed to open %s and %s", path, audioPath.c_str());
+        m_VideoFile.close();
+        m_AudioFile.close();
+        return false;
+    }
+
+    m_Pool.resize(RecorderPoolSize);
+    for (Slot& slot : m_Pool)
+    {
+        slot.spPixels = std::unique_ptr<byte[]>(new byte[DisplayBufferSize]);
+        slot.frame = 0;
+    }
+
+    // Black until the first frame is written
+    if (m_Format == RecordingY4M)
+    {
+        m_Converted.assign(LumaSize + ChromaSize * 2, 128);
+        memset(m_Converted.data(), 16, LumaSize);
+    }
+    else
+    {
+        m_Converted.assign(RGBFrameSize, 0);
+    }
+
+    m_Head = 0;
+    m_Tail = 0;
+    m_Frames = 0;
+    m_Dropped = 0;
+    m_Written = 0;
+    m_Samples = 0;
+    m_SampleRemainder = 0;
+    m_IsWriterStopping = false;
+    m_Writer = std::thread(&Recorder::RunWriter, this);
+
+    if (m_pGPU != nullptr)
+    {
+        m_pGPU->AttachDisplay();
+    }
+
+    Logger::Log("Recorder: Recording to %s and %s", path, audioPath.c_str());
+    return true;
+}
+
+// Writes what is left in the pool and closes the files
+void Recorder::Stop()
+{
+    if (!m_Writer.joinable())
+    {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_WriterMutex);
+        m_IsWriterStopping = true;
+    }
+
+    m_WriterCondition.notify_one();
+    m_Writer.join();
+
+    // The sizes in the WAV header are only known now
+    m_AudioFile.seekp(0);
+    WriteWAVHeader(m_Samples);
+    if (!m_VideoFile || !m_AudioFile)
+    {
+        Logger::LogError("Recorder: Failed to write %s", m_Path.c_str());
+    }
+
+    m_VideoFile.close();
+    m_AudioFile.close();
+    m_Pool.clear();
+
+    Logger::Log("Recorder: Wrote %llu frames to %s, %llu of them were dropped", GetFrameCount(), m_Path.c_str(), GetDroppedCount());
+}
+
+bool Recorder::IsRecording()
+{
+    return m_Writer.joinable();
+}
+
+void Recorder::SetGPU(GPU* pGPU)
+{
+    m_pGPU = pGPU;
+}
+
+void Recorder::AddFrame(const byte* pPixels)
+{
+    if (m_Pool.empty())
+    {
+        return;
+    }
+
+    unsigned long long frame = m_Frames.load(std::memory_order_relaxed);
+    unsigned long long head = m_Head.load(std::memory_order_relaxed);
+    if (head - m_Tail.load(std::memory_order_acquire) >= m_Pool.size())
+    {
+        m_Dropped.store(m_Dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        m_Frames.store(frame + 1, std::memory_order_release);
+        return;
+    }
+
+    Slot& slot = m_Pool[static_cast<size_t>(head % m_Pool.size())];
+    memcpy(slot.spPixels.get(), pPixels, DisplayBufferSize);
+    slot.frame = frame;
+    m_Frames.store(frame + 1, std::memory_order_release);
+    m_Head.store(head + 1, std::memory_order_release);
+
+    // Does not wait for the writer, a missed wakeup only costs RecorderWriterInterval
+    m_WriterCondition.notify_one();
+}
+
+unsigned long long Recorder::GetFrameCount()
+{
+    return m_Frames.load(std::memory_order_acquire);
+}
+
+unsigned long long Recorder::GetDroppedCount()
+{
+    return m_Dropped.load(std::memory_order_relaxed);
+}
+
+void Recorder::ConvertToYUV(const byte* pPixels, byte* pY, byte* pU, byte* pV)
+{
+    const unsigned int stride = FrameWidth * 4;
+    for (unsigned int y = 0; y < FrameHeight; y++)
+    {
+        const byte* pLine = pPixels + y * stride;
+        byte* pLuma = pY + y * FrameWidth;
+        unsigned int x = 0;
+
+#if RECORDER_SSE2
+        const __m128i coefficients = _mm_setr_epi16(0, 25, 129, 66, 0, 25, 129, 66);
+        const __m128i rounding = _mm_set1_epi32(128);
+        const __m128i offset = _mm_set1_epi32(16);
+        for (; x + 16 <= FrameWidth; x += 16)
+        {
+            __m128i values[4];
+            for (int index = 0; index < 4; index++)
+            {
+                __m128i sums = Weigh4(pLine + (x + index * 4) * 4, coefficients);
+                values[index] = _mm_add_epi32(_mm_srli_epi32(_mm_add_epi32(sums, rounding), 8), offset);
+            }
+
+            __m128i low = _mm_packs_epi32(values[0], values[1]);
+            __m128i high = _mm_packs_epi32(values[2], values[3]);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(pLuma + x), _mm_packus_epi16(low, high));
+        }
+#endif
+
+        for (; x < FrameWidth; x++)
+        {
+            pLuma[x] = Luma(pLine + x * 4);
+        }
+    }
+
+    for (unsigned int y = 0; y < FrameHeight; y += 2)
+    {
+        const byte* pTop = pPixels + y * stride;
+        const byte* pBottom = pTop + stride;
+        byte* pBlue = pU + (y / 2) * (FrameWidth / 2);
+        byte* pRed = pV + (y / 2) * (FrameWidth / 2);
+        unsigned int x = 0;
+
+#if RECORDER_SSE2
+        const __m128i blueCoefficients = _mm_setr_epi16(0, 112, -74, -38, 0, 112, -74, -38);
+        const __m128i redCoefficients = _mm_setr_epi16(0, -18, -94, 112, 0, -18, -94, 112);
+        for (; x + 16 <= FrameWidth; x += 16)
+        {
+            Chroma8(pTop + x * 4, pBottom + x * 4, blueCoefficients, pBlue + x / 2);
+            Chroma8(pTop + x * 4, pBottom + x * 4, redCoefficients, pRed + x / 2);
+        }
+#endif
+
+        for (; x < FrameWidth; x += 2)
+        {
+            pBlue[x / 2] = Chroma(pTop + x * 4, pBottom + x * 4, -38, -74, 112);
+            pRed[x / 2] = Chroma(pTop + x * 4, pBottom + x * 4, 112, -94, -18);
+        }
+    }
+}
+
+void Recorder::ConvertToRGB(const byte* pPixels, byte* pRGB)
+{
+    for (unsigned int index = 0; index < LumaSize; index++)
+    {
+        pRGB[index * 3 + 0] = pPixels[index * 4 + 3];
+        pRGB[index * 3 + 1] = pPixels[index * 4 + 2];
+        pRGB[index * 3 + 2] = pPixels[index * 4 + 1];
+    }
+}
+
+void Recorder::RunWriter()
+{
+    std::unique_lock<std::mutex> lock(m_WriterMutex);
+    while (true)
+    {
+        unsigned long long tail = m_Tail.load(std::memory_order_relaxed);
+        if (tail != m_Head.load(std::memory_order_acquire))
+        {
+            const Slot& slot = m_Pool[static_cast<size_t>(tail % m_Pool.size())];
+            WriteFrame(slot.spPixels.get(), slot.frame - m_Written);
+            m_Tail.store(tail + 1, std::memory_order_release);
+            continue;
+        }
+
+        if (m_IsWriterStopping)
+        {
+            break;
+        }
+
+        m_WriterCondition.wait_for(lock, std::chrono::milliseconds(RecorderWriterInterval));
+    }
+
+    // Frames dropped after the last one that made it
+    WriteFrame(nullptr, m_Frames.load(std::memory_order_acquire) - m_Written);
+}
+
+// Writes the previous frame again for each frame dropped before this one, then this one
+void Recorder::WriteFrame(const byte* pPixels, unsigned long long repeats)
+{
+    for (unsigned long long index = 0; index < repeats; index++)
+    {
+        WriteConverted();
+    }
+
+    if (pPixels == nullptr)
+    {
+        return;
+    }
+
+    if (m_Format == RecordingY4M)
+    {
+        byte* pY = m_Converted.data();
+        ConvertToYUV(pPixels, pY, pY + LumaSize, pY + LumaSize + ChromaSize);
+    }
+    else
+    {
+        ConvertToRGB(pPixels, m_Converted.data());
+    }
+
+    WriteConverted();
+}
+
+// One frame of video and the audio for the same time
+void Recorder::WriteConverted()
+{
+    if (m_Format == RecordingY4M)
+    {
+        m_VideoFile.write(Y4MFrameHeader, sizeof(Y4MFrameHeader) - 1);
+    }
+
+    m_VideoFile.write(reinterpret_cast<const char*>(m_Converted.data()), static_cast<std::streamsize>(m_Converted.size()));
+    m_Written++;
+
+    m_SampleRemainder += static_cast<unsigned long long>(RecorderFrameCycles) * RecorderSampleRate;
+    unsigned long long samples = m_SampleRemainder / RecorderSecondCycles;
+    m_SampleRemainder %= RecorderSecondCycles;
+
+    static const short silence[RecorderSampleRate / 50] = {};
+    m_AudioFile.write(reinterpret_cast<const char*>(silence), static_cast<std::streamsize>(samples * sizeof(short)));
+    m_Samples += samples;
+}
+
+// 16 bit mono PCM, little endian like the rest of the format
+bool Recorder::WriteWAVHeader(unsigned long long samples)
+{
+    unsigned int dataSize = static_cast<unsigned int>(samples * sizeof(short));
+    byte header[44];
+    auto put = [&header](unsigned int offset, unsigned int value, unsigned int size)
+    {
+        for (unsigned int index = 0; index < size; index++)
+        {
+            header[offset + index] = static_cast<byte>(value >> (index * 8));
+        }
+    };
+
+    memcpy(header + 0, "RIFF", 4);
+    put(4, 36 + dataSize, 4);
+    memcpy(header + 8, "WAVEfmt ", 8);
+    put(16, 16, 4);                                 // Size of the format chunk
+    put(20, 1, 2);                                  // PCM
+    put(22, 1, 2);                                  // Channels
+    put(24, RecorderSampleRate, 4);
+    put(28, RecorderSampleRate * sizeof(short), 4); // Bytes per second
+    put(32, sizeof(short), 2);                      // Bytes per sample
+    put(34, 16, 2);                                 // Bits per sample
+    memcpy(header + 36, "data", 4);
+    put(40, dataSize, 4);
+
+    m_AudioFile.write(reinterpret_cast<const char*>(header), sizeof(header));
+    return m_AudioFile.good();
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define RecorderPoolSize        16          // Frames that can wait for the writer, later ones are dropped
+#define RecorderWriterInterval  10          // Milliseconds the writer sleeps when it runs out of frames
+#define RecorderSampleRate      48000       // Audio samples per second, the rate the APU plays at
+#define RecorderFrameCycles     70224       // Cycles per frame and per second at normal speed
+#define RecorderSecondCycles    4194304
+
+class GPU;
+
+enum RecordingFormat
+{
+    RecordingY4M,       // YUV4MPEG2, 4:2:0, readable by most video tools
+    RecordingRGB,       // Raw 24 bit RGB frames, nothing else
+};
+
+/*
+    Records the frames shown at VSync to a video file and a WAV file next to it (path + ".wav").
+
+    AddFrame runs on the emulation thread and never waits: it copies the frame into a free slot of
+    a pool allocated by Start and hands the slot to a writer thread through a lock free ring. If the
+    writer is so far behind that the pool is full, the frame is dropped and counted instead. The
+    writer converts and writes the frames in order and writes the previous frame again in place of
+    a dropped one, so the video keeps the length of the emulated time.
+
+    The audio track gets one frame's worth of samples per frame, recorded or dropped, so both files
+    always cover the same time. The APU does not make samples yet, so the track is silent for now.
+*/
+class Recorder
+{
+public:
+    Recorder();
+    ~Recorder();
+
+    bool Start(const char* path, RecordingFormat format);
+    void Stop();
+    bool IsRecording();
+
+    // Set by GPU::SetRecorder, Start has it draw its display from then on
+    void SetGPU(GPU* pGPU);
+
+    // The frame is RGBA8888 as the GPU draws it, 160x144
+    void AddFrame(const byte* pPixels);
+
+    unsigned long long GetFrameCount();
+    unsigned long long GetDroppedCount();
+
+    // 4:2:0 with each chroma sample the average of 2x2 pixels, BT.601 studio range
+    static void ConvertToYUV(const byte* pPixels, byte* pY, byte* pU, byte* pV);
+    static void ConvertToRGB(const byte* pPixels, byte* pRGB);
+
+private:
+    struct Slot
+    {
+        std::unique_ptr<byte[]> spPixels;
+        unsigned long long frame;   // Frames before it, counting the dropped ones
+    };
+
+    void RunWriter();
+    void WriteFrame(const byte* pPixels, unsigned long long repeats);
+    void WriteConverted();
+    bool WriteWAVHeader(unsigned long long samples);
+
+private:
+    GPU* m_pGPU;
+    std::string m_Path;
+    RecordingFormat m_Format;
+    std::vector<Slot> m_Pool;
+    std::atomic<unsigned long long> m_Head;     // Slots handed to the writer so far
+    std::atomic<unsigned long long> m_Tail;     // Slots the writer is done with
+    std::atomic<unsigned long long> m_Frames;   // Frames added, counting the dropped ones
+    std::atomic<unsigned long long> m_Dropped;
+
+    // Writer
+    std::thread m_Writer;
+    std::mutex m_WriterMutex;
+    std::condition_variable m_WriterCondition;
+    bool m_IsWriterStopping;
+    std::ofstream m_VideoFile;
+    std::ofstream m_AudioFile;
+    std::vector<byte> m_Converted;              // The last frame written, ready to be written again
+    unsigned long long m_Written;               // Frames written, counting the repeated ones
+    unsigned long long m_Samples;               // Audio samples written
+    unsigned long long m_SampleRemainder;       // Fraction of a sample left over, in cycles times the sample rate
+};
@@ -1,17 +1,129 @@
 #include "pch.hpp"
 #include "Serial.hpp"
 
-// FF01 - SB - Serial transfer data (R/W)
-// FF02 - SC - Serial Transfer Control (R/W)
-#define SerialTransferData 0xFF01
-#define SerialTransferControl 0xFF02
+#include <algorithm>
+#include <thread>
 
-Serial::Serial()
+#define IsTransferStarted ISBITSET(m_Control, 7)
+#define IsInternalClock ISBITSET(m_Control, 0)
+
+Serial::Serial(ICPU* pCPU) :
+    m_CPU(pCPU),
+    m_Port(nullptr),
+    m_Data(0x00),
+    m_Control(0x00),
+    m_Cycles(0),
+    m_TransferCycle(0),
+    m_IsTransferring(false),
+    m_CyclesPerByte(SerialCyclesPerByte),
+    m_SyncWindow(SerialCyclesPerByte),
+    m_PeerCycles(0),
+    m_SentCycles(0),
+    m_PolledCycles(0),
+    m_HasReply(false),
+    m_Reply(0xFF),
+    m_HasIncoming(false),
+    m_IncomingCycle(0),
+    m_IncomingData(0xFF)
 {
 }
 
 Serial::~Serial()
 {
+    Connect(nullptr);
+}
+
+void Serial::Step(unsigned long cycles)
+{
+    m_Cycles += cycles;
+
+    if (m_Port != nullptr)
+    {
+        // Polling the port can be expensive (a system call for sockets), so only do it a few times
+        // per sync window. We cannot miss anything by this: we never run past what we know of the
+        // peer plus the window, and have to poll before we may go further.
+        if ((m_Cycles - m_PolledCycles) >= (m_SyncWindow / 4))
+        {
+            ReceiveMessages();
+        }
+
+        if (m_HasIncoming && (m_Cycles >= m_IncomingCycle))
+        {
+            // The peer clocked a byte in, take part if we were waiting for it
+            LinkMessage reply = { LinkMessageReply, m_Data, false, m_Cycles };
+            if (IsTransferStarted && !IsInternalClock)
+            {
+                reply.isAccepted = true;
+                CompleteTransfer(m_IncomingData);
+            }
+
+            m_HasIncoming = false;
+            m_Port->Send(reply);
+        }
+
+        if ((m_Cycles - m_SentCycles) >= (m_SyncWindow / 4))
+        {
+            SendTime();
+        }
+
+        if (m_Cycles > (m_PeerCycles + m_SyncWindow))
+        {
+            WaitForPeer();
+        }
+    }
+
+    if (m_IsTransferring && (m_Cycles >= m_TransferCycle))
+    {
+        m_IsTransferring = false;
+        if (m_Port == nullptr)
+        {
+            // Nobody on the other end, the input line stays high
+            CompleteTransfer(0xFF);
+        }
+        else
+        {
+            WaitForReply();
+            CompleteTransfer(m_Reply);
+        }
+    }
+}
+
+// See GPU::GetCyclesUntilEvent. A linked port has to be stepped every time to keep up with the peer.
+unsigned long Serial::GetCyclesUntilEvent()
+{
+    if (m_Port != nullptr)
+    {
+        return 0;
+    }
+
+    if (m_IsTransferring)
+    {
+        return (m_TransferCycle > m_Cycles) ? static_cast<unsigned long>(m_TransferCycle - m_Cycles) : 1;
+    }
+
+    return NoEventCycles;
+}
+
+void Serial::Connect(ILinkPort* pPort)
+{
+    if (m_Port != nullptr)
+    {
+        m_Port->Disconnect();
+    }
+
+    m_Port = pPort;
+    m_Cycles = 0;
+    m_PeerCycles = 0;
+    m_SentCycles = 0;
+    m_PolledCycles = 0;
+    m_HasReply = false;
+    m_HasIncoming = false;
+    m_IsTransferring = false;
+}
+
+void Serial::SetSyncWindow(unsigned long cycles)
+{
+    m_SyncWindow = (cycles < 4) ? 4 : cycles;
 }
 
 // IMemoryUnit
@@ -22,8 +134,8 @@ byte Serial::ReadByte(const ushort& address)
     case SerialTransferData:
         return m_Data;
     case SerialTransferControl:
-        Logger::Log("Serial::ReadByte is not implemented for address 0x%04X", address);
-        return 0x00;
+        // Bits 6-1 are unused and read back as 1
+        return m_Control | 0x7E;
     default:
         Logger::Log("Serial::ReadByte cannot read from address 0x%04X", address);
         return 0x00;
@@ -43,9 +155,143 @@ bool Serial::WriteByte(const ushort& address, const byte val)
             // Tests
             Logger::LogCharacter(m_Data);
         }
+
+        m_Control = val & 0x81;
+        if (IsTransferStarted && IsInternalClock)
+        {
+            StartTransfer();
+        }
         return true;
     default:
         Logger::Log("Serial::WriteByte cannot write to address 0x%04X", address);
         return false;
     }
 }
+
+void Serial::SetDoubleSpeed(bool isDoubleSpeed)
+{
+    m_CyclesPerByte = isDoubleSpeed ? (SerialCyclesPerByte / 2) : SerialCyclesPerByte;
+}
+
+// The link cable is not part of the state, a connected peer keeps its own clock
+void Serial::SaveState(StateWriter& writer)
+{
+    writer.Write(m_Data);
+    writer.Write(m_Control);
+    writer.Write(m_Cycles);
+    writer.Write(m_TransferCycle);
+    writer.Write(m_IsTransferring);
+    writer.Write(m_CyclesPerByte);
+}
+
+void Serial::LoadState(StateReader& reader)
+{
+    reader.Read(m_Data);
+    reader.Read(m_Control);
+    reader.Read(m_Cycles);
+    reader.Read(m_TransferCycle);
+    reader.Read(m_IsTransferring);
+    reader.Read(m_CyclesPerByte);
+}
+
+void Serial::StartTransfer()
+{
+    m_IsTransferring = true;
+    m_TransferCycle = m_Cycles + m_CyclesPerByte;
+    m_HasReply = false;
+
+    if (m_Port != nullptr)
+    {
+        LinkMessage message = { LinkMessageTransfer, m_Data, false, m_TransferCycle };
+        m_Port->Send(message);
+    }
+}
+
+void Serial::CompleteTransfer(byte data)
+{
+    m_Data = data;
+    m_Control = CLEARBIT(m_Control, 7);
+
+    if (m_CPU != nullptr)
+    {
+        m_CPU->TriggerInterrupt(INT58);
+    }
+}
+
+void Serial::ReceiveMessages()
+{
+    m_PolledCycles = m_Cycles;
+
+    LinkMessage message;
+    while (m_Port->Receive(message))
+    {
+        switch (message.type)
+        {
+        case LinkMessageTime:
+            m_PeerCycles = std::max(m_PeerCycles, message.cycle);
+            break;
+        case LinkMessageTransfer:
+            // The peer sent this when it started the transfer, one byte time before completion (or
+            // half of that in double speed, which only makes this estimate more conservative). A
+            // double speed peer can start before cycle SerialCyclesPerByte, so stop at 0.
+            m_HasIncoming = true;
+            m_IncomingCycle = message.cycle;
+            m_IncomingData = message.data;
+            if (message.cycle > SerialCyclesPerByte)
+            {
+                m_PeerCycles = std::max(m_PeerCycles, message.cycle - SerialCyclesPerByte);
+            }
+            break;
+        case LinkMessageReply:
+            m_HasReply = true;
+            m_Reply = message.isAccepted ? message.data : 0xFF;
+            m_PeerCycles = std::max(m_PeerCycles, message.cycle);
+            break;
+        }
+    }
+}
+
+void Serial::SendTime()
+{
+    LinkMessage message = { LinkMessageTime, 0x00, false, m_Cycles };
+    m_Port->Send(message);
+    m_SentCycles = m_Cycles;
+}
+
+// Blocks while we are more than the sync window ahead of the peer
+void Serial::WaitForPeer()
+{
+    if (m_SentCycles != m_Cycles)
+    {
+        // Make sure the peer knows where we are, or it may be waiting on us in turn
+        SendTime();
+    }
+
+    while (m_Port->IsConnected() && (m_Cycles > (m_PeerCycles + m_SyncWindow)))
+    {
+        std::this_thread::yield();
+        ReceiveMessages();
+    }
+}
+
+// Blocks until the peer has answered the transfer we started
+void Serial::WaitForReply()
+{
+    if (m_SentCycles != m_Cycles)
+    {
+        SendTime();
+    }
+
+    while (!m_HasReply && m_Port->IsConnected())
+    {
+        std::this_thread::yield();
+        ReceiveMessages();
+    }
+
+    if (!m_HasReply)
+    {
+        m_Reply = 0xFF;
+    }
+
+    m_HasReply = false;
+}
@@ -1,15 +1,79 @@
 #pragma once
 
+// FF01 - SB - Serial transfer data (R/W)
+// FF02 - SC - Serial Transfer Control (R/W)
+#define SerialTransferData 0xFF01
+#define SerialTransferControl 0xFF02
+
+// With the internal clock, bits are shifted out at 8192 Hz
+#define SerialCyclesPerBit 512
+#define SerialCyclesPerByte (SerialCyclesPerBit * 8)
+
+/*
+    The serial port, optionally connected to another Gameboy through a link cable.
+
+    The side using the internal clock (SC = 0x81) drives the transfer. When it starts, it tells the
+    peer at which cycle the eighth bit will be shifted. The peer exchanges its byte when it reaches
+    that cycle, as long as it was waiting with SC = 0x80, and replies with its old byte. The master
+    completes its own side at the same cycle, waiting for the reply if it has not arrived yet. Both
+    sides raise INT58 when their transfer completes.
+
+    Both sides also tell each other how far they have run, and neither runs more than the sync
+    window ahead of the other. As long as the window is no longer than one byte transfer, the peer
+    always hears about a transfer before reaching its completion cycle, so timing is exact. Over a
+    slow connection a larger window lets both sides run ahead further between messages; the only
+    other stall is the master waiting for the reply. The price is that the peer may hear about a
+    transfer after its completion cycle, and then completes it late, as soon as it does.
+
+    Cycles are always counted at the normal speed, so that both sides agree on the time even when
+    one of them runs in CGB double speed. The internal clock then shifts bits twice as fast.
+*/
 class Serial : public IMemoryUnit
 {
 public:
-    Serial();
+    Serial(ICPU* pCPU);
     ~Serial();
 
+    void Step(unsigned long cycles);
+    unsigned long GetCyclesUntilEvent();
+    void Connect(ILinkPort* pPort);
+    void SetSyncWindow(unsigned long cycles);
+    void SetDoubleSpeed(bool isDoubleSpeed);
+    void SaveState(StateWriter& writer);
+    void LoadState(StateReader& reader);
+
     // IMemoryUnit
     byte ReadByte(const ushort& address);
     bool WriteByte(const ushort& address, const byte val);
 
 private:
+    void StartTransfer();
+    void CompleteTransfer(byte data);
+    void ReceiveMessages();
+    void SendTime();
+    void WaitForPeer();
+    void WaitForReply();
+
+private:
+    ICPU* m_CPU;
+    ILinkPort* m_Port;
+
     byte m_Data;
+    byte m_Control;
+
+    unsigned long long m_Cycles;            // Cycles since the cable was connected
+    unsigned long long m_TransferCycle;     // When the internal clock transfer in progress completes
+    bool m_IsTransferring;
+    unsigned long m_CyclesPerByte;          // Internal clock byte time, halved in double speed
+
+    // Link synchronization
+    unsigned long m_SyncWindow;
+    unsigned long long m_PeerCycles;        // How far the peer told us it has run
+    unsigned long long m_SentCycles;        // How far we told the peer we have run
+    unsigned long long m_PolledCycles;      // When we last looked for messages from the peer
+    bool m_HasReply;
+    byte m_Reply;
+    bool m_HasIncoming;                     // The peer started a transfer and we still have to answer it
+    unsigned long long m_IncomingCycle;
+    byte m_IncomingData;
 };
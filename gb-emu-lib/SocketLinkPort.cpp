@@ -0,0 +1,349 @@
+#include "pch.hpp"
+#include "SocketLinkPort.hpp"
+
+#include <string>
+#include <thread>
+
+#if WINDOWS
+    #include <ws2tcpip.h>
+    #pragma comment(lib, "ws2_32.lib")
+
+    #define CloseSocket closesocket
+    #define IsWouldBlock() (WSAGetLastError() == WSAEWOULDBLOCK)
+    const LinkSocket InvalidLinkSocket = INVALID_SOCKET;
+#else
+    #include <errno.h>
+    #include <fcntl.h>
+    #include <netdb.h>
+    #include <netinet/in.h>
+    #include <netinet/tcp.h>
+    #include <sys/socket.h>
+    #include <sys/un.h>
+    #include <unistd.h>
+
+    #define CloseSocket close
+    #define IsWouldBlock() ((errno == EAGAIN) || (errno == EWOULDBLOCK))
+    const LinkSocket InvalidLinkSocket = -1;
+#endif
+
+// A peer that hangs up must not kill us with SIGPIPE
+#ifdef MSG_NOSIGNAL
+    #define LinkSendFlags MSG_NOSIGNAL
+#else
+    #define LinkSendFlags 0
+#endif
+
+SocketLinkPort::SocketLinkPort() :
+    m_Socket(InvalidLinkSocket),
+    m_IsConnected(false),
+    m_ListeningPort(0),
+    m_Latency(0),
+    m_BufferLength(0)
+{
+#if WINDOWS
+    WSADATA data;
+    WSAStartup(MAKEWORD(2, 2), &data);
+#endif
+}
+
+SocketLinkPort::~SocketLinkPort()
+{
+    Disconnect();
+
+#if WINDOWS
+    WSACleanup();
+#endif
+}
+
+bool SocketLinkPort::Listen(const char* address)
+{
+    return Open(address, true);
+}
+
+bool SocketLinkPort::Connect(const char* address)
+{
+    return Open(address, false);
+}
+
+void SocketLinkPort::SetInjectedLatency(unsigned int microseconds)
+{
+    m_Latency = std::chrono::microseconds(microseconds);
+}
+
+unsigned short SocketLinkPort::GetListeningPort()
+{
+    return m_ListeningPort;
+}
+
+// ILinkPort
+bool SocketLinkPort::Send(const LinkMessage& message)
+{
+    if (!m_IsConnected)
+    {
+        return false;
+    }
+
+    return Write(message);
+}
+
+bool SocketLinkPort::Receive(LinkMessage& message)
+{
+    // After a hang up, what the peer sent before it is still delivered
+    if (m_IsConnected)
+    {
+        Read();
+    }
+
+    if (m_Incoming.empty() || (m_Incoming.front().due > std::chrono::steady_clock::now()))
+    {
+        return false;
+    }
+
+    message = m_Incoming.front().message;
+    m_Incoming.pop_front();
+    return true;
+}
+
+bool SocketLinkPort::IsConnected()
+{
+    return m_IsConnected || !m_Incoming.empty();
+}
+
+void SocketLinkPort::Disconnect()
+{
+    if (m_Socket != InvalidLinkSocket)
+    {
+        CloseSocket(m_Socket);
+        m_Socket = InvalidLinkSocket;
+    }
+
+    m_IsConnected = false;
+    m_BufferLength = 0;
+}
+
+bool SocketLinkPort::Open(const char* address, bool isListening)
+{
+    Disconnect();
+    m_ListeningPort = 0;
+    m_Incoming.clear();
+
+    std::string text(address);
+    LinkSocket listener = InvalidLinkSocket;
+    LinkSocket connection = InvalidLinkSocket;
+
+    if (text.compare(0, 5, "unix:") == 0)
+    {
+#if WINDOWS
+        Logger::LogError("SocketLinkPort: Unix domain sockets are not supported, use host:port");
+        return false;
+#else
+        sockaddr_un name;
+        memset(&name, 0x00, sizeof(name));
+        name.sun_family = AF_UNIX;
+        strncpy(name.sun_path, text.c_str() + 5, sizeof(name.sun_path) - 1);
+
+        connection = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (isListening)
+        {
+            unlink(name.sun_path);
+            listener = connection;
+            connection = InvalidLinkSocket;
+            if ((bind(listener, reinterpret_cast<sockaddr*>(&name), sizeof(name)) == 0) && (listen(listener, 1) == 0))
+            {
+                connection = accept(listener, nullptr, nullptr);
+            }
+
+            unlink(name.sun_path);
+        }
+        else if (connect(connection, reinterpret_cast<sockaddr*>(&name), sizeof(name)) != 0)
+        {
+            CloseSocket(connection);
+            connection = InvalidLinkSocket;
+        }
+#endif
+    }
+    else
+    {
+        size_t colon = text.rfind(':');
+        if (colon == std::string::npos)
+        {
+            Logger::LogError("SocketLinkPort: '%s' is not a valid address", address);
+            return false;
+        }
+
+        addrinfo hints;
+        memset(&hints, 0x00, sizeof(hints));
+        hints.ai_family = AF_INET;
+        hints.ai_socktype = SOCK_STREAM;
+        hints.ai_flags = isListening ? AI_PASSIVE : 0;
+
+        addrinfo* pInfo = nullptr;
+        std::string host = text.substr(0, colon);
+        std::string port = text.substr(colon + 1);
+        if (getaddrinfo(host.empty() ? nullptr : host.c_str(), port.c_str(), &hints, &pInfo) != 0)
+        {
+            Logger::LogError("SocketLinkPort: Could not resolve '%s'", address);
+            return false;
+        }
+
+        connection = socket(pInfo->ai_family, pInfo->ai_socktype, pInfo->ai_protocol);
+        if (isListening)
+        {
+            int reuse = 1;
+            setsockopt(connection, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&reuse), sizeof(reuse));
+
+            listener = connection;
+            connection = InvalidLinkSocket;
+            if ((bind(listener, pInfo->ai_addr, static_cast<int>(pInfo->ai_addrlen)) == 0) && (listen(listener, 1) == 0))
+            {
+                // The port the system picked if we asked for port 0
+                sockaddr_in bound;
+                socklen_t boundLength = sizeof(bound);
+                if (getsockname(listener, reinterpret_cast<sockaddr*>(&bound), &boundLength) == 0)
+                {
+                    m_ListeningPort = ntohs(bound.sin_port);
+                }
+
+                connection = accept(listener, nullptr, nullptr);
+            }
+        }
+        else if (connect(connection, pInfo->ai_addr, static_cast<int>(pInfo->ai_addrlen)) != 0)
+        {
+            CloseSocket(connection);
+            connection = InvalidLinkSocket;
+        }
+
+        freeaddrinfo(pInfo);
+
+        if (connection != InvalidLinkSocket)
+        {
+            // Messages are tiny and latency is everything
+            int noDelay = 1;
+            setsockopt(connection, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&noDelay), sizeof(noDelay));
+        }
+    }
+
+    if (listener != InvalidLinkSocket)
+    {
+        CloseSocket(listener);
+    }
+
+    if (connection == InvalidLinkSocket)
+    {
+        Logger::LogError("SocketLinkPort: Could not %s '%s'", isListening ? "listen on" : "connect to", address);
+        return false;
+    }
+
+    m_Socket = connection;
+    m_IsConnected = true;
+    SetNonBlocking();
+
+#ifdef SO_NOSIGPIPE
+    int noSigPipe = 1;
+    setsockopt(m_Socket, SOL_SOCKET, SO_NOSIGPIPE, &noSigPipe, sizeof(noSigPipe));
+#endif
+
+    Logger::Log("SocketLinkPort: Connected through '%s'", address);
+    return true;
+}
+
+void SocketLinkPort::SetNonBlocking()
+{
+#if WINDOWS
+    u_long isNonBlocking = 1;
+    ioctlsocket(m_Socket, FIONBIO, &isNonBlocking);
+#else
+    fcntl(m_Socket, F_SETFL, fcntl(m_Socket, F_GETFL, 0) | O_NONBLOCK);
+#endif
+}
+
+// Reads whatever has arrived on the socket and queues the complete records
+void SocketLinkPort::Read()
+{
+    while (true)
+    {
+        int received = recv(
+            m_Socket,
+            reinterpret_cast<char*>(m_Buffer + m_BufferLength),
+            sizeof(m_Buffer) - m_BufferLength,
+            0);
+        if (received == 0)
+        {
+            Logger::Log("SocketLinkPort: The peer hung up");
+            Disconnect();
+            return;
+        }
+        else if (received < 0)
+        {
+            if (!IsWouldBlock())
+            {
+                Logger::LogError("SocketLinkPort: Receive failed");
+                Disconnect();
+            }
+
+            return;
+        }
+
+        m_BufferLength += received;
+
+        std::chrono::steady_clock::time_point due = std::chrono::steady_clock::now() + m_Latency;
+        int offset = 0;
+        for (; (offset + LinkRecordSize) <= m_BufferLength; offset += LinkRecordSize)
+        {
+            const byte* pRecord = m_Buffer + offset;
+
+            DelayedMessage delayed;
+            delayed.due = due;
+            delayed.message.type = pRecord[0];
+            delayed.message.data = pRecord[1];
+            delayed.message.isAccepted = (pRecord[2] != 0x00);
+            delayed.message.cycle = 0;
+            for (int index = 7; index >= 0; index--)
+            {
+                delayed.message.cycle = (delayed.message.cycle << 8) | pRecord[4 + index];
+            }
+
+            m_Incoming.push_back(delayed);
+        }
+
+        // Keep a partial record for next time
+        m_BufferLength -= offset;
+        memmove(m_Buffer, m_Buffer + offset, m_BufferLength);
+    }
+}
+
+bool SocketLinkPort::Write(const LinkMessage& message)
+{
+    byte record[LinkRecordSize];
+    record[0] = message.type;
+    record[1] = message.data;
+    record[2] = message.isAccepted ? 0x01 : 0x00;
+    record[3] = 0x00;
+    for (int index = 0; index < 8; index++)
+    {
+        record[4 + index] = static_cast<byte>(message.cycle >> (index * 8));
+    }
+
+    int sent = 0;
+    while (sent < LinkRecordSize)
+    {
+        int result = send(m_Socket, reinterpret_cast<const char*>(record + sent), LinkRecordSize - sent, LinkSendFlags);
+        if (result < 0)
+        {
+            if (!IsWouldBlock())
+            {
+                Logger::LogError("SocketLinkPort: Send failed");
+                Disconnect();
+                return false;
+            }
+
+            // The peer is not keeping up, give it a moment
+            std::this_thread::yield();
+            continue;
+        }
+
+        sent += result;
+    }
+
+    return true;
+}
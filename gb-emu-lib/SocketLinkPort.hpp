@@ -0,0 +1,71 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <deque>
+
+#if WINDOWS
+    #include <winsock2.h>
+    typedef SOCKET LinkSocket;
+#else
+    typedef int LinkSocket;
+#endif
+
+// type, data, isAccepted, padding and the cycle as 8 little endian bytes
+#define LinkRecordSize 12
+
+/*
+    One end of a link cable between two emulator processes, over a Unix domain socket
+    ("unix:/tmp/gamelad.sock", not on Windows) or TCP ("127.0.0.1:5000").
+
+    One side calls Listen(), which waits for the other side to Connect(). Listening on port 0 lets
+    the system pick a free port, GetListeningPort() tells another thread which one while Listen()
+    waits. Messages go over the wire as fixed size records. Receive never blocks, Send only blocks
+    while the socket buffer is full. Once the peer hangs up, Receive still delivers everything it
+    sent before, and IsConnected() stays true until that has all been received.
+
+    SetInjectedLatency() holds every incoming message back for the given time after it arrived, to
+    measure how the sync window copes with a slow connection without needing one.
+*/
+class SocketLinkPort : public ILinkPort
+{
+public:
+    SocketLinkPort();
+    ~SocketLinkPort();
+
+    bool Listen(const char* address);
+    bool Connect(const char* address);
+    void SetInjectedLatency(unsigned int microseconds);
+
+    // The TCP port Listen() is waiting on, 0 until it is bound
+    unsigned short GetListeningPort();
+
+    // ILinkPort
+    bool Send(const LinkMessage& message);
+    bool Receive(LinkMessage& message);
+    bool IsConnected();
+    void Disconnect();
+
+private:
+    struct DelayedMessage
+    {
+        std::chrono::steady_clock::time_point due;
+        LinkMessage message;
+    };
+
+    bool Open(const char* address, bool isListening);
+    void SetNonBlocking();
+    void Read();
+    bool Write(const LinkMessage& message);
+
+private:
+    LinkSocket m_Socket;
+    bool m_IsConnected;
+    std::atomic<unsigned short> m_ListeningPort;
+
+    std::chrono::microseconds m_Latency;
+    std::deque<DelayedMessage> m_Incoming;
+
+    byte m_Buffer[LinkRecordSize * 64];
+    int m_BufferLength;
+};
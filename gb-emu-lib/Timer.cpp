@@ -1,6 +1,8 @@
 #include "pch.hpp"
 #include "Timer.hpp"
 
+#include <algorithm>
+
 // FF04 - DIV - Divider Register (R/W)
 // FF05 - TIMA - Timer counter (R/W)
 // FF06 - TMA - Timer Modulo (R/W)
@@ -59,6 +61,23 @@ bool Timer::Counter::Step(unsigned int cycles)
     return false;
 }
 
+// Step returns as soon as the counter overflows, so a longer step would not do the same
+unsigned long Timer::Counter::GetCyclesUntilOverflow()
+{
+    if (!m_IsRunning)
+    {
+        return NoEventCycles;
+    }
+
+    if (m_Cycles <= 0)
+    {
+        // Increments left over from the last overflow
+        return 1;
+    }
+
+    return m_Cycles + (0xFF - m_Value) * FrequencyCounts[m_Frequency];
+}
+
 byte Timer::Counter::GetValue()
 {
     return m_Value;
@@ -85,31 +104,47 @@ void Timer::Counter::Stop()
     m_IsRunning = false;
 }
 
+void Timer::Counter::SaveState(StateWriter& writer)
+{
+    writer.Write(m_IsRunning);
+    writer.Write(m_Value);
+    writer.Write(m_Frequency);
+    writer.Write(m_Cycles);
+}
+
+void Timer::Counter::LoadState(StateReader& reader)
+{
+    reader.Read(m_IsRunning);
+    reader.Read(m_Value);
+    reader.Read(m_Frequency);
+    reader.Read(m_Cycles);
+
+    m_Frequency &= 0x03;
+}
+
 Timer::Timer(ICPU* pCPU) :
     m_CPU(pCPU),
+    m_DividerCounter(Frequency16384),
+    m_TimerCounter(Frequency4096),
     m_TimerModulo(0x00),
     m_TimerControl(0x00)
 {
-    m_DividerCounter = std::unique_ptr<Counter>(new Counter(Frequency16384));
-    m_TimerCounter = std::unique_ptr<Counter>(new Counter(Frequency4096));
 }
 
 Timer::~Timer()
 {
-    m_DividerCounter.reset();
-    m_TimerCounter.reset();
 }
 
 
 void Timer::Step(unsigned long cycles)
 {
-    m_DividerCounter->Step(cycles);
+    m_DividerCounter.Step(cycles);
 
     // If the timer counter overflows, reset to TimerModulo and trigger interrupt
-    if (m_TimerCounter->Step(cycles))
+    if (m_TimerCounter.Step(cycles))
     {
         // If the timer counter overflows, set back to this value
-        m_TimerCounter->SetValue(m_TimerModulo);
+        m_TimerCounter.SetValue(m_TimerModulo);
 
         if (m_CPU != nullptr)
         {
@@ -118,15 +153,37 @@ void Timer::Step(unsigned long cycles)
     }
 }
 
+// See GPU::GetCyclesUntilEvent, in CPU cycles
+unsigned long Timer::GetCyclesUntilEvent()
+{
+    return std::min(m_DividerCounter.GetCyclesUntilOverflow(), m_TimerCounter.GetCyclesUntilOverflow());
+}
+
+void Timer::SaveState(StateWriter& writer)
+{
+    m_DividerCounter.SaveState(writer);
+    m_TimerCounter.SaveState(writer);
+    writer.Write(m_TimerModulo);
+    writer.Write(m_TimerControl);
+}
+
+void Timer::LoadState(StateReader& reader)
+{
+    m_DividerCounter.LoadState(reader);
+    m_TimerCounter.LoadState(reader);
+    reader.Read(m_TimerModulo);
+    reader.Read(m_TimerControl);
+}
+
 // IMemoryUnit
 byte Timer::ReadByte(const ushort& address)
 {
     switch (address)
     {
     case Divider:
-        return m_DividerCounter->GetValue();
+        return m_DividerCounter.GetValue();
     case TimerCounter:
-        return m_TimerCounter->GetValue();
+        return m_TimerCounter.GetValue();
     case TimerModulo:
         return m_TimerModulo;
     case TimerControl:
@@ -142,24 +199,24 @@ bool Timer::WriteByte(const ushort& address, const byte val)
     switch (address)
     {
     case Divider:
-        m_DividerCounter->SetValue(0x00);
+        m_DividerCounter.SetValue(0x00);
         return true;
     case TimerCounter:
-        m_TimerCounter->SetValue(val);
+        m_TimerCounter.SetValue(val);
         return true;
     case TimerModulo:
         m_TimerModulo = val;
     case TimerControl:
         if (ISBITSET(val, 2))
         {
-            m_TimerCounter->Start();
+            m_TimerCounter.Start();
         }
         else
         {
-            m_TimerCounter->Stop();
+            m_TimerCounter.Stop();
         }
 
-        m_TimerCounter->SetFrequency(val & 0x03);
+        m_TimerCounter.SetFrequency(val & 0x03);
         return true;
     default:
         Logger::Log("Timer::ReadByte cannot write to address 0x%04X", address);
@@ -8,6 +8,7 @@ private:
     public:
         Counter(byte frequency);
         bool Step(unsigned int cycles);
+        unsigned long GetCyclesUntilOverflow();
 
         byte GetValue();
         void SetValue(byte value);
@@ -15,6 +16,9 @@ private:
         void Start();
         void Stop();
 
+        void SaveState(StateWriter& writer);
+        void LoadState(StateReader& reader);
+
     private:
         bool m_IsRunning;
         byte m_Value;
@@ -27,6 +31,9 @@ public:
     ~Timer();
 
     void Step(unsigned long cycles);
+    unsigned long GetCyclesUntilEvent();
+    void SaveState(StateWriter& writer);
+    void LoadState(StateReader& reader);
 
     // IMemoryUnit
     byte ReadByte(const ushort& address);
@@ -35,8 +42,8 @@ public:
 private:
     ICPU* m_CPU;
 
-    std::unique_ptr<Counter> m_DividerCounter;
-    std::unique_ptr<Counter> m_TimerCounter;
+    Counter m_DividerCounter;
+    Counter m_TimerCounter;
 
     byte m_TimerModulo;
     byte m_TimerControl;
@@ -0,0 +1,530 @@
+#include "pch.hpp"
+#include "Trace.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+
+/*
+    Mnemonics for the opcodes outside the regular 0x40-0xBF block. Operands are written as
+    d8/d16 (immediate), a8/a16 (address), r8 (relative jump) and s8 (signed offset), the decoder
+    replaces them with the value from the ROM. Unused opcodes are "-".
+*/
+static const char* const LowMnemonics[0x40] =
+{
+    "NOP",          "LD BC,d16",    "LD (BC),A",    "INC BC",       "INC B",        "DEC B",        "LD B,d8",      "RLCA",
+    "LD (a16),SP",  "ADD HL,BC",    "LD A,(BC)",    "DEC BC",       "INC C",        "DEC C",        "LD C,d8",      "RRCA",
+    "STOP",         "LD DE,d16",    "LD (DE),A",    "INC DE",       "INC D",        "DEC D",        "LD D,d8",      "RLA",
+    "JR r8",        "ADD HL,DE",    "LD A,(DE)",    "DEC DE",       "INC E",        "DEC E",        "LD E,d8",      "RRA",
+    "JR NZ,r8",     "LD HL,d16",    "LD (HL+),A",   "INC HL",       "INC H",        "DEC H",        "LD H,d8",      "DAA",
+    "JR Z,r8",      "ADD HL,HL",    "LD A,(HL+)",   "DEC HL",       "INC L",        "DEC L",        "LD L,d8",      "CPL",
+    "JR NC,r8",     "LD SP,d16",    "LD (HL-),A",   "INC SP",       "INC (HL)",     "DEC (HL)",     "LD (HL),d8",   "SCF",
+    "JR C,r8",      "ADD HL,SP",    "LD A,(HL-)",   "DEC SP",       "INC A",        "DEC A",        "LD A,d8",      "CCF",
+};
+
+static const char* const HighMnemonics[0x40] =
+{
+    "RET NZ",       "POP BC",       "JP NZ,a16",    "JP a16",       "CALL NZ,a16",  "PUSH BC",      "ADD A,d8",     "RST 00H",
+    "RET Z",        "RET",          "JP Z,a16",     "PREFIX CB",    "CALL Z,a16",   "CALL a16",     "ADC A,d8",     "RST 08H",
+    "RET NC",       "POP DE",       "JP NC,a16",    "-",            "CALL NC,a16",  "PUSH DE",      "SUB d8",       "RST 10H",
+    "RET C",        "RETI",         "JP C,a16",     "-",            "CALL C,a16",   "-",            "SBC A,d8",     "RST 18H",
+    "LDH (a8),A",   "POP HL",       "LD (C),A",     "-",            "-",            "PUSH HL",      "AND d8",       "RST 20H",
+    "ADD SP,s8",    "JP (HL)",      "LD (a16),A",   "-",            "-",            "-",            "XOR d8",       "RST 28H",
+    "LDH A,(a8)",   "POP AF",       "LD A,(C)",     "DI",           "-",            "PUSH AF",      "OR d8",        "RST 30H",
+    "LD HL,SP+s8",  "LD SP,HL",     "LD A,(a16)",   "EI",           "-",            "-",            "CP d8",        "RST 38H",
+};
+
+#define TraceMagic          0x52544247  // "GBTR"
+#define TraceRecordSize     7           // Without the bank
+#define TraceBankFlag       0x01        // In the low nibble of F, which is always zero
+
+static void PutValue(std::vector<byte>& bytes, unsigned long long value, unsigned int size)
+{
+    for (unsigned int index = 0; index < size; index++)
+    {
+        bytes.push_back(static_cast<byte>(value >> (8 * index)));
+    }
+}
+
+static unsigned long long GetValue(const byte* pBytes, unsigned int size)
+{
+    unsigned long long value = 0;
+    for (unsigned int index = 0; index < size; index++)
+    {
+        value |= static_cast<unsigned long long>(pBytes[index]) << (8 * index);
+    }
+
+    return value;
+}
+
+static const char* const RegisterNames[8] = { "B", "C", "D", "E", "H", "L", "(HL)", "A" };
+static const char* const ALUMnemonics[8] = { "ADD A,", "ADC A,", "SUB ", "SBC A,", "AND ", "XOR ", "OR ", "CP " };
+static const char* const ShiftMnemonics[8] = { "RLC", "RRC", "RL", "RR", "SLA", "SRA", "SWAP", "SRL" };
+static const char* const BitMnemonics[4] = { "", "BIT", "RES", "SET" };
+
+/*
+    Returns the text for an instruction. pBytes holds the opcode and the two bytes after it, or is
+    nullptr if they are not known (code outside the ROM), in which case the operands stay symbolic.
+*/
+static std::string Disassemble(ushort PC, byte opcode, const byte* pBytes)
+{
+    char text[32];
+    if ((opcode >= 0x40) && (opcode <= 0xBF))
+    {
+        if (opcode == 0x76)
+        {
+            return "HALT";
+        }
+
+        if (opcode < 0x80)
+        {
+            snprintf(text, sizeof(text), "LD %s,%s", RegisterNames[(opcode >> 3) & 0x07], RegisterNames[opcode & 0x07]);
+        }
+        else
+        {
+            snprintf(text, sizeof(text), "%s%s", ALUMnemonics[(opcode >> 3) & 0x07], RegisterNames[opcode & 0x07]);
+        }
+
+        return text;
+    }
+
+    if (opcode == 0xCB)
+    {
+        if (pBytes == nullptr)
+        {
+            return "PREFIX CB";
+        }
+
+        byte cb = pBytes[1];
+        if (cb < 0x40)
+        {
+            snprintf(text, sizeof(text), "%s %s", ShiftMnemonics[cb >> 3], RegisterNames[cb & 0x07]);
+        }
+        else
+        {
+            snprintf(text, sizeof(text), "%s %d,%s", BitMnemonics[cb >> 6], (cb >> 3) & 0x07, RegisterNames[cb & 0x07]);
+        }
+
+        return text;
+    }
+
+    std::string mnemonic = (opcode < 0x40) ? LowMnemonics[opcode] : HighMnemonics[opcode - 0xC0];
+    if (pBytes == nullptr)
+    {
+        return mnemonic;
+    }
+
+    const char* const placeholders[] = { "d16", "a16", "d8", "a8", "r8", "s8" };
+    for (const char* placeholder : placeholders)
+    {
+        size_t position = mnemonic.find(placeholder);
+        if (position == std::string::npos)
+        {
+            continue;
+        }
+
+        if (placeholder[1] == '1')
+        {
+            snprintf(text, sizeof(text), "$%04X", pBytes[1] | (pBytes[2] << 8));
+        }
+        else if (placeholder[0] == 'r')
+        {
+            snprintf(text, sizeof(text), "$%04X", static_cast<ushort>(PC + 2 + static_cast<sbyte>(pBytes[1])));
+        }
+        else if (placeholder[0] == 's')
+        {
+            snprintf(text, sizeof(text), "%d", static_cast<sbyte>(pBytes[1]));
+        }
+        else if (placeholder[0] == 'a')
+        {
+            snprintf(text, sizeof(text), "$FF%02X", pBytes[1]);
+        }
+        else
+        {
+            snprintf(text, sizeof(text), "$%02X", pBytes[1]);
+        }
+
+        mnemonic.replace(position, strlen(placeholder), text);
+        break;
+    }
+
+    return mnemonic;
+}
+
+// size is rounded up to a power of two
+Trace::Trace(unsigned int size) :
+    m_Index(0),
+    m_IsWriterStopping(false),
+    m_Written(0)
+{
+    unsigned long long ringSize = 1;
+    while (ringSize < size)
+    {
+        ringSize <<= 1;
+    }
+
+    m_Records.resize(static_cast<size_t>(ringSize));
+    m_Mask = ringSize - 1;
+}
+
+Trace::~Trace()
+{
+    StopWriter();
+}
+
+/*
+    Writes the records currently in the ring to a new file, oldest first. This may be called from
+    any thread, records that get overwritten while they are copied are left out.
+*/
+bool Trace::Dump(const char* path)
+{
+    std::vector<TraceRecord> records;
+    unsigned long long end = m_Index.load(std::memory_order_acquire);
+    unsigned long long start = (end > m_Records.size()) ? (end - m_Records.size()) : 0;
+    unsigned long long lost = Copy(start, records);
+
+    std::ofstream file(path, std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!file.is_open() || !WriteHeader(file))
+    {
+        Logger::LogError("Trace: Failed to write %s", path);
+        return false;
+    }
+
+    WriteChunk(file, records, start + lost);
+    Logger::Log("Trace: Wrote the last %d instructions to %s", static_cast<int>(records.size()), path);
+    return true;
+}
+
+// Starts a thread that keeps appending new records to a file until StopWriter is called
+bool Trace::StartWriter(const char* path)
+{
+    StopWriter();
+
+    m_WriterFile.open(path, std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!m_WriterFile.is_open() || !WriteHeader(m_WriterFile))
+    {
+        Logger::LogError("Trace: Failed to open %s", path);
+        m_WriterFile.close();
+        return false;
+    }
+
+    // Start with whatever is still in the ring, an empty chunk keeps the instruction count right
+    unsigned long long end = m_Index.load(std::memory_order_acquire);
+    m_Written = (end > m_Records.size()) ? (end - m_Records.size()) : 0;
+    WriteChunk(m_WriterFile, std::vector<TraceRecord>(), m_Written);
+    m_IsWriterStopping = false;
+    m_Writer = std::thread(&Trace::RunWriter, this);
+    return true;
+}
+
+void Trace::StopWriter()
+{
+    if (!m_Writer.joinable())
+    {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_WriterMutex);
+        m_IsWriterStopping = true;
+    }
+
+    m_WriterCondition.notify_one();
+    m_Writer.join();
+    m_WriterFile.close();
+}
+
+unsigned long long Trace::GetCount()
+{
+    return m_Index.load(std::memory_order_acquire);
+}
+
+/*
+    Copies the records from index start up to the current end of the ring. Returns how many at the
+    start were overwritten by the time the copy was done and had to be left out.
+*/
+unsigned long long Trace::Copy(unsigned long long start, std::vector<TraceRecord>& records)
+{
+    unsigned long long end = m_Index.load(std::memory_order_acquire);
+    records.clear();
+    records.reserve(static_cast<size_t>(end - start));
+    for (unsigned long long index = start; index < end; index++)
+    {
+        records.push_back(m_Records[static_cast<size_t>(index & m_Mask)]);
+    }
+
+    // The record at index is safe as long as the producer has not started on index + size
+    unsigned long long after = m_Index.load(std::memory_order_acquire);
+    unsigned long long firstSafe = (after >= m_Records.size()) ? (after - m_Records.size() + 1) : 0;
+    unsigned long long lost = 0;
+    if (firstSafe > start)
+    {
+        lost = (firstSafe - start < records.size()) ? (firstSafe - start) : records.size();
+        records.erase(records.begin(), records.begin() + static_cast<size_t>(lost));
+    }
+
+    return lost;
+}
+
+bool Trace::WriteHeader(std::ostream& file)
+{
+    std::vector<byte> header;
+    PutValue(header, TraceMagic, 4);
+    PutValue(header, TraceVersion, 4);
+    file.write(reinterpret_cast<const char*>(header.data()), header.size());
+    return file.good();
+}
+
+void Trace::WriteChunk(std::ostream& file, const std::vector<TraceRecord>& records, unsigned long long lost)
+{
+    std::vector<byte> bytes;
+    bytes.reserve(16 + (records.size() * TraceRecordSize));
+    PutValue(bytes, records.size(), 8);
+    PutValue(bytes, lost, 8);
+
+    ushort bank = 0;
+    for (const TraceRecord& record : records)
+    {
+        bool hasBank = (record.bank != bank);
+        bytes.push_back(record.opcode);
+        PutValue(bytes, record.PC, 2);
+        PutValue(bytes, (record.AF & 0xFFF0) | (hasBank ? TraceBankFlag : 0x00), 2);
+        PutValue(bytes, record.HL, 2);
+        if (hasBank)
+        {
+            PutValue(bytes, record.bank, 2);
+            bank = record.bank;
+        }
+    }
+
+    file.write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+}
+
+void Trace::RunWriter()
+{
+    std::unique_lock<std::mutex> lock(m_WriterMutex);
+    while (!m_IsWriterStopping)
+    {
+        m_WriterCondition.wait_for(lock, std::chrono::milliseconds(TraceWriterInterval));
+        Flush();
+    }
+
+    Flush();
+    m_WriterFile.flush();
+}
+
+void Trace::Flush()
+{
+    unsigned long long end = m_Index.load(std::memory_order_acquire);
+    if (end == m_Written)
+    {
+        return;
+    }
+
+    // Records the emulation has already lapped are gone
+    unsigned long long lost = 0;
+    if ((end - m_Written) > m_Records.size())
+    {
+        lost = end - m_Written - m_Records.size();
+        m_Written += lost;
+    }
+
+    lost += Copy(m_Written, m_WriterBuffer);
+    m_Written += lost + m_WriterBuffer.size();
+    WriteChunk(m_WriterFile, m_WriterBuffer, lost);
+}
+
+bool Trace::Open(std::ifstream& file, const char* tracePath)
+{
+    file.open(tracePath, std::ios::in | std::ios::binary);
+    byte header[8];
+    if (!file.is_open() ||
+        !file.read(reinterpret_cast<char*>(header), sizeof(header)) ||
+        (GetValue(&header[0], 4) != TraceMagic) ||
+        (GetValue(&header[4], 4) != TraceVersion))
+    {
+        Logger::LogError("Trace: %s is not a trace from this version", tracePath);
+        return false;
+    }
+
+    return true;
+}
+
+// Reads the next chunk, returns false at the end of the file or if the chunk is cut short
+bool Trace::ReadChunk(std::ifstream& file, std::vector<TraceRecord>& records, unsigned long long& lost, bool& isTruncated)
+{
+    isTruncated = false;
+    byte chunk[16];
+    if (!file.read(reinterpret_cast<char*>(chunk), sizeof(chunk)))
+    {
+        return false;
+    }
+
+    unsigned long long count = GetValue(&chunk[0], 8);
+    lost = GetValue(&chunk[8], 8);
+    records.clear();
+
+    ushort bank = 0;
+    byte bytes[TraceRecordSize + 2];
+    for (unsigned long long index = 0; index < count; index++)
+    {
+        if (!file.read(reinterpret_cast<char*>(bytes), TraceRecordSize))
+        {
+            isTruncated = true;
+            return false;
+        }
+
+        TraceRecord record;
+        record.opcode = bytes[0];
+        record.PC = static_cast<ushort>(GetValue(&bytes[1], 2));
+        record.AF = static_cast<ushort>(GetValue(&bytes[3], 2));
+        record.HL = static_cast<ushort>(GetValue(&bytes[5], 2));
+        if ((record.AF & TraceBankFlag) != 0)
+        {
+            if (!file.read(reinterpret_cast<char*>(&bytes[TraceRecordSize]), 2))
+            {
+                isTruncated = true;
+                return false;
+            }
+
+            bank = static_cast<ushort>(GetValue(&bytes[TraceRecordSize], 2));
+            record.AF &= 0xFFF0;
+        }
+
+        record.bank = bank;
+        records.push_back(record);
+    }
+
+    return true;
+}
+
+bool Trace::Decode(const char* tracePath, const char* romPath, std::ostream& out)
+{
+    std::ifstream file;
+    if (!Open(file, tracePath))
+    {
+        return false;
+    }
+
+    std::vector<byte> rom;
+    if (romPath != nullptr)
+    {
+        std::ifstream romFile(romPath, std::ios::in | std::ios::binary);
+        rom.assign(std::istreambuf_iterator<char>(romFile), std::istreambuf_iterator<char>());
+        if (rom.empty())
+        {
+            Logger::LogError("Trace: Failed to read %s, operands are left out", romPath);
+        }
+    }
+
+    unsigned long long index = 0;
+    unsigned long long lost = 0;
+    bool isTruncated = false;
+    std::vector<TraceRecord> records;
+    while (ReadChunk(file, records, lost, isTruncated))
+    {
+        if (lost != 0)
+        {
+            out << "... " << lost << " instructions not in the trace ..." << std::endl;
+            index += lost;
+        }
+
+        for (const TraceRecord& record : records)
+        {
+            // Only code in the ROM can be read back
+            const byte* pBytes = nullptr;
+            if (record.PC < 0x8000)
+            {
+                size_t offset = (record.PC < 0x4000) ? record.PC : ((record.bank * 0x4000) + (record.PC - 0x4000));
+                if ((offset + 2) < rom.size())
+                {
+                    pBytes = &rom[offset];
+                }
+            }
+
+            char line[96];
+            snprintf(line, sizeof(line), "%10llu  %02X:%04X  %-18s AF=%04X HL=%04X",
+                index, record.bank, record.PC, Disassemble(record.PC, record.opcode, pBytes).c_str(), record.AF, record.HL);
+            out << line << std::endl;
+            index++;
+        }
+    }
+
+    if (isTruncated)
+    {
+        Logger::LogError("Trace: %s is truncated", tracePath);
+        return false;
+    }
+
+    return true;
+}
+
+/*
+    Counts how often each opcode follows another and writes the most frequent pairs, the candidates
+    for fusing (see CPU::ExecuteFused). Pairs across instructions missing from the trace are left out.
+*/
+bool Trace::Profile(const char* tracePath, unsigned int maxPairs, std::ostream& out)
+{
+    std::ifstream file;
+    if (!Open(file, tracePath))
+    {
+        return false;
+    }
+
+    std::vector<unsigned long long> counts(0x10000, 0);
+    unsigned long long total = 0;
+    int previous = -1;
+    unsigned long long lost = 0;
+    bool isTruncated = false;
+    std::vector<TraceRecord> records;
+    while (ReadChunk(file, records, lost, isTruncated))
+    {
+        if (lost != 0)
+        {
+            previous = -1;
+        }
+
+        for (const TraceRecord& record : records)
+        {
+            if (previous >= 0)
+            {
+                counts[(previous << 8) | record.opcode]++;
+                total++;
+            }
+
+            previous = record.opcode;
+        }
+    }
+
+    if (isTruncated)
+    {
+        Logger::LogError("Trace: %s is truncated", tracePath);
+        return false;
+    }
+
+    std::vector<unsigned int> pairs;
+    for (unsigned int pair = 0; pair < counts.size(); pair++)
+    {
+        if (counts[pair] != 0)
+        {
+            pairs.push_back(pair);
+        }
+    }
+
+    std::sort(pairs.begin(), pairs.end(), [&counts](unsigned int a, unsigned int b) { return counts[a] > counts[b]; });
+    if (pairs.size() > maxPairs)
+    {
+        pairs.resize(maxPairs);
+    }
+
+    out << total << " opcode pairs" << std::endl;
+    for (unsigned int pair : pairs)
+    {
+        char line[96];
+        snprintf(line, sizeof(line), "%6.2f%%  %-18s %s", (counts[pair] * 100.0) / total,
+            Disassemble(0, static_cast<byte>(pair >> 8), nullptr).c_str(), Disassemble(0, static_cast<byte>(pair), nullptr).c_str());
+        out << line << std::endl;
+    }
+
+    return true;
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <fstream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#define TraceVersion        3
+#define TraceDefaultSize    0x10000     // Records kept in the ring, 640KB
+#define TraceWriterInterval 20          // Milliseconds between writer thread flushes
+#define TraceFaultPath      "gb-emu-fault.trace"
+
+/*
+    One executed instruction, recorded before it runs. Operands are not recorded, the decoder reads
+    them back from the ROM. This is the layout in the ring, files use the encoding described below.
+*/
+struct TraceRecord
+{
+    ushort PC;
+    ushort bank;    // ROM bank mapped at 0x4000-0x7FFF when PC is in there, 0 otherwise, MBC5 has 9 bits
+    ushort AF;
+    ushort HL;
+    byte opcode;
+};
+
+/*
+    An instruction trace, kept in a fixed size ring that always holds the most recent records.
+
+    Record() is a couple of stores and is meant to stay on in normal runs. The ring can be dumped to
+    a file at any time, or a writer thread can drain it to a file continuously. The writer never
+    slows the emulation down: if it falls a full ring behind, the oldest records are dropped and
+    the file notes how many.
+
+    File layout, all values little endian: "GBTR" and TraceVersion as 32 bit values, then any number
+    of chunks of a 64 bit record count, a 64 bit count of the instructions before the chunk that are
+    not in the file and the records themselves. A record is 7 bytes: the opcode, PC, AF and HL. The
+    low nibble of F is always zero, its bit 0 is set when the 16 bit ROM bank follows, which it does
+    whenever the bank differs from the record before it in the chunk (bank 0 for the first one).
+*/
+class Trace
+{
+public:
+    Trace(unsigned int size);
+    ~Trace();
+
+    void Record(ushort PC, ushort bank, byte opcode, ushort AF, ushort HL)
+    {
+        unsigned long long index = m_Index.load(std::memory_order_relaxed);
+        TraceRecord& record = m_Records[static_cast<size_t>(index & m_Mask)];
+        record.PC = PC;
+        record.bank = bank;
+        record.opcode = opcode;
+        record.AF = AF;
+        record.HL = HL;
+        m_Index.store(index + 1, std::memory_order_release);
+    }
+
+    bool Dump(const char* path);
+    bool StartWriter(const char* path);
+    void StopWriter();
+    unsigned long long GetCount();
+
+    // Writes a trace file as text, operands are filled in from the ROM if it is given
+    static bool Decode(const char* tracePath, const char* romPath, std::ostream& out);
+
+    // Writes the opcode pairs that run most often
+    static bool Profile(const char* tracePath, unsigned int maxPairs, std::ostream& out);
+
+private:
+    static bool Open(std::ifstream& file, const char* tracePath);
+    static bool ReadChunk(std::ifstream& file, std::vector<TraceRecord>& records, unsigned long long& lost, bool& isTruncated);
+    unsigned long long Copy(unsigned long long start, std::vector<TraceRecord>& records);
+    static bool WriteHeader(std::ostream& file);
+    static void WriteChunk(std::ostream& file, const std::vector<TraceRecord>& records, unsigned long long lost);
+    void RunWriter();
+    void Flush();
+
+private:
+    std::vector<TraceRecord> m_Records;
+    unsigned long long m_Mask;
+    std::atomic<unsigned long long> m_Index;    // Records written so far, the next one goes to m_Index & m_Mask
+
+    // Continuous writer
+    std::thread m_Writer;
+    std::mutex m_WriterMutex;
+    std::condition_variable m_WriterCondition;
+    bool m_IsWriterStopping;
+    std::ofstream m_WriterFile;
+    unsigned long long m_Written;   // Index of the first record the writer has not handled yet
+    std::vector<TraceRecord> m_WriterBuffer;
+};
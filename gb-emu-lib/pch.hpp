@@ -14,6 +14,7 @@ typedef signed char sbyte;
 typedef unsigned short ushort;
 
 #include "Logger.hpp"
+#include "MachineState.hpp"
 #include "IMemoryUnit.hpp"
 #include "ICPU.hpp"
 #include "IMMU.hpp"
@@ -22,3 +23,6 @@ typedef unsigned short ushort;
 #define ISBITSET(val, bit) (((val >> bit) & 0x01) == 0x01)
 #define SETBIT(val, bit) (val | (1 << bit))
 #define CLEARBIT(val, bit) (val & ~(1 << bit))
+
+// What GetCyclesUntilEvent returns for a component with nothing coming up
+#define NoEventCycles 0xFFFFFFFFul
@@ -0,0 +1,59 @@
+#include "stdafx.h"
+
+#include <AtomicFile.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+TEST_CLASS(AtomicFileTests)
+{
+public:
+    TEST_METHOD(ConcurrentWriteTest)
+    {
+        const char* path = "ConcurrentWriteTest.bin";
+
+        // Writers racing on one path, every one of them lands and the file is always one whole write
+        std::atomic<int> failures(0);
+        std::vector<std::thread> writers;
+        for (int writer = 0; writer < 4; writer++)
+        {
+            writers.push_back(std::thread([&, writer]()
+            {
+                std::vector<byte> data(0x40000, static_cast<byte>(writer + 1));
+                for (int write = 0; write < 20; write++)
+                {
+                    if (!WriteFileAtomic(path, data.data(), data.size()))
+                    {
+                        failures++;
+                    }
+                }
+            }));
+        }
+
+        for (std::thread& writer : writers)
+        {
+            writer.join();
+        }
+
+        Assert::AreEqual(0, failures.load());
+        std::ifstream file(path, std::ios::binary);
+        std::vector<byte> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        file.close();
+        Assert::AreEqual(0x40000, (int)data.size());
+        Assert::IsTrue((data[0] >= 1) && (data[0] <= 4));
+        Assert::IsTrue(std::all_of(data.begin(), data.end(), [&](byte value) { return value == data[0]; }));
+
+        // An existing file is replaced
+        const byte replacement[] = { 0x12, 0x34 };
+        Assert::IsTrue(WriteFileAtomic(path, replacement, sizeof(replacement)));
+        std::ifstream replaced(path, std::ios::binary);
+        data.assign((std::istreambuf_iterator<char>(replaced)), std::istreambuf_iterator<char>());
+        replaced.close();
+        Assert::AreEqual(2, (int)data.size());
+        Assert::AreEqual(0x34, (int)data[1]);
+
+        std::remove(path);
+    }
+};
@@ -1,6 +1,17 @@
 #include "stdafx.h"
 
 #include <CPU.hpp>
+#include <Lockstep.hpp>
+#include <MBC.hpp>
+#include <BootCache.hpp>
+#include <Debugger.hpp>
+#include <JIT.hpp>
+#include <Trace.hpp>
+
+#include "TestROM.hpp"
+
+#include <algorithm>
+#include <random>
 
 TEST_CLASS(CPUTests)
 {
@@ -46,6 +57,10 @@ private:
             return true;
         }
 
+        void SetCGBMode(bool isCGB)
+        {
+        }
+
         byte Read(const ushort& address)
         {
             return m_data[address];
@@ -57,10 +72,46 @@ private:
             return true;
         }
 
+        const byte* ResolveBlock(const ushort& address)
+        {
+            return &m_data[address];
+        }
+
+        void SaveState(StateWriter& writer)
+        {
+            writer.Write(m_data);
+        }
+
+        void LoadState(StateReader& reader)
+        {
+            reader.Read(m_data);
+        }
+
     private:
         byte m_data[0xFFFF + 1];
     };
 
+    // Fills a flat memory image with a random stream of valid opcodes and operands. HALT and STOP
+    // are left out, since they stop the instruction stream from making progress.
+    static void FillRandomInstructions(byte* memory, int size, unsigned int seed)
+    {
+        CPU cpu;
+        std::vector<byte> opCodes;
+        for (int opCode = 0x00; opCode <= 0xFF; opCode++)
+        {
+            if ((cpu.m_operationMap[opCode] != nullptr || opCode == 0xCB) && (opCode != 0x76) && (opCode != 0x10))
+            {
+                opCodes.push_back(static_cast<byte>(opCode));
+            }
+        }
+
+        std::mt19937 random(seed);
+        for (int index = 0; index < size; index++)
+        {
+            memory[index] = opCodes[random() % opCodes.size()];
+        }
+    }
+
 public:
     // Misc tests
     TEST_METHOD(Timing_Test)
@@ -1283,6 +1334,39 @@ public:
         spCPU.reset();
     }
 
+    TEST_METHOD(DoubleSpeed_Test)
+    {
+        // STOP 00, NOP, STOP 00
+        byte m_Mem[] = { 0x10, 0x00, 0x00, 0x10, 0x00 };
+        std::unique_ptr<CPU> spCPU = std::make_unique<CPU>();
+        spCPU->Initialize(new CPUTestsMMU(m_Mem, ARRAYSIZE(m_Mem)), true);
+        spCPU->m_isCGB = true;
+
+        // Prepare the speed switch
+        spCPU->WriteByte(SpeedSwitchAddress, 0xFF);
+        Assert::AreEqual(0x7F, (int)spCPU->ReadByte(SpeedSwitchAddress));
+
+        // Step the CPU 1 OpCode
+        Assert::AreEqual(SpeedSwitchCycles, spCPU->Step());
+
+        // Verify expectations after
+        Assert::AreEqual(0x0002, (int)spCPU->m_PC);
+        Assert::IsFalse(spCPU->m_isHalted);
+        Assert::AreEqual(0xFE, (int)spCPU->ReadByte(SpeedSwitchAddress));
+
+        // The CPU runs twice as fast as everything else now
+        Assert::AreEqual(2, spCPU->Step());
+        Assert::AreEqual(SpeedSwitchCycles * 2 + 4, (int)spCPU->m_cycles);
+
+        // Switching back stalls for the same real time
+        spCPU->WriteByte(SpeedSwitchAddress, 0x01);
+        Assert::AreEqual(SpeedSwitchCycles, spCPU->Step());
+        Assert::AreEqual(0x0005, (int)spCPU->m_PC);
+        Assert::AreEqual(0x7E, (int)spCPU->ReadByte(SpeedSwitchAddress));
+
+        spCPU.reset();
+    }
+
     // 0x12
     TEST_METHOD(LD_DE_A_Test)
     {
@@ -7240,4 +7324,410 @@ public:
 
         spCPU.reset();
     }
+
+    TEST_METHOD(Lockstep_Fuzz_Test)
+    {
+        std::unique_ptr<byte[]> spMemory = std::unique_ptr<byte[]>(new byte[0xFFFF + 1]);
+        for (unsigned int seed = 1; seed <= 16; seed++)
+        {
+            FillRandomInstructions(spMemory.get(), 0xFFFF + 1, seed);
+
+            std::unique_ptr<CPU> spReference = std::make_unique<CPU>();
+            std::unique_ptr<CPU> spCandidate = std::make_unique<CPU>();
+            spReference->Initialize(new CPUTestsMMU(spMemory.get(), 0xFFFF + 1), true);
+            spCandidate->Initialize(new CPUTestsMMU(spMemory.get(), 0xFFFF + 1), true);
+
+            Lockstep lockstep(spReference.get(), spCandidate.get());
+            lockstep.SetDigestInterval(64);
+            if (!lockstep.Run(20000))
+            {
+                lockstep.DumpDivergence();
+            }
+
+            Assert::IsFalse(lockstep.HasDiverged());
+            Assert::AreEqual(20000, (int)lockstep.GetStepCount());
+        }
+    }
+
+    TEST_METHOD(Lockstep_Divergence_Test)
+    {
+        std::unique_ptr<byte[]> spMemory = std::unique_ptr<byte[]>(new byte[0xFFFF + 1]);
+        FillRandomInstructions(spMemory.get(), 0xFFFF + 1, 1234);
+
+        // A register difference is caught on the next step
+        std::unique_ptr<CPU> spReference = std::make_unique<CPU>();
+        std::unique_ptr<CPU> spCandidate = std::make_unique<CPU>();
+        spReference->Initialize(new CPUTestsMMU(spMemory.get(), 0xFFFF + 1), true);
+        spCandidate->Initialize(new CPUTestsMMU(spMemory.get(), 0xFFFF + 1), true);
+
+        Lockstep registers(spReference.get(), spCandidate.get());
+        Assert::IsTrue(registers.Run(100));
+        spCandidate->m_SP ^= 0x0100;
+        Assert::IsFalse(registers.Run(100));
+        Assert::IsTrue(registers.HasDiverged());
+        Assert::AreEqual(101, (int)registers.GetStepCount());
+
+        // A memory difference is caught by the digest
+        spReference = std::make_unique<CPU>();
+        spCandidate = std::make_unique<CPU>();
+        spReference->Initialize(new CPUTestsMMU(spMemory.get(), 0xFFFF + 1), true);
+        spCandidate->Initialize(new CPUTestsMMU(spMemory.get(), 0xFFFF + 1), true);
+        spCandidate->m_MMU->Write(0xC123, spCandidate->m_MMU->Read(0xC123) ^ 0xFF);
+
+        Lockstep memory(spReference.get(), spCandidate.get());
+        Assert::IsFalse(memory.Run(1));
+        Assert::IsTrue(memory.HasDiverged());
+    }
+
+    TEST_METHOD(FastBoot_Test)
+    {
+        // A boot ROM that copies a header byte to WRAM, burns some cycles and unmaps itself
+        byte bootROM[0x100] = {
+            0x31, 0xFE, 0xFF,   // LD SP,0xFFFE
+            0x3E, 0x42,         // LD A,0x42
+            0xEA, 0x00, 0xC0,   // LD (0xC000),A
+            0x01, 0x00, 0x10,   // LD BC,0x1000
+            0x0B,               // DEC BC
+            0x78,               // LD A,B
+            0xB1,               // OR C
+            0x20, 0xFB,         // JR NZ,-5
+            0xFA, 0x44, 0x01,   // LD A,(0x0144)
+            0xEA, 0x01, 0xC0,   // LD (0xC001),A
+            0xC3, 0xFC, 0x00,   // JP 0x00FC
+        };
+        bootROM[0xFC] = 0x3E;   // LD A,0x01
+        bootROM[0xFD] = 0x01;
+        bootROM[0xFE] = 0xE0;   // LD (0xFF00+0x50),A
+        bootROM[0xFF] = 0x50;
+
+        std::vector<byte> cartridge(0x8000, 0x00);
+        cartridge[0x0144] = 0x5A;
+
+        TestROM rom("FastBoot_Test", cartridge, bootROM);
+        unsigned long long key = BootCache::MakeKey(bootROM, sizeof(bootROM), &cartridge[0x0100], 0x50);
+        BootCache::Clear();
+
+        // Boot normally for reference
+        std::unique_ptr<CPU> spReference = std::make_unique<CPU>();
+        Assert::IsTrue(spReference->Initialize());
+        Assert::IsTrue(spReference->LoadROM(rom.GetBootROMPath(), rom.GetCartridgePath()));
+        while (spReference->PeekMemory(0xFF50) == 0x00)
+        {
+            spReference->Step();
+        }
+
+        CPUState reference;
+        spReference->GetState(reference);
+        Assert::AreEqual(0x0100, (int)reference.PC);
+        Assert::AreEqual(0x5A, (int)spReference->PeekMemory(0xC001));
+
+        // The first fast boot runs the boot ROM and caches the result, the others restore it
+        for (int run = 0; run < 3; run++)
+        {
+            std::unique_ptr<CPU> spCPU = std::make_unique<CPU>();
+            Assert::IsTrue(spCPU->Initialize());
+            spCPU->SetFastBoot(true);
+            Assert::IsTrue(spCPU->LoadROM(rom.GetBootROMPath(), rom.GetCartridgePath()));
+
+            CPUState state;
+            spCPU->GetState(state);
+            Assert::AreEqual((int)reference.AF, (int)state.AF);
+            Assert::AreEqual((int)reference.BC, (int)state.BC);
+            Assert::AreEqual((int)reference.SP, (int)state.SP);
+            Assert::AreEqual((int)reference.PC, (int)state.PC);
+            Assert::AreEqual((int)reference.cycles, (int)state.cycles);
+            Assert::AreEqual(spReference->GetMemoryDigest(), spCPU->GetMemoryDigest());
+            Assert::AreEqual(0x01, (int)spCPU->PeekMemory(0xFF50));
+
+            std::vector<byte> cached;
+            Assert::IsTrue(BootCache::Find(key, cached));
+
+            if (run == 1)
+            {
+                // Only keep a copy on disk for the last run
+                BootCache::SetDirectory(".");
+                BootCache::Store(key, cached);
+                BootCache::Clear();
+            }
+        }
+
+        BootCache::Remove(key);
+        BootCache::SetDirectory(nullptr);
+        BootCache::Clear();
+    }
+
+    TEST_METHOD(MemoryFootprint_Test)
+    {
+        // An MBC1 cartridge with 8KB of RAM and a boot ROM that only unmaps itself
+        std::vector<byte> cartridge(0x8000, 0x00);
+        cartridge[CartridgeTypeAddress] = 0x02;    // MBC1+RAM
+        cartridge[ROMSizeAddress] = ROM_32KB;
+        cartridge[RAMSizeAddress] = RAM_8KB;
+
+        TestROM rom("MemoryFootprint_Test", cartridge);
+
+        std::unique_ptr<CPU> spFirst = std::make_unique<CPU>();
+        std::unique_ptr<CPU> spSecond = std::make_unique<CPU>();
+        Assert::IsTrue(spFirst->Initialize());
+        Assert::IsTrue(spSecond->Initialize());
+        Assert::IsTrue(spFirst->LoadROM(rom.GetBootROMPath(), rom.GetCartridgePath()));
+        Assert::IsTrue(spSecond->LoadROM(rom.GetBootROMPath(), rom.GetCartridgePath()));
+
+        // Everything but the cartridge RAM fits the budget, in one cache aligned block
+        Assert::IsTrue(spFirst->GetMemoryFootprint() <= MachineStateBudget + 0x2000);
+        Assert::AreEqual(0, (int)(reinterpret_cast<uintptr_t>(spFirst.get()) % CacheLineSize));
+        Assert::AreEqual(0, (int)(reinterpret_cast<uintptr_t>(spSecond.get()) % CacheLineSize));
+
+        // Both machines run off the same copy of the ROM
+        Assert::IsTrue(spFirst->m_cartridge->GetMemoryBlock(0x0000) == spSecond->m_cartridge->GetMemoryBlock(0x0000));
+
+        // The state every step touches sits in the first cache lines of the arena, the tables behind it
+        const byte* pBase = spFirst->m_Arena.GetBase();
+        size_t timerOffset = reinterpret_cast<const byte*>(spFirst->m_timer) - pBase;
+        size_t mmuOffset = reinterpret_cast<const byte*>(spFirst->m_MMU) - pBase;
+        size_t modeClockOffset = reinterpret_cast<const byte*>(&spFirst->m_GPU->m_ModeClock) - pBase;
+        Assert::AreEqual(0, (int)timerOffset);
+        Assert::IsTrue(mmuOffset < 16 * CacheLineSize);
+        Assert::IsTrue(modeClockOffset < 16 * CacheLineSize);
+
+        spFirst.reset();
+        spSecond.reset();
+    }
+
+#if JIT_X64
+    TEST_METHOD(JIT_Test)
+    {
+        TestROM rom("JIT_Test");
+
+        // Random code against the interpreter, with whatever it does to the I/O registers and interrupts
+        std::vector<byte> cartridge(0x8000, 0x00);
+        for (unsigned int seed = 1; seed <= 4; seed++)
+        {
+            FillRandomInstructions(cartridge.data(), static_cast<int>(cartridge.size()), seed);
+            cartridge[0x0147] = 0x00;   // ROM only, no RAM
+            cartridge[0x0148] = 0x00;
+            cartridge[0x0149] = 0x00;
+            rom.WriteCartridge(cartridge);
+
+            std::unique_ptr<CPU> spReference = std::make_unique<CPU>();
+            std::unique_ptr<CPU> spCandidate = std::make_unique<CPU>();
+            Assert::IsTrue(spReference->Initialize() && spReference->LoadROM(rom.GetBootROMPath(), rom.GetCartridgePath()));
+            Assert::IsTrue(spCandidate->Initialize() && spCandidate->LoadROM(rom.GetBootROMPath(), rom.GetCartridgePath()));
+            spReference->SetFusion(false);
+            Assert::IsTrue(spCandidate->EnableJIT(true));
+
+            Lockstep lockstep(spReference.get(), spCandidate.get());
+            lockstep.SetDigestInterval(64);
+            if (!lockstep.Run(20000))
+            {
+                lockstep.DumpDivergence();
+            }
+
+            Assert::IsFalse(lockstep.HasDiverged());
+        }
+
+        // A routine in work RAM is translated, then rewritten while it is in use
+        const byte program[] = {
+            0x21, 0x00, 0xC0,   // 0x0100 LD HL,0xC000
+            0x36, 0x3C,         // 0x0103 LD (HL),0x3C      INC A
+            0x23,               // 0x0105 INC HL
+            0x36, 0xC9,         // 0x0106 LD (HL),0xC9      RET
+            0x31, 0xFF, 0xDF,   // 0x0108 LD SP,0xDFFF
+            0xAF,               // 0x010B XOR A
+            0x06, 0x40,         // 0x010C LD B,0x40
+            0xCD, 0x00, 0xC0,   // 0x010E CALL 0xC000
+            0x05,               // 0x0111 DEC B
+            0x20, 0xFA,         // 0x0112 JR NZ,0x010E
+            0x21, 0x00, 0xC0,   // 0x0114 LD HL,0xC000
+            0x36, 0x3D,         // 0x0117 LD (HL),0x3D      DEC A
+            0x06, 0x10,         // 0x0119 LD B,0x10
+            0xCD, 0x00, 0xC0,   // 0x011B CALL 0xC000
+            0x05,               // 0x011E DEC B
+            0x20, 0xFA,         // 0x011F JR NZ,0x011B
+            0xEA, 0x00, 0xC1,   // 0x0121 LD (0xC100),A
+            0x18, 0xFE,         // 0x0124 JR 0x0124
+        };
+        std::fill(cartridge.begin(), cartridge.end(), 0x00);
+        memcpy(&cartridge[0x0100], program, sizeof(program));
+        rom.WriteCartridge(cartridge);
+
+        std::unique_ptr<CPU> spReference = std::make_unique<CPU>();
+        std::unique_ptr<CPU> spCandidate = std::make_unique<CPU>();
+        Assert::IsTrue(spReference->Initialize() && spReference->LoadROM(rom.GetBootROMPath(), rom.GetCartridgePath()));
+        Assert::IsTrue(spCandidate->Initialize() && spCandidate->LoadROM(rom.GetBootROMPath(), rom.GetCartridgePath()));
+        spReference->SetFusion(false);
+        Assert::IsTrue(spCandidate->EnableJIT(true));
+
+        Lockstep lockstep(spReference.get(), spCandidate.get());
+        if (!lockstep.Run(2000))
+        {
+            lockstep.DumpDivergence();
+        }
+
+        Assert::IsFalse(lockstep.HasDiverged());
+        Assert::AreEqual(0x30, (int)spCandidate->m_MMU->Read(0xC100));
+
+        // The tools that look at every instruction turn it off
+        Assert::IsTrue(spCandidate->GetDebugger() != nullptr);
+        Assert::IsFalse(spCandidate->EnableJIT(true));
+
+        // An MBC1 bank is switched out from under a routine that has been translated
+        const byte bankedProgram[] = {
+            0x31, 0xFF, 0xDF,   // 0x0100 LD SP,0xDFFF
+            0xAF,               // 0x0103 XOR A
+            0x06, 0x40,         // 0x0104 LD B,0x40
+            0xCD, 0x00, 0x40,   // 0x0106 CALL 0x4000
+            0x05,               // 0x0109 DEC B
+            0x20, 0xFA,         // 0x010A JR NZ,0x0106
+            0x4F,               // 0x010C LD C,A
+            0x3E, 0x02,         // 0x010D LD A,0x02
+            0xEA, 0x00, 0x20,   // 0x010F LD (0x2000),A
+            0x79,               // 0x0112 LD A,C
+            0x06, 0x10,         // 0x0113 LD B,0x10
+            0xCD, 0x00, 0x40,   // 0x0115 CALL 0x4000
+            0x05,               // 0x0118 DEC B
+            0x20, 0xFA,         // 0x0119 JR NZ,0x0115
+            0xEA, 0x00, 0xC1,   // 0x011B LD (0xC100),A
+            0x18, 0xFE,         // 0x011E JR 0x011E
+        };
+        const byte bank1[] = { 0xC6, 0x01, 0xC9 };  // ADD A,0x01; RET
+        const byte bank2[] = { 0xC6, 0x02, 0xC9 };  // ADD A,0x02; RET
+        cartridge.assign(0x10000, 0x00);
+        cartridge[CartridgeTypeAddress] = 0x01;    // MBC1
+        cartridge[ROMSizeAddress] = ROM_64KB;
+        cartridge[RAMSizeAddress] = RAM_None;
+        memcpy(&cartridge[0x0100], bankedProgram, sizeof(bankedProgram));
+        memcpy(&cartridge[0x4000], bank1, sizeof(bank1));
+        memcpy(&cartridge[0x8000], bank2, sizeof(bank2));
+        rom.WriteCartridge(cartridge);
+
+        spReference = std::make_unique<CPU>();
+        spCandidate = std::make_unique<CPU>();
+        Assert::IsTrue(spReference->Initialize() && spReference->LoadROM(rom.GetBootROMPath(), rom.GetCartridgePath()));
+        Assert::IsTrue(spCandidate->Initialize() && spCandidate->LoadROM(rom.GetBootROMPath(), rom.GetCartridgePath()));
+        spReference->SetFusion(false);
+        Assert::IsTrue(spCandidate->EnableJIT(true));
+
+        Lockstep bankedLockstep(spReference.get(), spCandidate.get());
+        if (!bankedLockstep.Run(2000))
+        {
+            bankedLockstep.DumpDivergence();
+        }
+
+        Assert::IsFalse(bankedLockstep.HasDiverged());
+        Assert::AreEqual(0x60, (int)spCandidate->m_MMU->Read(0xC100));
+
+        spReference.reset();
+        spCandidate.reset();
+    }
+#endif
+
+    TEST_METHOD(Fusion_Test)
+    {
+        std::vector<byte> cartridge(0x8000, 0x00);
+        const byte program[] = {
+            0x31, 0xFF, 0xDF,   // 0x0100 LD SP,0xDFFF
+            0x21, 0x00, 0x02,   // 0x0103 LD HL,0x0200
+            0x11, 0x00, 0xC0,   // 0x0106 LD DE,0xC000
+            0x01, 0x00, 0x01,   // 0x0109 LD BC,0x0100
+            0x2A,               // 0x010C LD A,(HL+)
+            0x12,               // 0x010D LD (DE),A
+            0x13,               // 0x010E INC DE
+            0x0B,               // 0x010F DEC BC
+            0x78,               // 0x0110 LD A,B
+            0xB1,               // 0x0111 OR C
+            0x20, 0xF8,         // 0x0112 JR NZ,0x010C
+            0xF0, 0x44,         // 0x0114 LDH A,(0x44)
+            0xFE, 0x90,         // 0x0116 CP 0x90
+            0x20, 0xFA,         // 0x0118 JR NZ,0x0114
+            0x3E, 0xF0,         // 0x011A LD A,0xF0
+            0xD6, 0x01,         // 0x011C SUB 0x01
+            0x30, 0xFC,         // 0x011E JR NC,0x011C
+            0x3E, 0x01,         // 0x0120 LD A,0x01
+            0xE0, 0xFF,         // 0x0122 LDH (0xFF),A
+            0xFB,               // 0x0124 EI
+            0x18, 0xFE,         // 0x0125 JR 0x0125
+        };
+        const byte start[] = {
+            0x3E, 0x91,         // 0x0004 LD A,0x91, the boot ROM ends here
+            0xE0, 0x40,         // 0x0006 LDH (0x40),A, turns the LCD on
+            0xC3, 0x00, 0x01,   // 0x0008 JP 0x0100
+        };
+        const byte handler[] = {
+            0x21, 0x00, 0xC1,   // 0x0040 LD HL,0xC100
+            0x34,               // 0x0043 INC (HL)
+            0xD9,               // 0x0044 RETI
+        };
+        memcpy(&cartridge[0x0100], program, sizeof(program));
+        memcpy(&cartridge[0x0004], start, sizeof(start));
+        memcpy(&cartridge[0x0040], handler, sizeof(handler));
+        for (int index = 0; index < 0x100; index++)
+        {
+            cartridge[0x0200 + index] = static_cast<byte>(index ^ 0x5A);
+        }
+
+        TestROM rom("Fusion_Test", cartridge);
+
+        // Every fused step has to end exactly where the interpreter gets to one instruction at a time
+        Lockstep lockstep;
+        Assert::IsTrue(lockstep.LoadROM(rom.GetBootROMPath(), rom.GetCartridgePath()));
+        if (!lockstep.Run(20000))
+        {
+            lockstep.DumpDivergence();
+        }
+
+        Assert::IsFalse(lockstep.HasDiverged());
+
+        std::unique_ptr<CPU> spCPU = std::make_unique<CPU>();
+        Assert::IsTrue(spCPU->Initialize());
+        Assert::IsTrue(spCPU->LoadROM(rom.GetBootROMPath(), rom.GetCartridgePath()));
+        for (int step = 0; step < 20000; step++)
+        {
+            spCPU->Step();
+        }
+
+        for (int index = 0; index < 0x100; index++)
+        {
+            Assert::AreEqual(index ^ 0x5A, (int)spCPU->m_MMU->Read(0xC000 + index));
+        }
+
+        Assert::IsTrue(spCPU->m_MMU->Read(0xC100) > 0);
+
+        // Waiting for the next VBlank takes a few steps instead of one per JR
+        int maxCycles = 0;
+        for (int step = 0; step < 100; step++)
+        {
+            maxCycles = std::max(maxCycles, spCPU->Step());
+        }
+
+        Assert::IsTrue(maxCycles > 12);
+
+        // A trace does not turn fusion off, and still gets every instruction the interpreter runs
+        std::unique_ptr<CPU> spFused = std::make_unique<CPU>();
+        Assert::IsTrue(spFused->Initialize() && spFused->LoadROM(rom.GetBootROMPath(), rom.GetCartridgePath()));
+        Trace* pFusedTrace = spFused->EnableTrace(0x1000);
+        maxCycles = 0;
+        for (int step = 0; step < 20000; step++)
+        {
+            maxCycles = std::max(maxCycles, spFused->Step());
+        }
+
+        Assert::IsTrue(maxCycles > 12);
+
+        std::unique_ptr<CPU> spSingle = std::make_unique<CPU>();
+        Assert::IsTrue(spSingle->Initialize() && spSingle->LoadROM(rom.GetBootROMPath(), rom.GetCartridgePath()));
+        spSingle->SetFusion(false);
+        Trace* pSingleTrace = spSingle->EnableTrace(0x1000);
+        while (spSingle->m_cycles < spFused->m_cycles)
+        {
+            spSingle->Step();
+        }
+
+        Assert::IsTrue(spSingle->m_cycles == spFused->m_cycles);
+        Assert::IsTrue(pSingleTrace->GetCount() == pFusedTrace->GetCount());
+
+        spCPU.reset();
+        spFused.reset();
+        spSingle.reset();
+    }
 };
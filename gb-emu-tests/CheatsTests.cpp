@@ -0,0 +1,113 @@
+#include "stdafx.h"
+
+#include <CPU.hpp>
+#include <Cheats.hpp>
+#include <Coverage.hpp>
+#include <Debugger.hpp>
+
+#include "TestROM.hpp"
+
+TEST_CLASS(CheatsTests)
+{
+public:
+    TEST_METHOD(CodesTest)
+    {
+        std::vector<byte> cartridge(0x8000, 0x00);
+        cartridge[0x0200] = 0x11;
+        cartridge[0x4200] = 0x22;
+
+        TestROM rom("CodesTest", cartridge);
+
+        std::unique_ptr<CPU> spCPU = std::make_unique<CPU>();
+        Assert::IsTrue(spCPU->Initialize());
+        Assert::IsTrue(spCPU->LoadROM(rom.GetBootROMPath(), rom.GetCartridgePath()));
+        Cheats* pCheats = spCPU->GetCheats();
+
+        // 0x99 at 0x0200, only while the ROM has 0x11 there
+        Assert::IsTrue(pCheats->AddCode("992-00F-A6E"));
+        Assert::AreEqual(0x99, (int)spCPU->PeekMemory(0x0200));
+        Assert::AreEqual(0x00, (int)spCPU->PeekMemory(0x0201));
+
+        // A compare that does not match leaves the ROM alone
+        Assert::IsTrue(pCheats->AddCode("992-00B-A6E"));
+        Assert::AreEqual(0x22, (int)spCPU->PeekMemory(0x4200));
+        Assert::IsTrue(pCheats->AddCode("772-00B"));
+        Assert::AreEqual(0x77, (int)spCPU->PeekMemory(0x4200));
+
+        Assert::IsTrue(pCheats->RemoveCode("992-00F-A6E"));
+        Assert::AreEqual(0x11, (int)spCPU->PeekMemory(0x0200));
+        Assert::IsTrue(!pCheats->RemoveCode("992-00F-A6E"));
+        Assert::IsTrue(!pCheats->AddCode("992-00F-A6G"));
+        Assert::IsTrue(!pCheats->AddCode("99200"));
+
+        // GameShark codes only write at VBlank
+        Assert::IsTrue(pCheats->AddCode("014200C0"));
+        Assert::AreEqual(0x00, (int)spCPU->PeekMemory(0xC000));
+        spCPU->TriggerInterrupt(INT40);
+        Assert::AreEqual(0x42, (int)spCPU->PeekMemory(0xC000));
+
+        // Codes for one RAM bank would write to whichever bank is mapped
+        Assert::IsTrue(!pCheats->AddCode("814300A0"));
+        Assert::IsTrue(!pCheats->AddCode("924300D0"));
+
+        pCheats->ClearAll();
+        Assert::AreEqual(0x22, (int)spCPU->PeekMemory(0x4200));
+        spCPU->m_MMU->Write(0xC000, 0x00);
+        spCPU->TriggerInterrupt(INT40);
+        Assert::AreEqual(0x00, (int)spCPU->PeekMemory(0xC000));
+
+        spCPU.reset();
+    }
+
+    TEST_METHOD(InterposerOrderTest)
+    {
+        std::vector<byte> cartridge(0x8000, 0x00);
+        const byte program[] = {
+            0xC3, 0x50, 0x01,   // 0x0100 JP 0x0150
+        };
+        const byte target[] = {
+            0x3E, 0x42,         // 0x0150 LD A,0x42
+            0x18, 0xFE,         // 0x0152 JR 0x0152
+        };
+        memcpy(&cartridge[0x0100], program, sizeof(program));
+        memcpy(&cartridge[0x0150], target, sizeof(target));
+
+        TestROM rom("InterposerOrderTest", cartridge);
+
+        std::unique_ptr<CPU> spCPU = std::make_unique<CPU>();
+        Assert::IsTrue(spCPU->Initialize());
+        Assert::IsTrue(spCPU->LoadROM(rom.GetBootROMPath(), rom.GetCartridgePath()));
+        Cheats* pCheats = spCPU->GetCheats();
+        Debugger* pDebugger = spCPU->GetDebugger();
+
+        // The cheat goes in first and comes out first, the breakpoint above it has to be relinked
+        Assert::IsTrue(pCheats->AddCode("001-50F"));
+        pDebugger->SetBreakpoint(0x0150);
+        Assert::AreEqual(0x00, (int)spCPU->PeekMemory(0x0150));
+        Assert::IsTrue(pCheats->RemoveCode("001-50F"));
+        Assert::AreEqual(0x3E, (int)spCPU->PeekMemory(0x0150));
+        pDebugger->ClearBreakpoint(0x0150);
+        Assert::AreEqual(0x3E, (int)spCPU->PeekMemory(0x0150));
+
+        // Coverage goes in above the breakpoint and has to stay once the breakpoint is gone
+        pDebugger->SetBreakpoint(0x0150);
+        Coverage* pCoverage = spCPU->EnableCoverage();
+        Assert::IsTrue(pCheats->AddCode("001-50F"));
+        pDebugger->ClearBreakpoint(0x0150);
+        Assert::IsTrue(pCheats->RemoveCode("001-50F"));
+
+        CPUState state;
+        for (int step = 0; step < 400; step++)
+        {
+            spCPU->Step();
+        }
+
+        spCPU->GetState(state);
+        Assert::AreEqual(0x0152, (int)state.PC);
+        Assert::AreEqual(0x42, (int)(state.AF >> 8));
+        Assert::AreEqual(CoverageOpcode, (int)pCoverage->GetMap()[0x0150]);
+        Assert::AreEqual(CoverageOperand, (int)pCoverage->GetMap()[0x0151]);
+
+        spCPU.reset();
+    }
+};
@@ -0,0 +1,79 @@
+#include "stdafx.h"
+
+#include <CPU.hpp>
+#include <Coverage.hpp>
+
+#include "TestROM.hpp"
+
+#include <string>
+
+TEST_CLASS(CoverageTests)
+{
+public:
+    TEST_METHOD(CoverageMapTest)
+    {
+        std::vector<byte> cartridge(0x8000, 0x00);
+        const byte program[] = {
+            0xFA, 0x00, 0x02,   // 0x0100 LD A,(0x0200)
+            0xC3, 0x00, 0x40,   // 0x0103 JP 0x4000
+        };
+        const byte bankedProgram[] = {
+            0xCB, 0x37,         // 0x4000 SWAP A
+            0x18, 0xFE,         // 0x4002 JR 0x4002
+        };
+        memcpy(&cartridge[0x0100], program, sizeof(program));
+        memcpy(&cartridge[0x4000], bankedProgram, sizeof(bankedProgram));
+
+        TestROM rom("CoverageMapTest", cartridge);
+        const char* mapPath = "CoverageMapTest.map";
+        const char* regionsPath = "CoverageMapTest.regions";
+
+        std::unique_ptr<CPU> spCPU = std::make_unique<CPU>();
+        Assert::IsTrue(spCPU->Initialize());
+        Assert::IsTrue(spCPU->LoadROM(rom.GetBootROMPath(), rom.GetCartridgePath()));
+        Coverage* pCoverage = spCPU->EnableCoverage();
+        Assert::IsTrue(pCoverage != nullptr);
+        for (int step = 0; step < 400; step++)
+        {
+            spCPU->Step();
+        }
+
+        const std::vector<byte>& map = pCoverage->GetMap();
+        Assert::AreEqual(0x8000, (int)map.size());
+        Assert::AreEqual(CoverageOpcode, (int)map[0x0100]);
+        Assert::AreEqual(CoverageOperand, (int)map[0x0101]);
+        Assert::AreEqual(CoverageOperand, (int)map[0x0102]);
+        Assert::AreEqual(CoverageData, (int)map[0x0200]);
+        Assert::AreEqual(CoverageOpcode, (int)map[0x4000]);
+        Assert::AreEqual(CoverageOperand, (int)map[0x4001]);
+        Assert::AreEqual(0x00, (int)map[0x4004]);
+
+        // The NOPs from 0x0004 up to the program and the program are one region, the bank another
+        std::vector<CodeRegion> regions = pCoverage->GetCodeRegions();
+        Assert::AreEqual(2, (int)regions.size());
+        Assert::AreEqual(0x0004, (int)regions[0].offset);
+        Assert::AreEqual(0x0102, (int)regions[0].length);
+        Assert::AreEqual(0x4000, (int)regions[1].offset);
+        Assert::AreEqual(0x0004, (int)regions[1].length);
+
+        Assert::IsTrue(pCoverage->SaveCodeRegions(regionsPath));
+        std::ifstream regionsFile(regionsPath);
+        std::string text((std::istreambuf_iterator<char>(regionsFile)), std::istreambuf_iterator<char>());
+        regionsFile.close();
+        Assert::IsTrue(text == "000004 0102\n004000 0004\n");
+
+        // A saved map adds to the next run
+        Assert::IsTrue(pCoverage->Save(mapPath));
+        spCPU = std::make_unique<CPU>();
+        Assert::IsTrue(spCPU->Initialize());
+        Assert::IsTrue(spCPU->LoadROM(rom.GetBootROMPath(), rom.GetCartridgePath()));
+        pCoverage = spCPU->EnableCoverage();
+        Assert::AreEqual(0x00, (int)pCoverage->GetMap()[0x4000]);
+        Assert::IsTrue(pCoverage->Load(mapPath));
+        Assert::AreEqual(CoverageOpcode, (int)pCoverage->GetMap()[0x4000]);
+
+        spCPU.reset();
+        std::remove(mapPath);
+        std::remove(regionsPath);
+    }
+};
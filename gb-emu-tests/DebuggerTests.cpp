@@ -0,0 +1,133 @@
+#include "stdafx.h"
+
+#include <CPU.hpp>
+#include <Debugger.hpp>
+#include <Emulator.hpp>
+#include <MBC.hpp>
+
+#include "TestROM.hpp"
+
+TEST_CLASS(DebuggerTests)
+{
+private:
+    static std::vector<DebugEvent>& GetDebugEvents()
+    {
+        static std::vector<DebugEvent> events;
+        return events;
+    }
+
+    static void OnDebugEvent(const DebugEvent& event)
+    {
+        GetDebugEvents().push_back(event);
+    }
+
+public:
+    TEST_METHOD(BreakpointTest)
+    {
+        std::vector<byte> cartridge(0x8000, 0x00);
+        const byte program[] = {
+            0x3E, 0x42,         // 0x0100 LD A,0x42
+            0xEA, 0x00, 0xC0,   // 0x0102 LD (0xC000),A
+            0xFA, 0x00, 0xC0,   // 0x0105 LD A,(0xC000)
+            0x18, 0xFE,         // 0x0108 JR 0x0108
+        };
+        memcpy(&cartridge[0x0100], program, sizeof(program));
+
+        TestROM rom("BreakpointTest", cartridge);
+
+        Emulator emulator;
+        Assert::IsTrue(emulator.Initialize(rom.GetBootROMPath(), rom.GetCartridgePath()));
+        GetDebugEvents().clear();
+        emulator.SetDebugCallback(&DebuggerTests::OnDebugEvent);
+        emulator.SetBreakpoint(0x0102);
+        emulator.SetBreakpoint(0x0101);     // An operand, never executed
+        emulator.SetBreakpoint(0x0200);     // Never reached
+        emulator.SetWatchpoint(0xC000, WatchRead | WatchWrite);
+        emulator.SetWatchpoint(0xC001, WatchWrite);
+
+        for (int step = 0; step < 400; step++)
+        {
+            emulator.Step();
+        }
+
+        std::vector<DebugEvent>& events = GetDebugEvents();
+        Assert::AreEqual(3, (int)events.size());
+
+        Assert::AreEqual((int)DebugEventBreakpoint, (int)events[0].type);
+        Assert::AreEqual(0x0102, (int)events[0].address);
+        Assert::AreEqual(0x0102, (int)events[0].state.PC);
+        Assert::AreEqual(0xEA, (int)events[0].value);
+        Assert::AreEqual(0x42, (int)(events[0].state.AF >> 8));
+        Assert::IsTrue(!events[0].snapshot.empty());
+
+        Assert::AreEqual((int)DebugEventWrite, (int)events[1].type);
+        Assert::AreEqual(0xC000, (int)events[1].address);
+        Assert::AreEqual(0x42, (int)events[1].value);
+
+        Assert::AreEqual((int)DebugEventRead, (int)events[2].type);
+        Assert::AreEqual(0xC000, (int)events[2].address);
+        Assert::AreEqual(0x42, (int)events[2].value);
+
+        // Nothing triggers once everything is cleared
+        emulator.ClearDebugPoints();
+        emulator.SetBreakpoint(0x0108);
+        emulator.ClearBreakpoint(0x0108);
+        for (int step = 0; step < 100; step++)
+        {
+            emulator.Step();
+        }
+
+        Assert::AreEqual(3, (int)events.size());
+
+        emulator.Stop();
+    }
+
+    TEST_METHOD(SnapshotTest)
+    {
+        // A 64KB MBC1 cartridge with 8KB of RAM
+        std::vector<byte> cartridge(0x10000, 0x00);
+        cartridge[0x0147] = MBC1RAM;
+        cartridge[0x0148] = 0x01;
+        cartridge[0x0149] = 0x02;
+        const byte program[] = {
+            0x3E, 0x0A,         // 0x0100 LD A,0x0A
+            0xEA, 0x00, 0x00,   // 0x0102 LD (0x0000),A, enables the RAM
+            0x3E, 0x55,         // 0x0105 LD A,0x55
+            0xEA, 0x00, 0xA0,   // 0x0107 LD (0xA000),A
+            0x3E, 0x02,         // 0x010A LD A,0x02
+            0xEA, 0x00, 0x20,   // 0x010C LD (0x2000),A
+            0xC3, 0x00, 0x40,   // 0x010F JP 0x4000
+        };
+        memcpy(&cartridge[0x0100], program, sizeof(program));
+        cartridge[0x8000] = 0x18;                               // 02:4000 JR 0x4000
+        cartridge[0x8001] = 0xFE;
+
+        TestROM rom("SnapshotTest", cartridge);
+
+        Emulator emulator;
+        Assert::IsTrue(emulator.Initialize(rom.GetBootROMPath(), rom.GetCartridgePath()));
+        GetDebugEvents().clear();
+        emulator.SetDebugCallback(&DebuggerTests::OnDebugEvent);
+        emulator.SetBreakpoint(0x4000);
+        for (int step = 0; step < 400; step++)
+        {
+            emulator.Step();
+        }
+
+        emulator.Stop();
+        std::vector<DebugEvent>& events = GetDebugEvents();
+        Assert::IsTrue(!events.empty());
+
+        // The snapshot brings back the ROM bank the hit was in and the cartridge RAM
+        std::unique_ptr<CPU> spCPU = std::make_unique<CPU>();
+        Assert::IsTrue(spCPU->Initialize() && spCPU->LoadROM(rom.GetBootROMPath(), rom.GetCartridgePath()));
+        StateReader reader(events[0].snapshot.data(), events[0].snapshot.size());
+        Assert::IsTrue(spCPU->LoadState(reader));
+        Assert::AreEqual(0x4000, (int)spCPU->m_PC);
+        Assert::AreEqual(2, (int)spCPU->m_cartridge->GetROMBank());
+        Assert::AreEqual(0x18, (int)spCPU->PeekMemory(0x4000));
+        Assert::AreEqual(0x55, (int)spCPU->PeekMemory(0xA000));
+
+        spCPU.reset();
+    }
+};
@@ -46,6 +46,10 @@ private:
             return true;
         }
 
+        void SetCGBMode(bool isCGB)
+        {
+        }
+
         byte Read(const ushort& address)
         {
             return m_data[address];
@@ -57,6 +61,21 @@ private:
             return true;
         }
 
+        const byte* ResolveBlock(const ushort& address)
+        {
+            return &m_data[address];
+        }
+
+        void SaveState(StateWriter& writer)
+        {
+            writer.Write(m_data);
+        }
+
+        void LoadState(StateReader& reader)
+        {
+            reader.Read(m_data);
+        }
+
     private:
         byte m_data[0xFFFF + 1];
     };
@@ -125,4 +144,163 @@ public:
         spGPU.reset();
         spMMU.reset();
     }
+
+    TEST_METHOD(DirtyLinesTest)
+    {
+        std::unique_ptr<GPUTestsMMU> spMMU = std::unique_ptr<GPUTestsMMU>(new GPUTestsMMU(nullptr, 0));
+        std::unique_ptr<GPU> spGPU = std::unique_ptr<GPU>(new GPU(spMMU.get(), nullptr));
+
+        // Every line starts out dirty, the first VSync clears them
+        for (int line = 0; line < 144; line++)
+        {
+            Assert::IsTrue(spGPU->GetDirtyLines()[line]);
+        }
+
+        spGPU->RenderImage();
+        for (int line = 0; line < 144; line++)
+        {
+            Assert::IsFalse(spGPU->GetDirtyLines()[line]);
+        }
+
+        // LCD on, BG on, all tiles use color 0
+        Assert::IsTrue(spGPU->WriteByte(LCDControl, 0x91));
+        Assert::IsTrue(spGPU->WriteByte(BGPaletteData, 0x00));
+
+        // The screen was cleared to black by the constructor, so the first white line is dirty
+        spGPU->m_LCDControllerYCoordinate = 10;
+        spGPU->RenderScanline();
+        Assert::IsTrue(spGPU->GetDirtyLines()[10]);
+        Assert::IsFalse(spGPU->GetDirtyLines()[9]);
+        Assert::IsFalse(spGPU->GetDirtyLines()[11]);
+
+        // Drawing the same line again changes nothing
+        spGPU->RenderImage();
+        spGPU->RenderScanline();
+        Assert::IsFalse(spGPU->GetDirtyLines()[10]);
+
+        // A palette change does
+        Assert::IsTrue(spGPU->WriteByte(BGPaletteData, 0x03));
+        spGPU->RenderScanline();
+        Assert::IsTrue(spGPU->GetDirtyLines()[10]);
+
+        // Turning the LCD off clears the screen and dirties every line
+        spGPU->RenderImage();
+        Assert::IsTrue(spGPU->WriteByte(LCDControl, 0x00));
+        for (int line = 0; line < 144; line++)
+        {
+            Assert::IsTrue(spGPU->GetDirtyLines()[line]);
+        }
+
+        spGPU.reset();
+        spMMU.reset();
+    }
+
+    TEST_METHOD(HDMATest)
+    {
+        byte source[0x100];
+        for (unsigned int index = 0; index < ARRAYSIZE(source); index++)
+        {
+            source[index] = static_cast<byte>(index);
+        }
+
+        std::unique_ptr<GPUTestsMMU> spMMU = std::unique_ptr<GPUTestsMMU>(new GPUTestsMMU(source, ARRAYSIZE(source)));
+        std::unique_ptr<GPU> spGPU = std::unique_ptr<GPU>(new GPU(spMMU.get(), nullptr));
+
+        // Bank switching is ignored in DMG mode
+        Assert::IsTrue(spGPU->WriteByte(VRAMBank, 0x01));
+        Assert::AreEqual(0xFF, (int)spGPU->ReadByte(VRAMBank));
+        spGPU->SetCGBMode(true);
+
+        // General purpose DMA of 2 blocks from 0x0000 to 0x8100 in bank 1
+        Assert::IsTrue(spGPU->WriteByte(VRAMBank, 0x01));
+        Assert::AreEqual(0xFF, (int)spGPU->ReadByte(VRAMBank));
+        Assert::IsTrue(spGPU->WriteByte(HDMASourceHigh, 0x00));
+        Assert::IsTrue(spGPU->WriteByte(HDMASourceLow, 0x0F));        // The low 4 bits are ignored
+        Assert::IsTrue(spGPU->WriteByte(HDMADestinationHigh, 0xE1)); // So are the top 3
+        Assert::IsTrue(spGPU->WriteByte(HDMADestinationLow, 0x00));
+        Assert::IsTrue(spGPU->WriteByte(HDMALengthModeStart, 0x01));
+        Assert::AreEqual(0xFF, (int)spGPU->ReadByte(HDMALengthModeStart));
+        for (int index = 0; index < 0x20; index++)
+        {
+            Assert::AreEqual(index, (int)spGPU->ReadByte(0x8100 + index));
+        }
+
+        // Nothing was written to bank 0
+        Assert::IsTrue(spGPU->WriteByte(VRAMBank, 0x00));
+        Assert::AreEqual(0xFE, (int)spGPU->ReadByte(VRAMBank));
+        Assert::AreEqual(0x00, (int)spGPU->ReadByte(0x8110));
+
+        // HBlank DMA of 3 blocks continues from where the last transfer stopped, one block per line
+        Assert::IsTrue(spGPU->WriteByte(LCDControl, 0x80));
+        spGPU->Step(4);
+        Assert::IsTrue(spGPU->WriteByte(HDMALengthModeStart, 0x82));
+        Assert::AreEqual(0x02, (int)spGPU->ReadByte(HDMALengthModeStart));
+        for (int line = 0; line < 3; line++)
+        {
+            Assert::AreEqual(0x00, (int)spGPU->ReadByte(0x8120 + (line * 0x10)));
+            spGPU->Step(ReadingOAMCycles);
+            spGPU->Step(ReadingOAMVRAMCycles);
+            Assert::AreEqual(0x20 + (line * 0x10), (int)spGPU->ReadByte(0x8120 + (line * 0x10)));
+            spGPU->Step(HBlankCycles);
+        }
+
+        Assert::AreEqual(0xFF, (int)spGPU->ReadByte(HDMALengthModeStart));
+        Assert::AreEqual(0x00, (int)spGPU->ReadByte(0x8150));
+
+        spGPU.reset();
+        spMMU.reset();
+    }
+
+    TEST_METHOD(CGBPaletteTest)
+    {
+        std::unique_ptr<GPUTestsMMU> spMMU = std::unique_ptr<GPUTestsMMU>(new GPUTestsMMU(nullptr, 0));
+        std::unique_ptr<GPU> spGPU = std::unique_ptr<GPU>(new GPU(spMMU.get(), nullptr));
+        spGPU->SetCGBMode(true);
+
+        // Write pure red (0x001F) and pure blue (0x7C00) to BG palette 1, colors 0 and 1
+        Assert::IsTrue(spGPU->WriteByte(CGBBGPaletteIndex, 0x88));
+        Assert::AreEqual(0xC8, (int)spGPU->ReadByte(CGBBGPaletteIndex));
+        Assert::IsTrue(spGPU->WriteByte(CGBBGPaletteData, 0x1F));
+        Assert::IsTrue(spGPU->WriteByte(CGBBGPaletteData, 0x00));
+        Assert::IsTrue(spGPU->WriteByte(CGBBGPaletteData, 0x00));
+        Assert::IsTrue(spGPU->WriteByte(CGBBGPaletteData, 0x7C));
+        Assert::AreEqual(0xCC, (int)spGPU->ReadByte(CGBBGPaletteIndex));
+
+        // Reading does not increment
+        Assert::IsTrue(spGPU->WriteByte(CGBBGPaletteIndex, 0x0B));
+        Assert::AreEqual(0x7C, (int)spGPU->ReadByte(CGBBGPaletteData));
+        Assert::AreEqual(0x7C, (int)spGPU->ReadByte(CGBBGPaletteData));
+
+        // The colors are converted as they are written, A B G R in memory
+        const byte* red = reinterpret_cast<const byte*>(&spGPU->m_BGColors[4]);
+        const byte* blue = reinterpret_cast<const byte*>(&spGPU->m_BGColors[5]);
+        Assert::AreEqual(0xFF, (int)red[0]);
+        Assert::AreEqual(0x00, (int)red[1]);
+        Assert::AreEqual(0x00, (int)red[2]);
+        Assert::AreEqual(0xFF, (int)red[3]);
+        Assert::AreEqual(0xFF, (int)blue[1]);
+        Assert::AreEqual(0x00, (int)blue[3]);
+
+        // Color correction mixes the channels
+        spGPU->SetColorCorrection(true);
+        Assert::AreEqual(0xC9, (int)red[3]);
+        Assert::AreEqual(0x2E, (int)red[1]);
+
+        // A tile using palette 1 from VRAM bank 1 is drawn with it
+        Assert::IsTrue(spGPU->WriteByte(LCDControl, 0x91));
+        Assert::IsTrue(spGPU->WriteByte(0x9800, 0x00));     // Tile 0
+        Assert::IsTrue(spGPU->WriteByte(VRAMBank, 0x01));
+        Assert::IsTrue(spGPU->WriteByte(0x9800, 0x09));     // Palette 1, tile data in bank 1
+        Assert::IsTrue(spGPU->WriteByte(0x8000, 0x0F));     // Right half color 1
+        Assert::IsTrue(spGPU->WriteByte(0x8001, 0x00));
+        spGPU->SetColorCorrection(false);
+        spGPU->m_LCDControllerYCoordinate = 0;
+        const byte* pFrame = spGPU->GetCurrentFrame();
+        spGPU->RenderScanline();
+        Assert::AreEqual(0xFF, (int)pFrame[3]);             // Left, red
+        Assert::AreEqual(0xFF, (int)pFrame[(7 * 4) + 1]);   // Right, blue
+
+        spGPU.reset();
+        spMMU.reset();
+    }
 };
@@ -0,0 +1,72 @@
+#include "stdafx.h"
+
+#include <CPU.hpp>
+#include <JIT.hpp>
+#include <JITCache.hpp>
+
+#include "TestROM.hpp"
+
+#include <vector>
+
+TEST_CLASS(JITCacheTests)
+{
+#if JIT_X64
+private:
+    // The cycles of the first step of the loop at 0x0150, one JR unless its block is translated
+    static int RunFirstStep(const TestROM& rom)
+    {
+        std::unique_ptr<CPU> spCPU = std::make_unique<CPU>();
+        Assert::IsTrue(spCPU->Initialize() && spCPU->LoadROM(rom.GetBootROMPath(), rom.GetCartridgePath()));
+        spCPU->SetFusion(false);
+        Assert::IsTrue(spCPU->EnableJIT(true));
+
+        CPUState state;
+        spCPU->GetState(state);
+        for (int step = 0; (step < 1000) && (state.PC != 0x0150); step++)
+        {
+            spCPU->Step();
+            spCPU->GetState(state);
+        }
+
+        Assert::AreEqual(0x0150, (int)state.PC);
+        int cycles = spCPU->Step();
+        for (int step = 0; step < 1000; step++)
+        {
+            spCPU->Step();
+        }
+
+        // Stores the blocks translated during the run
+        Assert::IsTrue(spCPU->EnableJIT(false));
+        return cycles;
+    }
+
+public:
+    TEST_METHOD(BlockStartsTest)
+    {
+        std::vector<byte> cartridge(0x8000, 0x00);              // NOPs from 0x0004 on
+        cartridge[0x0150] = 0x18;                               // 0x0150 JR 0x0150
+        cartridge[0x0151] = 0xFE;
+        cartridge[0x014D] = 0x41;                               // Header and global checksums, run as
+        cartridge[0x014E] = 0x42;                               // LD B,C; LD B,D; LD B,E
+        cartridge[0x014F] = 0x43;
+
+        TestROM rom("BlockStartsTest", cartridge);
+        unsigned long long key = JITCache::MakeKey(cartridge.data());
+        JITCache::SetDirectory(".");
+        JITCache::Remove(key);
+
+        // Translated on the second visit without an entry, on the first with one
+        Assert::AreEqual(12, RunFirstStep(rom));
+        Assert::IsTrue(RunFirstStep(rom) > 12);
+
+        // The checksums are the same, the page of the loop is dropped when it is first used
+        cartridge[0x0120] = 0x04;                               // 0x0120 INC B
+        rom.WriteCartridge(cartridge);
+        Assert::AreEqual(12, RunFirstStep(rom));
+        Assert::IsTrue(RunFirstStep(rom) > 12);
+
+        JITCache::Remove(key);
+        JITCache::SetDirectory(nullptr);
+    }
+#endif
+};
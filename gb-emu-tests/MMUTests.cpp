@@ -0,0 +1,42 @@
+#include "stdafx.h"
+
+#include <MMU.hpp>
+
+TEST_CLASS(MMUTests)
+{
+public:
+    TEST_METHOD(WRAMBankTest)
+    {
+        std::unique_ptr<MMU> spMMU = std::make_unique<MMU>();
+
+        // SVBK does nothing in DMG mode
+        Assert::IsTrue(spMMU->Write(0xD000, 0x11));
+        Assert::IsTrue(spMMU->Write(0xFF70, 0x02));
+        Assert::AreEqual(0xFF, (int)spMMU->Read(0xFF70));
+        Assert::AreEqual(0x11, (int)spMMU->Read(0xD000));
+
+        spMMU->SetCGBMode(true);
+        Assert::AreEqual(0xF9, (int)spMMU->Read(0xFF70));
+
+        // Fill each bank with its own number
+        for (byte bank = 1; bank <= 7; bank++)
+        {
+            Assert::IsTrue(spMMU->Write(0xFF70, bank));
+            Assert::AreEqual(0xF8 | bank, (int)spMMU->Read(0xFF70));
+            Assert::IsTrue(spMMU->Write(0xD123, bank));
+        }
+
+        // Bank 0 selects bank 1, the echo follows the selected bank and bank 0 stays in place
+        Assert::IsTrue(spMMU->Write(0xC123, 0xCC));
+        for (byte bank = 0; bank <= 7; bank++)
+        {
+            Assert::IsTrue(spMMU->Write(0xFF70, bank));
+            Assert::AreEqual((bank == 0) ? 1 : bank, (int)spMMU->Read(0xD123));
+            Assert::AreEqual((bank == 0) ? 1 : bank, (int)spMMU->Read(0xF123));
+            Assert::AreEqual((bank == 0) ? 1 : bank, (int)spMMU->ResolveBlock(0xD120)[3]);
+            Assert::AreEqual(0xCC, (int)spMMU->Read(0xC123));
+        }
+
+        spMMU.reset();
+    }
+};
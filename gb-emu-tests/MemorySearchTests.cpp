@@ -0,0 +1,94 @@
+#include "stdafx.h"
+
+#include <CPU.hpp>
+#include <MemorySearch.hpp>
+
+#include "TestROM.hpp"
+
+TEST_CLASS(MemorySearchTests)
+{
+public:
+    TEST_METHOD(SearchTest)
+    {
+        std::vector<byte> cartridge(0x8000, 0x00);
+        cartridge[CartridgeTypeAddress] = 0x02;    // MBC1+RAM
+        cartridge[ROMSizeAddress] = ROM_32KB;
+        cartridge[RAMSizeAddress] = RAM_8KB;
+
+        TestROM rom("SearchTest", cartridge);
+
+        std::unique_ptr<CPU> spCPU = std::make_unique<CPU>();
+        Assert::IsTrue(spCPU->Initialize());
+        Assert::IsTrue(spCPU->LoadROM(rom.GetBootROMPath(), rom.GetCartridgePath()));
+        spCPU->Step();                  // Run the boot ROM so it is unmapped
+        spCPU->Step();
+        IMMU* pMMU = spCPU->m_MMU;
+        pMMU->Write(0x0000, 0x0A);      // Enable the cartridge RAM
+
+        // 8 bit, work RAM in both banks, HRAM and cartridge RAM. The cartridge RAM starts out with
+        // whatever was in memory, so the search starts with what changed.
+        MemorySearch search;
+        search.Start(spCPU.get(), 1);
+        pMMU->Write(0xC123, 5);
+        pMMU->Write(0xD456, 5);
+        pMMU->Write(0xFF90, 5);
+        pMMU->Write(0xBFFF, ~pMMU->Read(0xBFFF));
+        Assert::IsTrue(search.Filter(spCPU.get(), SearchChanged));
+        Assert::AreEqual(4, (int)search.GetCount());
+        pMMU->Write(0xBFFF, 5);
+        Assert::IsTrue(search.Filter(spCPU.get(), SearchEqual, 5));
+        Assert::AreEqual(4, (int)search.GetCount());
+
+        std::vector<SearchResult> results = search.GetResults(0x100);
+        Assert::AreEqual(4, (int)results.size());
+        Assert::AreEqual(0xC123, (int)results[0].address);
+        Assert::AreEqual(0xD456, (int)results[1].address);
+        Assert::AreEqual(1, (int)results[1].bank);
+        Assert::AreEqual(0xFF90, (int)results[2].address);
+        Assert::AreEqual(0xBFFF, (int)results[3].address);
+        Assert::AreEqual(5, (int)results[3].value);
+
+        pMMU->Write(0xC123, 6);
+        pMMU->Write(0xD456, 4);
+        Assert::IsTrue(search.Filter(spCPU.get(), SearchUnchanged));
+        Assert::AreEqual(2, (int)search.GetCount());
+        pMMU->Write(0xFF90, 6);
+        pMMU->Write(0xBFFF, 4);
+        Assert::IsTrue(search.Filter(spCPU.get(), SearchDecreased));
+        Assert::AreEqual(1, (int)search.GetCount());
+        Assert::AreEqual(0xBFFF, (int)search.GetResults(0x100)[0].address);
+
+        // Nothing else changes, so everything but one address has to go
+        search.Start(spCPU.get(), 1);
+        pMMU->Write(0xC800, 1);
+        Assert::IsTrue(search.Filter(spCPU.get(), SearchIncreased));
+        Assert::AreEqual(1, (int)search.GetCount());
+        Assert::IsTrue(search.Filter(spCPU.get(), SearchChanged));
+        Assert::AreEqual(0, (int)search.GetCount());
+
+        // 16 bit, at even and odd addresses
+        pMMU->Write(0xA011, 0x00);
+        pMMU->Write(0xA012, 0x00);
+        search.Start(spCPU.get(), 2);
+        pMMU->Write(0xC200, 0x34);
+        pMMU->Write(0xC201, 0x12);
+        pMMU->Write(0xA011, 0x34);
+        pMMU->Write(0xA012, 0x12);
+        Assert::IsTrue(search.Filter(spCPU.get(), SearchChanged));
+        Assert::IsTrue(search.Filter(spCPU.get(), SearchEqual, 0x1234));
+        results = search.GetResults(0x100);
+        Assert::AreEqual(2, (int)results.size());
+        Assert::AreEqual(0xC200, (int)results[0].address);
+        Assert::AreEqual(0xA011, (int)results[1].address);
+        Assert::AreEqual(0x1234, (int)results[1].value);
+
+        // Only the high byte changes
+        pMMU->Write(0xC201, 0x13);
+        pMMU->Write(0xA012, 0x11);
+        Assert::IsTrue(search.Filter(spCPU.get(), SearchIncreased));
+        Assert::AreEqual(1, (int)search.GetCount());
+        Assert::AreEqual(0xC200, (int)search.GetResults(0x100)[0].address);
+
+        spCPU.reset();
+    }
+};
@@ -0,0 +1,150 @@
+#include "stdafx.h"
+
+#include <CPU.hpp>
+#include <GPU.hpp>
+#include <Recorder.hpp>
+
+#include "TestROM.hpp"
+
+#include <random>
+
+TEST_CLASS(RecorderTests)
+{
+public:
+    TEST_METHOD(RecordingTest)
+    {
+        auto fileSize = [](const char* path)
+        {
+            std::ifstream file(path, std::ios::in | std::ios::binary | std::ios::ate);
+            return file.is_open() ? static_cast<long long>(file.tellg()) : -1;
+        };
+
+        auto samplesFor = [](unsigned long long frames)
+        {
+            return static_cast<long long>((frames * RecorderFrameCycles * RecorderSampleRate) / RecorderSecondCycles);
+        };
+
+        const long long Y4MHeaderSize = 52;
+        const long long Y4MFrameSize = 6 + 160 * 144 * 3 / 2;
+        const long long RGBFrameSize = 160 * 144 * 3;
+        const long long WAVHeaderSize = 44;
+
+        // The pixels are A B G R in memory, the conversion has to match the plain formulas
+        std::vector<byte> pixels(160 * 144 * 4);
+        std::mt19937 random(75);
+        for (byte& value : pixels)
+        {
+            value = static_cast<byte>(random());
+        }
+
+        std::vector<byte> YUV(160 * 144 * 3 / 2);
+        byte* pY = YUV.data();
+        byte* pU = pY + 160 * 144;
+        byte* pV = pU + 80 * 72;
+        Recorder::ConvertToYUV(pixels.data(), pY, pU, pV);
+        for (int index = 0; index < 160 * 144; index++)
+        {
+            const byte* pPixel = &pixels[index * 4];
+            int luma = ((66 * pPixel[3] + 129 * pPixel[2] + 25 * pPixel[1] + 128) >> 8) + 16;
+            Assert::AreEqual(luma, (int)pY[index]);
+        }
+
+        for (int y = 0; y < 72; y++)
+        {
+            for (int x = 0; x < 80; x++)
+            {
+                int R = 0;
+                int G = 0;
+                int B = 0;
+                for (int offset : { 0, 4, 160 * 4, 160 * 4 + 4 })
+                {
+                    const byte* pPixel = &pixels[(y * 2 * 160 + x * 2) * 4 + offset];
+                    R += pPixel[3];
+                    G += pPixel[2];
+                    B += pPixel[1];
+                }
+
+                Assert::AreEqual((-38 * R - 74 * G + 112 * B + 512 + (128 << 10)) >> 10, (int)pU[y * 80 + x]);
+                Assert::AreEqual((112 * R - 94 * G - 18 * B + 512 + (128 << 10)) >> 10, (int)pV[y * 80 + x]);
+            }
+        }
+
+        // A single frame is never dropped and is written as converted
+        const char* videoPath = "RecordingTest.y4m";
+        const char* audioPath = "RecordingTest.y4m.wav";
+        {
+            Recorder recorder;
+            Assert::IsTrue(recorder.Start(videoPath, RecordingY4M));
+            Assert::IsTrue(recorder.IsRecording());
+            recorder.AddFrame(pixels.data());
+            recorder.Stop();
+            Assert::IsFalse(recorder.IsRecording());
+            Assert::AreEqual(1ull, recorder.GetFrameCount());
+            Assert::AreEqual(0ull, recorder.GetDroppedCount());
+        }
+
+        std::ifstream video(videoPath, std::ios::in | std::ios::binary);
+        std::vector<char> contents((std::istreambuf_iterator<char>(video)), std::istreambuf_iterator<char>());
+        video.close();
+        Assert::AreEqual(Y4MHeaderSize + Y4MFrameSize, static_cast<long long>(contents.size()));
+        Assert::IsTrue(memcmp(contents.data(), "YUV4MPEG2 W160 H144 ", 20) == 0);
+        Assert::IsTrue(memcmp(&contents[Y4MHeaderSize], "FRAME\n", 6) == 0);
+        Assert::IsTrue(memcmp(&contents[Y4MHeaderSize + 6], YUV.data(), YUV.size()) == 0);
+        Assert::AreEqual(WAVHeaderSize + samplesFor(1) * 2, fileSize(audioPath));
+
+        // However many frames the writer could not keep up with, the files cover every frame
+        {
+            Recorder recorder;
+            Assert::IsTrue(recorder.Start(videoPath, RecordingRGB));
+            for (int frame = 0; frame < 200; frame++)
+            {
+                pixels[frame] ^= 0xFF;
+                recorder.AddFrame(pixels.data());
+            }
+
+            recorder.Stop();
+            Assert::AreEqual(200ull, recorder.GetFrameCount());
+            Assert::IsTrue(recorder.GetDroppedCount() < 200);
+        }
+
+        Assert::AreEqual(200 * RGBFrameSize, fileSize(videoPath));
+        Assert::AreEqual(WAVHeaderSize + samplesFor(200) * 2, fileSize(audioPath));
+
+        // Through the machine, every VSync is a frame
+        std::vector<byte> cartridge(0x8000, 0x00);
+        const byte program[] = {
+            0x3E, 0x91,         // 0x0004 LD A,0x91
+            0xE0, 0x40,         // 0x0006 LDH (0x40),A, turns the LCD on
+            0x18, 0xFE,         // 0x0008 JR 0x0008
+        };
+        memcpy(&cartridge[0x0004], program, sizeof(program));
+
+        TestROM rom("RecordingTest", cartridge);
+
+        std::unique_ptr<CPU> spCPU = std::make_unique<CPU>();
+        Assert::IsTrue(spCPU->Initialize() && spCPU->LoadROM(rom.GetBootROMPath(), rom.GetCartridgePath()));
+
+        // Asking for the dropped frames or stopping does not start drawing the display
+        Assert::AreEqual(0, (int)spCPU->GetRecorder()->GetDroppedCount());
+        spCPU->GetRecorder()->Stop();
+        Assert::IsTrue(spCPU->m_GPU->m_spDisplayPixels == nullptr);
+
+        Assert::IsTrue(spCPU->GetRecorder()->Start(videoPath, RecordingY4M));
+        Assert::IsTrue(spCPU->m_GPU->m_spDisplayPixels != nullptr);
+        unsigned long cycles = 0;
+        while (cycles < 10 * RecorderFrameCycles)
+        {
+            cycles += spCPU->Step();
+        }
+
+        Recorder* pRecorder = spCPU->GetRecorder();
+        pRecorder->Stop();
+        unsigned long long frames = pRecorder->GetFrameCount();
+        Assert::IsTrue((frames >= 9) && (frames <= 10));
+        Assert::AreEqual(Y4MHeaderSize + static_cast<long long>(frames) * Y4MFrameSize, fileSize(videoPath));
+
+        spCPU.reset();
+        std::remove(videoPath);
+        std::remove(audioPath);
+    }
+};
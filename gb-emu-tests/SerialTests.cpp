@@ -0,0 +1,381 @@
+#include "stdafx.h"
+
+#include <LinkCable.hpp>
+#include <Serial.hpp>
+#include <SocketLinkPort.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <thread>
+
+// Port 0 lets the system pick a free one
+#define SocketTestAddress "127.0.0.1:0"
+
+TEST_CLASS(SerialTests)
+{
+private:
+    // Counts the serial interrupts raised by the unit under test
+    class SerialTestsCPU : public ICPU
+    {
+    public:
+        SerialTestsCPU() : m_SerialInterrupts(0) {}
+
+        bool Initialize() { return true; }
+        bool LoadROM(const char* bootROMPath, const char* cartridgePath) { return true; }
+        int Step() { return 0; }
+        byte* GetCurrentFrame() { return nullptr; }
+        const bool* GetDirtyLines() { return nullptr; }
+        void SetInput(byte input, byte buttons) {}
+        void SetVSyncCallback(void(*pCallback)()) {}
+        void SetColorCorrection(bool isEnabled) {}
+        void ConnectLink(ILinkPort* pPort) {}
+        void SetLinkSyncWindow(unsigned long cycles) {}
+        void SetFastBoot(bool isEnabled) {}
+        bool EnableAudio() { return true; }
+        Debugger* GetDebugger() { return nullptr; }
+        Trace* EnableTrace(unsigned int size) { return nullptr; }
+        Coverage* EnableCoverage() { return nullptr; }
+        Cheats* GetCheats() { return nullptr; }
+        bool EnableJIT(bool isEnabled) { return false; }
+        Recorder* GetRecorder() { return nullptr; }
+
+        void TriggerInterrupt(byte interrupt)
+        {
+            if (interrupt == INT58)
+            {
+                m_SerialInterrupts++;
+            }
+        }
+
+        int m_SerialInterrupts;
+    };
+
+    // Plays back a list of messages and counts how often the unit under test had to wait for it
+    class SerialTestsPort : public ILinkPort
+    {
+    public:
+        SerialTestsPort() : m_Waits(0) {}
+
+        bool Send(const LinkMessage& message) { return true; }
+        void Disconnect() {}
+
+        bool Receive(LinkMessage& message)
+        {
+            if (m_Messages.empty())
+            {
+                return false;
+            }
+
+            message = m_Messages.front();
+            m_Messages.pop_front();
+            return true;
+        }
+
+        // Only asked while waiting, nothing more is coming so the wait ends at once
+        bool IsConnected()
+        {
+            m_Waits++;
+            return false;
+        }
+
+        std::deque<LinkMessage> m_Messages;
+        int m_Waits;
+    };
+
+    /*
+        Plays one side of a session of byte exchanges over the link. The master sends 0..count-1
+        and expects 0xFF - i back, the slave the other way round. Every step publishes how far this
+        side has run, so the other thread can measure the skew.
+    */
+    static void RunSession(
+        Serial* pSerial,
+        bool isMaster,
+        int count,
+        std::atomic<unsigned long>* pOwnCycles,
+        std::atomic<unsigned long>* pPeerCycles,
+        long* pMaxSkew,
+        int* pErrors)
+    {
+        unsigned long cycles = 0;
+        for (int index = 0; index < count; index++)
+        {
+            byte sent = static_cast<byte>(isMaster ? index : 0xFF - index);
+            byte expected = static_cast<byte>(isMaster ? 0xFF - index : index);
+
+            pSerial->WriteByte(SerialTransferData, sent);
+            pSerial->WriteByte(SerialTransferControl, isMaster ? 0x81 : 0x80);
+
+            // The master waits a little before starting, so the slave is always armed in time
+            while (ISBITSET(pSerial->ReadByte(SerialTransferControl), 7))
+            {
+                pSerial->Step(4);
+                cycles += 4;
+                pOwnCycles->store(cycles);
+
+                long skew = static_cast<long>(cycles) - static_cast<long>(pPeerCycles->load());
+                if (skew > *pMaxSkew)
+                {
+                    *pMaxSkew = skew;
+                }
+            }
+
+            if (pSerial->ReadByte(SerialTransferData) != expected)
+            {
+                (*pErrors)++;
+            }
+
+            if (isMaster)
+            {
+                for (int wait = 0; wait < 64; wait++)
+                {
+                    pSerial->Step(4);
+                    cycles += 4;
+                    pOwnCycles->store(cycles);
+                }
+            }
+        }
+    }
+
+    // Links two ports over localhost TCP
+    static bool ConnectSockets(SocketLinkPort& listenPort, SocketLinkPort& connectPort)
+    {
+        std::atomic<bool> isListening(false);
+        std::atomic<bool> isListenDone(false);
+        std::thread listenThread([&]()
+        {
+            isListening = listenPort.Listen(SocketTestAddress);
+            isListenDone = true;
+        });
+
+        // Wait for the listener to be bound, then connect to the port it got
+        std::string address;
+        for (int attempt = 0; (attempt < 200) && !isListenDone; attempt++)
+        {
+            unsigned short port = listenPort.GetListeningPort();
+            if (port != 0)
+            {
+                address = "127.0.0.1:" + std::to_string(port);
+                break;
+            }
+
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+
+        bool isConnected = !address.empty() && connectPort.Connect(address.c_str());
+        if (!isConnected && !address.empty())
+        {
+            // Wake the listener up so we can join it
+            SocketLinkPort wakePort;
+            wakePort.Connect(address.c_str());
+        }
+
+        listenThread.join();
+        return isListening && isConnected;
+    }
+
+    /*
+        Runs a session between two serial units linked over localhost TCP and returns the emulated
+        frames per second the link allows, i.e. the speed limit the sync protocol imposes.
+    */
+    static double RunSocketSession(unsigned int latency, unsigned long window, int count, int* pErrors)
+    {
+        SocketLinkPort listenPort;
+        SocketLinkPort connectPort;
+        if (!ConnectSockets(listenPort, connectPort))
+        {
+            (*pErrors)++;
+            return 0.0;
+        }
+
+        listenPort.SetInjectedLatency(latency);
+        connectPort.SetInjectedLatency(latency);
+
+        SerialTestsCPU masterCPU;
+        SerialTestsCPU slaveCPU;
+        Serial master(&masterCPU);
+        Serial slave(&slaveCPU);
+        master.SetSyncWindow(window);
+        slave.SetSyncWindow(window);
+        master.Connect(&listenPort);
+        slave.Connect(&connectPort);
+
+        std::atomic<unsigned long> masterCycles(0);
+        std::atomic<unsigned long> slaveCycles(0);
+        long masterSkew = 0;
+        long slaveSkew = 0;
+
+        ::Logger::Disable();
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        int masterErrors = 0;
+        int slaveErrors = 0;
+        std::thread masterThread(RunSession, &master, true, count, &masterCycles, &slaveCycles, &masterSkew, &masterErrors);
+        std::thread slaveThread(RunSession, &slave, false, count, &slaveCycles, &masterCycles, &slaveSkew, &slaveErrors);
+        masterThread.join();
+        slaveThread.join();
+        *pErrors += masterErrors + slaveErrors;
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        ::Logger::Enable();
+
+        return (masterCycles.load() / 70224.0) / elapsed.count();
+    }
+
+public:
+    TEST_METHOD(UnlinkedTransferTest)
+    {
+        SerialTestsCPU cpu;
+        Serial serial(&cpu);
+
+        Assert::AreEqual(0x7E, (int)serial.ReadByte(SerialTransferControl));
+
+        // Internal clock with nothing connected, the byte takes 4096 cycles and reads back 0xFF
+        serial.WriteByte(SerialTransferData, 0x42);
+        serial.WriteByte(SerialTransferControl, 0x81);
+        Assert::AreEqual(0xFF, (int)serial.ReadByte(SerialTransferControl));
+
+        for (int cycles = 0; cycles < SerialCyclesPerByte - 4; cycles += 4)
+        {
+            serial.Step(4);
+        }
+
+        Assert::AreEqual(0x42, (int)serial.ReadByte(SerialTransferData));
+        Assert::AreEqual(0, cpu.m_SerialInterrupts);
+
+        serial.Step(4);
+        Assert::AreEqual(0xFF, (int)serial.ReadByte(SerialTransferData));
+        Assert::AreEqual(0x7F, (int)serial.ReadByte(SerialTransferControl));
+        Assert::AreEqual(1, cpu.m_SerialInterrupts);
+
+        // External clock with nothing connected never completes
+        serial.WriteByte(SerialTransferControl, 0x80);
+        for (int cycles = 0; cycles < SerialCyclesPerByte * 4; cycles += 4)
+        {
+            serial.Step(4);
+        }
+
+        Assert::AreEqual(0xFE, (int)serial.ReadByte(SerialTransferControl));
+        Assert::AreEqual(1, cpu.m_SerialInterrupts);
+    }
+
+    TEST_METHOD(LinkedTransferTest)
+    {
+        const int count = 64;
+
+        LinkCable cable;
+        SerialTestsCPU masterCPU;
+        SerialTestsCPU slaveCPU;
+        Serial master(&masterCPU);
+        Serial slave(&slaveCPU);
+        master.Connect(cable.GetPort(0));
+        slave.Connect(cable.GetPort(1));
+
+        std::atomic<unsigned long> masterCycles(0);
+        std::atomic<unsigned long> slaveCycles(0);
+        long masterSkew = 0;
+        long slaveSkew = 0;
+        int masterErrors = 0;
+        int slaveErrors = 0;
+
+        // The master uses SC = 0x81, which also echoes every byte for the test ROMs
+        ::Logger::Disable();
+        std::thread masterThread(RunSession, &master, true, count, &masterCycles, &slaveCycles, &masterSkew, &masterErrors);
+        std::thread slaveThread(RunSession, &slave, false, count, &slaveCycles, &masterCycles, &slaveSkew, &slaveErrors);
+        masterThread.join();
+        slaveThread.join();
+        ::Logger::Enable();
+
+        Assert::AreEqual(0, masterErrors);
+        Assert::AreEqual(0, slaveErrors);
+        Assert::AreEqual(count, masterCPU.m_SerialInterrupts);
+        Assert::AreEqual(count, slaveCPU.m_SerialInterrupts);
+
+        // Neither side ever ran more than the sync window (plus one step) ahead of the other
+        Assert::IsTrue(masterSkew <= SerialCyclesPerByte + 4);
+        Assert::IsTrue(slaveSkew <= SerialCyclesPerByte + 4);
+
+        // A byte takes exactly one byte time on the master, so the session length is known
+        Assert::AreEqual(count * (SerialCyclesPerByte + 64 * 4), (int)masterCycles.load());
+    }
+
+    TEST_METHOD(DoubleSpeedPeerTest)
+    {
+        // A double speed peer starts a transfer at cycle 0, it completes half a byte time later
+        SerialTestsCPU cpu;
+        SerialTestsPort port;
+        Serial serial(&cpu);
+        serial.Connect(&port);
+        LinkMessage transfer = { LinkMessageTransfer, 0x42, false, SerialCyclesPerByte / 2 };
+        port.m_Messages.push_back(transfer);
+
+        // That only tells us the peer is at cycle 0 or later, a full window from it needs no wait
+        for (int cycles = 0; cycles < SerialCyclesPerByte; cycles += 4)
+        {
+            serial.Step(4);
+        }
+
+        Assert::AreEqual(0, port.m_Waits);
+
+        serial.Step(4);
+        Assert::AreEqual(1, port.m_Waits);
+    }
+
+    TEST_METHOD(SocketLinkTest)
+    {
+        const unsigned int latencies[] = { 0, 250 };
+        const unsigned long windows[] = { SerialCyclesPerByte, SerialCyclesPerByte * 4 };
+
+        for (unsigned int latency : latencies)
+        {
+            for (unsigned long window : windows)
+            {
+                int errors = 0;
+                double framesPerSecond = RunSocketSession(latency, window, 32, &errors);
+                Assert::AreEqual(0, errors);
+
+                ::Logger::Log(
+                    "Link over TCP, %u us latency, %lu cycle window: %.1f emulated frames/s",
+                    latency, window, framesPerSecond);
+            }
+        }
+
+        // The peer replies and hangs up at once, the reply still counts, also while held back
+        for (unsigned int latency : latencies)
+        {
+            SocketLinkPort listenPort;
+            SocketLinkPort connectPort;
+            Assert::IsTrue(ConnectSockets(listenPort, connectPort));
+            listenPort.SetInjectedLatency(latency);
+
+            SerialTestsCPU cpu;
+            Serial serial(&cpu);
+            serial.Connect(&listenPort);
+            serial.WriteByte(SerialTransferData, 0x42);
+            serial.WriteByte(SerialTransferControl, 0x81);
+
+            LinkMessage transfer = { LinkMessageTime, 0x00, false, 0 };
+            for (int attempt = 0; (attempt < 200) && (transfer.type != LinkMessageTransfer); attempt++)
+            {
+                if (!connectPort.Receive(transfer))
+                {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+                }
+            }
+
+            Assert::AreEqual(LinkMessageTransfer, (int)transfer.type);
+            Assert::AreEqual(0x42, (int)transfer.data);
+            LinkMessage reply = { LinkMessageReply, 0x99, true, transfer.cycle };
+            Assert::IsTrue(connectPort.Send(reply));
+            connectPort.Disconnect();
+
+            ::Logger::Disable();
+            while (ISBITSET(serial.ReadByte(SerialTransferControl), 7))
+            {
+                serial.Step(4);
+            }
+
+            ::Logger::Enable();
+            Assert::AreEqual(0x99, (int)serial.ReadByte(SerialTransferData));
+            Assert::IsFalse(listenPort.IsConnected());
+        }
+    }
+};
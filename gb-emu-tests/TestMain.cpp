@@ -2,10 +2,20 @@
 
 #if !WINDOWS
 #include <CPU.hpp>
+#include "AtomicFileTests.cpp"
+#include "CheatsTests.cpp"
+#include "CoverageTests.cpp"
 #include "CPUTests.cpp"
+#include "DebuggerTests.cpp"
 #include "GPUTests.cpp"
+#include "JITCacheTests.cpp"
 #include "JoypadTests.cpp"
 #include "MBCTests.cpp"
+#include "MemorySearchTests.cpp"
+#include "MMUTests.cpp"
+#include "RecorderTests.cpp"
+#include "SerialTests.cpp"
+#include "TraceTests.cpp"
 
 int main(int arg, char** argv)
 {
@@ -13,6 +23,19 @@ int main(int arg, char** argv)
     int failed = 0;
 
     std::cout << "----------------------------------" << std::endl;
+    TEST_SETUP(AtomicFileTests);
+    TEST_CALL(AtomicFileTests, ConcurrentWriteTest);
+    TEST_CLEANUP();
+
+    TEST_SETUP(CheatsTests);
+    TEST_CALL(CheatsTests, CodesTest);
+    TEST_CALL(CheatsTests, InterposerOrderTest);
+    TEST_CLEANUP();
+
+    TEST_SETUP(CoverageTests);
+    TEST_CALL(CoverageTests, CoverageMapTest);
+    TEST_CLEANUP();
+
     TEST_SETUP(CPUTests);
 
     // Misc Tests
@@ -38,6 +61,7 @@ int main(int arg, char** argv)
     TEST_CALL(CPUTests, LDSPnn_Test);
     TEST_CALL(CPUTests, LDDn_Test);
     TEST_CALL(CPUTests, STOP_Test);
+    TEST_CALL(CPUTests, DoubleSpeed_Test);
     TEST_CALL(CPUTests, RLA_Test);
     TEST_CALL(CPUTests, RRA2_Test);
     TEST_CALL(CPUTests, LDA_DE__Test);
@@ -241,10 +265,42 @@ int main(int arg, char** argv)
     TEST_CALL(CPUTests, DAA_Test);
     TEST_CALL(CPUTests, RRCA2_Test);
 
+    // Lockstep harness
+    TEST_CALL(CPUTests, Lockstep_Fuzz_Test);
+    TEST_CALL(CPUTests, Lockstep_Divergence_Test);
+
+    // Fast boot
+    TEST_CALL(CPUTests, FastBoot_Test);
+
+    // Memory footprint
+    TEST_CALL(CPUTests, MemoryFootprint_Test);
+
+    // JIT
+#if JIT_X64
+    TEST_CALL(CPUTests, JIT_Test);
+#endif
+
+    // Fusion
+    TEST_CALL(CPUTests, Fusion_Test);
+
+    TEST_CLEANUP();
+
+    TEST_SETUP(DebuggerTests);
+    TEST_CALL(DebuggerTests, BreakpointTest);
+    TEST_CALL(DebuggerTests, SnapshotTest);
     TEST_CLEANUP();
 
     TEST_SETUP(GPUTests);
     TEST_CALL(GPUTests, GPUCycleTest);
+    TEST_CALL(GPUTests, DirtyLinesTest);
+    TEST_CALL(GPUTests, HDMATest);
+    TEST_CALL(GPUTests, CGBPaletteTest);
+    TEST_CLEANUP();
+
+    TEST_SETUP(JITCacheTests);
+#if JIT_X64
+    TEST_CALL(JITCacheTests, BlockStartsTest);
+#endif
     TEST_CLEANUP();
 
     TEST_SETUP(JoypadTests);
@@ -258,6 +314,30 @@ int main(int arg, char** argv)
     TEST_CALL(MBCTests, MBC3Test);
     TEST_CLEANUP();
 
+    TEST_SETUP(MemorySearchTests);
+    TEST_CALL(MemorySearchTests, SearchTest);
+    TEST_CLEANUP();
+
+    TEST_SETUP(MMUTests);
+    TEST_CALL(MMUTests, WRAMBankTest);
+    TEST_CLEANUP();
+
+    TEST_SETUP(RecorderTests);
+    TEST_CALL(RecorderTests, RecordingTest);
+    TEST_CLEANUP();
+
+    TEST_SETUP(SerialTests);
+    TEST_CALL(SerialTests, UnlinkedTransferTest);
+    TEST_CALL(SerialTests, LinkedTransferTest);
+    TEST_CALL(SerialTests, DoubleSpeedPeerTest);
+    TEST_CALL(SerialTests, SocketLinkTest);
+    TEST_CLEANUP();
+
+    TEST_SETUP(TraceTests);
+    TEST_CALL(TraceTests, TraceFileTest);
+    TEST_CALL(TraceTests, HighBankTest);
+    TEST_CLEANUP();
+
     std::cout << "----------------------------------" << std::endl;
     std::cout << "Passed: " << passed << "   Failed: " << failed << "   Total: " << passed + failed << std::endl;
 
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+/*
+    The boot ROM and cartridge files of a test that runs the whole machine, named after the test
+    and removed again when it goes out of scope. Without a boot ROM of its own the test gets one
+    that only unmaps itself, so the cartridge starts at 0x0100.
+*/
+class TestROM
+{
+public:
+    TestROM(const char* name, const byte* pBootROM = nullptr) :
+        m_BootROMPath(std::string(name) + ".bin"),
+        m_CartridgePath(std::string(name) + ".gb")
+    {
+        byte bootROM[0x100] = { 0x3E, 0x01, 0xE0, 0x50 };     // LD A,0x01; LD (0xFF00+0x50),A
+        if (pBootROM != nullptr)
+        {
+            memcpy(bootROM, pBootROM, sizeof(bootROM));
+        }
+
+        std::ofstream(m_BootROMPath, std::ios::binary).write(reinterpret_cast<const char*>(bootROM), sizeof(bootROM));
+    }
+
+    TestROM(const char* name, const std::vector<byte>& cartridge, const byte* pBootROM = nullptr) :
+        TestROM(name, pBootROM)
+    {
+        WriteCartridge(cartridge);
+    }
+
+    ~TestROM()
+    {
+        std::remove(m_BootROMPath.c_str());
+        std::remove(m_CartridgePath.c_str());
+    }
+
+    // Replaces the cartridge, for tests that run more than one
+    void WriteCartridge(const std::vector<byte>& cartridge)
+    {
+        std::ofstream(m_CartridgePath, std::ios::binary).write(reinterpret_cast<const char*>(cartridge.data()), cartridge.size());
+    }
+
+    const char* GetBootROMPath() const { return m_BootROMPath.c_str(); }
+    const char* GetCartridgePath() const { return m_CartridgePath.c_str(); }
+
+private:
+    std::string m_BootROMPath;
+    std::string m_CartridgePath;
+};
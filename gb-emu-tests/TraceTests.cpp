@@ -0,0 +1,137 @@
+#include "stdafx.h"
+
+#include <Cartridge.hpp>
+#include <Emulator.hpp>
+#include <MBC.hpp>
+#include <Trace.hpp>
+
+#include "TestROM.hpp"
+
+#include <sstream>
+#include <string>
+
+TEST_CLASS(TraceTests)
+{
+private:
+    static int CountDecodedInstructions(const std::string& text)
+    {
+        std::istringstream lines(text);
+        std::string line;
+        int count = 0;
+        while (std::getline(lines, line))
+        {
+            count += (line.compare(0, 3, "...") != 0) ? 1 : 0;
+        }
+
+        return count;
+    }
+
+    static std::streamoff GetFileSize(const char* path)
+    {
+        std::ifstream file(path, std::ios::in | std::ios::binary | std::ios::ate);
+        return file.tellg();
+    }
+
+public:
+    TEST_METHOD(TraceFileTest)
+    {
+        std::vector<byte> cartridge(0x8000, 0x00);
+        const byte program[] = {
+            0x3E, 0x42,         // 0x0100 LD A,0x42
+            0xEA, 0x00, 0xC0,   // 0x0102 LD (0xC000),A
+            0xCB, 0x37,         // 0x0105 SWAP A
+            0x18, 0xFE,         // 0x0107 JR 0x0107
+        };
+        memcpy(&cartridge[0x0100], program, sizeof(program));
+
+        TestROM rom("TraceFileTest", cartridge);
+        const char* tracePath = "TraceFileTest.trace";
+
+        Emulator emulator;
+        Assert::IsTrue(emulator.Initialize(rom.GetBootROMPath(), rom.GetCartridgePath()));
+        emulator.EnableTrace(8);
+        for (int step = 0; step < 400; step++)
+        {
+            emulator.Step();
+        }
+
+        // The ring only keeps the last 8 instructions, all of them the loop
+        Assert::IsTrue(emulator.DumpTrace(tracePath));
+        std::ostringstream text;
+        Assert::IsTrue(Trace::Decode(tracePath, rom.GetCartridgePath(), text));
+        Assert::IsTrue(text.str().find("instructions not in the trace") != std::string::npos);
+        Assert::IsTrue(text.str().find("00:0107  JR $0107") != std::string::npos);
+        Assert::IsTrue(text.str().find("SWAP") == std::string::npos);
+
+        // The header, one chunk and 7 bytes per instruction, the bank stays 0
+        Assert::AreEqual(8 + 16 + (7 * CountDecodedInstructions(text.str())), (int)GetFileSize(tracePath));
+
+        /*
+            With a ring the writer cannot fall behind on, the file has every instruction. The loop is
+            reached after 258 steps, from there on a step runs the JR up to a few hundred times.
+        */
+        emulator.Stop();
+        Assert::IsTrue(emulator.Initialize(rom.GetBootROMPath(), rom.GetCartridgePath()));
+        emulator.EnableTrace(0x1000);
+        Assert::IsTrue(emulator.StartTraceWriter(tracePath));
+        for (int step = 0; step < 264; step++)
+        {
+            emulator.Step();
+        }
+
+        emulator.StopTraceWriter();
+        std::ostringstream written;
+        Assert::IsTrue(Trace::Decode(tracePath, rom.GetCartridgePath(), written));
+        Assert::IsTrue(written.str().find("LD A,$42") != std::string::npos);
+        Assert::IsTrue(written.str().find("LD ($C000),A") != std::string::npos);
+        Assert::IsTrue(written.str().find("SWAP A") != std::string::npos);
+
+        emulator.Stop();
+        std::remove(tracePath);
+    }
+
+    TEST_METHOD(HighBankTest)
+    {
+        // An 8MB MBC5 cartridge, whose ROM bank number has 9 bits
+        std::vector<byte> cartridge(0x800000, 0x00);
+        cartridge[CartridgeTypeAddress] = MBC5;
+        cartridge[ROMSizeAddress] = 0x08;
+        const byte program[] = {
+            0x3E, 0x01,         // 0x0100 LD A,0x01
+            0xEA, 0x00, 0x30,   // 0x0102 LD (0x3000),A
+            0xEA, 0x00, 0x20,   // 0x0105 LD (0x2000),A
+            0xC3, 0x00, 0x40,   // 0x0108 JP 0x4000
+        };
+        const byte bankedProgram[] = {
+            0xCB, 0x37,         // 0x4000 SWAP A
+            0x18, 0xFC,         // 0x4002 JR 0x4000
+        };
+        memcpy(&cartridge[0x0100], program, sizeof(program));
+        memcpy(&cartridge[0x101 * 0x4000], bankedProgram, sizeof(bankedProgram));
+
+        TestROM rom("HighBankTest", cartridge);
+        const char* tracePath = "HighBankTest.trace";
+
+        Emulator emulator;
+        Assert::IsTrue(emulator.Initialize(rom.GetBootROMPath(), rom.GetCartridgePath()));
+        emulator.EnableTrace(8);
+        for (int step = 0; step < 400; step++)
+        {
+            emulator.Step();
+        }
+
+        // Bank 0x101 would be bank 0x01, all NOPs, if the bank lost its top bit
+        Assert::IsTrue(emulator.DumpTrace(tracePath));
+        std::ostringstream text;
+        Assert::IsTrue(Trace::Decode(tracePath, rom.GetCartridgePath(), text));
+        Assert::IsTrue(text.str().find("101:4000  SWAP A") != std::string::npos);
+        Assert::IsTrue(text.str().find("101:4002  JR $4000") != std::string::npos);
+        Assert::IsTrue(text.str().find("NOP") == std::string::npos);
+
+        // Only the first record carries the bank
+        Assert::AreEqual(8 + 16 + (7 * CountDecodedInstructions(text.str())) + 2, (int)GetFileSize(tracePath));
+
+        emulator.Stop();
+        std::remove(tracePath);
+    }
+};
@@ -67,6 +67,7 @@ typedef signed char sbyte;
 typedef unsigned short ushort;
 
 #include "Logger.hpp"
+#include "MachineState.hpp"
 #include "IMemoryUnit.hpp"
 #include "ICPU.hpp"
 #include "IMMU.hpp"
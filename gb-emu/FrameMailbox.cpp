@@ -0,0 +1,63 @@
+#include "PCH.hpp"
+#include "FrameMailbox.hpp"
+
+const unsigned int MailboxIndexMask = 0x03;
+const unsigned int MailboxFreshFrame = 0x04;
+
+FrameMailbox::FrameMailbox() :
+    m_Middle(1),
+    m_Back(0),
+    m_Front(2),
+    m_PublishedCount(0),
+    m_DroppedCount(0)
+{
+    memset(m_Buffers, 0x00, sizeof(m_Buffers));
+}
+
+MailboxFrame* FrameMailbox::GetBackBuffer()
+{
+    return &m_Buffers[m_Back];
+}
+
+void FrameMailbox::Publish()
+{
+    m_Buffers[m_Back].number = m_PublishedCount.load(std::memory_order_relaxed) + 1;
+
+    // Hand the finished back buffer over and take whatever was in the middle
+    unsigned int previous = m_Middle.exchange(m_Back | MailboxFreshFrame, std::memory_order_acq_rel);
+    m_Back = previous & MailboxIndexMask;
+
+    m_PublishedCount.fetch_add(1, std::memory_order_relaxed);
+    if (previous & MailboxFreshFrame)
+    {
+        // The presentation thread never saw that one
+        m_DroppedCount.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+bool FrameMailbox::Acquire()
+{
+    if ((m_Middle.load(std::memory_order_relaxed) & MailboxFreshFrame) == 0)
+    {
+        return false;
+    }
+
+    unsigned int previous = m_Middle.exchange(m_Front, std::memory_order_acq_rel);
+    m_Front = previous & MailboxIndexMask;
+    return true;
+}
+
+MailboxFrame* FrameMailbox::GetFrontBuffer()
+{
+    return &m_Buffers[m_Front];
+}
+
+unsigned long FrameMailbox::GetPublishedCount()
+{
+    return m_PublishedCount.load(std::memory_order_relaxed);
+}
+
+unsigned long FrameMailbox::GetDroppedCount()
+{
+    return m_DroppedCount.load(std::memory_order_relaxed);
+}
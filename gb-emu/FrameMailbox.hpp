@@ -0,0 +1,53 @@
+#pragma once
+
+#include <atomic>
+
+#define FrameBufferSize (160 * 144 * 4)
+#define FrameLines 144
+
+// A completed frame, with the lines that changed since the frame before it
+struct MailboxFrame
+{
+    byte pixels[FrameBufferSize];
+    bool dirtyLines[FrameLines];
+    unsigned long number;
+    Uint64 inputTimestamp;      // The oldest input in this frame not yet shown, 0 if there is none
+};
+
+/*
+    A lock-free triple buffer for handing completed frames from the emulation thread to the
+    presentation thread.
+
+    The producer always owns the back buffer and the consumer always owns the front buffer. The
+    third buffer sits in the middle and is swapped atomically with either side, so neither thread
+    ever waits on the other. A frame published while the previous one is still unclaimed replaces
+    it, and the replaced frame is counted as dropped. Frames are numbered as they are published, so
+    the consumer can tell when it missed one.
+*/
+class FrameMailbox
+{
+public:
+    FrameMailbox();
+
+    // Emulation thread
+    MailboxFrame* GetBackBuffer();
+    void Publish();
+
+    // Presentation thread
+    bool Acquire();
+    MailboxFrame* GetFrontBuffer();
+
+    unsigned long GetPublishedCount();
+    unsigned long GetDroppedCount();
+
+private:
+    MailboxFrame m_Buffers[3];
+
+    // The index of the middle buffer, plus MailboxFreshFrame while it holds an unclaimed frame
+    std::atomic<unsigned int> m_Middle;
+    unsigned int m_Back;
+    unsigned int m_Front;
+
+    std::atomic<unsigned long> m_PublishedCount;
+    std::atomic<unsigned long> m_DroppedCount;
+};
@@ -0,0 +1,210 @@
+#include "PCH.hpp"
+#include "FramePacer.hpp"
+
+#include <chrono>
+#include <cmath>
+#include <thread>
+
+// Never spin for less than this, sleeps are not precise enough
+const double MinimumSpinWindowInSec = 0.0005;
+
+// Never spin for more than this, no matter how bad the scheduler is
+const double MaximumSpinWindowInSec = 0.002;
+
+// If we fall this many frames behind, give up on catching up and start over from now
+const unsigned long MaximumFramesBehind = 3;
+
+FramePacer::FramePacer() :
+    m_Frequency(static_cast<double>(SDL_GetPerformanceFrequency())),
+    m_Speed(1.0),
+    m_Oversleep(0.0)
+{
+    SetSpeed(1.0);
+    Reset();
+}
+
+void FramePacer::Reset()
+{
+    m_BaseTime = SDL_GetPerformanceCounter();
+    m_FrameIndex = 0;
+    m_LastFrameTime = m_BaseTime;
+    ResetStatistics();
+}
+
+void FramePacer::SetSpeed(double speed)
+{
+    if (speed <= 0.0)
+    {
+        return;
+    }
+
+    m_Speed = speed;
+    m_TicksPerFrame = (m_Frequency * DMGCyclesPerFrame) / (DMGClockRate * m_Speed);
+
+    // Restart the schedule at the new rate from the current frame
+    m_BaseTime = SDL_GetPerformanceCounter();
+    m_FrameIndex = 0;
+    ResetStatistics();
+}
+
+double FramePacer::GetSpeed()
+{
+    return m_Speed;
+}
+
+void FramePacer::WaitForNextFrame()
+{
+    Uint64 start = SDL_GetPerformanceCounter();
+    double work = static_cast<double>(start - m_LastFrameTime);
+
+    m_FrameIndex++;
+    Uint64 deadline = m_BaseTime + static_cast<Uint64>(m_FrameIndex * m_TicksPerFrame);
+    Uint64 now = start;
+
+    if ((now > deadline) && ((now - deadline) > (MaximumFramesBehind * m_TicksPerFrame)))
+    {
+        // We are hopelessly behind (debugger, window drag, etc.), resynchronize to now instead
+        // of running a burst of frames to catch up.
+        m_BaseTime = now;
+        m_FrameIndex = 0;
+        deadline = now;
+    }
+
+    double spinWindow = MinimumSpinWindowInSec * m_Frequency + m_Oversleep;
+    if (spinWindow > MaximumSpinWindowInSec * m_Frequency)
+    {
+        spinWindow = MaximumSpinWindowInSec * m_Frequency;
+    }
+
+    // Sleep away most of the remaining time
+    if ((now < deadline) && ((deadline - now) > spinWindow))
+    {
+        double sleepTicks = (deadline - now) - spinWindow;
+        std::this_thread::sleep_for(std::chrono::microseconds(static_cast<long long>(sleepTicks * 1000000.0 / m_Frequency)));
+
+        // Track how much longer than requested the sleep took
+        Uint64 woke = SDL_GetPerformanceCounter();
+        double overshoot = static_cast<double>(woke - now) - sleepTicks;
+        if (overshoot < 0.0)
+        {
+            overshoot = 0.0;
+        }
+
+        m_Oversleep = (m_Oversleep * 0.9) + (overshoot * 0.1);
+        now = woke;
+    }
+
+    // Spin for the last fraction of a millisecond
+    while (now < deadline)
+    {
+        now = SDL_GetPerformanceCounter();
+    }
+
+    // Update statistics
+    double interval = static_cast<double>(now - m_LastFrameTime);
+    m_LastFrameTime = now;
+
+    m_FrameCount++;
+    double delta = interval - m_Mean;
+    m_Mean += delta / m_FrameCount;
+    m_M2 += delta * (interval - m_Mean);
+
+    double error = std::fabs(interval - m_TicksPerFrame);
+    if ((m_FrameCount > 1) && (error > m_MaxError))
+    {
+        // The first interval includes whatever happened before the pacer started, skip it
+        m_MaxError = error;
+    }
+
+    double workDelta = work - m_WorkMean;
+    m_WorkMean += workDelta / m_FrameCount;
+    m_WorkM2 += workDelta * (work - m_WorkMean);
+    if ((m_FrameCount > 1) && (work > m_MaxWork))
+    {
+        m_MaxWork = work;
+    }
+}
+
+void FramePacer::ResetStatistics()
+{
+    m_LastFrameTime = SDL_GetPerformanceCounter();
+    m_FrameCount = 0;
+    m_Mean = 0.0;
+    m_M2 = 0.0;
+    m_MaxError = 0.0;
+    m_WorkMean = 0.0;
+    m_WorkM2 = 0.0;
+    m_MaxWork = 0.0;
+}
+
+unsigned long FramePacer::GetFrameCount()
+{
+    return m_FrameCount;
+}
+
+double FramePacer::GetTargetFrameTime()
+{
+    return TicksToMilliseconds(m_TicksPerFrame);
+}
+
+double FramePacer::GetAverageFrameTime()
+{
+    return TicksToMilliseconds(m_Mean);
+}
+
+double FramePacer::GetFrameTimeJitter()
+{
+    if (m_FrameCount < 2)
+    {
+        return 0.0;
+    }
+
+    return TicksToMilliseconds(std::sqrt(m_M2 / (m_FrameCount - 1)));
+}
+
+double FramePacer::GetMaxFrameTimeError()
+{
+    return TicksToMilliseconds(m_MaxError);
+}
+
+double FramePacer::GetAverageWorkTime()
+{
+    return TicksToMilliseconds(m_WorkMean);
+}
+
+double FramePacer::GetWorkTimeJitter()
+{
+    if (m_FrameCount < 2)
+    {
+        return 0.0;
+    }
+
+    return TicksToMilliseconds(std::sqrt(m_WorkM2 / (m_FrameCount - 1)));
+}
+
+double FramePacer::GetMaxWorkTime()
+{
+    return TicksToMilliseconds(m_MaxWork);
+}
+
+void FramePacer::LogStatistics()
+{
+    Logger::Log(
+        "Frame pacing at %.2fx: %lu frames, target %.4f ms, average %.4f ms, jitter %.4f ms, max error %.4f ms",
+        m_Speed,
+        m_FrameCount,
+        GetTargetFrameTime(),
+        GetAverageFrameTime(),
+        GetFrameTimeJitter(),
+        GetMaxFrameTimeError());
+    Logger::Log(
+        "Emulation work per frame: average %.4f ms, jitter %.4f ms, max %.4f ms",
+        GetAverageWorkTime(),
+        GetWorkTimeJitter(),
+        GetMaxWorkTime());
+}
+
+double FramePacer::TicksToMilliseconds(double ticks)
+{
+    return (ticks * 1000.0) / m_Frequency;
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+// The DMG runs at 4.194304 MHz and draws a frame every 70224 cycles (~59.7275 Hz)
+#define DMGClockRate        4194304.0
+#define DMGCyclesPerFrame   70224
+
+/*
+    Paces the emulation loop to the real DMG refresh rate.
+
+    Each frame deadline is computed from a fixed base time rather than from the end of the
+    previous frame, so rounding and oversleep never accumulate into drift. The pacer sleeps for
+    most of the interval and only spins for the final fraction of a millisecond. The spin window
+    grows with the observed oversleep of the host scheduler.
+*/
+class FramePacer
+{
+public:
+    FramePacer();
+
+    void Reset();
+    void SetSpeed(double speed);
+    double GetSpeed();
+    void WaitForNextFrame();
+
+    // Frame time statistics, in milliseconds
+    void ResetStatistics();
+    unsigned long GetFrameCount();
+    double GetTargetFrameTime();
+    double GetAverageFrameTime();
+    double GetFrameTimeJitter();
+    double GetMaxFrameTimeError();
+    double GetAverageWorkTime();
+    double GetWorkTimeJitter();
+    double GetMaxWorkTime();
+    void LogStatistics();
+
+private:
+    double TicksToMilliseconds(double ticks);
+
+private:
+    double m_Frequency;         // Performance counter ticks per second
+    double m_Speed;             // 1.0 = real time, < 1.0 = slow motion, > 1.0 = fast forward
+    double m_TicksPerFrame;     // Frame interval at the current speed
+
+    Uint64 m_BaseTime;          // The time frame 0 was due
+    unsigned long m_FrameIndex; // Frames since m_BaseTime
+    Uint64 m_LastFrameTime;     // When the last frame was released
+    double m_Oversleep;         // Smoothed sleep overshoot, in ticks
+
+    // Welford running statistics over the released frame intervals
+    unsigned long m_FrameCount;
+    double m_Mean;
+    double m_M2;
+    double m_MaxError;
+
+    // The same over the time spent emulating each frame, i.e. before WaitForNextFrame was called
+    double m_WorkMean;
+    double m_WorkM2;
+    double m_MaxWork;
+};
@@ -0,0 +1,35 @@
+#include "PCH.hpp"
+#include "InputQueue.hpp"
+
+InputQueue::InputQueue() :
+    m_Head(0),
+    m_Tail(0)
+{
+}
+
+bool InputQueue::Push(const InputEvent& event)
+{
+    unsigned int tail = m_Tail.load(std::memory_order_relaxed);
+    if ((tail - m_Head.load(std::memory_order_acquire)) >= InputQueueSize)
+    {
+        // Full, the emulation thread has not run for a long time
+        return false;
+    }
+
+    m_Events[tail & (InputQueueSize - 1)] = event;
+    m_Tail.store(tail + 1, std::memory_order_release);
+    return true;
+}
+
+bool InputQueue::Pop(InputEvent& event)
+{
+    unsigned int head = m_Head.load(std::memory_order_relaxed);
+    if (head == m_Tail.load(std::memory_order_acquire))
+    {
+        return false;
+    }
+
+    event = m_Events[head & (InputQueueSize - 1)];
+    m_Head.store(head + 1, std::memory_order_release);
+    return true;
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <atomic>
+
+// Must be a power of two
+#define InputQueueSize 256
+
+// The joypad state after a key was pressed or released, and when that happened
+struct InputEvent
+{
+    Uint64 timestamp;   // SDL_GetPerformanceCounter() when the event was handled
+    byte input;
+    byte buttons;
+};
+
+/*
+    A single-producer, single-consumer queue of input events. The main thread pushes events as SDL
+    delivers them, the emulation thread pops them once per scanline of the frame in flight and
+    applies each one at the emulated cycle that matches its timestamp. Neither side ever blocks.
+*/
+class InputQueue
+{
+public:
+    InputQueue();
+
+    // Main thread
+    bool Push(const InputEvent& event);
+
+    // Emulation thread
+    bool Pop(InputEvent& event);
+
+private:
+    InputEvent m_Events[InputQueueSize];
+    std::atomic<unsigned int> m_Head;   // Next event to pop
+    std::atomic<unsigned int> m_Tail;   // Next free slot
+};
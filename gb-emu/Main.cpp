@@ -1,12 +1,22 @@
 #include "PCH.hpp"
 #include <Emulator.hpp>
+#include <SocketLinkPort.hpp>
+#include <Trace.hpp>
 
-// Play with this 1/120 is "FAST" and 1/60 is "SLOW"
-const double TimePerFrame = 1.0 / 120.0;
-//const double TimePerFrame = 16.783536 / 1000;
+#include "FrameMailbox.hpp"
+#include "FramePacer.hpp"
+#include "InputQueue.hpp"
 
-// The number of CPU cycles per frame
-const unsigned int CyclesPerFrame = 70224;
+#include <atomic>
+#include <iostream>
+#include <thread>
+
+// The emulation speed multipliers available through the - and = keys
+const double Speeds[] = { 0.25, 0.5, 1.0, 2.0, 4.0 };
+const int NormalSpeedIndex = 2;
+
+// Where the R key records to, the audio goes next to it with ".wav" added
+#define RecordingPath "gb-emu-recording.y4m"
 
 struct SDLWindowDeleter
 {
@@ -41,91 +51,374 @@ struct SDLTextureDeleter
     }
 };
 
-void Render(SDL_Renderer* pRenderer, SDL_Texture* pTexture, Emulator& emulator)
+// TODO: refactor this
+std::unique_ptr<SDL_Renderer, SDLRendererDeleter> spRenderer;
+std::unique_ptr<SDL_Texture, SDLTextureDeleter> spTexture;
+Emulator emulator;
+
+/*
+    Emulation runs on its own thread and presentation on the main thread. The emulation thread
+    publishes every completed frame into the mailbox and never waits for the graphics driver. The
+    main thread shows whichever frame is the newest at each display refresh. In turbo mode most
+    frames are replaced before anyone looks at them.
+*/
+FrameMailbox frameMailbox;
+
+// How often the emulation thread looks for new input, once per scanline
+#define InputPollCycles 456
+
+std::atomic<bool> isEmulating(true);
+std::atomic<bool> isTurbo(false);
+std::atomic<int> requestedSpeedIndex(NormalSpeedIndex);
+std::atomic<unsigned int> recordingToggles(0);     // R presses, only the main thread writes it
+std::atomic<bool> isRecordingFailed(false);         // Set by the emulation thread, cleared by the main thread
+InputQueue inputQueue;
+std::atomic<unsigned long> emulatedFrames(0);
+
+/*
+    Input to photon latency: from a key event to the return of the first present that shows a frame
+    emulated after the event was applied. The renderer waits for VSync, so that is when the frame
+    starts to scan out. The emulation thread stamps each frame with the oldest applied input the
+    main thread has not shown yet, so an input survives its frame being replaced in the mailbox.
+*/
+Uint64 appliedInputTimestamp = 0;                   // Emulation thread
+std::atomic<Uint64> presentedInputTimestamp(0);     // Main thread, the newest input shown
+unsigned long latencyCount = 0;
+Uint64 latencyTotal = 0;
+Uint64 latencyMax = 0;
+
+// The emulator will call this whenever we hit VBlank
+void VSyncCallback()
+{
+    MailboxFrame* pFrame = frameMailbox.GetBackBuffer();
+    memcpy(pFrame->pixels, emulator.GetCurrentFrame(), FrameBufferSize);
+    memcpy(pFrame->dirtyLines, emulator.GetDirtyLines(), sizeof(pFrame->dirtyLines));
+    pFrame->inputTimestamp = (appliedInputTimestamp > presentedInputTimestamp) ? appliedInputTimestamp : 0;
+    frameMailbox.Publish();
+}
+
+// Redraws the window from the texture
+void Present(SDL_Renderer* pRenderer, SDL_Texture* pTexture)
 {
     // Clear window
     SDL_SetRenderDrawColor(pRenderer, 0xFF, 0xFF, 0xFF, 0xFF);
     SDL_RenderClear(pRenderer);
 
-    byte* pPixels;
-    int pitch = 0;
-    SDL_LockTexture(pTexture, nullptr, (void**)&pPixels, &pitch);
-
     // Render Game
-    byte* pData = emulator.GetCurrentFrame();
-    memcpy(pPixels, pData, 160 * 144 * 4);
-
-    SDL_UnlockTexture(pTexture);
-
     SDL_RenderCopy(pRenderer, pTexture, nullptr, nullptr);
 
     // Update window
     SDL_RenderPresent(pRenderer);
 }
 
-// TODO: refactor this
-std::unique_ptr<SDL_Renderer, SDLRendererDeleter> spRenderer;
-std::unique_ptr<SDL_Texture, SDLTextureDeleter> spTexture;
-Emulator emulator;
-
-// The emulator will call this whenever we hit VBlank
-void VSyncCallback()
+/*
+    Shows the newest completed frame, if there is one we have not shown yet. Only the runs of lines
+    that changed are uploaded to the texture, and a frame without any changes is not presented at
+    all. The dirty lines are relative to the frame before, so if any frames were replaced in the
+    mailbox before we got to them, the whole frame is uploaded instead.
+*/
+void Render(SDL_Renderer* pRenderer, SDL_Texture* pTexture, unsigned long& presentedFrameNumber)
 {
-    Render(spRenderer.get(), spTexture.get(), emulator);
+    if (!frameMailbox.Acquire())
+    {
+        return;
+    }
+
+    const MailboxFrame* pFrame = frameMailbox.GetFrontBuffer();
+    bool isComplete = (pFrame->number != presentedFrameNumber + 1);
+    presentedFrameNumber = pFrame->number;
+
+    bool isChanged = false;
+    int line = 0;
+    while (line < FrameLines)
+    {
+        if (!isComplete && !pFrame->dirtyLines[line])
+        {
+            line++;
+            continue;
+        }
+
+        // Upload this run of dirty lines in one go
+        int first = line;
+        while ((line < FrameLines) && (isComplete || pFrame->dirtyLines[line]))
+        {
+            line++;
+        }
+
+        SDL_Rect rect = { 0, first, 160, line - first };
+        SDL_UpdateTexture(pTexture, &rect, pFrame->pixels + (first * 160 * 4), 160 * 4);
+        isChanged = true;
+    }
+
+    if (isChanged)
+    {
+        Present(pRenderer, pTexture);
+    }
+
+    // An input that changed nothing on screen has no photon to measure
+    if (pFrame->inputTimestamp > presentedInputTimestamp)
+    {
+        if (isChanged)
+        {
+            Uint64 latency = SDL_GetPerformanceCounter() - pFrame->inputTimestamp;
+            latencyCount++;
+            latencyTotal += latency;
+            latencyMax = (latency > latencyMax) ? latency : latencyMax;
+        }
+
+        presentedInputTimestamp = pFrame->inputTimestamp;
+    }
 }
 
-void ProcessInput(Emulator& emulator)
+void LogInputLatency()
 {
-    SDL_PumpEvents();
-    const Uint8 *keys = SDL_GetKeyboardState(NULL);
-    byte input = JOYPAD_NONE;
-    byte buttons = JOYPAD_NONE;
-
-    if(keys[SDL_SCANCODE_W])
+    if (latencyCount == 0)
     {
-        input |= JOYPAD_INPUT_UP;
+        return;
     }
 
-    if(keys[SDL_SCANCODE_A])
+    double frequency = static_cast<double>(SDL_GetPerformanceFrequency());
+    Logger::Log(
+        "Input to photon latency over %lu inputs: average %.4f ms, max %.4f ms",
+        latencyCount,
+        (latencyTotal * 1000.0) / (frequency * latencyCount),
+        (latencyMax * 1000.0) / frequency);
+}
+
+void ChangeSpeed(int delta)
+{
+    int index = requestedSpeedIndex + delta;
+    if (index < 0 || index >= static_cast<int>(sizeof(Speeds) / sizeof(Speeds[0])))
     {
-        input |= JOYPAD_INPUT_LEFT;
+        return;
     }
 
-    if(keys[SDL_SCANCODE_S])
+    requestedSpeedIndex = index;
+}
+
+void SetKey(byte& state, byte mask, bool isPressed)
+{
+    if (isPressed)
+    {
+        state |= mask;
+    }
+    else
     {
-        input |= JOYPAD_INPUT_DOWN;
+        state &= ~mask;
     }
+}
 
-    if(keys[SDL_SCANCODE_D])
+// Applies a key press or release to the joypad state and queues the new state for the emulator
+void ProcessInput(const SDL_KeyboardEvent& key)
+{
+    static byte input = JOYPAD_NONE;
+    static byte buttons = JOYPAD_NONE;
+
+    bool isPressed = (key.type == SDL_KEYDOWN);
+    switch (key.keysym.scancode)
     {
-        input |= JOYPAD_INPUT_RIGHT;
+    case SDL_SCANCODE_W:
+        SetKey(input, JOYPAD_INPUT_UP, isPressed);
+        break;
+    case SDL_SCANCODE_A:
+        SetKey(input, JOYPAD_INPUT_LEFT, isPressed);
+        break;
+    case SDL_SCANCODE_S:
+        SetKey(input, JOYPAD_INPUT_DOWN, isPressed);
+        break;
+    case SDL_SCANCODE_D:
+        SetKey(input, JOYPAD_INPUT_RIGHT, isPressed);
+        break;
+    case SDL_SCANCODE_K:
+        SetKey(buttons, JOYPAD_BUTTONS_A, isPressed);
+        break;
+    case SDL_SCANCODE_L:
+        SetKey(buttons, JOYPAD_BUTTONS_B, isPressed);
+        break;
+    case SDL_SCANCODE_N:
+        SetKey(buttons, JOYPAD_BUTTONS_START, isPressed);
+        break;
+    case SDL_SCANCODE_M:
+        SetKey(buttons, JOYPAD_BUTTONS_SELECT, isPressed);
+        break;
+    case SDL_SCANCODE_TAB:
+        // Turbo runs for as long as Tab is held down
+        isTurbo = isPressed;
+        return;
+    case SDL_SCANCODE_MINUS:
+        if (isPressed)
+        {
+            ChangeSpeed(-1);
+        }
+        return;
+    case SDL_SCANCODE_EQUALS:
+        if (isPressed)
+        {
+            ChangeSpeed(1);
+        }
+        return;
+    case SDL_SCANCODE_R:
+        // The emulation thread starts and stops the recording between frames
+        if (isPressed)
+        {
+            recordingToggles++;
+        }
+        return;
+    default:
+        return;
     }
 
-    if(keys[SDL_SCANCODE_K])
+    InputEvent event = { SDL_GetPerformanceCounter(), input, buttons };
+    if (!inputQueue.Push(event))
     {
-        buttons |= JOYPAD_BUTTONS_A;
+        Logger::LogError("Input queue is full, dropping input");
     }
+}
 
-    if(keys[SDL_SCANCODE_L])
+/*
+    Applies the queued input that is due by the given cycle of the frame in flight. The frame started
+    at frameStart and is paced to last frameTicks, so an event is due at the cycle that is as far
+    into the frame as the event is into that time. Events from before the frame started, while we
+    waited for it to be due, are due right away, and so is everything in turbo mode. A frame is
+    emulated faster than real time, so an event can be due at a cycle we have not reached yet, it
+    waits in event until then.
+*/
+void DeliverInput(InputEvent& event, bool& isEventWaiting, unsigned int cycle, Uint64 frameStart, Uint64 frameTicks)
+{
+    while (isEventWaiting || inputQueue.Pop(event))
     {
-        buttons |= JOYPAD_BUTTONS_B;
+        if (!isTurbo && (frameTicks > 0) && (event.timestamp > frameStart) &&
+            (((event.timestamp - frameStart) * DMGCyclesPerFrame) / frameTicks > cycle))
+        {
+            isEventWaiting = true;
+            return;
+        }
+
+        isEventWaiting = false;
+        emulator.SetInput(event.input, event.buttons);
+        if (appliedInputTimestamp <= presentedInputTimestamp)
+        {
+            appliedInputTimestamp = event.timestamp;
+        }
     }
+}
 
-    if(keys[SDL_SCANCODE_N])
+// The emulation thread: runs whole frames, paced to the selected speed or flat out in turbo
+void RunEmulation()
+{
+    FramePacer pacer;
+    int speedIndex = NormalSpeedIndex;
+    bool wasTurbo = false;
+    bool wasRecording = false;
+    unsigned int handledToggles = 0;
+
+    InputEvent event;
+    bool isEventWaiting = false;
+    Uint64 lastFrameStart = SDL_GetPerformanceCounter();
+
+    unsigned int cycles = 0;
+    while (isEmulating)
     {
-        buttons |= JOYPAD_BUTTONS_START;
+        int requested = requestedSpeedIndex;
+        if (requested != speedIndex)
+        {
+            pacer.LogStatistics();
+            speedIndex = requested;
+            pacer.SetSpeed(Speeds[speedIndex]);
+            Logger::Log("Emulation speed set to %.2fx", Speeds[speedIndex]);
+        }
+
+        // Presses that came in pairs since the last frame cancel out
+        unsigned int toggles = recordingToggles;
+        if (((toggles - handledToggles) & 1) != 0)
+        {
+            if (wasRecording)
+            {
+                emulator.StopRecording();
+                wasRecording = false;
+            }
+            else if (emulator.StartRecording(RecordingPath, RecordingY4M))
+            {
+                wasRecording = true;
+            }
+            else
+            {
+                isRecordingFailed = true;
+            }
+        }
+
+        handledToggles = toggles;
+
+        // Frames are as long as the last one took, which is what the pacer holds them to
+        Uint64 frameStart = SDL_GetPerformanceCounter();
+        Uint64 frameTicks = frameStart - lastFrameStart;
+        lastFrameStart = frameStart;
+
+        unsigned int nextPoll = 0;
+        while (cycles < DMGCyclesPerFrame)
+        {
+            if (cycles >= nextPoll)
+            {
+                DeliverInput(event, isEventWaiting, cycles, frameStart, frameTicks);
+                nextPoll = cycles + InputPollCycles;
+            }
+
+            cycles += emulator.Step();
+        }
+
+        cycles -= DMGCyclesPerFrame;
+        emulatedFrames++;
+
+        if (isTurbo)
+        {
+            wasTurbo = true;
+            continue;
+        }
+
+        if (wasTurbo)
+        {
+            // We are far ahead of the old schedule, start a new one from here
+            wasTurbo = false;
+            pacer.Reset();
+        }
+
+        // Sleep (and finally spin) until this frame is due
+        pacer.WaitForNextFrame();
     }
 
-    if(keys[SDL_SCANCODE_M])
+    pacer.LogStatistics();
+}
+
+// Shows the measured emulation speed in the window title, as a multiple of the real DMG
+void UpdateTitle(SDL_Window* pWindow, double speed, bool turbo)
+{
+    char title[64];
+    if (turbo)
     {
-        buttons |= JOYPAD_BUTTONS_SELECT;
+        snprintf(title, sizeof(title), "GameLad - Turbo %.1fx", speed);
+    }
+    else
+    {
+        snprintf(title, sizeof(title), "GameLad - %.2fx", speed);
     }
 
-    emulator.SetInput(input, buttons);
+    SDL_SetWindowTitle(pWindow, title);
 }
 
 int main(int argc, char** argv)
 {
+    // Offline trace decoding: --decode-trace <trace file> [rom], the ROM fills in the operands
+    if ((argc > 2) && (strcmp(argv[1], "--decode-trace") == 0))
+    {
+        return Trace::Decode(argv[2], (argc > 3) ? argv[3] : nullptr, std::cout) ? 0 : 1;
+    }
+
+    // Opcode pair profile: --profile-trace <trace file> [pairs]
+    if ((argc > 2) && (strcmp(argv[1], "--profile-trace") == 0))
+    {
+        return Trace::Profile(argv[2], (argc > 3) ? atoi(argv[3]) : 32, std::cout) ? 0 : 1;
+    }
+
     int windowWidth = 160;
     int windowHeight = 144;
     int windowScale = 2;
@@ -179,6 +472,17 @@ int main(int argc, char** argv)
         romPath = argv[2];
     }
 
+    // Link cable to another GameLad: "listen <address>" or "connect <address>", where the address
+    // is host:port or unix:/path
+    SocketLinkPort linkPort;
+    std::string linkMode;
+    std::string linkAddress;
+    if(argc > 4)
+    {
+        linkMode = argv[3];
+        linkAddress = argv[4];
+    }
+
     bool isRunning = true;
     std::unique_ptr<SDL_Window, SDLWindowDeleter> spWindow;
 
@@ -208,7 +512,7 @@ int main(int argc, char** argv)
 
     // Create renderer
     spRenderer = std::unique_ptr<SDL_Renderer, SDLRendererDeleter>(
-        SDL_CreateRenderer(spWindow.get(), -1, SDL_RENDERER_ACCELERATED));
+        SDL_CreateRenderer(spWindow.get(), -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC));
     if (spRenderer == nullptr)
     {
         Logger::LogError("Renderer could not be created! SDL error: '%s'", SDL_GetError());
@@ -216,56 +520,132 @@ int main(int argc, char** argv)
     }
 
     spTexture = std::unique_ptr<SDL_Texture, SDLTextureDeleter>(
-        SDL_CreateTexture(spRenderer.get(), SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_STREAMING, 160, 144));
+        SDL_CreateTexture(spRenderer.get(), SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_STATIC, 160, 144));
 
     if (emulator.Initialize(bootROM.empty() ? nullptr : bootROM.data(), romPath.data()))
     {
         emulator.SetVSyncCallback(&VSyncCallback);
+        emulator.SetColorCorrection(true);
+        emulator.EnableAudio();
+
+        // Cheap enough to leave on, a bad opcode dumps the last instructions to TraceFaultPath
+        emulator.EnableTrace(TraceDefaultSize);
+
+        if (!linkMode.empty())
+        {
+            bool isLinked = false;
+            if (linkMode == "listen")
+            {
+                Logger::Log("Waiting for the other Gameboy on %s", linkAddress.c_str());
+                isLinked = linkPort.Listen(linkAddress.c_str());
+            }
+            else if (linkMode == "connect")
+            {
+                isLinked = linkPort.Connect(linkAddress.c_str());
+            }
+
+            if (isLinked)
+            {
+                emulator.ConnectLink(&linkPort);
+            }
+            else
+            {
+                Logger::LogError("Running without a link cable");
+            }
+        }
+
+        std::thread emulationThread(RunEmulation);
+
+        // Present at the display refresh rate, no matter how fast the emulation runs
+        SDL_DisplayMode mode;
+        int refreshRate = 60;
+        if ((SDL_GetCurrentDisplayMode(0, &mode) == 0) && (mode.refresh_rate > 0))
+        {
+            refreshRate = mode.refresh_rate;
+        }
+
+        Uint64 frequency = SDL_GetPerformanceFrequency();
+        Uint64 presentTicks = frequency / refreshRate;
+        Uint64 nextPresent = SDL_GetPerformanceCounter();
+        unsigned long presentedFrameNumber = 0;
+
+        // The title shows the emulation speed, measured over half a second
+        Uint64 speedTime = nextPresent;
+        unsigned long speedFrames = 0;
 
-        unsigned int cycles = 0;
-        Uint64 frameStart = SDL_GetPerformanceCounter();
         while (isRunning)
         {
-            // Poll for window input
-            while (SDL_PollEvent(&event) != 0)
+            // Handle window events until the next refresh is due
+            Uint64 now = SDL_GetPerformanceCounter();
+            int timeout = 0;
+            if (now < nextPresent)
             {
-                if (event.type == SDL_QUIT)
+                timeout = static_cast<int>(((nextPresent - now) * 1000 + frequency - 1) / frequency);
+            }
+
+            if (SDL_WaitEventTimeout(&event, timeout) != 0)
+            {
+                do
                 {
-                    isRunning = false;
-                    emulator.SetVSyncCallback(nullptr);
-                }
+                    if (event.type == SDL_QUIT)
+                    {
+                        isRunning = false;
+                    }
+                    else if (event.type == SDL_WINDOWEVENT && event.window.event == SDL_WINDOWEVENT_EXPOSED)
+                    {
+                        // Unchanged frames are never presented, so redraw whatever is on the texture
+                        Present(spRenderer.get(), spTexture.get());
+                    }
+                    else if ((event.type == SDL_KEYDOWN || event.type == SDL_KEYUP) && !event.key.repeat)
+                    {
+                        ProcessInput(event.key);
+                    }
+                } while (SDL_PollEvent(&event) != 0);
             }
 
-            if (!isRunning)
+            now = SDL_GetPerformanceCounter();
+            if (!isRunning || (now < nextPresent))
             {
-                // Exit early if the app is closing
                 continue;
             }
 
-            ProcessInput(emulator);
-            while (cycles < CyclesPerFrame)
+            nextPresent += presentTicks;
+            if (nextPresent <= now)
             {
-                cycles += emulator.Step();
+                // Missed one or more refreshes, do not try to make them up
+                nextPresent = now + presentTicks;
             }
 
-            cycles -= CyclesPerFrame;
+            Render(spRenderer.get(), spTexture.get(), presentedFrameNumber);
 
-            Uint64 frameEnd = SDL_GetPerformanceCounter();
-            // Loop until we use up the rest of our frame time
-            while (true)
+            if (isRecordingFailed.exchange(false))
             {
-                frameEnd = SDL_GetPerformanceCounter();
-                double frameElapsedInSec = (double)(frameEnd - frameStart) / SDL_GetPerformanceFrequency();
-
-                // Break out once we use up our time per frame
-                if (frameElapsedInSec >= TimePerFrame)
-                {
-                    break;
-                }
+                Logger::LogError("Could not record to %s, press R to try again", RecordingPath);
             }
 
-            frameStart = frameEnd;
+            if ((now - speedTime) >= (frequency / 2))
+            {
+                unsigned long frames = emulatedFrames;
+                double seconds = static_cast<double>(now - speedTime) / frequency;
+                double speed = ((frames - speedFrames) / seconds) / (DMGClockRate / DMGCyclesPerFrame);
+                UpdateTitle(spWindow.get(), speed, isTurbo);
+
+                speedTime = now;
+                speedFrames = frames;
+            }
         }
+
+        isEmulating = false;
+        emulationThread.join();
+        emulator.SetVSyncCallback(nullptr);
+        emulator.StopRecording();
+        LogInputLatency();
+
+        Logger::Log(
+            "Presented %lu of %lu frames (%lu replaced before they could be shown)",
+            frameMailbox.GetPublishedCount() - frameMailbox.GetDroppedCount(),
+            frameMailbox.GetPublishedCount(),
+            frameMailbox.GetDroppedCount());
     }
 
     emulator.Stop();